@@ -5,3 +5,4 @@ include(CMakeDependentOption)
 #--------------------------------------------------------------------
 option(BUILD_SHARED_LIBS "Build Dura2D as a shared library" OFF)
 option(USE_CCACHE "Enable compiler cache that can drastically improve build times" ${DURA_IS_MAIN})
+option(USE_AVX "Solve contacts 8-wide with AVX instead of 4-wide with SSE" OFF)
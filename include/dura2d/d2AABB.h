@@ -15,6 +15,8 @@ struct D2_API d2AABB
 
     d2Body *Collider{};
 
+    int32 childIndex{}; ///< The shape child this proxy bounds.
+
     d2AABB() = default;
 
     d2AABB(const d2Vec2& lower, const d2Vec2& upper) : lowerBound(lower), upperBound(upper) {}
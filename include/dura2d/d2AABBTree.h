@@ -11,7 +11,8 @@ struct d2Node
 {
     d2Node *parent;
     d2Node *children[2]{};
-    bool childrenCrossed{};
+    uint32 crossedPass{}; // the last ComputePairs that crossed the children
+    bool isResting{}; // every proxy below belongs to a static or sleeping body, so nothing below moves
     d2AABB aabb;
     d2AABB *data;
 
@@ -54,10 +55,12 @@ struct d2Node
             const d2Vec2 marginVec(margin, margin);
             aabb.lowerBound = data->lowerBound - marginVec;
             aabb.upperBound = data->upperBound + marginVec;
+            isResting = data->Collider->GetType() == d2_staticBody || !data->Collider->IsAwake();
         }
         else
         {
             aabb.Combine(children[0]->aabb, children[1]->aabb);
+            isResting = children[0]->isResting && children[1]->isResting;
         }
     }
 
@@ -80,10 +83,12 @@ public:
 
     void Add(d2Body* body) override;
     void Remove(d2Body* body) override;
+    void AddBodies(d2Body* const* bodies, int32 count) override;
+    void Refresh(d2Body* body) override;
     void Update(void) override;
     ColliderPairList& ComputePairs(void) override;
     d2Body* Pick(const d2Vec2 &point) const override;
-    void Query(const d2AABB &aabb, ColliderList &output) const override { (void)aabb; (void)output; }
+    void Query(const d2AABB &aabb, ColliderList &output) const override;
 
     void Draw(const d2Draw &draw) const override;
 
@@ -93,13 +98,14 @@ private:
 
     void UpdateNodeHelper(d2Node *node, NodeList &invalidNodes);
     void InsertNode(d2Node *node, d2Node **parent);
+    d2Node *BuildNode(d2Node **leaves, int32 count);
     void RemoveNode(d2Node *node);
     void ComputePairsHelper(d2Node *n0, d2Node *n1);
-    void ClearChildrenCrossFlagHelper(d2Node *node);
     void CrossChildren(d2Node *node);
 
     d2Node *m_root;
     ColliderPairList m_pairs{};
+    uint32 m_pairPass{}; // number of ComputePairs calls, marks the crossed nodes without clearing them
     float m_margin;
     NodeList m_invalidNodes;
 };
@@ -3,13 +3,14 @@
 
 #include "d2api.h"
 
+#include "d2AABB.h"
+#include "d2BodyStorage.h"
 #include "d2Shape.h"
 #include "d2Math.h"
 #include "d2Types.h"
 
 // Forward declarations
 class d2World;
-struct d2AABB;
 
 // enums
 enum d2BodyType
@@ -18,6 +19,14 @@ enum d2BodyType
     d2_dynamicBody      //< A dynamic body is fully simulated.
 };
 
+/** @brief Everything needed to create a body, see d2World::CreateBodies(). */
+struct D2_API d2BodyDef
+{
+    const d2Shape* shape { nullptr }; ///< The shape of the body, cloned by the body.
+    d2Vec2 position;                  ///< The initial position of the body.
+    real mass { 0.0f };               ///< The mass of the body, 0 for a static body.
+};
+
 /**
  * @class d2Body
  * @brief A class representing a 2D rigid body.
@@ -42,9 +51,19 @@ public:
      */
     ~d2Body();
 
-    /** @brief Computes the Axis-Aligned Bounding Box of the body. */
+    /** @brief Computes the Axis-Aligned Bounding Boxes of every child of the body's shape. */
     void ComputeAABB();
 
+    /**
+     * @brief Computes how far the body can travel in a step and grows its proxies by that distance,
+     * so the contacts it is about to make are found ahead of time.
+     * @param dt The time step.
+     */
+    void ComputeSpeculativeDistance(real dt);
+
+    /** @brief Gets the distance the body can travel in the current step. */
+    inline real GetSpeculativeDistance() const;
+
     /**
      * @brief Adds a force to the body.
      *
@@ -136,7 +155,7 @@ public:
      *
      * @return The position of the body.
      */
-    inline const d2Vec2& GetPosition() const;
+    inline d2Vec2 GetPosition() const;
 
     /**
      * @brief Sets the position of the body.
@@ -150,7 +169,7 @@ public:
      *
      * @return The velocity of the body.
      */
-    inline const d2Vec2& GetVelocity() const;
+    inline d2Vec2 GetVelocity() const;
 
     /** @brief Set acceleration of the body. */
     inline void SetAcceleration(const d2Vec2& acceleration);
@@ -165,6 +184,23 @@ public:
      */
     inline real GetAngularVelocity() const;
 
+    /**
+     * @brief Gets the position and rotation of the body.
+     *
+     * @return The transform of the body.
+     */
+    inline d2Transform GetTransform() const;
+
+    /**
+     * @brief Gets the stable handle of the body.
+     *
+     * Unlike a pointer, the handle can be checked with d2World::GetBody() once the body may have
+     * been destroyed.
+     *
+     * @return The handle of the body.
+     */
+    inline d2BodyId GetId() const;
+
     /**
      * @brief Gets the rotation angle of the body.
      *
@@ -228,11 +264,26 @@ public:
     inline d2Shape* GetShape() const;
 
     /**
-     * @brief Gets the Axis-Aligned Bounding Box of the body.
+     * @brief Gets the Axis-Aligned Bounding Box of a child of the body's shape.
+     *
+     * @param childIndex The index of the shape child.
+     * @return A pointer to the Axis-Aligned Bounding Box of the child.
+     */
+    inline d2AABB* GetAABB(int32 childIndex = 0) const;
+
+    /**
+     * @brief Gets the number of broadphase proxies of the body, one per shape child.
      *
-     * @return A pointer to the Axis-Aligned Bounding Box of the body.
+     * @return The number of proxies.
      */
-    inline d2AABB* GetAABB() const;
+    inline int32 GetProxyCount() const;
+
+    /**
+     * @brief Gets the type of the body.
+     *
+     * @return The type of the body.
+     */
+    inline d2BodyType GetType() const;
 
     /**
      * @brief Gets the next body in a linked list of bodies.
@@ -257,6 +308,15 @@ public:
      */
     inline real GetSleepTime() const;
 
+    /**
+     * @brief Gets the order in which the body was created in its world.
+     *
+     * Unlike the address of the body, it is the same on every machine running the same scene.
+     *
+     * @return The creation index of the body.
+     */
+    inline uint32 GetCreationIndex() const;
+
     /**
      * @brief Gets the wake state of the body.
      *
@@ -267,6 +327,11 @@ public:
     /**
      * @brief Sets the wake state of the body.
      *
+     * A sleeping body is skipped by the step until it's woken up by a contact with a moving
+     * body or by the user: forces, impulses and new positions or velocities wake it. The whole
+     * island of a body falls asleep at once, and waking any of its bodies wakes all of them.
+     * Putting a single body to sleep only lasts if nothing it touches moves.
+     *
      * @param awake The wake state of the body.
      */
     inline void SetAwake(bool awake);
@@ -277,40 +342,77 @@ public:
     /** @brief Sets the gravity scale of the body */
     inline void SetGravityScale(real gravityScale);
 
+    /**
+     * @brief Should this body be treated like a bullet for continuous collision detection?
+     *
+     * Bullets are swept against static geometry in sub-steps, so they don't tunnel through
+     * thin walls when they move further than their own size in one step.
+     *
+     * @param flag Whether the body is a bullet.
+     */
+    inline void SetBullet(bool flag);
+
+    /** @brief Is this body treated like a bullet for continuous collision detection? */
+    inline bool IsBullet() const;
+
+    /**
+     * @brief Should this body only detect overlaps?
+     *
+     * Sensors don't generate contacts and are never solved, their overlaps with other bodies
+     * are reported as sensor events by the world. Two sensors don't detect each other.
+     *
+     * @param flag Whether the body is a sensor.
+     */
+    inline void SetSensor(bool flag);
+
+    /** @brief Does this body only detect overlaps? */
+    inline bool IsSensor() const;
+
 private:
     friend class d2World;
+    friend class d2Constraint;
+    friend class d2ConstraintSolver;
+    friend class d2IslandBuilder;
+    friend class d2PositionSolver;
+    friend class d2BodyStorage;
+
+    // References to the state of the body in the storage of its world, for the solvers
+    inline d2Vec2& Position();
+    inline d2Rot& Rotation();
+    inline d2Vec2& Velocity();
+    inline real& AngularVelocity();
+    inline const d2Vec2& Acceleration() const;
+    inline real AngularAcceleration() const;
+
+    // Wake the other bodies of the island the body fell asleep with
+    void WakeIsland();
+
+    // Tell the broadphase the body fell asleep or woke up
+    void RefreshProxies();
 
     enum
     {
-        e_awakeFlag = 0x0001
+        e_awakeFlag = 0x0001,
+        e_bulletFlag = 0x0002,
+        e_sensorFlag = 0x0004
     };
 
     uint16 m_flags{};
     d2BodyType m_type{};
 
-    d2Transform m_transform; ///< The transformation of the body.
-
-    d2Vec2 velocity {}; ///< The velocity of the body.
-    d2Vec2 acceleration {}; ///< The acceleration of the body.
-
-    real m_gravityScale{ 1.0f }; ///< The gravity scale of the body.
+    // The transform, velocities, forces and masses live in the storage of the world
+    d2BodyStorage* m_storage { nullptr }; ///< The struct-of-arrays storage of the world.
+    int32 m_denseIndex { -1 }; ///< Index of the body in the arrays of the storage, changes when a body is removed.
+    d2BodyId m_id; ///< Stable handle of the body.
 
-    real angularVelocity {}; ///< The angular velocity of the body.
-    real angularAcceleration {}; ///< The angular acceleration of the body.
-
-    d2Vec2 sumForces {}; ///< The sum of all forces applied to the body.
-    real sumTorque {}; ///< The sum of all torques applied to the body.
-
-    real mass {}; ///< The mass of the body.
-    real invMass {}; ///< The inverse of the mass of the body.
     real I {}; ///< The moment of inertia of the body.
-    real invI {}; ///< The inverse of the moment of inertia of the body.
 
     real restitution {}; ///< The coefficient of restitution (elasticity) of the body.
 
     real friction {}; ///< The coefficient of friction of the body.
 
-    d2AABB *aabb { nullptr }; ///< A pointer to the Axis-Aligned Bounding Box of the body.
+    d2AABB *aabb { nullptr }; ///< The Axis-Aligned Bounding Boxes of the body, one per shape child.
+    int32 m_proxyCount { 0 }; ///< The number of Axis-Aligned Bounding Boxes of the body.
 
     d2Shape *shape { nullptr }; ///< A pointer to the shape/geometry of the body.
 
@@ -319,51 +421,101 @@ private:
     d2Body* next { nullptr }; ///< A pointer to the next body in a linked list of bodies.
 
     real m_sleepTime{}; ///< The time that the body has been stationary.
+
+    real m_speculativeDistance{}; ///< How far the body can travel in the current step, added to its proxies.
+
+    int32 m_solverIndex{}; ///< Index in the solver body array of the constraint solver, always 0 for static bodies.
+    int32 m_islandIndex{}; ///< Index of the body in the island builder, only valid during a step.
+    int32 m_sleepingIsland { -1 }; ///< Sleeping island of the island builder the body belongs to, or -1.
+    uint32 m_creationIndex{}; ///< Order in which the body was created in its world.
 };
 
-inline const d2Vec2& d2Body::GetPosition() const
+inline d2Vec2& d2Body::Position()
+{
+    return m_storage->positions[m_denseIndex];
+}
+
+inline d2Rot& d2Body::Rotation()
+{
+    return m_storage->rotations[m_denseIndex];
+}
+
+inline d2Vec2& d2Body::Velocity()
+{
+    return m_storage->velocities[m_denseIndex];
+}
+
+inline real& d2Body::AngularVelocity()
+{
+    return m_storage->angularVelocities[m_denseIndex];
+}
+
+inline const d2Vec2& d2Body::Acceleration() const
 {
-    return m_transform.p;
+    return m_storage->accelerations[m_denseIndex];
+}
+
+inline real d2Body::AngularAcceleration() const
+{
+    return m_storage->angularAccelerations[m_denseIndex];
+}
+
+inline d2Vec2 d2Body::GetPosition() const
+{
+    return m_storage->positions[m_denseIndex];
 }
 
 inline void d2Body::SetPosition(const d2Vec2& position)
 {
-    m_transform.p = position;
+    if (m_type != d2_staticBody && !IsAwake()) SetAwake(true);
+    Position() = position;
+    shape->UpdateVertices(GetTransform());
 }
 
-inline const d2Vec2& d2Body::GetVelocity() const
+inline d2Vec2 d2Body::GetVelocity() const
 {
-    return velocity;
+    return m_storage->velocities[m_denseIndex];
 }
 
 inline void d2Body::SetAcceleration(const d2Vec2& acceleration)
 {
-    this->acceleration = acceleration;
+    m_storage->accelerations[m_denseIndex] = acceleration;
 }
 
 inline void d2Body::SetAngularVelocity(real angularVelocity)
 {
-    this->angularVelocity = angularVelocity;
+    if (m_type != d2_staticBody && !IsAwake()) SetAwake(true);
+    AngularVelocity() = angularVelocity;
 }
 
 inline real d2Body::GetAngularVelocity() const
 {
-    return angularVelocity;
+    return m_storage->angularVelocities[m_denseIndex];
+}
+
+inline d2Transform d2Body::GetTransform() const
+{
+    return { m_storage->positions[m_denseIndex], m_storage->rotations[m_denseIndex] };
+}
+
+inline d2BodyId d2Body::GetId() const
+{
+    return m_id;
 }
 
 inline real d2Body::GetRotation() const
 {
-    return m_transform.q.GetAngle();
+    return m_storage->rotations[m_denseIndex].GetAngle();
 }
 
 inline real d2Body::GetMass() const
 {
-    return mass;
+    return m_storage->masses[m_denseIndex];
 }
 
 inline real d2Body::GetInvMass() const
 {
-    return invMass;
+    return m_storage->invMasses[m_denseIndex];
 }
 
 inline real d2Body::GetI() const
@@ -373,7 +525,7 @@ inline real d2Body::GetI() const
 
 inline real d2Body::GetInvI() const
 {
-    return invI;
+    return m_storage->invInertias[m_denseIndex];
 }
 
 inline void d2Body::SetFriction(real friction)
@@ -401,9 +553,19 @@ inline d2Shape* d2Body::GetShape() const
     return shape;
 }
 
-inline d2AABB* d2Body::GetAABB() const
+inline d2AABB* d2Body::GetAABB(int32 childIndex) const
 {
-    return aabb;
+    return aabb + childIndex;
+}
+
+inline int32 d2Body::GetProxyCount() const
+{
+    return m_proxyCount;
+}
+
+inline d2BodyType d2Body::GetType() const
+{
+    return m_type;
 }
 
 inline d2Body* d2Body::GetNext()
@@ -431,14 +593,58 @@ inline real d2Body::GetSleepTime() const
     return m_sleepTime;
 }
 
+inline uint32 d2Body::GetCreationIndex() const
+{
+    return m_creationIndex;
+}
+
 inline real d2Body::GetGravityScale() const
 {
-    return m_gravityScale;
+    return m_storage->gravityScales[m_denseIndex];
 }
 
 inline void d2Body::SetGravityScale(real gravityScale)
 {
-    m_gravityScale = gravityScale;
+    m_storage->gravityScales[m_denseIndex] = gravityScale;
+}
+
+inline void d2Body::SetBullet(bool flag)
+{
+    if (flag)
+    {
+        m_flags |= e_bulletFlag;
+    }
+    else
+    {
+        m_flags &= ~e_bulletFlag;
+    }
+}
+
+inline bool d2Body::IsBullet() const
+{
+    return (m_flags & e_bulletFlag) == e_bulletFlag;
+}
+
+inline void d2Body::SetSensor(bool flag)
+{
+    if (flag)
+    {
+        m_flags |= e_sensorFlag;
+    }
+    else
+    {
+        m_flags &= ~e_sensorFlag;
+    }
+}
+
+inline bool d2Body::IsSensor() const
+{
+    return (m_flags & e_sensorFlag) == e_sensorFlag;
+}
+
+inline real d2Body::GetSpeculativeDistance() const
+{
+    return m_speculativeDistance;
 }
 
 inline bool d2Body::IsAwake() const
@@ -448,6 +654,8 @@ inline bool d2Body::IsAwake() const
 
 inline void d2Body::SetAwake(bool awake)
 {
+    const int32 i = m_denseIndex;
+    const bool changed = IsAwake() != awake;
     if (awake)
     {
         m_flags |= e_awakeFlag;
@@ -457,11 +665,17 @@ inline void d2Body::SetAwake(bool awake)
     {
         m_flags &= ~e_awakeFlag;
         m_sleepTime = 0.0f;
-        velocity = d2Vec2(0, 0);
-        angularVelocity = 0.0f;
-        sumForces = d2Vec2(0, 0);
-        sumTorque = 0.0f;
+        m_storage->velocities[i] = d2Vec2(0, 0);
+        m_storage->angularVelocities[i] = 0.0f;
+        m_storage->accelerations[i] = d2Vec2(0, 0);
+        m_storage->angularAccelerations[i] = 0.0f;
+        m_storage->forces[i] = d2Vec2(0, 0);
+        m_storage->torques[i] = 0.0f;
     }
+    m_storage->moving[i] = awake && m_type == d2_dynamicBody;
+
+    if (changed) RefreshProxies();
+    if (awake && m_sleepingIsland >= 0) WakeIsland();
 }
 
 #endif
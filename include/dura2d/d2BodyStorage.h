@@ -0,0 +1,103 @@
+#ifndef D2BODYSTORAGE_H
+#define D2BODYSTORAGE_H
+
+#include <vector>
+
+#include "d2api.h"
+#include "d2Math.h"
+#include "d2Types.h"
+
+class d2Body;
+
+/**
+ * @brief Stable handle to a body of a world.
+ *
+ * The index names a slot that outlives the body, and the generation tells the bodies that
+ * used the slot apart, so a handle to a destroyed body never resolves to the one created after
+ * it. A default constructed handle is null.
+ */
+struct D2_API d2BodyId
+{
+    int32 index { -1 }; ///< Slot of the body in the storage of its world.
+    uint32 generation { 0 }; ///< Generation of the slot when the body was created, never 0 for a live body.
+
+    /** @brief Whether the handle was ever set, it may still name a destroyed body. */
+    bool IsNull() const { return generation == 0; }
+
+    bool operator==(const d2BodyId &other) const { return index == other.index && generation == other.generation; }
+    bool operator!=(const d2BodyId &other) const { return !(*this == other); }
+};
+
+/**
+ * @brief Struct-of-arrays storage of the state the step streams over.
+ *
+ * Each array holds one entry per body, at the dense index of the body. The arrays stay packed:
+ * removing a body moves the last one into its place, so only the handles are stable. Everything
+ * the step doesn't touch every frame, such as the shape or the material, stays in the d2Body.
+ */
+class D2_API d2BodyStorage
+{
+public:
+    /**
+     * @brief Add a body at the end of the arrays and give it a handle.
+     * @param body The body, its dense index and handle are set.
+     * @param transform The initial transform of the body.
+     * @param mass The mass of the body, 0 for static bodies.
+     * @param invI The inverse of the moment of inertia of the body.
+     * @param dynamic Whether the body is simulated.
+     */
+    void Add(d2Body* body, const d2Transform& transform, real mass, real invI, bool dynamic);
+
+    /**
+     * @brief Remove a body, the last body takes its dense index and its handle goes stale.
+     * @param body The body to remove.
+     */
+    void Remove(d2Body* body);
+
+    /**
+     * @brief Reserve room for more bodies so adding them doesn't grow the arrays one at a time.
+     *
+     * The arrays at least double when they grow, so reserving for each batch keeps the amortized
+     * cost of push_back.
+     *
+     * @param count The number of bodies the arrays must hold without growing.
+     */
+    void Reserve(int32 count);
+
+    /**
+     * @brief Get the body of a handle.
+     * @param id The handle.
+     * @return The body, or nullptr if it was destroyed or the handle is null.
+     */
+    d2Body* Get(d2BodyId id) const;
+
+    /** @brief Get the number of bodies. */
+    int32 GetCount() const { return (int32)bodies.size(); }
+
+    std::vector<d2Body*> bodies; ///< The bodies, densely packed.
+    std::vector<d2Vec2> positions; ///< Positions of the origins of the bodies.
+    std::vector<d2Rot> rotations; ///< Rotations of the bodies.
+    std::vector<d2Vec2> velocities; ///< Linear velocities.
+    std::vector<real> angularVelocities; ///< Angular velocities.
+    std::vector<d2Vec2> accelerations; ///< Linear accelerations of the forces of the last step.
+    std::vector<real> angularAccelerations; ///< Angular accelerations of the torques of the last step.
+    std::vector<d2Vec2> forces; ///< Forces applied since the last step.
+    std::vector<real> torques; ///< Torques applied since the last step.
+    std::vector<real> masses; ///< Masses.
+    std::vector<real> invMasses; ///< Inverse masses.
+    std::vector<real> invInertias; ///< Inverse moments of inertia.
+    std::vector<real> gravityScales; ///< Gravity scales.
+    std::vector<uint8> moving; ///< Whether the body is dynamic and awake, so the step can skip the others without reading the body.
+
+private:
+    struct Slot
+    {
+        int32 denseIndex; ///< Dense index of the body, or the next free slot once the body is destroyed.
+        uint32 generation;
+    };
+
+    std::vector<Slot> m_slots;
+    int32 m_freeSlot { -1 }; ///< Head of the list of free slots.
+};
+
+#endif //D2BODYSTORAGE_H
@@ -3,14 +3,16 @@
 
 #include <memory>
 #include <utility>
-#include <list>
+#include <vector>
 
 #include "dura2d/d2Body.h"
+#include "dura2d/d2AABB.h"
 
 class d2Draw;
 
-typedef std::pair<d2Body*, d2Body*> ColliderPair;
-typedef std::list<ColliderPair> ColliderPairList;
+// A pair of overlapping proxies, each one bounds a child of a body's shape
+typedef std::pair<d2AABB*, d2AABB*> ColliderPair;
+typedef std::vector<ColliderPair> ColliderPairList;
 
 class d2Broadphase
 {
@@ -18,12 +20,21 @@ public:
 
     virtual ~d2Broadphase() = default;
 
-    // adds a new d2AABB to the broadphase
+    // adds the d2AABB proxies of a body to the broadphase
     virtual void Add(d2Body* body) = 0;
 
-    // removes a d2AABB from the broadphase
+    // removes the d2AABB proxies of a body from the broadphase
     virtual void Remove(d2Body* body) = 0;
 
+    // adds the proxies of many bodies at once, one body at a time unless the broadphase knows better
+    virtual void AddBodies(d2Body* const* bodies, int32 count);
+
+    // removes the proxies of many bodies at once
+    virtual void RemoveBodies(d2Body* const* bodies, int32 count);
+
+    // refreshes the proxies of a body that fell asleep or woke up
+    virtual void Refresh(d2Body* body);
+
     // updates broadphase to react to changes to d2AABB
     virtual void Update(void) = 0;
 
@@ -40,7 +51,45 @@ public:
     virtual void Query(const d2AABB &aabb, ColliderList &output) const = 0;
 
     virtual void Draw(const d2Draw &draw) const = 0;
+
+protected:
+    // proxies of the same body never collide, and neither do two static bodies
+    static bool ShouldCollide(const d2AABB &a, const d2AABB &b);
 };
 
+inline void
+d2Broadphase::AddBodies(d2Body* const* bodies, int32 count)
+{
+    for (int32 i = 0; i < count; ++i)
+    {
+        Add(bodies[i]);
+    }
+}
+
+inline void
+d2Broadphase::RemoveBodies(d2Body* const* bodies, int32 count)
+{
+    for (int32 i = 0; i < count; ++i)
+    {
+        Remove(bodies[i]);
+    }
+}
+
+inline void
+d2Broadphase::Refresh(d2Body* body)
+{
+    (void)body;
+}
+
+inline bool
+d2Broadphase::ShouldCollide(const d2AABB &a, const d2AABB &b)
+{
+    if (a.Collider == b.Collider) return false;
+
+    // Static and sleeping bodies don't move, nothing new can happen between them
+    auto isMoving = [](const d2Body *body) { return body->GetType() != d2_staticBody && body->IsAwake(); };
+    return isMoving(a.Collider) || isMoving(b.Collider);
+}
+
 
 #endif //DURA2D_D2BROADPHASE_H
@@ -4,15 +4,79 @@
 #include "d2Body.h"
 #include "d2Contact.h"
 
+/**
+ * @brief Narrowphase routines. Each routine takes the bodies for the contacts along with the
+ * convex shapes to collide, with their vertices in world space, so children of chains and
+ * compounds go through the same code as single shapes.
+ *
+ * Shapes closer than the speculative distance also produce contacts, with a negative depth
+ * that holds their separation. The solver lets those close the gap but not cross it, so
+ * fast bodies are caught before they overlap.
+ */
 struct d2CollisionDetection
 {
-    static bool IsColliding(d2Body *a, d2Body *b, std::vector<d2Contact> &contacts);
+    static bool IsColliding(d2Body *a, d2Body *b, std::vector<d2Contact> &contacts, real speculativeDistance = 0.0F);
 
-    static bool IsCollidingCircleCircle(d2Body *a, d2Body *b, std::vector<d2Contact> &contacts);
+    static bool IsColliding(d2Body *a, int32 childA, d2Body *b, int32 childB, std::vector<d2Contact> &contacts,
+                            real speculativeDistance = 0.0F);
 
-    static bool IsCollidingPolygonPolygon(d2Body *a, d2Body *b, std::vector<d2Contact> &contacts);
+    static bool IsColliding(d2Body *a, const d2Shape *shapeA, d2Body *b, const d2Shape *shapeB, std::vector<d2Contact> &contacts,
+                            real speculativeDistance = 0.0F);
 
-    static bool IsCollidingPolygonCircle(d2Body *polygon, d2Body *circle, std::vector<d2Contact> &contacts);
+    /**
+     * @brief Boolean overlap test for sensors, without building any contact.
+     *
+     * Every shape is handled as a convex core inflated by a radius: a separating axis is looked
+     * for first, then the closest features of the cores are compared with the radii.
+     */
+    static bool TestOverlap(const d2Body *a, int32 childA, const d2Body *b, int32 childB);
+
+    static bool TestOverlap(const d2Shape *shapeA, const d2Shape *shapeB);
+
+    static bool IsCollidingCircleCircle(d2Body *a, const d2CircleShape *aCircleShape,
+                                        d2Body *b, const d2CircleShape *bCircleShape,
+                                        std::vector<d2Contact> &contacts,
+                                        real speculativeDistance = 0.0F);
+
+    static bool IsCollidingPolygonPolygon(d2Body *a, const d2PolygonShape *aPolygonShape,
+                                          d2Body *b, const d2PolygonShape *bPolygonShape,
+                                          std::vector<d2Contact> &contacts,
+                                          real speculativeDistance = 0.0F);
+
+    static bool IsCollidingPolygonCircle(d2Body *polygon, const d2PolygonShape *polygonShape,
+                                         d2Body *circle, const d2CircleShape *circleShape,
+                                         std::vector<d2Contact> &contacts,
+                                         real speculativeDistance = 0.0F);
+
+    static bool IsCollidingCapsuleCircle(d2Body *capsule, const d2CapsuleShape *capsuleShape,
+                                         d2Body *circle, const d2CircleShape *circleShape,
+                                         std::vector<d2Contact> &contacts,
+                                         real speculativeDistance = 0.0F);
+
+    static bool IsCollidingCapsuleCapsule(d2Body *a, const d2CapsuleShape *aCapsuleShape,
+                                          d2Body *b, const d2CapsuleShape *bCapsuleShape,
+                                          std::vector<d2Contact> &contacts,
+                                          real speculativeDistance = 0.0F);
+
+    static bool IsCollidingPolygonCapsule(d2Body *polygon, const d2PolygonShape *polygonShape,
+                                          d2Body *capsule, const d2CapsuleShape *capsuleShape,
+                                          std::vector<d2Contact> &contacts,
+                                          real speculativeDistance = 0.0F);
+
+    static bool IsCollidingEdgeCircle(d2Body *edgeBody, const d2EdgeShape *edge,
+                                      d2Body *circle, const d2CircleShape *circleShape,
+                                      std::vector<d2Contact> &contacts,
+                                      real speculativeDistance = 0.0F);
+
+    static bool IsCollidingEdgePolygon(d2Body *edgeBody, const d2EdgeShape *edge,
+                                       d2Body *polygon, const d2PolygonShape *polygonShape,
+                                       std::vector<d2Contact> &contacts,
+                                       real speculativeDistance = 0.0F);
+
+    static bool IsCollidingEdgeCapsule(d2Body *edgeBody, const d2EdgeShape *edge,
+                                       d2Body *capsule, const d2CapsuleShape *capsuleShape,
+                                       std::vector<d2Contact> &contacts,
+                                       real speculativeDistance = 0.0F);
 };
 
 #endif
@@ -6,4 +6,68 @@ const int MILLISECS_PER_FRAME = 1000 / FPS;
 
 const int PIXELS_PER_METER = 50;
 
+// Collision and constraint tolerance, in pixels
+const float LINEAR_SLOP = 0.01f;
+
+// Angular tolerance of the joints, in radians. The position solver counts an angle of
+// ANGULAR_SLOP as much as LINEAR_SLOP of distance
+const float ANGULAR_SLOP = 2.0f / 180.0f * 3.14159265359f;
+
+// Position solver. Every iteration removes this fraction of a penetration, never more than
+// MAX_POSITION_CORRECTION pixels at once. Off by default: without warm starting the velocity
+// iterations need the Baumgarte bias to hold stacks together
+const int POSITION_ITERATIONS = 0;
+const float POSITION_CORRECTION_RATE = 0.2f;
+const float MAX_POSITION_CORRECTION = 10.0f;
+
+// Largest margin a moving body adds to find speculative contacts, in pixels. The margin
+// is the distance the body can travel in the step, capped by this value
+const float SPECULATIVE_DISTANCE_MAX = 20.0f;
+
+// Approach speed above which a contact reports a hit event, in pixels per second
+const float HIT_EVENT_THRESHOLD = 50.0f;
+
+// Minimum number of broadphase pairs handed to a narrowphase worker
+const int NARROWPHASE_MIN_PAIRS = 64;
+
+// Default number of graph colors the solver spreads the joints and contacts over. Constraints that
+// don't fit in any color share bodies with every color and are solved one by one afterwards
+const int SOLVER_GRAPH_COLOR_COUNT = 12;
+
+// Minimum number of contact batches and joints of a color handed to a solver worker
+const int SOLVER_MIN_COLOR_ITEMS = 16;
+
+// Contacts bounce with the restitution of their bodies once they approach faster than this, in
+// pixels per second. Slower contacts come to rest instead of jittering
+const float RESTITUTION_THRESHOLD = 50.0f;
+
+// Two-point manifolds are solved as one 2x2 system while the condition number of its mass
+// matrix stays below this, and point by point otherwise
+const float BLOCK_SOLVER_MAX_CONDITION = 1000.0f;
+
+// A body rests while it moves slower than these, in pixels and radians per second. An island
+// falls asleep once all its bodies rested for TIME_TO_SLEEP seconds
+const float LINEAR_SLEEP_TOLERANCE = 2.5f;
+const float ANGULAR_SLEEP_TOLERANCE = 0.035f;
+const float TIME_TO_SLEEP = 0.5f;
+
+// Soft step solver. Contacts and joints are springs of the given frequency, in hertz, and damping
+// ratio, and a penetration is never pushed out faster than CONTACT_PUSH_MAX_VELOCITY, in pixels
+// per second. The contact frequency is capped to a quarter of the sub-step rate
+const int SOLVER_SUBSTEPS = 4;
+const float CONTACT_HERTZ = 30.0f;
+const float CONTACT_DAMPING_RATIO = 10.0f;
+const float CONTACT_PUSH_MAX_VELOCITY = 150.0f;
+const float JOINT_HERTZ = 60.0f;
+const float JOINT_DAMPING_RATIO = 2.0f;
+
+// Fraction of the position error of a joint the Baumgarte solver removes per step
+const float JOINT_BAUMGARTE = 0.2f;
+
+// Continuous collision of bullet bodies. A sub-step never moves a bullet further than this
+// fraction of its inner radius, and the time of impact is refined by bisection
+const float CCD_SUBSTEP_FRACTION = 0.5f;
+const int CCD_MAX_SUBSTEPS = 64;
+const int CCD_BISECTION_ITERATIONS = 8;
+
 #endif
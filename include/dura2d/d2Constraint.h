@@ -2,6 +2,31 @@
 #define CONSTRAINT_H
 
 #include "d2Body.h"
+#include "d2Constants.h"
+
+struct d2SolverBody;
+
+/**
+ * @brief Coefficients of a soft constraint, a spring and damper reached in closed form.
+ *
+ * The impulse of a row becomes -massScale * m * (J * V + biasRate * C) - impulseScale * λ, with m
+ * the effective mass and λ the impulse accumulated so far.
+ */
+struct D2_API d2Softness
+{
+    real biasRate;     ///< Fraction of the position error fixed per second.
+    real massScale;    ///< Scale of the effective mass, 1 for a rigid row.
+    real impulseScale; ///< Fraction of the accumulated impulse relaxed every solve, 0 for a rigid row.
+};
+
+/**
+ * @brief Make the softness of a constraint from its stiffness and damping.
+ * @param hertz The natural frequency of the spring, zero for a rigid constraint without bias.
+ * @param dampingRatio The damping ratio, 1 for critical damping.
+ * @param h The time step the constraint is solved over.
+ * @return The softness coefficients.
+ */
+D2_API d2Softness d2MakeSoftness(real hertz, real dampingRatio, real h);
 
 class d2Constraint
 {
@@ -15,18 +40,57 @@ public:
     d2Constraint* next;
     d2Constraint* prev;
 
+    // Velocities of the constraint solver while it runs, the body velocities are used when null
+    d2SolverBody* solverBodies { nullptr };
+    int32 indexA { 0 }; // Index of body "a" in solverBodies
+    int32 indexB { 0 }; // Index of body "b" in solverBodies
+
+    // Stiffness and damping of the constraint in the soft step solver
+    real hertz { JOINT_HERTZ };
+    real dampingRatio { JOINT_DAMPING_RATIO };
+
     virtual ~d2Constraint() = default;
 
-    d2MatMN GetInvM() const;
+    d2Vec<6> GetInvM() const;
+
+    d2Vec<6> GetVelocities() const;
 
-    d2VecN GetVelocities() const;
+    // Motion of both bodies since the start of the step, zero outside of the soft step solver
+    d2Vec<6> GetDeltaPositions() const;
+
+    void ApplyImpulses(const d2Vec<6> &impulses);
+
+    // Move the bodies as ApplyImpulses() changes their velocities, static bodies are never written
+    void ApplyPositionImpulses(const d2Vec<6> &impulses);
+
+    // Same as above, one body at a time, for the joints solving their rows in closed form
+    void GetVelocities(d2Vec2 &va, real &wa, d2Vec2 &vb, real &wb) const;
+
+    // Static bodies are never written, other workers may be reading them
+    void SetVelocities(const d2Vec2 &va, real wa, const d2Vec2 &vb, real wb);
+
+    void GetDeltaPositions(d2Vec2 &dpa, real &dqa, d2Vec2 &dpb, real &dqb) const;
+
+    // Push b by P and pull a by -P, with the angular impulses of each body
+    void ApplyPositionImpulse(const d2Vec2 &P, real angularA, real angularB);
 
     virtual void PreSolve(const real dt) { (void)dt; }
 
-    virtual void Solve() {}
+    // Returns the size of the impulse change, summed over the rows
+    virtual real Solve() { return 0.0f; }
 
     virtual void PostSolve() {}
 
+    // Soft step solver, the constraint is prepared once per step and solved over sub-steps of h
+    virtual void PrepareSoft(const real h) { (void)h; }
+
+    virtual void WarmStart() {}
+
+    virtual real SolveSoft(bool useBias) { (void)useBias; return 0.0f; }
+
+    // Position solver, one non-linear Gauss-Seidel iteration. Returns the position error before it.
+    virtual real SolvePosition() { return 0.0f; }
+
     void SetNext(d2Constraint* next) { this->next = next; }
 
     void SetPrev(d2Constraint* prev) { this->prev = prev; }
@@ -38,33 +102,17 @@ public:
     const d2Constraint* GetPrev() const { return prev; }
 };
 
-class d2JointConstraint : public d2Constraint
-{
-private:
-    d2MatMN jacobian;
-    d2VecN cachedLambda;
-    real bias;
-
-public:
-    d2JointConstraint();
-
-    d2JointConstraint(d2Body *a, d2Body *b, const d2Vec2 &anchorPoint);
-
-    void PreSolve(const real dt) override;
-
-    void Solve() override;
-
-    void PostSolve() override;
-};
-
 class d2PenetrationConstraint : public d2Constraint
 {
 private:
-    d2MatMN jacobian;
-    d2VecN cachedLambda;
+    d2Mat<2, 6> jacobian;
+    d2Vec<2> cachedLambda;
+    d2Vec<2> effectiveMass; // 1 / (J * M^-1 * Jt) of the normal and tangent rows, solved independently
     real bias;
     d2Vec2 normal;    // Normal direction of the penetration in A's local space
     real friction; // Friction coefficient between the two penetrating m_bodiesList
+    real restitution; // Restitution coefficient between the two penetrating bodies
+    real relativeVelocity; // Normal velocity before the solve, negative when approaching
 
 public:
     d2PenetrationConstraint();
@@ -77,7 +125,7 @@ public:
 
     void PreSolve(const real dt) override;
 
-    void Solve() override;
+    real Solve() override;
 
     void PostSolve() override;
 };
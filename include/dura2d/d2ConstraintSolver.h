@@ -0,0 +1,376 @@
+#ifndef D2CONSTRAINTSOLVER_H
+#define D2CONSTRAINTSOLVER_H
+
+#include <vector>
+
+#include "d2api.h"
+#include "d2Math.h"
+#include "d2Contact.h"
+
+// Number of contacts solved together, one per SIMD lane
+#if defined(__AVX__)
+#define D2_SIMD_WIDTH 8
+#else
+#define D2_SIMD_WIDTH 4
+#endif
+
+class d2Body;
+class d2Constraint;
+class d2ThreadPool;
+
+/**
+ * @brief Velocity state of a body as seen by the constraint solver.
+ *
+ * The joints and contacts read and write these instead of the bodies, so a batch can be gathered
+ * from a single contiguous array. Index 0 is shared by every static body and never moves.
+ * Everything a row needs from a body fits in 32 bytes, the solve never touches the d2Body objects.
+ */
+struct alignas(32) D2_API d2SolverBody
+{
+    d2Vec2 v;     ///< Linear velocity.
+    real w;       ///< Angular velocity.
+    d2Vec2 dp;    ///< Translation since the start of the step, moved by the soft step solver only.
+    real dq;      ///< Rotation since the start of the step, moved by the soft step solver only.
+    real invMass; ///< Inverse mass, zero for the static body.
+    real invI;    ///< Inverse rotational inertia, zero for the static body.
+};
+
+/** @brief One point of the manifolds of a d2ContactBatch, in SoA layout. */
+struct alignas(32) D2_API d2ContactBatchPoint
+{
+    real raCrossN[D2_SIMD_WIDTH]; ///< Lever arm of a crossed with the normal.
+    real rbCrossN[D2_SIMD_WIDTH]; ///< Lever arm of b crossed with the normal.
+    real raCrossT[D2_SIMD_WIDTH]; ///< Lever arm of a crossed with the tangent.
+    real rbCrossT[D2_SIMD_WIDTH]; ///< Lever arm of b crossed with the tangent.
+
+    real normalMass[D2_SIMD_WIDTH];  ///< 1 / (J * M^-1 * Jt) of the normal row, zero for a missing point.
+    real tangentMass[D2_SIMD_WIDTH]; ///< 1 / (J * M^-1 * Jt) of the tangent row, zero without friction.
+    real bias[D2_SIMD_WIDTH];
+    real separation[D2_SIMD_WIDTH]; ///< Separation at the start of the step, negative when penetrating.
+
+    real relativeVelocity[D2_SIMD_WIDTH]; ///< Normal velocity before the solve, negative when approaching.
+    real maxNormalImpulse[D2_SIMD_WIDTH]; ///< Largest normal impulse of the solve, zero if it never touched.
+
+    real normalImpulse[D2_SIMD_WIDTH];  ///< Accumulated normal impulse.
+    real tangentImpulse[D2_SIMD_WIDTH]; ///< Accumulated tangent impulse.
+};
+
+/**
+ * @brief D2_SIMD_WIDTH contact manifolds in SoA layout, one per lane.
+ *
+ * A manifold holds the one or two points the narrowphase found between two shapes, sharing their
+ * normal. No two lanes of a batch share a dynamic body, so the lanes are solved at once and
+ * scattered back without conflicts. Unused lanes and points point at the static solver body and
+ * have no mass.
+ */
+struct alignas(32) D2_API d2ContactBatch
+{
+    int32 indexA[D2_SIMD_WIDTH];
+    int32 indexB[D2_SIMD_WIDTH];
+    int32 pointCount[D2_SIMD_WIDTH];
+
+    // Inverse masses and moments of inertia, zero for static bodies
+    real invMassA[D2_SIMD_WIDTH];
+    real invIA[D2_SIMD_WIDTH];
+    real invMassB[D2_SIMD_WIDTH];
+    real invIB[D2_SIMD_WIDTH];
+
+    real normalX[D2_SIMD_WIDTH];
+    real normalY[D2_SIMD_WIDTH];
+    real friction[D2_SIMD_WIDTH];
+    real restitution[D2_SIMD_WIDTH];
+
+    // Mass matrix K = J * M^-1 * Jt of both normal rows and its inverse, zero when the points
+    // are solved one by one
+    real k11[D2_SIMD_WIDTH];
+    real k12[D2_SIMD_WIDTH];
+    real k22[D2_SIMD_WIDTH];
+    real blockMass11[D2_SIMD_WIDTH];
+    real blockMass12[D2_SIMD_WIDTH];
+    real blockMass22[D2_SIMD_WIDTH];
+
+    // Soft step solver
+    real biasRate[D2_SIMD_WIDTH]; ///< Softness of the contact, see d2Softness.
+    real massScale[D2_SIMD_WIDTH];
+    real impulseScale[D2_SIMD_WIDTH];
+
+    d2ContactBatchPoint points[2];
+};
+
+/** @brief Range of the batches and joints of a graph color. */
+struct D2_API d2SolverColor
+{
+    int32 batchStart;
+    int32 batchCount;
+    int32 jointStart;
+    int32 jointCount;
+};
+
+/** @brief How much the impulses changed over one iteration of the solver. */
+struct D2_API d2SolverIteration
+{
+    real maxImpulse;   ///< Largest impulse change of a joint or contact point, summed over its rows.
+    real totalImpulse; ///< Impulse changes of all the joints and contact points.
+};
+
+/** @brief What a color does to its joints and contacts. */
+enum d2SolverStage
+{
+    d2_solveStage = 0, //< Baumgarte iteration.
+    d2_warmStartStage, //< Soft step, apply the impulses of the last sub-step.
+    d2_softSolveStage, //< Soft step, iteration pushing out of the position error.
+    d2_relaxStage,     //< Soft step, iteration removing the velocity the push added.
+    d2_restitutionStage //< Last pass, bouncing the contacts that approached fast enough.
+};
+
+/**
+ * @brief Solves the joints and penetration constraints of a step over a graph coloring.
+ *
+ * The joints and contacts are spread over graph colors so that no dynamic body appears twice in
+ * a color. The colors are solved one after the other, and the constraints of a color in parallel
+ * on the worker pool. The contacts of a color are packed in batches of D2_SIMD_WIDTH solved with
+ * SSE, or AVX when the library is built with it.
+ *
+ * The constraints that don't fit in any color go to the overflow color, solved serially after
+ * the others with the same math. With zero colors everything is solved serially.
+ *
+ * Solve() runs Baumgarte iterations over the step. SolveSoft() runs the soft step instead: the
+ * step is split in sub-steps, each integrating the velocities, solving soft constraints against
+ * the separations moved by the sub-steps so far, integrating the positions and relaxing.
+ *
+ * Both end with a restitution pass. The contacts that approached faster than
+ * RESTITUTION_THRESHOLD before the solve, and pushed at some point of it, leave with their
+ * approach velocity scaled by the restitution of the bodies.
+ */
+class D2_API d2ConstraintSolver
+{
+public:
+    /**
+     * @brief Constructor.
+     * @param threadPool The workers the colors are solved on, null to solve serially.
+     */
+    explicit d2ConstraintSolver(d2ThreadPool* threadPool = nullptr);
+
+    /**
+     * @brief Build the solver bodies, the colors and the batches of a step.
+     *
+     * The joints must be pre-solved before, so their warm starting is seen by the solver bodies.
+     *
+     * @param contacts The contacts to solve.
+     * @param contactCount The number of contacts.
+     * @param joints The joints to solve.
+     * @param jointCount The number of joints.
+     * @param dt The time step.
+     */
+    void Prepare(const d2Contact* contacts, int32 contactCount, d2Constraint* const* joints, int32 jointCount, real dt);
+
+    /**
+     * @brief Solve all the constraints, reading and writing the body velocities.
+     * @param iterations The largest number of iterations over all the constraints, fewer once an
+     * iteration changes no impulse by more than the tolerance.
+     */
+    void Solve(int32 iterations);
+
+    /**
+     * @brief Solve all the constraints over sub-steps with soft constraints, moving the bodies.
+     *
+     * The velocities of the bodies must hold the whole step of forces, integrated over its time
+     * step, which is spread back over the sub-steps. The joints are prepared here and must not be
+     * pre-solved. The positions of the bodies are integrated, they must not be integrated again.
+     *
+     * @param subStepCount The number of sub-steps.
+     * @param contactHertz The stiffness of the contacts, capped to a quarter of the sub-step rate.
+     * @param contactDampingRatio The damping ratio of the contacts.
+     */
+    void SolveSoft(int32 subStepCount, real contactHertz, real contactDampingRatio);
+
+    /**
+     * @brief Set the number of graph colors, the rest of the constraints go to the overflow color.
+     * @param colorCount The number of colors, in [0, 32].
+     */
+    void SetColorCount(int32 colorCount);
+
+    /**
+     * @brief Choose whether the contacts push out of penetration through their velocity bias.
+     *
+     * Off when the positions are corrected after the velocities are integrated, the joints then
+     * solve their rigid point rows, prepared with PrepareSoft(). Speculative contacts keep their
+     * bias either way.
+     *
+     * @param flag Whether the penetrations are fed back to the velocities, true by default.
+     */
+    void SetBaumgarte(bool flag);
+
+    /**
+     * @brief Set the impulse change below which Solve() stops iterating.
+     * @param tolerance The largest impulse change of a converged iteration, zero to never stop early.
+     */
+    void SetTolerance(real tolerance);
+
+    /**
+     * @brief Get the impulse change below which Solve() stops iterating.
+     * @return The tolerance, zero when every iteration runs.
+     */
+    real GetTolerance() const;
+
+    /**
+     * @brief Choose whether the impulse changes reported by GetIterations() are summed in a fixed order.
+     *
+     * The velocities never depend on the number of workers, only the float sums of the reported
+     * impulses do, as each worker adds up its own range. With the flag on, they are added up
+     * constraint by constraint in order instead.
+     *
+     * @param flag Whether the reported impulses are the same for any number of workers.
+     */
+    void SetDeterministic(bool flag);
+
+    /**
+     * @brief Get the impulse changes of the iterations of the last solve.
+     *
+     * One entry per iteration of Solve(), or per sub-step of SolveSoft(). The relaxation and
+     * restitution passes are not counted.
+     *
+     * @return The iterations in order.
+     */
+    const std::vector<d2SolverIteration>& GetIterations() const;
+
+    /**
+     * @brief Get the number of graph colors the constraints are spread over.
+     * @return The number of colors, not counting the overflow color.
+     */
+    int32 GetMaxColorCount() const;
+
+    /**
+     * @brief Get the number of graph colors in use, the last one is the overflow color.
+     * @return The number of colors.
+     */
+    int32 GetColorCount() const;
+
+    /**
+     * @brief Get the batches of a color.
+     * @param color The color index, in [0, GetColorCount()).
+     * @param count Receives the number of batches of the color.
+     * @return Pointer to the first batch of the color.
+     */
+    const d2ContactBatch* GetColorBatches(int32 color, int32& count) const;
+
+    /**
+     * @brief Get the joints of a color.
+     * @param color The color index, in [0, GetColorCount()).
+     * @param count Receives the number of joints of the color.
+     * @return Pointer to the first joint of the color.
+     */
+    d2Constraint* const* GetColorJoints(int32 color, int32& count) const;
+
+    /**
+     * @brief Get the number of contacts and joints that didn't fit in any color.
+     * @return The number of overflow constraints.
+     */
+    int32 GetOverflowCount() const;
+
+    /**
+     * @brief Get the body behind a solver body.
+     * @param index The solver body index, as found in the batches.
+     * @return The body, null for the shared static body at index 0.
+     */
+    const d2Body* GetBody(int32 index) const;
+
+private:
+    int32 AddBody(d2Body* body);
+    int32 AssignColor(int32 indexA, int32 indexB);
+    void LoadVelocities();
+    void StoreVelocities();
+    void SolveColors(d2SolverStage stage);
+    void SolveColor(const d2SolverColor& color, d2SolverStage stage);
+    real SolveJoint(d2Constraint* joint, d2SolverStage stage);
+    void SolveBatch(d2ContactBatch& batch, d2SolverStage stage, d2SolverIteration& iteration);
+    void SolveBlock(d2ContactBatch& batch, int32 lane, real bias1, real bias2);
+    void SolveLane(d2ContactBatch& batch, int32 lane, d2SolverStage stage, d2SolverIteration& iteration);
+    void WarmStartLane(d2ContactBatch& batch, int32 lane);
+    void RestituteLane(d2ContactBatch& batch, int32 lane);
+
+    d2ThreadPool* m_threadPool;
+    int32 m_maxColorCount; ///< Number of graph colors before the overflow color.
+    real m_dt { 0.0f };    ///< Time step of the last Prepare().
+    real m_invH { 0.0f };  ///< Inverse of the sub-step of the soft step solver.
+    bool m_baumgarte { true }; ///< Whether penetrations are fed back as velocity bias.
+    real m_tolerance { 0.0f }; ///< Impulse change below which Solve() stops iterating.
+    bool m_deterministic { false }; ///< Whether the impulse changes are summed in constraint order.
+
+    std::vector<d2Body*> m_bodies; ///< The bodies behind the solver bodies, index 0 is the static body.
+    std::vector<d2SolverBody> m_solverBodies;
+    std::vector<uint32> m_bodyColors; ///< Bit mask of the colors used by each solver body.
+
+    std::vector<int32> m_manifolds; ///< First contact of each manifold, then the end of the last one.
+    std::vector<int32> m_manifoldBodies; ///< Solver bodies A and B of each manifold.
+    std::vector<std::vector<int32>> m_colorContacts; ///< Manifolds of each color, the last one is the overflow.
+    std::vector<std::vector<d2Constraint*>> m_colorJoints; ///< Joints of each color, the last one is the overflow.
+
+    std::vector<d2SolverColor> m_colors; ///< The non empty colors, then the overflow color.
+    std::vector<d2ContactBatch> m_batches; ///< Batches of all the colors in order.
+    std::vector<d2Constraint*> m_joints; ///< Joints of all the colors in order.
+    int32 m_overflowCount { 0 };
+
+    std::vector<d2SolverIteration> m_iterations; ///< Impulse changes of the iterations of the last solve.
+    std::vector<d2SolverIteration> m_workerIterations; ///< Impulse changes of the current iteration, per worker.
+    std::vector<d2SolverIteration> m_itemIterations; ///< Impulse changes of each item of a color, when deterministic.
+};
+
+inline void d2ConstraintSolver::SetBaumgarte(bool flag)
+{
+    m_baumgarte = flag;
+}
+
+inline void d2ConstraintSolver::SetTolerance(real tolerance)
+{
+    m_tolerance = tolerance;
+}
+
+inline real d2ConstraintSolver::GetTolerance() const
+{
+    return m_tolerance;
+}
+
+inline void d2ConstraintSolver::SetDeterministic(bool flag)
+{
+    m_deterministic = flag;
+}
+
+inline const std::vector<d2SolverIteration>& d2ConstraintSolver::GetIterations() const
+{
+    return m_iterations;
+}
+
+inline int32 d2ConstraintSolver::GetMaxColorCount() const
+{
+    return m_maxColorCount;
+}
+
+inline int32 d2ConstraintSolver::GetColorCount() const
+{
+    return (int32)m_colors.size();
+}
+
+inline const d2ContactBatch* d2ConstraintSolver::GetColorBatches(int32 color, int32& count) const
+{
+    count = m_colors[color].batchCount;
+    return m_batches.data() + m_colors[color].batchStart;
+}
+
+inline d2Constraint* const* d2ConstraintSolver::GetColorJoints(int32 color, int32& count) const
+{
+    count = m_colors[color].jointCount;
+    return m_joints.data() + m_colors[color].jointStart;
+}
+
+inline int32 d2ConstraintSolver::GetOverflowCount() const
+{
+    return m_overflowCount;
+}
+
+inline const d2Body* d2ConstraintSolver::GetBody(int32 index) const
+{
+    return m_bodies[index];
+}
+
+#endif //D2CONSTRAINTSOLVER_H
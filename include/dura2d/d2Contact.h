@@ -1,10 +1,12 @@
 #ifndef CONTACT_H
 #define CONTACT_H
 
+#include <vector>
+
 #include "dura2d/d2api.h"
+#include "dura2d/d2Math.h"
 
 class d2Body;
-struct d2Vec2;
 
 struct D2_API d2Contact
 {
@@ -16,6 +18,82 @@ struct D2_API d2Contact
 
     d2Vec2 normal;
     real depth;
+
+    int32 childA { 0 }; ///< Child shape of a, for chains and compounds.
+    int32 childB { 0 }; ///< Child shape of b, for chains and compounds.
+};
+
+/**
+ * @brief A pair of touching child shapes, used to follow contacts from one step to the next.
+ *
+ * Body a is always the one created first, so a pair has a single key whatever order the
+ * broadphase reports it in, and the pairs sort the same way on every machine.
+ */
+struct D2_API d2ContactPair
+{
+    d2Body *a;
+    d2Body *b;
+
+    int32 childA;
+    int32 childB;
+
+    bool operator<(const d2ContactPair& other) const;
+    bool operator==(const d2ContactPair& other) const;
 };
 
+/** @brief Reported when two shapes start touching faster than the hit event threshold. */
+struct D2_API d2ContactHitEvent
+{
+    d2ContactPair pair;
+
+    d2Vec2 point;       ///< Point of the hit, in world space.
+    d2Vec2 normal;      ///< Normal of the hit, from pair.a to pair.b.
+    real approachSpeed; ///< Speed at which the shapes approach along the normal, before the solve.
+};
+
+/**
+ * @brief Contact events of the last step, read as flat arrays.
+ *
+ * The bodies are only valid until the next step, or until they are destroyed.
+ */
+struct D2_API d2ContactEvents
+{
+    std::vector<d2ContactPair> beginEvents; ///< Pairs that started touching.
+    std::vector<d2ContactPair> endEvents;   ///< Pairs that stopped touching.
+    std::vector<d2ContactHitEvent> hitEvents;
+
+    void Clear();
+};
+
+/**
+ * @brief Sensor events of the last step, read as flat arrays. In every pair, body a is the sensor.
+ *
+ * The bodies are only valid until the next step, or until they are destroyed.
+ */
+struct D2_API d2SensorEvents
+{
+    std::vector<d2ContactPair> beginEvents; ///< Bodies that started overlapping a sensor.
+    std::vector<d2ContactPair> endEvents;   ///< Bodies that stopped overlapping a sensor.
+
+    void Clear();
+};
+
+inline bool d2ContactPair::operator==(const d2ContactPair& other) const
+{
+    return a == other.a && b == other.b && childA == other.childA && childB == other.childB;
+}
+
+inline void d2ContactEvents::Clear()
+{
+    beginEvents.clear();
+    endEvents.clear();
+    hitEvents.clear();
+}
+
+inline void d2SensorEvents::Clear()
+{
+    beginEvents.clear();
+    endEvents.clear();
+}
+
 #endif
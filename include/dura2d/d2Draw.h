@@ -96,6 +96,12 @@ public:
 
     virtual void DrawSolidCircle(const d2Vec2 &center, float radius, const float &angle, const d2Color &color) const = 0;
 
+    /**
+     * @brief Draws a capsule. By default the caps are drawn as solid circles joined by their two
+     * side segments, override it to fill the body.
+     */
+    virtual void DrawSolidCapsule(const d2Vec2 &p1, const d2Vec2 &p2, float radius, const d2Color &color) const;
+
     virtual void DrawTransform(const d2Transform & transform) const = 0;
 
     virtual void DrawSegment(const d2Vec2 &p1, const d2Vec2 &p2, const d2Color &color) const = 0;
@@ -128,5 +134,22 @@ d2Draw::ClearFlags(uint32 flags)
     m_flags &= ~flags;
 }
 
+inline void
+d2Draw::DrawSolidCapsule(const d2Vec2 &p1, const d2Vec2 &p2, float radius, const d2Color &color) const
+{
+    DrawSolidCircle(p1, radius, 0.0f, color);
+    DrawSolidCircle(p2, radius, 0.0f, color);
+
+    // The sides, offset from the axis along its normal
+    d2Vec2 axis = p2 - p1;
+    const real length = axis.Lenght();
+    if (length <= 0.0f) return;
+
+    axis /= length;
+    const d2Vec2 offset(-axis.y * radius, axis.x * radius);
+    DrawSegment(p1 + offset, p2 + offset, color);
+    DrawSegment(p1 - offset, p2 - offset, color);
+}
+
 
 #endif //D2DRAW_H
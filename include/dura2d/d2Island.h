@@ -0,0 +1,185 @@
+#ifndef D2ISLAND_H
+#define D2ISLAND_H
+
+#include <vector>
+
+#include "d2api.h"
+#include "d2Types.h"
+#include "d2Contact.h"
+
+class d2Body;
+class d2BodyStorage;
+class d2Constraint;
+
+/**
+ * @brief A group of dynamic bodies connected by contacts or joints.
+ *
+ * Nothing in an island touches a dynamic body of another island, so islands can be solved
+ * independently. The ranges index the arrays of the d2IslandBuilder that built them.
+ */
+struct D2_API d2Island
+{
+    int32 bodyStart;
+    int32 bodyCount;
+    int32 contactStart;
+    int32 contactCount;
+    int32 jointStart;
+    int32 jointCount;
+
+    /** @brief Number of contacts and joints of the island. */
+    int32 GetConstraintCount() const { return contactCount + jointCount; }
+};
+
+/**
+ * @brief Builds the simulation islands of a step by union-find over the contacts and joints.
+ *
+ * Only the awake dynamic bodies are built into islands, static and sleeping bodies don't link
+ * islands together and are never written by the solver. The islands are sorted from the most to
+ * the least constraints. The bodies, contacts and joints are grouped by island so each island is
+ * a contiguous range of them.
+ *
+ * Islands that fall asleep are kept, with their contacts, until one of their bodies is woken. Then
+ * the whole island wakes at once, and its contacts are handed back to the step that woke it since
+ * the narrowphase skips the pairs of sleeping bodies.
+ */
+class D2_API d2IslandBuilder
+{
+public:
+    /**
+     * @brief Build the islands of the awake bodies.
+     * @param storage The body storage of the world, only its awake dynamic bodies are visited.
+     * @param contacts The contacts found by the narrowphase.
+     * @param joints The list of joints of the world.
+     */
+    void Build(const d2BodyStorage& storage, const std::vector<d2Contact>& contacts, d2Constraint* joints);
+
+    /**
+     * @brief Get the number of islands built by the last Build().
+     * @return The number of islands, one per group of connected awake dynamic bodies.
+     */
+    int32 GetIslandCount() const;
+
+    /**
+     * @brief Get an island.
+     * @param index The island index, in [0, GetIslandCount()).
+     * @return The island, by decreasing constraint count.
+     */
+    const d2Island& GetIsland(int32 index) const;
+
+    /**
+     * @brief Put an island built by the last Build() to sleep and keep it until it's woken.
+     *
+     * The bodies aren't changed, the caller puts them to sleep.
+     *
+     * @param index The island index, in [0, GetIslandCount()).
+     */
+    void Sleep(int32 index);
+
+    /**
+     * @brief Wake every body of a sleeping island, see d2Body::SetAwake().
+     *
+     * The bodies and contacts of the island are added to the woken bodies and contacts.
+     *
+     * @param index The sleeping island index of a body of the island.
+     */
+    void Wake(int32 index);
+
+    /** @brief Get the number of sleeping islands. */
+    int32 GetSleepingIslandCount() const;
+
+    /** @brief Get the bodies woken since the last ClearWoken(). */
+    const std::vector<d2Body*>& GetWokenBodies() const;
+
+    /** @brief Get the contacts of the islands woken since the last ClearWoken(). */
+    const std::vector<d2Contact>& GetWokenContacts() const;
+
+    /** @brief Forget the woken bodies and contacts. */
+    void ClearWoken();
+
+    /** @brief Get the dynamic bodies, grouped by island. */
+    d2Body* const* GetBodies() const;
+
+    /** @brief Get the contacts, grouped by island. */
+    const d2Contact* GetContacts() const;
+
+    /** @brief Get the joints, grouped by island. */
+    d2Constraint* const* GetJoints() const;
+
+private:
+    int32 Find(int32 index);
+    void Union(int32 indexA, int32 indexB);
+
+    // A sleeping island, the slot is reused once it's woken
+    struct SleepingIsland
+    {
+        std::vector<d2Body*> bodies;
+        std::vector<d2Contact> contacts;
+    };
+
+    std::vector<int32> m_parents; ///< Union-find forest over the awake dynamic bodies.
+    std::vector<d2Body*> m_bodies;
+    std::vector<d2Contact> m_contacts;
+    std::vector<d2Constraint*> m_joints;
+    std::vector<d2Island> m_islands;
+
+    std::vector<SleepingIsland> m_sleepingIslands;
+    std::vector<int32> m_freeSleepingIslands; ///< Slots of the woken islands.
+    std::vector<d2Body*> m_wokenBodies;
+    std::vector<d2Contact> m_wokenContacts;
+
+    // Scratch of Build(), kept between steps so building doesn't allocate
+    std::vector<d2Body*> m_awakeBodies;
+    std::vector<int32> m_bodyIslands;
+    std::vector<int32> m_rootIslands;
+    std::vector<d2Island> m_unsortedIslands;
+    std::vector<int32> m_contactIslands;
+    std::vector<d2Constraint*> m_jointList;
+    std::vector<int32> m_jointIslands;
+    std::vector<int32> m_order;
+    std::vector<int32> m_ranks;
+    std::vector<int32> m_bodyCursors;
+    std::vector<int32> m_contactCursors;
+    std::vector<int32> m_jointCursors;
+};
+
+inline int32 d2IslandBuilder::GetIslandCount() const
+{
+    return (int32)m_islands.size();
+}
+
+inline int32 d2IslandBuilder::GetSleepingIslandCount() const
+{
+    return (int32)(m_sleepingIslands.size() - m_freeSleepingIslands.size());
+}
+
+inline const std::vector<d2Body*>& d2IslandBuilder::GetWokenBodies() const
+{
+    return m_wokenBodies;
+}
+
+inline const std::vector<d2Contact>& d2IslandBuilder::GetWokenContacts() const
+{
+    return m_wokenContacts;
+}
+
+inline const d2Island& d2IslandBuilder::GetIsland(int32 index) const
+{
+    return m_islands[index];
+}
+
+inline d2Body* const* d2IslandBuilder::GetBodies() const
+{
+    return m_bodies.data();
+}
+
+inline const d2Contact* d2IslandBuilder::GetContacts() const
+{
+    return m_contacts.data();
+}
+
+inline d2Constraint* const* d2IslandBuilder::GetJoints() const
+{
+    return m_joints.data();
+}
+
+#endif //D2ISLAND_H
@@ -0,0 +1,374 @@
+#ifndef D2JOINT_H
+#define D2JOINT_H
+
+#include "d2api.h"
+#include "d2Constraint.h"
+
+/** @brief Type of a joint, the key of its entry in the d2JointRegistry. */
+enum d2JointType
+{
+    d2_pinJoint = 0,   //< Pins the anchors together through their squared distance.
+    d2_revoluteJoint,  //< Pins the anchors together, with an optional angle range and motor.
+    d2_distanceJoint,  //< Keeps the anchors at a fixed length.
+    d2_prismaticJoint, //< Slides b along an axis of a without rotating, with an optional range and motor.
+    d2_weldJoint,      //< Glues b to a.
+    d2_motorJoint,     //< Drives b towards an offset from a, within a largest force and torque.
+    d2_jointTypeCount
+};
+
+/**
+ * @brief Everything needed to create a joint of any type, see d2World::CreateJoint().
+ *
+ * Each type reads the fields it needs and ignores the others. Initialize() fills the bodies, the
+ * anchors and the rest pose from the current pose of the bodies.
+ */
+struct D2_API d2JointDef
+{
+    d2JointType type { d2_revoluteJoint };
+    d2Body* bodyA { nullptr };
+    d2Body* bodyB { nullptr };
+    d2Vec2 localAnchorA;           ///< Anchor of a in its local space.
+    d2Vec2 localAnchorB;           ///< Anchor of b in its local space.
+    real referenceAngle { 0.0f };  ///< Angle of b relative to a at rest, revolute, prismatic and weld joints.
+
+    // Stiffness and damping of the joint in the soft step solver
+    real hertz { JOINT_HERTZ };
+    real dampingRatio { JOINT_DAMPING_RATIO };
+
+    real length { 0.0f }; ///< Distance between the anchors, distance joint.
+
+    d2Vec2 localAxisA { 1.0f, 0.0f }; ///< Unit axis b slides along in the local space of a, prismatic joint.
+
+    // Range of the angle of a revolute joint, in radians, or of the translation of a prismatic joint
+    bool enableLimit { false };
+    real lower { 0.0f };
+    real upper { 0.0f };
+
+    // Motor of a revolute joint, in radians per second and torque, or of a prismatic joint, in
+    // pixels per second and force
+    bool enableMotor { false };
+    real motorSpeed { 0.0f };
+    real maxMotorForce { 0.0f };
+
+    // Target of a motor joint, the position of b in the frame of a and the angle between them
+    d2Vec2 linearOffset;
+    real angularOffset { 0.0f };
+    real maxForce { 0.0f };
+    real maxTorque { 0.0f };
+    real correctionFactor { 0.3f }; ///< Fraction of the offset error fixed per step, in [0, 1].
+
+    /**
+     * @brief Join two bodies at a world point in their current pose.
+     * @param bodyA The first body.
+     * @param bodyB The second body.
+     * @param anchor The anchor of both bodies, in world space.
+     */
+    void Initialize(d2Body* bodyA, d2Body* bodyB, const d2Vec2& anchor);
+
+    /**
+     * @brief Join two bodies at a world point each in their current pose, at their current length.
+     * @param bodyA The first body.
+     * @param bodyB The second body.
+     * @param anchorA The anchor of a, in world space.
+     * @param anchorB The anchor of b, in world space.
+     */
+    void Initialize(d2Body* bodyA, d2Body* bodyB, const d2Vec2& anchorA, const d2Vec2& anchorB);
+};
+
+/**
+ * @brief Base of the joints created by d2World::CreateJoint().
+ *
+ * The joints solve their rows in closed form, as the soft step solver sees them. The Baumgarte
+ * solver prepares the same rows over the whole step with a rigid bias of JOINT_BAUMGARTE, and the
+ * position solver corrects them on the current positions.
+ *
+ * The bodies are solved with their lever arms and separation at the start of the step. The soft
+ * step follows the separation and angle over the sub-steps to first order.
+ */
+class D2_API d2Joint : public d2Constraint
+{
+public:
+    explicit d2Joint(const d2JointDef &def);
+
+    d2JointType GetType() const { return type; }
+
+    void PreSolve(const real dt) override;
+
+    real Solve() override;
+
+protected:
+    // Measure the bodies at the start of the step or sub-steps of h, the angle from the reference
+    void PrepareBodies(const real h, real referenceAngle);
+
+    // pb - pa and the angle of b relative to a, moved by the sub-steps so far
+    d2Vec2 GetSeparation(const d2Vec2 &dpa, real dqa, const d2Vec2 &dpb, real dqb) const;
+    real GetAngle(real dqa, real dqb) const;
+
+    // Inverse of the 2x2 mass matrix of the rows pinning the anchors together
+    d2Mat<2, 2> GetPointMass() const;
+
+    // Rows pinning the anchors together, C is the separation. Returns the size of the impulse change.
+    real SolvePointRows(const d2Mat<2, 2> &pointMass, d2Vec2 &pointImpulse, const d2Vec2 &C, bool useBias,
+                        d2Vec2 &va, real &wa, d2Vec2 &vb, real &wb) const;
+
+    // One-sided row of a limit, pushing while C < 0 and speculative above. Returns the impulse change.
+    real SolveLimitRow(real C, real Cdot, real mass, real &impulse, bool useBias) const;
+
+    // Position solver, pin the anchors together measured at the current positions. Returns the
+    // distance between the anchors before the correction.
+    real SolvePointPosition();
+
+    d2JointType type;
+
+    d2Vec2 ra;         // Anchor of a relative to its center, in world space
+    d2Vec2 rb;         // Anchor of b relative to its center, in world space
+    d2Vec2 separation; // pb - pa at the start of the step
+    real angle;        // Angle of b relative to a at the start of the step
+    real mA, iA, mB, iB;
+
+    real h;      // Time step the rows are solved over, the sub-step of the soft step solver
+    real invH;
+    d2Softness softness;
+};
+
+/**
+ * @brief The legacy joint, pinning the anchors together through their squared distance.
+ *
+ * The Baumgarte solver solves the single squared distance row, the other solvers pin the anchors
+ * with two rigid point rows, the squared distance row has no gradient once the anchors meet.
+ */
+class D2_API d2JointConstraint : public d2Joint
+{
+private:
+    d2Vec<6> jacobian;
+    real cachedLambda;
+    real bias;
+    real effectiveMass; // 1 / (J * M^-1 * Jt), the row is solved in closed form
+
+    d2Mat<2, 2> pointMass; // Inverse of the 2x2 mass matrix of the point constraint
+    d2Vec2 pointImpulse;   // Accumulated impulse of the point constraint
+
+public:
+    explicit d2JointConstraint(const d2JointDef &def);
+
+    d2JointConstraint(d2Body *a, d2Body *b, const d2Vec2 &anchorPoint);
+
+    void PreSolve(const real dt) override;
+
+    real Solve() override;
+
+    void PostSolve() override;
+
+    void PrepareSoft(const real h) override;
+
+    void WarmStart() override;
+
+    real SolveSoft(bool useBias) override;
+
+    real SolvePosition() override;
+};
+
+/** @brief Pins the anchors together, free to rotate within an optional range and driven by an optional motor. */
+class D2_API d2RevoluteJoint : public d2Joint
+{
+private:
+    real referenceAngle;
+    bool enableLimit;
+    real lowerAngle;
+    real upperAngle;
+    bool enableMotor;
+    real motorSpeed;
+    real maxMotorTorque;
+
+    d2Mat<2, 2> pointMass; // Inverse of the 2x2 mass matrix of the point rows
+    real axialMass;        // 1 / (iA + iB) of the angular rows
+
+    d2Vec2 linearImpulse;
+    real motorImpulse;
+    real lowerImpulse;
+    real upperImpulse;
+
+public:
+    explicit d2RevoluteJoint(const d2JointDef &def);
+
+    void SetMotorSpeed(real speed) { motorSpeed = speed; }
+
+    void PrepareSoft(const real h) override;
+
+    void WarmStart() override;
+
+    real SolveSoft(bool useBias) override;
+
+    real SolvePosition() override;
+};
+
+/** @brief Keeps the anchors at a fixed length, both bodies free to rotate. */
+class D2_API d2DistanceJoint : public d2Joint
+{
+private:
+    real length;
+
+    d2Vec2 axis;     // Unit direction from pa to pb at the start of the step, zero once they meet
+    real crossA;     // ra × axis
+    real crossB;     // rb × axis
+    real axialMass;  // 1 / (J * M^-1 * Jt) of the row
+    real impulse;
+
+public:
+    explicit d2DistanceJoint(const d2JointDef &def);
+
+    void PrepareSoft(const real h) override;
+
+    void WarmStart() override;
+
+    real SolveSoft(bool useBias) override;
+
+    real SolvePosition() override;
+};
+
+/**
+ * @brief Slides b along an axis of a without rotating, within an optional range and driven by an
+ * optional motor.
+ *
+ * The row across the axis and the angular row are solved together as a 2x2 block.
+ */
+class D2_API d2PrismaticJoint : public d2Joint
+{
+private:
+    real referenceAngle;
+    d2Vec2 localAxisA;
+    bool enableLimit;
+    real lowerTranslation;
+    real upperTranslation;
+    bool enableMotor;
+    real motorSpeed;
+    real maxMotorForce;
+
+    d2Vec2 axis;            // Slide axis in world space
+    d2Vec2 perp;            // Axis rotated a quarter turn
+    real a1, a2;            // Lever arms of the axial rows, (d + ra) × axis and rb × axis
+    real s1, s2;            // Lever arms of the perpendicular row, (d + ra) × perp and rb × perp
+    real axialMass;         // 1 / (J * M^-1 * Jt) of the axial rows
+    d2Mat<2, 2> blockMass;  // Inverse of the mass matrix of the perpendicular and angular rows
+
+    d2Vec2 impulse;         // Accumulated impulses of the perpendicular and angular rows
+    real motorImpulse;
+    real lowerImpulse;
+    real upperImpulse;
+
+public:
+    explicit d2PrismaticJoint(const d2JointDef &def);
+
+    void SetMotorSpeed(real speed) { motorSpeed = speed; }
+
+    void PrepareSoft(const real h) override;
+
+    void WarmStart() override;
+
+    real SolveSoft(bool useBias) override;
+
+    real SolvePosition() override;
+};
+
+/** @brief Glues b to a, the angular row is solved before the point rows. */
+class D2_API d2WeldJoint : public d2Joint
+{
+private:
+    real referenceAngle;
+
+    d2Mat<2, 2> pointMass; // Inverse of the 2x2 mass matrix of the point rows
+    real axialMass;        // 1 / (iA + iB) of the angular row
+
+    d2Vec2 linearImpulse;
+    real angularImpulse;
+
+public:
+    explicit d2WeldJoint(const d2JointDef &def);
+
+    void PrepareSoft(const real h) override;
+
+    void WarmStart() override;
+
+    real SolveSoft(bool useBias) override;
+
+    real SolvePosition() override;
+};
+
+/**
+ * @brief Drives the center of b towards an offset from the center of a, and its angle towards an
+ * offset from the angle of a.
+ *
+ * The error is fed back to the velocities by correctionFactor every step, through impulses no
+ * larger than the largest force and torque over the step. The joint has no position error to
+ * correct, so it is left alone by the position solver.
+ */
+class D2_API d2MotorJoint : public d2Joint
+{
+private:
+    d2Vec2 linearOffset;
+    real angularOffset;
+    real maxForce;
+    real maxTorque;
+    real correctionFactor;
+
+    d2Vec2 offset;     // Linear offset rotated to world space
+    real linearMass;   // 1 / (mA + mB), the anchors are the centers
+    real angularMass;  // 1 / (iA + iB)
+
+    d2Vec2 linearImpulse;
+    real angularImpulse;
+
+public:
+    explicit d2MotorJoint(const d2JointDef &def);
+
+    void SetLinearOffset(const d2Vec2 &offset) { linearOffset = offset; }
+
+    void SetAngularOffset(real offset) { angularOffset = offset; }
+
+    void PrepareSoft(const real h) override;
+
+    void WarmStart() override;
+
+    real SolveSoft(bool useBias) override;
+};
+
+/** @brief Builds a joint of a registered type in memory of the registered size. */
+typedef d2Joint* d2JointCreateFcn(void* memory, const d2JointDef& def);
+
+/** @brief Entry of a joint type in the d2JointRegistry. */
+struct D2_API d2JointRegister
+{
+    d2JointCreateFcn* createFcn;
+    int32 size; ///< Bytes the world allocates for a joint of the type.
+};
+
+/**
+ * @brief Table of the joint types d2World::CreateJoint() builds from a d2JointDef.
+ *
+ * Every type starts with its built-in joint. A type may be registered again with a joint of its
+ * own, before any joint of that type is created, the world frees the joints with the size they
+ * are registered with.
+ */
+class D2_API d2JointRegistry
+{
+public:
+    /**
+     * @brief Register the joint built for a type.
+     * @param type The joint type.
+     * @param createFcn Builds the joint in the memory given, with placement new.
+     * @param size The size of the joint.
+     */
+    static void Register(d2JointType type, d2JointCreateFcn* createFcn, int32 size);
+
+    /**
+     * @brief Get the joint built for a type.
+     * @param type The joint type.
+     * @return The entry of the type.
+     */
+    static const d2JointRegister& Get(d2JointType type);
+
+private:
+    static d2JointRegister* GetRegisters();
+};
+
+#endif //D2JOINT_H
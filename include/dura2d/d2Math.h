@@ -3,6 +3,7 @@
 
 #include <cmath>
 #include <cfloat>
+#include <utility>
 
 #include "d2api.h"
 #include "d2Types.h"
@@ -188,6 +189,7 @@ struct D2_API d2MatMN
 
     /**
      * @brief Solves a system of linear equations using the Gauss-Seidel method.
+     * @details Meant for large coupled systems, small fixed-size blocks are solved exactly by d2Solve.
      * @param A The matrix of coefficients.
      * @param b The vector of constants.
      * @return The solution vector.
@@ -199,6 +201,327 @@ struct D2_API d2MatMN
     d2VecN *rows; ///< The rows of the matrix.
 };
 
+template <typename F, int... I>
+constexpr void
+d2UnrollImpl(F &&f, std::integer_sequence<int, I...>)
+{
+    (f(I), ...);
+}
+
+/**
+ * @brief Calls f(0), f(1), ..., f(N - 1) as a straight sequence of calls.
+ * @details Used by the fixed-size types so their loops are unrolled even in debug builds.
+ * @tparam N The number of calls.
+ */
+template <int N, typename F>
+constexpr void
+d2Unroll(F &&f)
+{
+    d2UnrollImpl(f, std::make_integer_sequence<int, N>{});
+}
+
+/**
+ * @brief Alignment of a fixed-size vector of N components.
+ * @details Vectors of at least 4 components are aligned to 16 bytes so their rows load into SIMD registers.
+ */
+constexpr int
+d2VecAlignment(int N)
+{
+    return N * (int)sizeof(real) >= 16 ? 16 : (int)alignof(real);
+}
+
+/**
+ * @struct d2Vec
+ * @brief Represents an N-dimensional vector whose size is known at compile time.
+ * @details Unlike d2VecN, the components are stored inline, so it never touches the heap.
+ * @tparam N The dimension of the vector.
+ */
+template <int N>
+struct alignas(d2VecAlignment(N)) d2Vec
+{
+    static_assert(N > 0, "d2Vec needs at least one component");
+
+    /** @brief Sets all components of the vector to zero. */
+    constexpr void Zero()
+    {
+        d2Unroll<N>([this](int i) { data[i] = 0.0F; });
+    }
+
+    /**
+     * @brief Calculates the dot product with another vector.
+     * @param v The other vector.
+     * @return The dot product.
+     */
+    constexpr real Dot(const d2Vec &v) const
+    {
+        real sum = 0.0F;
+        d2Unroll<N>([&](int i) { sum += data[i] * v.data[i]; });
+        return sum;
+    }
+
+    /**
+     * @brief Calculates the squared magnitude of the vector.
+     * @return The squared magnitude of the vector.
+     */
+    constexpr real LenghtSquared() const { return Dot(*this); }
+
+    // Overloaded operators
+    constexpr bool operator==(const d2Vec &v) const
+    {
+        bool equal = true;
+        d2Unroll<N>([&](int i) { equal = equal && data[i] == v.data[i]; });
+        return equal;
+    }
+    constexpr bool operator!=(const d2Vec &v) const { return !(*this == v); }
+    constexpr d2Vec operator+(const d2Vec &v) const { d2Vec r = *this; r += v; return r; }
+    constexpr d2Vec operator-(const d2Vec &v) const { d2Vec r = *this; r -= v; return r; }
+    constexpr d2Vec operator*(const real n) const { d2Vec r = *this; r *= n; return r; }
+    constexpr d2Vec operator/(const real n) const { d2Vec r = *this; r /= n; return r; }
+    constexpr d2Vec operator-() const { d2Vec r; d2Unroll<N>([&](int i) { r.data[i] = -data[i]; }); return r; }
+    constexpr d2Vec &operator+=(const d2Vec &v) { d2Unroll<N>([&](int i) { data[i] += v.data[i]; }); return *this; }
+    constexpr d2Vec &operator-=(const d2Vec &v) { d2Unroll<N>([&](int i) { data[i] -= v.data[i]; }); return *this; }
+    constexpr d2Vec &operator*=(const real n) { d2Unroll<N>([&](int i) { data[i] *= n; }); return *this; }
+    constexpr d2Vec &operator/=(const real n) { return *this *= 1.0F / n; }
+    constexpr real operator[](const int index) const { return data[index]; }
+    constexpr real &operator[](const int index) { return data[index]; }
+
+    real data[N] {}; ///< The data of the vector.
+};
+
+template <int N>
+constexpr d2Vec<N>
+operator * (real s, const d2Vec<N>& v)
+{
+    return v * s;
+}
+
+/**
+ * @struct d2Mat
+ * @brief Represents an MxN matrix whose size is known at compile time.
+ * @details Unlike d2MatMN, the rows are stored inline, so it never touches the heap.
+ * @tparam M The number of rows in the matrix.
+ * @tparam N The number of columns in the matrix.
+ */
+template <int M, int N>
+struct d2Mat
+{
+    /**
+     * @brief Builds the identity matrix.
+     * @return A matrix with ones on its diagonal.
+     */
+    static constexpr d2Mat Identity()
+    {
+        d2Mat result;
+        d2Unroll<(M < N ? M : N)>([&](int i) { result.rows[i][i] = 1.0F; });
+        return result;
+    }
+
+    /** @brief Sets all components of the matrix to zero. */
+    constexpr void Zero()
+    {
+        d2Unroll<M>([this](int i) { rows[i].Zero(); });
+    }
+
+    /**
+     * @brief Gets a column of the matrix.
+     * @param j The index of the column.
+     * @return The column as a vector.
+     */
+    constexpr d2Vec<M> GetColumn(int j) const
+    {
+        d2Vec<M> result;
+        d2Unroll<M>([&](int i) { result[i] = rows[i][j]; });
+        return result;
+    }
+
+    /**
+     * @brief Transposes the matrix.
+     * @return The transposed matrix.
+     */
+    constexpr d2Mat<N, M> Transpose() const
+    {
+        d2Mat<N, M> result;
+        d2Unroll<M>([&](int i) { d2Unroll<N>([&](int j) { result.rows[j][i] = rows[i][j]; }); });
+        return result;
+    }
+
+    /**
+     * @brief Multiplies the transpose of the matrix by a vector, without building the transpose.
+     * @param v The vector, one component per row.
+     * @return The sum of the rows scaled by the components of v.
+     */
+    constexpr d2Vec<N> TransposeMultiply(const d2Vec<M> &v) const
+    {
+        d2Vec<N> result;
+        d2Unroll<M>([&](int i) { result += rows[i] * v[i]; });
+        return result;
+    }
+
+    // Matrix-vector multiplication
+    constexpr d2Vec<M> operator*(const d2Vec<N> &v) const
+    {
+        d2Vec<M> result;
+        d2Unroll<M>([&](int i) { result[i] = rows[i].Dot(v); });
+        return result;
+    }
+
+    // Matrix-matrix multiplication, the rows of the result are combinations of the rows of m
+    template <int P>
+    constexpr d2Mat<M, P> operator*(const d2Mat<N, P> &m) const
+    {
+        d2Mat<M, P> result;
+        d2Unroll<M>([&](int i) { result.rows[i] = m.TransposeMultiply(rows[i]); });
+        return result;
+    }
+
+    // Overloaded operators
+    constexpr bool operator==(const d2Mat &m) const
+    {
+        bool equal = true;
+        d2Unroll<M>([&](int i) { equal = equal && rows[i] == m.rows[i]; });
+        return equal;
+    }
+    constexpr bool operator!=(const d2Mat &m) const { return !(*this == m); }
+    constexpr d2Mat operator+(const d2Mat &m) const { d2Mat r = *this; r += m; return r; }
+    constexpr d2Mat operator-(const d2Mat &m) const { d2Mat r = *this; r -= m; return r; }
+    constexpr d2Mat operator*(const real n) const { d2Mat r = *this; r *= n; return r; }
+    constexpr d2Mat operator-() const { return *this * -1.0F; }
+    constexpr d2Mat &operator+=(const d2Mat &m) { d2Unroll<M>([&](int i) { rows[i] += m.rows[i]; }); return *this; }
+    constexpr d2Mat &operator-=(const d2Mat &m) { d2Unroll<M>([&](int i) { rows[i] -= m.rows[i]; }); return *this; }
+    constexpr d2Mat &operator*=(const real n) { d2Unroll<M>([&](int i) { rows[i] *= n; }); return *this; }
+    constexpr const d2Vec<N> &operator[](const int index) const { return rows[index]; }
+    constexpr d2Vec<N> &operator[](const int index) { return rows[index]; }
+
+    d2Vec<N> rows[M] {}; ///< The rows of the matrix.
+};
+
+template <int M, int N>
+constexpr d2Mat<M, N>
+operator * (real s, const d2Mat<M, N>& m)
+{
+    return m * s;
+}
+
+/**
+ * @brief Inverts a scalar, the 1x1 case of the direct solvers.
+ * @param k The value to invert.
+ * @return 1 / k, or zero when k is zero so a row that cannot move gets no impulse.
+ */
+constexpr real
+d2Invert(real k)
+{
+    return k != 0.0F ? 1.0F / k : 0.0F;
+}
+
+/**
+ * @brief Inverts a 2x2 matrix with Cramer's rule.
+ * @param A The matrix to invert.
+ * @return The inverse of A, or zero when A is singular.
+ */
+constexpr d2Mat<2, 2>
+d2Invert(const d2Mat<2, 2> &A)
+{
+    const real det = d2Invert(A[0][0] * A[1][1] - A[0][1] * A[1][0]);
+    d2Mat<2, 2> inverse;
+    inverse[0][0] = det * A[1][1];
+    inverse[0][1] = -det * A[0][1];
+    inverse[1][0] = -det * A[1][0];
+    inverse[1][1] = det * A[0][0];
+    return inverse;
+}
+
+/**
+ * @brief Inverts a 3x3 matrix with Cramer's rule, through its adjugate.
+ * @param A The matrix to invert.
+ * @return The inverse of A, or zero when A is singular.
+ */
+constexpr d2Mat<3, 3>
+d2Invert(const d2Mat<3, 3> &A)
+{
+    d2Mat<3, 3> adjugate;
+    adjugate[0][0] = A[1][1] * A[2][2] - A[1][2] * A[2][1];
+    adjugate[0][1] = A[0][2] * A[2][1] - A[0][1] * A[2][2];
+    adjugate[0][2] = A[0][1] * A[1][2] - A[0][2] * A[1][1];
+    adjugate[1][0] = A[1][2] * A[2][0] - A[1][0] * A[2][2];
+    adjugate[1][1] = A[0][0] * A[2][2] - A[0][2] * A[2][0];
+    adjugate[1][2] = A[0][2] * A[1][0] - A[0][0] * A[1][2];
+    adjugate[2][0] = A[1][0] * A[2][1] - A[1][1] * A[2][0];
+    adjugate[2][1] = A[0][1] * A[2][0] - A[0][0] * A[2][1];
+    adjugate[2][2] = A[0][0] * A[1][1] - A[0][1] * A[1][0];
+    const real det = A[0][0] * adjugate[0][0] + A[0][1] * adjugate[1][0] + A[0][2] * adjugate[2][0];
+    return adjugate * d2Invert(det);
+}
+
+/**
+ * @brief Solves A x = b for a symmetric positive semi-definite A with an LDLt factorization.
+ * @details Exact in N^3 / 6 steps with a single division per row. Directions with a zero pivot,
+ * which no body can move along, get a zero component.
+ * @tparam N The size of the system.
+ * @param A The symmetric matrix of coefficients, only its lower triangle is read.
+ * @param b The vector of constants.
+ * @return The solution vector.
+ */
+template <int N>
+constexpr d2Vec<N>
+d2SolveLDLT(const d2Mat<N, N> &A, const d2Vec<N> &b)
+{
+    // A = L D Lt, L unit lower triangular and D diagonal
+    d2Mat<N, N> L;
+    d2Vec<N> D, invD;
+    for (int j = 0; j < N; ++j) {
+        D[j] = A[j][j];
+        for (int k = 0; k < j; ++k) D[j] -= L[j][k] * L[j][k] * D[k];
+        invD[j] = D[j] > 0.0F ? 1.0F / D[j] : 0.0F;
+
+        for (int i = j + 1; i < N; ++i) {
+            real l = A[i][j];
+            for (int k = 0; k < j; ++k) l -= L[i][k] * L[j][k] * D[k];
+            L[i][j] = l * invD[j];
+        }
+    }
+
+    // L y = b, then D z = y, then Lt x = z
+    d2Vec<N> x = b;
+    for (int i = 0; i < N; ++i)
+        for (int k = 0; k < i; ++k)
+            x[i] -= L[i][k] * x[k];
+    for (int i = 0; i < N; ++i) x[i] *= invD[i];
+    for (int i = N - 1; i >= 0; --i)
+        for (int k = i + 1; k < N; ++k)
+            x[i] -= L[k][i] * x[k];
+    return x;
+}
+
+/**
+ * @brief Solves the dense system A x = b directly.
+ * @details Sizes up to 3 use Cramer's rule, bigger symmetric blocks an LDLt factorization.
+ * Iterative solvers such as d2MatMN::SolveGaussSeidel are only worth it for large coupled systems.
+ * @param A The matrix of coefficients, symmetric when bigger than 3x3.
+ * @param b The vector of constants.
+ * @return The solution vector, zero along singular directions.
+ */
+template <int N>
+constexpr d2Vec<N>
+d2Solve(const d2Mat<N, N> &A, const d2Vec<N> &b)
+{
+    if constexpr (N == 1) {
+        d2Vec<1> x;
+        x[0] = d2Invert(A[0][0]) * b[0];
+        return x;
+    } else if constexpr (N <= 3) {
+        return d2Invert(A) * b;
+    } else {
+        return d2SolveLDLT(A, b);
+    }
+}
+
+// Multiply a d2Vec2 by a 2x2 matrix
+inline d2Vec2
+d2Mul(const d2Mat<2, 2> &A, const d2Vec2 &v)
+{
+    return {A[0][0] * v.x + A[0][1] * v.y, A[1][0] * v.x + A[1][1] * v.y};
+}
+
 /**
  * @struct d2Rot
  * @brief Represents a rotation in 2D space.
@@ -215,7 +538,7 @@ struct D2_API d2Rot
      * @brief Default constructor.
      * @details Initializes the rotation to identity.
      */
-    d2Rot() : s(0.0F), c(0.0F) {}
+    d2Rot() : s(0.0F), c(1.0F) {}
 
     /**
      * @brief Constructor that initializes the rotation with given angle in radians.
@@ -396,4 +719,27 @@ d2Rotate(const d2Rot& rot, const d2Vec2& v)
     return {x, y};
 }
 
+// Rotate a d2Vec2 backwards, from world to local space
+inline d2Vec2
+d2InvRotate(const d2Rot& rot, const d2Vec2& v)
+{
+    real x = rot.c * v.x + rot.s * v.y;
+    real y = -rot.s * v.x + rot.c * v.y;
+    return {x, y};
+}
+
+// Transform a point
+inline d2Vec2
+d2TransformPoint(const d2Transform& xf, const d2Vec2& v)
+{
+    return d2Rotate(xf.q, v) + xf.p;
+}
+
+// Compose two transforms, B is expressed in the frame of A
+inline d2Transform
+d2Mul(const d2Transform& A, const d2Transform& B)
+{
+    return {d2TransformPoint(A, B.p), A.q + B.q};
+}
+
 #endif //D2MATH_H
@@ -6,12 +6,18 @@
 class d2NSquaredBroad : public d2Broadphase
 {
 public:
-        // adds a new d2AABB to the broadphase
+        // adds the d2AABB proxies of a body to the broadphase
         void Add(d2Body* body) override;
 
-        // removes a d2AABB from the broadphase
+        // removes the d2AABB proxies of a body from the broadphase
         void Remove(d2Body* body) override;
 
+        // adds the proxies of many bodies with a single reservation
+        void AddBodies(d2Body* const* bodies, int32 count) override;
+
+        // removes the proxies of many bodies in a single pass over the proxies
+        void RemoveBodies(d2Body* const* bodies, int32 count) override;
+
         // updates broadphase to react to changes to d2AABB
         void Update(void) override;
 
@@ -28,7 +34,7 @@ public:
         void Query(const d2AABB &aabb, ColliderList &output) const override;
 
 private:
-        std::vector<d2Body *> bodies{};
+        std::vector<d2AABB *> proxies{};
         ColliderPairList m_pairs{};
 };
 
@@ -0,0 +1,69 @@
+#ifndef D2POSITIONSOLVER_H
+#define D2POSITIONSOLVER_H
+
+#include <vector>
+
+#include "d2api.h"
+#include "d2Math.h"
+#include "d2Contact.h"
+
+class d2Body;
+class d2Constraint;
+
+/**
+ * @brief A contact as seen by the position solver, in the local space of its bodies.
+ *
+ * The points are taken before the bodies move, so the separation can be measured again at any
+ * later position of the bodies.
+ */
+struct D2_API d2PositionContact
+{
+    d2Body *a;
+    d2Body *b;
+
+    d2Vec2 localPointA; ///< Contact point on a, in the local space of a.
+    d2Vec2 localPointB; ///< Contact point on b, in the local space of b.
+    d2Vec2 localNormal; ///< Normal from a to b, in the local space of a.
+};
+
+/**
+ * @brief Corrects the penetration left after the velocities are integrated.
+ *
+ * Non-linear Gauss-Seidel: every iteration measures the contacts and joints again at the current
+ * positions and moves the bodies by a fraction of the error, one constraint at a time. Moving the
+ * positions adds no velocity, so the correction doesn't add energy the way a velocity bias does.
+ *
+ * Islands share no dynamic body, so different islands can be solved at once.
+ */
+class D2_API d2PositionSolver
+{
+public:
+    /**
+     * @brief Take the contacts of a step in the local space of their bodies.
+     *
+     * Must be called before the bodies move, while the contact points still lie on them.
+     *
+     * @param contacts The contacts of the step.
+     * @param contactCount The number of contacts.
+     */
+    void Prepare(const d2Contact* contacts, int32 contactCount);
+
+    /**
+     * @brief Correct the positions of an island.
+     * @param contactStart The first contact of the island, as passed to Prepare().
+     * @param contactCount The number of contacts of the island.
+     * @param joints The joints of the island.
+     * @param jointCount The number of joints.
+     * @param iterations The largest number of iterations.
+     * @return The number of iterations run, fewer once every error is below the tolerance.
+     */
+    int32 Solve(int32 contactStart, int32 contactCount, d2Constraint* const* joints, int32 jointCount,
+                int32 iterations) const;
+
+private:
+    static real SolveContact(const d2PositionContact& contact);
+
+    std::vector<d2PositionContact> m_contacts;
+};
+
+#endif //D2POSITIONSOLVER_H
@@ -11,7 +11,11 @@ enum D2_API d2ShapeType
 {
     CIRCLE,
     POLYGON,
-    BOX
+    BOX,
+    CAPSULE,
+    EDGE,
+    CHAIN,
+    COMPOUND
 };
 
 struct D2_API d2Shape
@@ -26,12 +30,26 @@ struct D2_API d2Shape
     virtual void UpdateVertices(const d2Transform &transform) = 0;
 
     virtual real GetMomentOfInertia() const = 0;
+
+    /**
+     * @brief Gets the area of the shape, used to weight the children of a compound shape.
+     * @return The area of the shape.
+     */
+    virtual real GetArea() const = 0;
+
+    /**
+     * @brief Gets the number of children of the shape, each child gets its own broadphase proxy.
+     * @return The number of children.
+     */
+    virtual int32 GetChildCount() const { return 1; }
 };
 
 struct D2_API d2CircleShape : public d2Shape
 {
     real radius;
 
+    d2Vec2 worldCenter; ///< The center of the circle in world space.
+
     d2CircleShape(const real radius);
 
     virtual ~d2CircleShape();
@@ -40,9 +58,11 @@ struct D2_API d2CircleShape : public d2Shape
 
     d2Shape *Clone() const override;
 
-    void UpdateVertices(const d2Transform &transform) override { (void)transform; };
+    void UpdateVertices(const d2Transform &transform) override { worldCenter = transform.p; };
 
     real GetMomentOfInertia() const override;
+
+    real GetArea() const override;
 };
 
 struct D2_API d2PolygonShape : public d2Shape
@@ -82,6 +102,8 @@ struct D2_API d2PolygonShape : public d2Shape
 
     real GetMomentOfInertia() const override;
 
+    real GetArea() const override;
+
     void UpdateVertices(const d2Transform &transform) override;
 
     friend class d2World;
@@ -100,4 +122,193 @@ struct D2_API d2BoxShape : public d2PolygonShape
     real GetMomentOfInertia() const override;
 };
 
+struct D2_API d2CapsuleShape : public d2Shape
+{
+    real radius;
+
+    d2Vec2 localVertices[2]; ///< The centers of the two caps in local space.
+    d2Vec2 worldVertices[2]; ///< The centers of the two caps in world space.
+
+    /**
+     * @brief Constructor for a capsule aligned with the local x-axis.
+     * @param length The distance between the centers of the two caps.
+     * @param radius The radius of the caps.
+     */
+    d2CapsuleShape(real length, real radius);
+
+    /**
+     * @brief Constructor for a capsule between two cap centers.
+     * @param center1 The center of the first cap in local space.
+     * @param center2 The center of the second cap in local space.
+     * @param radius The radius of the caps.
+     */
+    d2CapsuleShape(const d2Vec2 &center1, const d2Vec2 &center2, real radius);
+
+    virtual ~d2CapsuleShape();
+
+    d2ShapeType GetType() const override;
+
+    d2Shape *Clone() const override;
+
+    real GetLength() const;
+
+    real GetMomentOfInertia() const override;
+
+    real GetArea() const override;
+
+    void UpdateVertices(const d2Transform &transform) override;
+};
+
+/**
+ * @brief A line segment. One-sided edges use the ghost vertices of their neighbours to
+ * collide smoothly across the seams, and only collide on their right side (looking from
+ * vertex 1 to vertex 2), the same side the polygon edge normals point to.
+ */
+struct D2_API d2EdgeShape : public d2Shape
+{
+    d2Vec2 localVertices[4]; ///< Ghost vertex 0, the segment vertices 1 and 2, and ghost vertex 3 in local space.
+    d2Vec2 worldVertices[4]; ///< The same vertices in world space.
+
+    bool oneSided { false };
+
+    d2EdgeShape() = default;
+
+    /**
+     * @brief Constructor for a two-sided edge.
+     * @param v1 The first vertex in local space.
+     * @param v2 The second vertex in local space.
+     */
+    d2EdgeShape(const d2Vec2 &v1, const d2Vec2 &v2);
+
+    /**
+     * @brief Constructor for a one-sided edge with ghost vertices.
+     * @param v0 The vertex preceding the edge.
+     * @param v1 The first vertex in local space.
+     * @param v2 The second vertex in local space.
+     * @param v3 The vertex following the edge.
+     */
+    d2EdgeShape(const d2Vec2 &v0, const d2Vec2 &v1, const d2Vec2 &v2, const d2Vec2 &v3);
+
+    virtual ~d2EdgeShape();
+
+    d2ShapeType GetType() const override;
+
+    d2Shape *Clone() const override;
+
+    real GetMomentOfInertia() const override;
+
+    real GetArea() const override;
+
+    void UpdateVertices(const d2Transform &transform) override;
+};
+
+/**
+ * @brief A one-sided chain of edges, meant for static level geometry. Every segment is a
+ * child of the shape with its own broadphase proxy, and uses its neighbours as ghost
+ * vertices so nothing snags on the seams.
+ */
+struct D2_API d2ChainShape : public d2Shape
+{
+    int32 m_vertexCount { 0 };
+
+    d2Vec2* localVertices { nullptr };
+    d2Vec2* worldVertices { nullptr };
+
+    d2Vec2 localGhosts[2]; ///< The vertices before the first and after the last one in local space.
+    d2Vec2 worldGhosts[2]; ///< The same ghost vertices in world space.
+
+    bool loop { false };
+
+    /**
+     * @brief Constructor for a closed loop, the last vertex connects back to the first one.
+     * @param vertices The vertices in local space, counter-clockwise to collide from outside.
+     * @param vertexCount The number of vertices, at least 3.
+     */
+    d2ChainShape(const d2Vec2* vertices, int32 vertexCount);
+
+    /**
+     * @brief Constructor for an open chain.
+     * @param vertices The vertices in local space.
+     * @param vertexCount The number of vertices, at least 2.
+     * @param prevVertex The ghost vertex preceding the first one.
+     * @param nextVertex The ghost vertex following the last one.
+     */
+    d2ChainShape(const d2Vec2* vertices, int32 vertexCount, const d2Vec2 &prevVertex, const d2Vec2 &nextVertex);
+
+    d2ChainShape(const d2ChainShape &other) = delete;
+    d2ChainShape &operator=(const d2ChainShape &other) = delete;
+
+    virtual ~d2ChainShape();
+
+    d2ShapeType GetType() const override;
+
+    d2Shape *Clone() const override;
+
+    real GetMomentOfInertia() const override;
+
+    real GetArea() const override;
+
+    void UpdateVertices(const d2Transform &transform) override;
+
+    int32 GetChildCount() const override;
+
+    /**
+     * @brief Gets a segment of the chain, in world space.
+     * @param edge The edge to fill.
+     * @param index The child index of the segment.
+     */
+    void GetChildEdge(d2EdgeShape *edge, int32 index) const;
+};
+
+/**
+ * @brief A rigid set of convex child shapes, each placed with a transform relative to the body.
+ *
+ * Every child gets its own broadphase proxy and is collided on its own, while the body merges
+ * their mass properties, weighting the children by area. Like the other shapes, the body origin
+ * is taken as the center of mass: the children are moved so their centroid sits on it, and a
+ * body created with the compound places the frame the children were given in at its position.
+ */
+struct D2_API d2CompoundShape : public d2Shape
+{
+    std::vector<d2Shape*> m_children; ///< The child shapes, owned by the compound.
+    std::vector<d2Transform> m_localTransforms; ///< The transform of each child relative to the centroid.
+    d2Vec2 m_center { 0.0F, 0.0F }; ///< The centroid in the frame the children were given in.
+
+    d2CompoundShape() = default;
+
+    d2CompoundShape(const d2CompoundShape &other) = delete;
+    d2CompoundShape &operator=(const d2CompoundShape &other) = delete;
+
+    virtual ~d2CompoundShape();
+
+    /**
+     * @brief Adds a copy of a shape as a child and moves the children to the new centroid.
+     *
+     * Chains and compounds can't be nested.
+     *
+     * @param shape The shape to copy.
+     * @param localTransform The transform of the child in the frame of the compound.
+     */
+    void AddChild(const d2Shape &shape, const d2Transform &localTransform);
+
+    /**
+     * @brief Gets a child shape, its vertices are in world space.
+     * @param index The child index.
+     * @return The child shape.
+     */
+    d2Shape *GetChild(int32 index) const { return m_children[index]; }
+
+    d2ShapeType GetType() const override;
+
+    d2Shape *Clone() const override;
+
+    real GetMomentOfInertia() const override;
+
+    real GetArea() const override;
+
+    void UpdateVertices(const d2Transform &transform) override;
+
+    int32 GetChildCount() const override;
+};
+
 #endif
@@ -0,0 +1,91 @@
+#ifndef D2THREADPOOL_H
+#define D2THREADPOOL_H
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "d2api.h"
+#include "d2Types.h"
+
+/**
+ * @brief A small fork-join worker pool used to spread the step phases across cores.
+ *
+ * The calling thread always takes part in the work as worker 0, so a pool with a
+ * single worker never spawns a thread and runs everything inline.
+ */
+class D2_API d2ThreadPool
+{
+public:
+    /**
+     * @brief Range task executed by the pool.
+     * @param begin The first index of the range.
+     * @param end One past the last index of the range.
+     * @param workerIndex The index of the worker running the range, in [0, GetWorkerCount()).
+     */
+    typedef std::function<void(int32 begin, int32 end, int32 workerIndex)> d2RangeTask;
+
+    /**
+     * @brief Constructor that starts the requested number of workers.
+     * @param workerCount The number of workers, including the calling thread.
+     */
+    explicit d2ThreadPool(int32 workerCount = 1);
+
+    /** @brief Destructor that joins all the worker threads. */
+    ~d2ThreadPool();
+
+    /**
+     * @brief Restart the pool with a different number of workers.
+     * @param workerCount The number of workers, including the calling thread.
+     */
+    void SetWorkerCount(int32 workerCount);
+
+    /**
+     * @brief Get the number of workers, including the calling thread.
+     * @return The number of workers.
+     */
+    int32 GetWorkerCount() const;
+
+    /**
+     * @brief Split [0, count) in contiguous ranges, one per worker, and run them in parallel.
+     *
+     * Worker i always receives the i-th range, so the partition only depends on the
+     * item count and the worker count. Results gathered per worker and concatenated in
+     * worker order are therefore identical to a serial run over the same range.
+     *
+     * @param count The number of items to process.
+     * @param minRange The minimum number of items worth handing to a worker.
+     * @param task The task to run for each range.
+     */
+    void ParallelFor(int32 count, int32 minRange, const d2RangeTask& task);
+
+    d2ThreadPool(const d2ThreadPool& other) = delete;
+    d2ThreadPool& operator=(const d2ThreadPool& other) = delete;
+
+private:
+    void Start(int32 workerCount);
+    void Stop();
+    void WorkerMain(int32 workerIndex, uint32 generation);
+    void RunRange(int32 workerIndex);
+
+    std::vector<std::thread> m_threads; ///< Worker threads, worker 0 is the caller.
+    std::mutex m_mutex;
+    std::condition_variable m_wakeCondition;
+    std::condition_variable m_doneCondition;
+
+    const d2RangeTask* m_task { nullptr }; ///< The task of the current dispatch.
+    int32 m_count { 0 }; ///< Item count of the current dispatch.
+    int32 m_rangeSize { 0 }; ///< Items per worker of the current dispatch.
+    int32 m_pending { 0 }; ///< Workers that still have to finish the current dispatch.
+    uint32 m_generation { 0 }; ///< Incremented on every dispatch to wake the workers.
+    bool m_exit { false };
+};
+
+inline int32 d2ThreadPool::GetWorkerCount() const
+{
+    return (int32)m_threads.size() + 1;
+}
+
+#endif //D2THREADPOOL_H
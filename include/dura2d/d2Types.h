@@ -7,6 +7,8 @@ typedef signed int int32;
 typedef unsigned char uint8;
 typedef unsigned short uint16;
 typedef unsigned int uint32;
+typedef signed long long int64;
+typedef unsigned long long uint64;
 typedef float real;
 
 #endif //D2TYPES_H
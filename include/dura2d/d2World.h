@@ -1,19 +1,38 @@
 #ifndef D2WORLD_H
 #define D2WORLD_H
 
+#include <utility>
 #include <vector>
 
 #include "d2api.h"
 #include "d2Math.h"
+#include "d2BodyStorage.h"
+#include "d2Constants.h"
+#include "d2Contact.h"
+#include "d2ConstraintSolver.h"
 #include "memory/d2BlockAllocator.h"
 
 // Forward declarations
 struct d2Color;
 class d2Body;
+struct d2BodyDef;
 struct d2Shape;
 class d2Broadphase;
 class d2Constraint;
+class d2ConstraintSolver;
+class d2Joint;
+struct d2JointDef;
 class d2Draw;
+class d2IslandBuilder;
+class d2PositionSolver;
+class d2ThreadPool;
+
+/** @brief How the world solves its joints and contacts. */
+enum d2SolverType
+{
+    d2_baumgarteSolver = 0, //< Velocity iterations over the step with Baumgarte stabilization.
+    d2_softStepSolver       //< Sub-steps of soft constraints, each followed by a relaxation.
+};
 
 /**
  * @brief Represents a 2D physics world.
@@ -49,16 +68,46 @@ public:
     void DestroyBody(d2Body* body);
 
     /**
-     * @brief Create a joint between two bodies.
+     * @brief Create many bodies at once.
+     *
+     * The storage grows once for the whole batch and the bodies are inserted in the broadphase
+     * together, which is much cheaper than creating them one by one.
+     *
+     * @param defs The shape, position and mass of each body.
+     * @param count The number of bodies.
+     * @param ids If not null, receives the handle of each body, in the order of the definitions.
+     */
+    void CreateBodies(const d2BodyDef* defs, int32 count, d2BodyId* ids = nullptr);
+
+    /**
+     * @brief Destroy many bodies at once.
+     *
+     * The contacts and events of the whole batch are pruned in a single pass. Stale handles are
+     * skipped, so a batch can name bodies that may already be gone.
+     *
+     * @param ids The handles of the bodies.
+     * @param count The number of handles.
+     */
+    void DestroyBodies(const d2BodyId* ids, int32 count);
+
+    /**
+     * @brief Create a pin joint between two bodies.
      * @param bodyA The first body.
      * @param bodyB The second body.
      * @param anchorPoint The anchor point for the joint.
      * @return Pointer to the created joint.
      */
-    d2Constraint* CreateJoint(d2Body* bodyA, d2Body* bodyB, d2Vec2 anchorPoint);
+    d2Joint* CreateJoint(d2Body* bodyA, d2Body* bodyB, d2Vec2 anchorPoint);
 
     /**
-     * @brief Destroy a joint.
+     * @brief Create a joint of any type, built by the d2JointRegistry entry of its type.
+     * @param def The type, bodies and settings of the joint.
+     * @return Pointer to the created joint.
+     */
+    d2Joint* CreateJoint(const d2JointDef& def);
+
+    /**
+     * @brief Destroy a joint created by CreateJoint().
      * @param joint The joint to destroy.
      * @warning This will automatically remove the joint from the world.
      */
@@ -91,9 +140,13 @@ public:
     /**
      * @brief Update the world simulation by a specified time step.
      * @param dt The time step for the update.
-     * @param posIterations The number of position iterations for the update.
+     * @param velocityIterations The number of velocity iterations of the Baumgarte solver. The soft
+     * step solver runs one iteration and one relaxation per sub-step instead.
+     * @param positionIterations The largest number of position iterations run after the velocities
+     * are integrated, stopping early once the errors are within the slop. With none, the
+     * penetrations are pushed out through the velocity bias instead. Unused by the soft step solver.
      */
-    void Step(real dt, int32 posIterations = 3);
+    void Step(real dt, int32 velocityIterations = 3, int32 positionIterations = POSITION_ITERATIONS);
 
     /**
      * @brief Solve the world simulation by a specified time step.
@@ -103,15 +156,257 @@ public:
 
     /**
      * @brief Check for collisions between m_bodiesList.
+     *
+     * The broadphase pairs are split in contiguous ranges across the workers, each
+     * worker writes its contacts in its own buffer and the buffers are merged in
+     * worker order, so the result matches a single threaded run.
+     *
+     * Pairs closer than the distance their bodies can travel in the step also produce
+     * speculative contacts, with a negative depth. Pairs with a sensor only run a boolean
+     * overlap test and never produce contacts.
      */
     void CheckCollisions();
 
+    /**
+     * @brief Compare the pairs touching after CheckCollisions with the ones of the previous step
+     * and fill the contact events.
+     *
+     * Speculative contacts count as touching in the step their gap closes. Pairs that start
+     * touching faster than the hit event threshold also report a hit.
+     *
+     * @param dt The time step.
+     */
+    void UpdateContactEvents(real dt);
+
+    /**
+     * @brief Compare the sensor overlaps found by CheckCollisions with the ones of the previous step
+     * and fill the sensor events.
+     */
+    void UpdateSensorEvents();
+
+    /**
+     * @brief Move a bullet body through the step in sub-steps, stopping it at the first impact
+     * with static geometry.
+     *
+     * The bullet is swept against the static proxies overlapping its motion. The sub-steps are
+     * short enough for the body to overlap anything it would cross, and the first colliding
+     * sub-step is refined by bisection. The bullet is left slightly overlapping at the time of
+     * impact, so the contact is resolved by the next step.
+     *
+     * @param body The bullet body.
+     * @param dt The time step.
+     */
+    void SolveContinuous(d2Body* body, real dt);
+
+    /**
+     * @brief Solve the joints and contacts of the step island by island.
+     *
+     * Islands bigger than a worker's share of the constraints are solved together by the colored
+     * solver on the whole pool. The others are dealt to the workers from the biggest down, each
+     * to the least loaded worker, and solved one after the other with no synchronization.
+     *
+     * @param dt The time step.
+     * @param iterations The number of solver iterations.
+     * @param baumgarte Whether the contacts push out of penetration through their velocity bias.
+     */
+    void SolveIslands(real dt, int32 iterations, bool baumgarte);
+
+    /**
+     * @brief Correct the positions of the awake islands with constraints, island by island.
+     * @param iterations The largest number of position iterations per island.
+     */
+    void SolvePositions(int32 iterations);
+
+    /**
+     * @brief Accumulate the time the bodies of the awake islands rest and put the islands whose
+     * bodies all rested for TIME_TO_SLEEP to sleep.
+     *
+     * A body rests while its speeds are under LINEAR_SLEEP_TOLERANCE and ANGULAR_SLEEP_TOLERANCE.
+     * Sleeping bodies are skipped by the integration, the broadphase pairs, the narrowphase and
+     * the solver until a moving body touches their island or the user moves them.
+     *
+     * @param dt The time step.
+     */
+    void UpdateSleep(real dt);
+
+    /**
+     * @brief Get the number of islands, the ones built in the last step and the sleeping ones.
+     * @return The number of groups of dynamic bodies connected by contacts or joints.
+     */
+    int32 GetIslandCount() const;
+
+    /**
+     * @brief Get the number of position iterations run in the last step.
+     * @return The most iterations any island needed, zero when the positions weren't corrected.
+     */
+    int32 GetPositionIterationCount() const;
+
+    /**
+     * @brief Get the impulse changes of the velocity iterations of the last step.
+     *
+     * The islands are merged iteration by iteration, keeping the largest change and summing the
+     * totals. The list is as long as the island that iterated the most, one entry per sub-step
+     * with the soft step solver.
+     *
+     * @return The iterations in order, empty when nothing was solved.
+     */
+    const std::vector<d2SolverIteration>& GetSolverIterations() const;
+
+    /**
+     * @brief Get the contacts found by the last call to CheckCollisions.
+     * @return Reference to the list of contacts.
+     */
+    const std::vector<d2Contact>& GetContacts() const;
+
+    /**
+     * @brief Get the contact events of the last step.
+     * @return Reference to the begin, end and hit event arrays.
+     */
+    const d2ContactEvents& GetContactEvents() const;
+
+    /**
+     * @brief Get the sensor events of the last step.
+     * @return Reference to the begin and end event arrays.
+     */
+    const d2SensorEvents& GetSensorEvents() const;
+
+    /**
+     * @brief Set the approach speed above which a contact reports a hit event.
+     * @param threshold The approach speed, in pixels per second.
+     */
+    void SetHitEventThreshold(real threshold);
+
+    /**
+     * @brief Get the approach speed above which a contact reports a hit event.
+     * @return The approach speed, in pixels per second.
+     */
+    real GetHitEventThreshold() const;
+
+    /**
+     * @brief Enable or disable sleeping, disabling it wakes every body.
+     * @param flag Whether resting islands may fall asleep.
+     */
+    void SetAllowSleeping(bool flag);
+
+    /**
+     * @brief Can resting islands fall asleep?
+     * @return Whether sleeping is enabled.
+     */
+    bool GetAllowSleeping() const;
+
+    /**
+     * @brief Set the number of workers used to step the world.
+     * @param workerCount The number of workers, including the calling thread.
+     */
+    void SetWorkerCount(int32 workerCount);
+
+    /**
+     * @brief Get the number of workers used to step the world.
+     * @return The number of workers, including the calling thread.
+     */
+    int32 GetWorkerCount() const;
+
+    /**
+     * @brief Make the steps give bit-identical results whatever the number of workers.
+     *
+     * The pairs, contacts, islands and colors are always built in an order that only depends on
+     * the scene. With the flag on, islands are also never solved together, so one converging
+     * early can't stop the iterations of another, and the reported impulses are summed in
+     * constraint order instead of per worker. Machines running the same build on the same
+     * scene then step it identically, which GetStateHash() verifies.
+     *
+     * @param flag Whether the steps are deterministic, off by default.
+     */
+    void SetDeterministic(bool flag);
+
+    /** @brief Are the steps bit-identical whatever the number of workers? */
+    bool GetDeterministic() const;
+
+    /**
+     * @brief Hash of the state of every body, to compare two runs step by step.
+     *
+     * Covers the transforms, velocities and awake flags of the bodies, bit for bit.
+     *
+     * @return A 64 bit FNV-1a hash of the bodies.
+     */
+    uint64 GetStateHash() const;
+
+    /**
+     * @brief Set the number of graph colors the joints and contacts are solved in parallel over.
+     *
+     * The constraints that don't fit in any color are solved serially in the overflow color, so
+     * zero colors solves everything serially.
+     *
+     * @param colorCount The number of colors, in [0, 32].
+     */
+    void SetSolverColorCount(int32 colorCount);
+
+    /**
+     * @brief Get the number of graph colors of the solver.
+     * @return The number of colors, not counting the overflow color.
+     */
+    int32 GetSolverColorCount() const;
+
+    /**
+     * @brief Set the impulse change below which the velocity iterations of an island stop.
+     *
+     * An iteration converged once no joint or contact point changed its impulse by more than
+     * the tolerance, the step then skips the iterations left. Unused by the soft step solver.
+     *
+     * @param tolerance The impulse change, zero to always run every iteration.
+     */
+    void SetSolverTolerance(real tolerance);
+
+    /** @brief Get the impulse change below which the velocity iterations of an island stop. */
+    real GetSolverTolerance() const;
+
+    /**
+     * @brief Choose how the joints and contacts are solved.
+     *
+     * The soft step solver splits the step in sub-steps and treats every constraint as a stiff
+     * spring, which holds tall stacks and long chains with far fewer iterations. The bodies
+     * touched by constraints are then moved by the solver, a sub-step at a time.
+     *
+     * @param type The solver, d2_baumgarteSolver by default.
+     */
+    void SetSolverType(d2SolverType type);
+
+    /** @brief Get how the joints and contacts are solved. */
+    d2SolverType GetSolverType() const;
+
+    /**
+     * @brief Set the number of sub-steps of the soft step solver.
+     * @param subStepCount The number of sub-steps per step, at least 1.
+     */
+    void SetSubStepCount(int32 subStepCount);
+
+    /** @brief Get the number of sub-steps of the soft step solver. */
+    int32 GetSubStepCount() const;
+
+    /**
+     * @brief Set the stiffness and damping of the contacts in the soft step solver.
+     *
+     * Contacts against static bodies are twice as stiff. The stiffness of each joint is set on the
+     * joint itself.
+     *
+     * @param hertz The natural frequency of the contacts, capped to a quarter of the sub-step rate.
+     * @param dampingRatio The damping ratio of the contacts, 1 for critical damping.
+     */
+    void SetContactSoftness(real hertz, real dampingRatio);
+
     /**
      * @brief Get pointer to the array of m_bodiesList.
      * @return Pointer to the array of m_bodiesList.
      */
     d2Body* GetBodies() const;
 
+    /**
+     * @brief Get the body of a handle.
+     * @param id The handle, from d2Body::GetId().
+     * @return The body, or nullptr if it was destroyed.
+     */
+    d2Body* GetBody(d2BodyId id) const;
+
     /**
      * @brief Get the number of m_bodiesList in the world.
      * @return The number of m_bodiesList in the world.
@@ -127,6 +422,9 @@ public:
     /** @brief Draw a shape. */
     void DrawShape(const d2Body* body, const bool &mesh, const d2Color& color);
 
+    /** @brief Draw a shape with its vertices in world space, at the given angle. */
+    void DrawShape(d2Shape* shape, real angle, const bool &mesh, const d2Color& color);
+
     /** @brief Debug draw the world. */
     void DebugDraw();
 
@@ -134,17 +432,65 @@ public:
     d2World(const d2World& other) = delete;
     d2World& operator=(const d2World& other) = delete;
 
+    /** @brief Allocate a body and link it in the list, without adding it to the broadphase. */
+    d2Body* NewBody(const d2Shape& shape, d2Vec2 position, real mass);
+
+    /** @brief Wake what rested on the destroyed bodies and drop their contacts, overlaps and events. */
+    template <typename IsDestroyed>
+    void ForgetBodies(IsDestroyed isDestroyed);
+
+    /** @brief Unlink a body from the list and free it, once it left the broadphase. */
+    void FreeBody(d2Body* body);
+
     d2Vec2 m_gravity {0.0f, -9.8f }; /**< Acceleration due to gravity. */
     d2Broadphase* broadphase; /**< Broad-phase collision detection algorithm. */
     d2BlockAllocator m_blockAllocator; /**< Memory m_blockAllocator for small objects. */
 
+    d2BodyStorage m_bodyStorage; /**< State of the bodies the step streams over, and their handles. */
     d2Body* m_bodiesList { nullptr }; /**< Array of m_bodiesList in the world. */
     int32 m_bodyCount { 0 }; /**< Number of m_bodiesList in the world. */
+    uint32 m_creationCount { 0 }; /**< Number of bodies ever created, the creation index of the next one. */
+    std::vector<d2Body*> m_batchBodies; /**< Scratch bodies of CreateBodies() and DestroyBodies(). */
 
     d2Constraint *m_constraints { nullptr }; /**< List of constraints in the world. */
     int32 m_constraintCount { 0 }; /**< Number of constraints in the world. */
 
     d2Draw* m_debugDraw { nullptr }; /**< Debug draw object. */
+
+    d2ThreadPool* m_threadPool { nullptr }; /**< Workers used by the parallel step phases. */
+    d2ConstraintSolver* m_constraintSolver { nullptr }; /**< Colored solver of the joints and contacts of a step. */
+    std::vector<d2ConstraintSolver*> m_islandSolvers; /**< One solver per worker for the small islands. */
+    std::vector<std::vector<int32>> m_workerIslands; /**< Scratch small islands dealt to each worker. */
+    std::vector<int32> m_workerLoads; /**< Scratch constraint count dealt to each worker. */
+    d2IslandBuilder* m_islandBuilder { nullptr }; /**< Islands of the last step. */
+    d2PositionSolver* m_positionSolver { nullptr }; /**< Position correction of the contacts of a step. */
+    std::vector<d2Contact> m_contacts; /**< Contacts found by the narrowphase. */
+    std::vector<std::vector<d2Contact>> m_workerContacts; /**< Per worker narrowphase output. */
+    std::vector<d2Contact> m_continuousContacts; /**< Scratch contacts for the bullet sweeps. */
+    std::vector<d2Body*> m_continuousCandidates; /**< Scratch bodies along a bullet sweep. */
+    std::vector<std::pair<d2Body*, int32>> m_continuousTargets; /**< Scratch static children a bullet sweep can hit. */
+    std::vector<uint8> m_integrateFlags; /**< Bodies integrated by the step, by dense index of the storage. */
+
+    d2ContactEvents m_contactEvents; /**< Contact events of the last step. */
+    std::vector<d2ContactPair> m_touchingPairs; /**< Pairs touching in the last step, sorted. */
+    std::vector<d2ContactPair> m_previousTouchingPairs; /**< Pairs touching in the step before, sorted. */
+    real m_hitEventThreshold { HIT_EVENT_THRESHOLD }; /**< Approach speed that reports a hit event. */
+    bool m_allowSleep { true }; /**< Whether resting islands fall asleep. */
+
+    d2SolverType m_solverType { d2SolverType::d2_baumgarteSolver }; /**< How the constraints are solved. */
+    int32 m_subStepCount { SOLVER_SUBSTEPS }; /**< Sub-steps of the soft step solver. */
+    real m_contactHertz { CONTACT_HERTZ }; /**< Stiffness of the contacts in the soft step solver. */
+    real m_contactDampingRatio { CONTACT_DAMPING_RATIO }; /**< Damping of the contacts in the soft step solver. */
+    int32 m_positionIterationCount { 0 }; /**< Position iterations run in the last step. */
+    std::vector<int32> m_workerPositionIterations; /**< Scratch position iterations run by each worker. */
+    std::vector<d2SolverIteration> m_solverIterations; /**< Velocity iterations of the last step, merged over the islands. */
+    std::vector<std::vector<d2SolverIteration>> m_islandSolverIterations; /**< Velocity iterations of each island. */
+    bool m_deterministic { false }; /**< Whether islands are solved on their own and the reductions keep a fixed order. */
+
+    d2SensorEvents m_sensorEvents; /**< Sensor events of the last step. */
+    std::vector<d2ContactPair> m_sensorOverlaps; /**< Sensor overlaps of the last step, sorted. */
+    std::vector<d2ContactPair> m_previousSensorOverlaps; /**< Sensor overlaps of the step before, sorted. */
+    std::vector<std::vector<d2ContactPair>> m_workerSensorOverlaps; /**< Per worker sensor overlaps. */
 };
 
 inline d2Body* d2World::GetBodies() const
@@ -152,6 +498,11 @@ inline d2Body* d2World::GetBodies() const
     return m_bodiesList;
 }
 
+inline d2Body* d2World::GetBody(d2BodyId id) const
+{
+    return m_bodyStorage.Get(id);
+}
+
 inline int32 d2World::GetBodyCount() const
 {
     return m_bodyCount;
@@ -167,4 +518,60 @@ inline int32 d2World::GetConstraintCount() const
     return m_constraintCount;
 }
 
+inline const std::vector<d2Contact>& d2World::GetContacts() const
+{
+    return m_contacts;
+}
+
+inline const d2ContactEvents& d2World::GetContactEvents() const
+{
+    return m_contactEvents;
+}
+
+inline const d2SensorEvents& d2World::GetSensorEvents() const
+{
+    return m_sensorEvents;
+}
+
+inline void d2World::SetHitEventThreshold(real threshold)
+{
+    m_hitEventThreshold = threshold;
+}
+
+inline real d2World::GetHitEventThreshold() const
+{
+    return m_hitEventThreshold;
+}
+
+inline bool d2World::GetAllowSleeping() const
+{
+    return m_allowSleep;
+}
+
+inline void d2World::SetSolverType(d2SolverType type)
+{
+    m_solverType = type;
+}
+
+inline d2SolverType d2World::GetSolverType() const
+{
+    return m_solverType;
+}
+
+inline void d2World::SetSubStepCount(int32 subStepCount)
+{
+    m_subStepCount = d2Max<int32>(subStepCount, 1);
+}
+
+inline int32 d2World::GetSubStepCount() const
+{
+    return m_subStepCount;
+}
+
+inline void d2World::SetContactSoftness(real hertz, real dampingRatio)
+{
+    m_contactHertz = hertz;
+    m_contactDampingRatio = dampingRatio;
+}
+
 #endif // D2WORLD_H
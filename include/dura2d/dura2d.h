@@ -12,9 +12,13 @@
 #include "d2Broadphase.h"
 
 #include "d2Body.h"
+#include "d2BodyStorage.h"
 #include "d2World.h"
 #include "d2Shape.h"
 
 #include "d2Constraint.h"
+#include "d2ConstraintSolver.h"
+#include "d2Joint.h"
+#include "d2PositionSolver.h"
 
 #endif //DURA2D_H
@@ -2,35 +2,122 @@
 
 #include "dura2d/d2Draw.h"
 
+#include <algorithm>
 #include <queue>
 
 void
 d2AABBTree::Add(d2Body *body)
 {
+    // One leaf per shape child
+    for (int32 i = 0; i < body->GetProxyCount(); ++i)
+    {
+        if (!m_root)
+        {
+            m_root = new d2Node();
+            m_root->SetLeaf(body->GetAABB(i));
+            m_root->UpdateAABB(m_margin);
+        }
+        else
+        {
+            d2Node *node = new d2Node();
+            node->SetLeaf(body->GetAABB(i));
+            node->UpdateAABB(m_margin);
+            InsertNode(node, &m_root);
+        }
+    }
+}
+
+void
+d2AABBTree::Remove(d2Body *body)
+{
+    for (int32 i = 0; i < body->GetProxyCount(); ++i)
+    {
+        d2Node *node = static_cast<d2Node *>(body->GetAABB(i)->userData);
+
+        node->data = nullptr;
+        body->GetAABB(i)->userData = nullptr;
+
+        RemoveNode(node);
+    }
+}
+
+void
+d2AABBTree::AddBodies(d2Body *const *bodies, int32 count)
+{
+    NodeList leaves;
+    for (int32 i = 0; i < count; ++i)
+    {
+        for (int32 j = 0; j < bodies[i]->GetProxyCount(); ++j)
+        {
+            d2Node *node = new d2Node();
+            node->SetLeaf(bodies[i]->GetAABB(j));
+            node->UpdateAABB(m_margin);
+            leaves.push_back(node);
+        }
+    }
+    if (leaves.empty()) return;
+
+    // The new leaves are built into a subtree of their own, inserted as a single node
+    d2Node *subtree = BuildNode(leaves.data(), (int32)leaves.size());
     if (!m_root)
     {
-        m_root = new d2Node();
-        m_root->SetLeaf(body->GetAABB());
-        m_root->UpdateAABB(m_margin);
+        m_root = subtree;
     }
     else
     {
-        d2Node *node = new d2Node();
-        node->SetLeaf(body->GetAABB());
-        node->UpdateAABB(m_margin);
-        InsertNode(node, &m_root);
+        InsertNode(subtree, &m_root);
     }
 }
 
 void
-d2AABBTree::Remove(d2Body *body)
+d2AABBTree::Refresh(d2Body *body)
 {
-    d2Node *node = static_cast<d2Node *>(body->GetAABB()->userData);
+    // Only the path to the root can change, and only up to the first node that keeps its flag
+    const bool resting = body->GetType() == d2_staticBody || !body->IsAwake();
+    for (int32 i = 0; i < body->GetProxyCount(); ++i)
+    {
+        d2Node *node = static_cast<d2Node *>(body->GetAABB(i)->userData);
+        if (!node) continue;
 
-    node->data = nullptr;
-    body->GetAABB()->userData = nullptr;
+        node->isResting = resting;
+        for (d2Node *parent = node->parent; parent; parent = parent->parent)
+        {
+            const bool parentResting = parent->children[0]->isResting && parent->children[1]->isResting;
+            if (parent->isResting == parentResting) break;
+            parent->isResting = parentResting;
+        }
+    }
+}
+
+// Top down build, each branch splits its leaves at the median of their centers along the
+// longest axis of the centers
+d2Node *
+d2AABBTree::BuildNode(d2Node **leaves, int32 count)
+{
+    if (count == 1) return leaves[0];
 
-    RemoveNode(node);
+    d2Vec2 lowerCenter = leaves[0]->aabb.GetCenter();
+    d2Vec2 upperCenter = lowerCenter;
+    for (int32 i = 1; i < count; ++i)
+    {
+        lowerCenter = d2Min(lowerCenter, leaves[i]->aabb.GetCenter());
+        upperCenter = d2Max(upperCenter, leaves[i]->aabb.GetCenter());
+    }
+    const d2Vec2 spread = upperCenter - lowerCenter;
+    const bool splitX = spread.x >= spread.y;
+
+    const int32 half = count / 2;
+    std::nth_element(leaves, leaves + half, leaves + count, [splitX](const d2Node *a, const d2Node *b)
+    {
+        const d2Vec2 centerA = a->aabb.GetCenter();
+        const d2Vec2 centerB = b->aabb.GetCenter();
+        return splitX ? centerA.x < centerB.x : centerA.y < centerB.y;
+    });
+
+    d2Node *node = new d2Node();
+    node->SetBranch(BuildNode(leaves, half), BuildNode(leaves + half, count - half));
+    node->UpdateAABB(m_margin);
+    return node;
 }
 
 void
@@ -84,6 +171,9 @@ d2AABBTree::Update(void)
 void
 d2AABBTree::UpdateNodeHelper(d2Node *node, NodeList &invalidNodes)
 {
+    // The bounds of static and sleeping bodies don't change
+    if (node->isResting) return;
+
     if (node->IsLeaf())
     {
         if (!node->aabb.Contains(*node->data))
@@ -158,49 +248,45 @@ d2AABBTree::ComputePairs(void)
     m_pairs.clear();
     if (!m_root || m_root->IsLeaf()) return m_pairs;
 
-    ClearChildrenCrossFlagHelper(m_root);
-
+    ++m_pairPass;
     ComputePairsHelper(m_root->children[0], m_root->children[1]);
 
     return m_pairs;
 }
 
-void
-d2AABBTree::ClearChildrenCrossFlagHelper(d2Node *node)
-{
-    node->childrenCrossed = false;
-    if (!node->IsLeaf())
-    {
-        ClearChildrenCrossFlagHelper(node->children[0]);
-        ClearChildrenCrossFlagHelper(node->children[1]);
-    }
-}
-
 void
 d2AABBTree::CrossChildren(d2Node *node)
 {
-    if (!node->childrenCrossed)
+    // Nothing to find between proxies that don't move
+    if (node->crossedPass != m_pairPass && !node->isResting)
     {
         ComputePairsHelper(node->children[0], node->children[1]);
-        node->childrenCrossed = true;
+        node->crossedPass = m_pairPass;
     }
 }
 
 void
 d2AABBTree::ComputePairsHelper(d2Node *n0, d2Node *n1)
 {
+    // Pairs inside each subtree are found regardless of the pair between them
+    if (!n0->IsLeaf()) CrossChildren(n0);
+    if (!n1->IsLeaf()) CrossChildren(n1);
+
+    // Disjoint subtrees or resting against resting can't produce any pair
+    if (n0->isResting && n1->isResting) return;
+    if (!n0->aabb.Overlaps(n1->aabb)) return;
+
     if (n0->IsLeaf())
     {
         if (n1->IsLeaf())
         {
-            if (n0->data->Overlaps(*n1->data))
+            if (ShouldCollide(*n0->data, *n1->data) && n0->data->Overlaps(*n1->data))
             {
-                m_pairs.emplace_back(n0->data->Collider, n1->data->Collider);
+                m_pairs.emplace_back(n0->data, n1->data);
             }
         }
         else
         {
-            CrossChildren(n1);
             ComputePairsHelper(n0, n1->children[0]);
             ComputePairsHelper(n0, n1->children[1]);
         }
@@ -209,14 +295,11 @@ d2AABBTree::ComputePairsHelper(d2Node *n0, d2Node *n1)
     {
         if (n1->IsLeaf())
         {
-            CrossChildren(n0);
             ComputePairsHelper(n0->children[0], n1);
             ComputePairsHelper(n0->children[1], n1);
         }
         else
         {
-            CrossChildren(n0);
-            CrossChildren(n1);
             ComputePairsHelper(n0->children[0], n1->children[0]);
             ComputePairsHelper(n0->children[0], n1->children[1]);
             ComputePairsHelper(n0->children[1], n1->children[0]);
@@ -253,6 +336,35 @@ d2AABBTree::Pick(const d2Vec2 &point) const
     return nullptr;
 }
 
+void
+d2AABBTree::Query(const d2AABB &aabb, ColliderList &output) const
+{
+    std::queue<d2Node*> q;
+
+    if (m_root)
+        q.push(m_root);
+
+    while (!q.empty())
+    {
+        d2Node &node = *q.front();
+        q.pop();
+
+        if (!node.aabb.Overlaps(aabb))
+            continue;
+
+        if (node.IsLeaf())
+        {
+            if (node.data->Overlaps(aabb))
+                output.push_back(node.data->Collider);
+        }
+        else
+        {
+            q.push(node.children[0]);
+            q.push(node.children[1]);
+        }
+    }
+}
+
 void d2AABBTree::Draw(const d2Draw &draw) const
 {
     std::queue<std::pair<d2Node*, int>> q{};
@@ -1,42 +1,342 @@
 #include "dura2d/d2CollisionDetection.h"
+#include "dura2d/d2Constants.h"
 #include <limits>
 
 bool
-d2CollisionDetection::IsColliding(d2Body *a, d2Body *b, std::vector<d2Contact> &contacts)
+d2CollisionDetection::IsColliding(d2Body *a, d2Body *b, std::vector<d2Contact> &contacts, real speculativeDistance)
 {
-    d2ShapeType aType = a->GetShape()->GetType();
-    d2ShapeType bType = b->GetShape()->GetType();
+    return IsColliding(a, 0, b, 0, contacts, speculativeDistance);
+}
+
+// Resolve a child of the body shape to a convex shape, chain children are built into "edge"
+static const d2Shape *
+GetChildShape(const d2Body *body, int32 childIndex, d2EdgeShape *edge)
+{
+    const d2Shape *shape = body->GetShape();
+    switch (shape->GetType()) {
+        case CHAIN:
+            ((const d2ChainShape *) shape)->GetChildEdge(edge, childIndex);
+            return edge;
+        case COMPOUND:
+            return ((const d2CompoundShape *) shape)->GetChild(childIndex);
+        default:
+            return shape;
+    }
+}
+
+bool
+d2CollisionDetection::IsColliding(d2Body *a, int32 childA, d2Body *b, int32 childB, std::vector<d2Contact> &contacts,
+                                  real speculativeDistance)
+{
+    d2EdgeShape chainEdgeA, chainEdgeB;
+    const d2Shape *shapeA = GetChildShape(a, childA, &chainEdgeA);
+    const d2Shape *shapeB = GetChildShape(b, childB, &chainEdgeB);
+
+    return IsColliding(a, shapeA, b, shapeB, contacts, speculativeDistance);
+}
+
+bool
+d2CollisionDetection::IsColliding(d2Body *a, const d2Shape *shapeA, d2Body *b, const d2Shape *shapeB, std::vector<d2Contact> &contacts,
+                                  real speculativeDistance)
+{
+    d2ShapeType aType = shapeA->GetType();
+    d2ShapeType bType = shapeB->GetType();
 
     bool aIsCircle = aType == CIRCLE;
     bool bIsCircle = bType == CIRCLE;
     bool aIsPolygon = aType == POLYGON || aType == BOX;
     bool bIsPolygon = bType == POLYGON || bType == BOX;
+    bool aIsCapsule = aType == CAPSULE;
+    bool bIsCapsule = bType == CAPSULE;
+    bool aIsEdge = aType == EDGE;
+    bool bIsEdge = bType == EDGE;
 
+    // Each shape is only cast once its type is known
     if (aIsCircle && bIsCircle) {
-        return IsCollidingCircleCircle(a, b, contacts);
+        return IsCollidingCircleCircle(a, (const d2CircleShape *) shapeA, b, (const d2CircleShape *) shapeB, contacts, speculativeDistance);
     }
     if (aIsPolygon && bIsPolygon) {
-        return IsCollidingPolygonPolygon(a, b, contacts);
+        return IsCollidingPolygonPolygon(a, (const d2PolygonShape *) shapeA, b, (const d2PolygonShape *) shapeB, contacts, speculativeDistance);
     }
     if (aIsPolygon && bIsCircle) {
-        return IsCollidingPolygonCircle(a, b, contacts);
+        return IsCollidingPolygonCircle(a, (const d2PolygonShape *) shapeA, b, (const d2CircleShape *) shapeB, contacts, speculativeDistance);
     }
     if (aIsCircle && bIsPolygon) {
-        return IsCollidingPolygonCircle(b, a, contacts);
+        return IsCollidingPolygonCircle(b, (const d2PolygonShape *) shapeB, a, (const d2CircleShape *) shapeA, contacts, speculativeDistance);
+    }
+    if (aIsCapsule && bIsCapsule) {
+        return IsCollidingCapsuleCapsule(a, (const d2CapsuleShape *) shapeA, b, (const d2CapsuleShape *) shapeB, contacts, speculativeDistance);
+    }
+    if (aIsCapsule && bIsCircle) {
+        return IsCollidingCapsuleCircle(a, (const d2CapsuleShape *) shapeA, b, (const d2CircleShape *) shapeB, contacts, speculativeDistance);
+    }
+    if (aIsCircle && bIsCapsule) {
+        return IsCollidingCapsuleCircle(b, (const d2CapsuleShape *) shapeB, a, (const d2CircleShape *) shapeA, contacts, speculativeDistance);
+    }
+    if (aIsPolygon && bIsCapsule) {
+        return IsCollidingPolygonCapsule(a, (const d2PolygonShape *) shapeA, b, (const d2CapsuleShape *) shapeB, contacts, speculativeDistance);
+    }
+    if (aIsCapsule && bIsPolygon) {
+        return IsCollidingPolygonCapsule(b, (const d2PolygonShape *) shapeB, a, (const d2CapsuleShape *) shapeA, contacts, speculativeDistance);
+    }
+
+    // Edges don't collide with each other
+    if (aIsEdge && bIsCircle) {
+        return IsCollidingEdgeCircle(a, (const d2EdgeShape *) shapeA, b, (const d2CircleShape *) shapeB, contacts, speculativeDistance);
+    }
+    if (aIsCircle && bIsEdge) {
+        return IsCollidingEdgeCircle(b, (const d2EdgeShape *) shapeB, a, (const d2CircleShape *) shapeA, contacts, speculativeDistance);
+    }
+    if (aIsEdge && bIsPolygon) {
+        return IsCollidingEdgePolygon(a, (const d2EdgeShape *) shapeA, b, (const d2PolygonShape *) shapeB, contacts, speculativeDistance);
+    }
+    if (aIsPolygon && bIsEdge) {
+        return IsCollidingEdgePolygon(b, (const d2EdgeShape *) shapeB, a, (const d2PolygonShape *) shapeA, contacts, speculativeDistance);
+    }
+    if (aIsEdge && bIsCapsule) {
+        return IsCollidingEdgeCapsule(a, (const d2EdgeShape *) shapeA, b, (const d2CapsuleShape *) shapeB, contacts, speculativeDistance);
+    }
+    if (aIsCapsule && bIsEdge) {
+        return IsCollidingEdgeCapsule(b, (const d2EdgeShape *) shapeB, a, (const d2CapsuleShape *) shapeA, contacts, speculativeDistance);
     }
     return false;
 }
 
-bool
-d2CollisionDetection::IsCollidingCircleCircle(d2Body *a, d2Body *b, std::vector<d2Contact> &contacts)
+///////////////////////////////////////////////////////////////////////////////
+// Rounded polygons
+///////////////////////////////////////////////////////////////////////////////
+// Capsules are handled as a two vertex polygon (a segment, whose two edges
+// face opposite directions) inflated by a radius. This lets capsule-capsule
+// and polygon-capsule share the same closed-form SAT + clipping routine.
+///////////////////////////////////////////////////////////////////////////////
+
+// Closest points between the segments p1-q1 and p2-q2
+struct d2SegmentDistance
 {
-    d2CircleShape *aCircleShape = (d2CircleShape *) a->GetShape();
-    d2CircleShape *bCircleShape = (d2CircleShape *) b->GetShape();
+    d2Vec2 closest1;
+    d2Vec2 closest2;
+    real fraction1;
+    real fraction2;
+    real distanceSquared;
+};
+
+static d2SegmentDistance
+SegmentDistance(const d2Vec2 &p1, const d2Vec2 &q1, const d2Vec2 &p2, const d2Vec2 &q2)
+{
+    d2SegmentDistance result{};
+
+    const d2Vec2 d1 = q1 - p1;
+    const d2Vec2 d2 = q2 - p2;
+    const d2Vec2 r = p1 - p2;
+    const real dd1 = d1.Dot(d1);
+    const real dd2 = d2.Dot(d2);
+    const real rd1 = r.Dot(d1);
+    const real rd2 = r.Dot(d2);
+
+    const real epsSqr = FLT_EPSILON * FLT_EPSILON;
+
+    real f1 = 0.0F;
+    real f2 = 0.0F;
+    if (dd1 < epsSqr || dd2 < epsSqr) {
+        // Degenerate segments
+        if (dd1 >= epsSqr) {
+            f1 = d2Clamp(-rd1 / dd1, 0.0F, 1.0F);
+        } else if (dd2 >= epsSqr) {
+            f2 = d2Clamp(rd2 / dd2, 0.0F, 1.0F);
+        }
+    } else {
+        // Non-degenerate segments
+        const real d12 = d1.Dot(d2);
+        const real denom = dd1 * dd2 - d12 * d12;
+
+        // Fraction on segment 1, zero for parallel segments
+        if (denom != 0.0F) {
+            f1 = d2Clamp((d12 * rd2 - rd1 * dd2) / denom, 0.0F, 1.0F);
+        }
+
+        // Compute point on segment 2 closest to p1 + f1 * d1
+        f2 = (d12 * f1 + rd2) / dd2;
+
+        // Clamping of segment 2 requires a do over on segment 1
+        if (f2 < 0.0F) {
+            f2 = 0.0F;
+            f1 = d2Clamp(-rd1 / dd1, 0.0F, 1.0F);
+        } else if (f2 > 1.0F) {
+            f2 = 1.0F;
+            f1 = d2Clamp((d12 - rd1) / dd1, 0.0F, 1.0F);
+        }
+    }
+
+    result.closest1 = p1 + d1 * f1;
+    result.closest2 = p2 + d2 * f2;
+    result.fraction1 = f1;
+    result.fraction2 = f2;
+    result.distanceSquared = (result.closest2 - result.closest1).LenghtSquared();
+    return result;
+}
+
+static d2Vec2
+EdgeNormal(const d2Vec2 *vertices, int count, int index)
+{
+    return (vertices[(index + 1) % count] - vertices[index]).Normal();
+}
+
+// Find the max separation between poly1 and poly2 using the edge normals from poly1
+static real
+FindMaxSeparation(int &edgeIndex, const d2Vec2 *vertices1, int count1, const d2Vec2 *vertices2, int count2)
+{
+    real maxSeparation = std::numeric_limits<real>::lowest();
+    for (int i = 0; i < count1; ++i) {
+        const d2Vec2 n = EdgeNormal(vertices1, count1, i);
+        const d2Vec2 v1 = vertices1[i];
+
+        real si = std::numeric_limits<real>::max();
+        for (int j = 0; j < count2; ++j) {
+            si = d2Min(si, (vertices2[j] - v1).Dot(n));
+        }
+
+        if (si > maxSeparation) {
+            maxSeparation = si;
+            edgeIndex = i;
+        }
+    }
+    return maxSeparation;
+}
+
+// Record a contact between the surfaces of "a" and "b", the normal always goes from "a" to "b"
+static void
+AddContact(d2Body *a, d2Body *b, const d2Vec2 &pointA, const d2Vec2 &pointB, const d2Vec2 &normal,
+           std::vector<d2Contact> &contacts)
+{
+    d2Contact contact;
+    contact.a = a;
+    contact.b = b;
+    contact.normal = normal;
+    contact.start = pointB;
+    contact.end = pointA;
+    contact.depth = (pointA - pointB).Dot(normal);
+    contacts.push_back(contact);
+}
+
+static bool
+CollideRoundedPolygons(d2Body *a, const d2Vec2 *verticesA, int countA, real radiusA,
+                       d2Body *b, const d2Vec2 *verticesB, int countB, real radiusB,
+                       std::vector<d2Contact> &contacts, real speculativeDistance)
+{
+    const real radius = radiusA + radiusB;
+    const real maxDistance = radius + speculativeDistance;
+
+    int edgeA = 0;
+    const real separationA = FindMaxSeparation(edgeA, verticesA, countA, verticesB, countB);
+    if (separationA > maxDistance) {
+        return false;
+    }
+
+    int edgeB = 0;
+    const real separationB = FindMaxSeparation(edgeB, verticesB, countB, verticesA, countA);
+    if (separationB > maxDistance) {
+        return false;
+    }
+
+    // The reference polygon owns the separating axis, favour "a" to avoid flip-flopping
+    const bool flip = separationB > 0.1F * LINEAR_SLOP + separationA;
+    const d2Vec2 *vertices1 = flip ? verticesB : verticesA;
+    const d2Vec2 *vertices2 = flip ? verticesA : verticesB;
+    const int count1 = flip ? countB : countA;
+    const int count2 = flip ? countA : countB;
+    const real radius1 = flip ? radiusB : radiusA;
+    const real radius2 = flip ? radiusA : radiusB;
+    const int edge1 = flip ? edgeB : edgeA;
+    const real separation = d2Max(separationA, separationB);
 
-    const d2Vec2 ab = b->GetPosition() - a->GetPosition();
+    const d2Vec2 normal1 = EdgeNormal(vertices1, count1, edge1);
+
+    // Find the incident edge on poly2
+    int edge2 = 0;
+    real minDot = std::numeric_limits<real>::max();
+    for (int i = 0; i < count2; ++i) {
+        const real dot = normal1.Dot(EdgeNormal(vertices2, count2, i));
+        if (dot < minDot) {
+            minDot = dot;
+            edge2 = i;
+        }
+    }
+
+    const d2Vec2 v11 = vertices1[edge1];
+    const d2Vec2 v12 = vertices1[(edge1 + 1) % count1];
+    const d2Vec2 v21 = vertices2[edge2];
+    const d2Vec2 v22 = vertices2[(edge2 + 1) % count2];
+
+    // Emits a contact from a point on the reference and a point on the incident surfaces
+    auto emit = [&](const d2Vec2 &point1, const d2Vec2 &point2, const d2Vec2 &normal)
+    {
+        if (flip) {
+            AddContact(a, b, point2, point1, normal * -1.0F, contacts);
+        } else {
+            AddContact(a, b, point1, point2, normal, contacts);
+        }
+    };
+
+    // The cores are apart, only the radii overlap. Vertex-vertex needs its own normal.
+    if (separation > 0.1F * LINEAR_SLOP) {
+        const d2SegmentDistance result = SegmentDistance(v11, v12, v21, v22);
+        const bool vertex1 = result.fraction1 == 0.0F || result.fraction1 == 1.0F;
+        const bool vertex2 = result.fraction2 == 0.0F || result.fraction2 == 1.0F;
+        if (vertex1 && vertex2) {
+            const real distance = d2Sqrt(result.distanceSquared);
+            if (distance > maxDistance || distance == 0.0F) {
+                return false;
+            }
+
+            const d2Vec2 normal = (result.closest2 - result.closest1) / distance;
+            emit(result.closest1 + normal * radius1, result.closest2 - normal * radius2, normal);
+            return true;
+        }
+    }
+
+    // Clip the incident edge against the side planes of the reference edge
+    const d2Vec2 tangent = (v12 - v11).UnitVector();
+    const real lower1 = 0.0F;
+    const real upper1 = (v12 - v11).Dot(tangent);
+
+    // The incident edge runs in the opposite direction
+    const real upper2 = (v21 - v11).Dot(tangent);
+    const real lower2 = (v22 - v11).Dot(tangent);
+
+    d2Vec2 vLower = v22;
+    if (lower2 < lower1 && upper2 - lower2 > FLT_EPSILON) {
+        vLower = v22 + (v21 - v22) * ((lower1 - lower2) / (upper2 - lower2));
+    }
+
+    d2Vec2 vUpper = v21;
+    if (upper2 > upper1 && upper2 - lower2 > FLT_EPSILON) {
+        vUpper = v22 + (v21 - v22) * ((upper1 - lower2) / (upper2 - lower2));
+    }
+
+    bool isColliding = false;
+    for (const d2Vec2 &vClip: {vLower, vUpper}) {
+        const real s = (vClip - v11).Dot(normal1);
+        if (s > maxDistance) {
+            continue;
+        }
+
+        // Project the clipped point to the reference surface
+        emit(vClip - normal1 * (s - radius1), vClip - normal1 * radius2, normal1);
+        isColliding = true;
+    }
+    return isColliding;
+}
+
+bool
+d2CollisionDetection::IsCollidingCircleCircle(d2Body *a, const d2CircleShape *aCircleShape,
+                                              d2Body *b, const d2CircleShape *bCircleShape,
+                                              std::vector<d2Contact> &contacts, real speculativeDistance)
+{
+    const d2Vec2 ab = bCircleShape->worldCenter - aCircleShape->worldCenter;
     const real radiusSum = aCircleShape->radius + bCircleShape->radius;
+    const real maxDistance = radiusSum + speculativeDistance;
 
-    bool isColliding = ab.LenghtSquared() <= (radiusSum * radiusSum);
+    bool isColliding = ab.LenghtSquared() <= (maxDistance * maxDistance);
 
     if (!isColliding) {
         return false;
@@ -48,10 +348,10 @@ d2CollisionDetection::IsCollidingCircleCircle(d2Body *a, d2Body *b, std::vector<
     contact.normal = ab;
     contact.normal.Normalize();
 
-    contact.start = b->GetPosition() - contact.normal * bCircleShape->radius;
-    contact.end = a->GetPosition() + contact.normal * aCircleShape->radius;
+    contact.start = bCircleShape->worldCenter - contact.normal * bCircleShape->radius;
+    contact.end = aCircleShape->worldCenter + contact.normal * aCircleShape->radius;
 
-    contact.depth = (contact.end - contact.start).Lenght();
+    contact.depth = (contact.end - contact.start).Dot(contact.normal);
 
     contacts.push_back(contact);
 
@@ -59,23 +359,23 @@ d2CollisionDetection::IsCollidingCircleCircle(d2Body *a, d2Body *b, std::vector<
 }
 
 bool
-d2CollisionDetection::IsCollidingPolygonPolygon(d2Body *a, d2Body *b, std::vector<d2Contact> &contacts)
+d2CollisionDetection::IsCollidingPolygonPolygon(d2Body *a, const d2PolygonShape *aPolygonShape,
+                                                d2Body *b, const d2PolygonShape *bPolygonShape,
+                                                std::vector<d2Contact> &contacts, real speculativeDistance)
 {
-    auto *aPolygonShape = (d2PolygonShape *) a->GetShape();
-    auto *bPolygonShape = (d2PolygonShape *) b->GetShape();
     int aIndexReferenceEdge, bIndexReferenceEdge;
     d2Vec2 aSupportPoint, bSupportPoint;
     real abSeparation = aPolygonShape->FindMinSeparation(bPolygonShape, aIndexReferenceEdge, aSupportPoint);
-    if (abSeparation >= 0) {
+    if (abSeparation > speculativeDistance) {
         return false;
     }
     real baSeparation = bPolygonShape->FindMinSeparation(aPolygonShape, bIndexReferenceEdge, bSupportPoint);
-    if (baSeparation >= 0) {
+    if (baSeparation > speculativeDistance) {
         return false;
     }
 
-    d2PolygonShape *referenceShape;
-    d2PolygonShape *incidentShape;
+    const d2PolygonShape *referenceShape;
+    const d2PolygonShape *incidentShape;
     int indexReferenceEdge;
     if (abSeparation > baSeparation) {
         referenceShape = aPolygonShape;
@@ -116,15 +416,17 @@ d2CollisionDetection::IsCollidingPolygonPolygon(d2Body *a, d2Body *b, std::vecto
     auto vref = referenceShape->worldVertices[indexReferenceEdge];
 
     // Loop all clipped points, but only consider those where separation is negative (objects are penetrating each other)
+    // or within the speculative distance
     for (auto &vclip: clippedPoints) {
         real separation = (vclip - vref).Dot(referenceEdge.Normal());
-        if (separation <= 0) {
+        if (separation <= speculativeDistance) {
             d2Contact contact;
             contact.a = a;
             contact.b = b;
             contact.normal = referenceEdge.Normal();
             contact.start = vclip;
             contact.end = vclip + contact.normal * -separation;
+            contact.depth = -separation;
             if (baSeparation >= abSeparation) {
                 std::swap(contact.start, contact.end); // the start-end points are always from "a" to "b"
                 contact.normal *= -1.0;                // the collision normal is always from "a" to "b"
@@ -137,10 +439,11 @@ d2CollisionDetection::IsCollidingPolygonPolygon(d2Body *a, d2Body *b, std::vecto
 }
 
 bool
-d2CollisionDetection::IsCollidingPolygonCircle(d2Body *polygon, d2Body *circle, std::vector<d2Contact> &contacts)
+d2CollisionDetection::IsCollidingPolygonCircle(d2Body *polygon, const d2PolygonShape *polygonShape,
+                                               d2Body *circle, const d2CircleShape *circleShape,
+                                               std::vector<d2Contact> &contacts, real speculativeDistance)
 {
-    const d2PolygonShape *polygonShape = (d2PolygonShape *) polygon->GetShape();
-    const d2CircleShape *circleShape = (d2CircleShape *) circle->GetShape();
+    const real maxDistance = circleShape->radius + speculativeDistance;
     const d2Vec2 *polygonVertices = polygonShape->worldVertices;
     const int vertexCount = polygonShape->m_vertexCount;
 
@@ -157,7 +460,7 @@ d2CollisionDetection::IsCollidingPolygonCircle(d2Body *polygon, d2Body *circle,
         d2Vec2 normal = edge.Normal();
 
         // Compare the circle center with the rectangle vertex
-        d2Vec2 vertexToCircleCenter = circle->GetPosition() - polygonVertices[currVertex];
+        d2Vec2 vertexToCircleCenter = circleShape->worldCenter - polygonVertices[currVertex];
         real projection = vertexToCircleCenter.Dot(normal);
 
         // If we found a dot product projection that is in the positive/outside side of the normal
@@ -184,11 +487,11 @@ d2CollisionDetection::IsCollidingPolygonCircle(d2Body *polygon, d2Body *circle,
         ///////////////////////////////////////
         // Check if we are inside region A:
         ///////////////////////////////////////
-        d2Vec2 v1 = circle->GetPosition() - minCurrVertex; // vector from the nearest vertex to the circle center
+        d2Vec2 v1 = circleShape->worldCenter - minCurrVertex; // vector from the nearest vertex to the circle center
         d2Vec2 v2 = minNextVertex - minCurrVertex; // the nearest edge (from curr vertex to next vertex)
         if (v1.Dot(v2) < 0) {
             // Distance from vertex to circle center is greater than radius... no collision
-            if (v1.Lenght() > circleShape->radius) {
+            if (v1.Lenght() > maxDistance) {
                 return false;
             } else {
                 // Detected collision in region A:
@@ -196,18 +499,18 @@ d2CollisionDetection::IsCollidingPolygonCircle(d2Body *polygon, d2Body *circle,
                 contact.b = circle;
                 contact.depth = circleShape->radius - v1.Lenght();
                 contact.normal = v1.Normalize();
-                contact.start = circle->GetPosition() + (contact.normal * -circleShape->radius);
+                contact.start = circleShape->worldCenter + (contact.normal * -circleShape->radius);
                 contact.end = contact.start + (contact.normal * contact.depth);
             }
         } else {
             ///////////////////////////////////////
             // Check if we are inside region B:
             ///////////////////////////////////////
-            v1 = circle->GetPosition() - minNextVertex; // vector from the next nearest vertex to the circle center
+            v1 = circleShape->worldCenter - minNextVertex; // vector from the next nearest vertex to the circle center
             v2 = minCurrVertex - minNextVertex;   // the nearest edge
             if (v1.Dot(v2) < 0) {
                 // Distance from vertex to circle center is greater than radius... no collision
-                if (v1.Lenght() > circleShape->radius) {
+                if (v1.Lenght() > maxDistance) {
                     return false;
                 } else {
                     // Detected collision in region B:
@@ -215,14 +518,14 @@ d2CollisionDetection::IsCollidingPolygonCircle(d2Body *polygon, d2Body *circle,
                     contact.b = circle;
                     contact.depth = circleShape->radius - v1.Lenght();
                     contact.normal = v1.Normalize();
-                    contact.start = circle->GetPosition() + (contact.normal * -circleShape->radius);
+                    contact.start = circleShape->worldCenter + (contact.normal * -circleShape->radius);
                     contact.end = contact.start + (contact.normal * contact.depth);
                 }
             } else {
                 ///////////////////////////////////////
                 // We are inside region C:
                 ///////////////////////////////////////
-                if (distanceCircleEdge > circleShape->radius) {
+                if (distanceCircleEdge > maxDistance) {
                     // No collision... Distance between the closest distance and the circle center is greater than the radius.
                     return false;
                 } else {
@@ -231,7 +534,7 @@ d2CollisionDetection::IsCollidingPolygonCircle(d2Body *polygon, d2Body *circle,
                     contact.b = circle;
                     contact.depth = circleShape->radius - distanceCircleEdge;
                     contact.normal = (minNextVertex - minCurrVertex).Normal();
-                    contact.start = circle->GetPosition() - (contact.normal * circleShape->radius);
+                    contact.start = circleShape->worldCenter - (contact.normal * circleShape->radius);
                     contact.end = contact.start + (contact.normal * contact.depth);
                 }
             }
@@ -242,7 +545,7 @@ d2CollisionDetection::IsCollidingPolygonCircle(d2Body *polygon, d2Body *circle,
         contact.b = circle;
         contact.depth = circleShape->radius - distanceCircleEdge;
         contact.normal = (minNextVertex - minCurrVertex).Normal();
-        contact.start = circle->GetPosition() - (contact.normal * circleShape->radius);
+        contact.start = circleShape->worldCenter - (contact.normal * circleShape->radius);
         contact.end = contact.start + (contact.normal * contact.depth);
     }
 
@@ -250,3 +553,506 @@ d2CollisionDetection::IsCollidingPolygonCircle(d2Body *polygon, d2Body *circle,
 
     return true;
 }
+
+bool
+d2CollisionDetection::IsCollidingCapsuleCircle(d2Body *capsule, const d2CapsuleShape *capsuleShape,
+                                               d2Body *circle, const d2CircleShape *circleShape,
+                                               std::vector<d2Contact> &contacts, real speculativeDistance)
+{
+
+    // Find the closest point on the capsule segment to the circle center
+    const d2Vec2 p1 = capsuleShape->worldVertices[0];
+    const d2Vec2 p2 = capsuleShape->worldVertices[1];
+    const d2Vec2 center = circleShape->worldCenter;
+    const d2Vec2 e = p2 - p1;
+
+    real t = 0.0F;
+    const real ee = e.Dot(e);
+    if (ee > FLT_EPSILON) {
+        t = d2Clamp((center - p1).Dot(e) / ee, 0.0F, 1.0F);
+    }
+    const d2Vec2 closest = p1 + e * t;
+
+    // It is now a circle-circle test
+    const d2Vec2 d = center - closest;
+    const real maxDistance = capsuleShape->radius + circleShape->radius + speculativeDistance;
+    const real distanceSquared = d.LenghtSquared();
+    if (distanceSquared > maxDistance * maxDistance) {
+        return false;
+    }
+
+    const real distance = d2Sqrt(distanceSquared);
+    const d2Vec2 normal = distance > FLT_EPSILON ? d / distance : e.Normal();
+
+    AddContact(capsule, circle,
+               closest + normal * capsuleShape->radius,
+               center - normal * circleShape->radius,
+               normal, contacts);
+    return true;
+}
+
+bool
+d2CollisionDetection::IsCollidingCapsuleCapsule(d2Body *a, const d2CapsuleShape *aCapsuleShape,
+                                                d2Body *b, const d2CapsuleShape *bCapsuleShape,
+                                                std::vector<d2Contact> &contacts, real speculativeDistance)
+{
+
+    const d2Vec2 p1 = aCapsuleShape->worldVertices[0];
+    const d2Vec2 q1 = aCapsuleShape->worldVertices[1];
+    const d2Vec2 p2 = bCapsuleShape->worldVertices[0];
+    const d2Vec2 q2 = bCapsuleShape->worldVertices[1];
+    const real radiusA = aCapsuleShape->radius;
+    const real radiusB = bCapsuleShape->radius;
+    const real radius = radiusA + radiusB;
+    const real maxDistance = radius + speculativeDistance;
+
+    // Two segments have no area, so SAT on their normals misses the end caps. Use the closest points instead.
+    const d2SegmentDistance result = SegmentDistance(p1, q1, p2, q2);
+    if (result.distanceSquared > maxDistance * maxDistance) {
+        return false;
+    }
+    const real distance = d2Sqrt(result.distanceSquared);
+
+    const real length1 = (q1 - p1).Lenght();
+    const d2Vec2 u1 = length1 > FLT_EPSILON ? (q1 - p1) / length1 : d2Vec2(1.0F, 0.0F);
+    const d2Vec2 u2 = (q2 - p2).UnitVector();
+
+    // The side of "a" facing "b"
+    d2Vec2 normal(-u1.y, u1.x);
+    const d2Vec2 side = distance > FLT_EPSILON ? result.closest2 - result.closest1 : (p2 + q2) - (p1 + q1);
+    if (normal.Dot(side) < 0.0F) {
+        normal *= -1.0F;
+    }
+
+    // Roughly parallel and overlapping along "a" gives a two point manifold, so capsules can lie flat on each other
+    const real fp2 = (p2 - p1).Dot(u1);
+    const real fq2 = (q2 - p1).Dot(u1);
+    const bool outsideA = (fp2 <= 0.0F && fq2 <= 0.0F) || (fp2 >= length1 && fq2 >= length1);
+    const bool parallel = d2Abs(u1.Cross(u2)) < 0.1F;
+
+    if (parallel && !outsideA && d2Abs(fq2 - fp2) > FLT_EPSILON) {
+        bool isColliding = false;
+        for (const real limit: {0.0F, length1}) {
+            // Clip segment "b" to the extent of segment "a"
+            const real t = d2Clamp((limit - fp2) / (fq2 - fp2), 0.0F, 1.0F);
+            const d2Vec2 v = p2 + (q2 - p2) * t;
+            const real s = (v - p1).Dot(normal);
+            if (s > maxDistance) {
+                continue;
+            }
+
+            const d2Vec2 onA = p1 + u1 * d2Clamp((v - p1).Dot(u1), 0.0F, length1);
+            AddContact(a, b, onA + normal * radiusA, v - normal * radiusB, normal, contacts);
+            isColliding = true;
+        }
+        return isColliding;
+    }
+
+    if (distance > FLT_EPSILON) {
+        normal = (result.closest2 - result.closest1) / distance;
+    }
+    AddContact(a, b, result.closest1 + normal * radiusA, result.closest2 - normal * radiusB, normal, contacts);
+    return true;
+}
+
+bool
+d2CollisionDetection::IsCollidingPolygonCapsule(d2Body *polygon, const d2PolygonShape *polygonShape,
+                                                d2Body *capsule, const d2CapsuleShape *capsuleShape,
+                                                std::vector<d2Contact> &contacts, real speculativeDistance)
+{
+
+    return CollideRoundedPolygons(polygon, polygonShape->worldVertices, polygonShape->m_vertexCount, 0.0F,
+                                  capsule, capsuleShape->worldVertices, 2, capsuleShape->radius,
+                                  contacts, speculativeDistance);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Edges
+///////////////////////////////////////////////////////////////////////////////
+// One-sided edges only collide from the side their normal points to, and use
+// the ghost vertices of the neighbouring edges to reject the contacts that
+// belong to them. This removes ghost collisions at the seams of a chain.
+// See https://box2d.org/posts/2020/06/ghost-collisions/
+///////////////////////////////////////////////////////////////////////////////
+
+bool
+d2CollisionDetection::IsCollidingEdgeCircle(d2Body *edgeBody, const d2EdgeShape *edge,
+                                            d2Body *circle, const d2CircleShape *circleShape,
+                                            std::vector<d2Contact> &contacts, real speculativeDistance)
+{
+    const real radius = circleShape->radius;
+    const real maxDistance = radius + speculativeDistance;
+
+    const d2Vec2 Q = circleShape->worldCenter;
+    const d2Vec2 A = edge->worldVertices[1];
+    const d2Vec2 B = edge->worldVertices[2];
+    const d2Vec2 e = B - A;
+
+    // Normal points to the right for a CCW winding
+    d2Vec2 n(e.y, -e.x);
+    const real offset = n.Dot(Q - A);
+    if (edge->oneSided && offset < 0.0F) {
+        return false;
+    }
+
+    // Barycentric coordinates
+    const real u = e.Dot(B - Q);
+    const real v = e.Dot(Q - A);
+
+    d2Vec2 P;
+    if (v <= 0.0F) {
+        // Region A
+        P = A;
+
+        // Is the circle in Region AB of the previous edge?
+        if (edge->oneSided) {
+            const d2Vec2 e1 = A - edge->worldVertices[0];
+            if (e1.Dot(A - Q) > 0.0F) {
+                return false;
+            }
+        }
+    } else if (u <= 0.0F) {
+        // Region B
+        P = B;
+
+        // Is the circle in Region AB of the next edge?
+        if (edge->oneSided) {
+            const d2Vec2 e2 = edge->worldVertices[3] - B;
+            if (e2.Dot(Q - B) > 0.0F) {
+                return false;
+            }
+        }
+    } else {
+        // Region AB
+        P = (A * u + B * v) / e.Dot(e);
+    }
+
+    const d2Vec2 d = Q - P;
+    if (d.LenghtSquared() > maxDistance * maxDistance) {
+        return false;
+    }
+
+    d2Vec2 normal;
+    if (v > 0.0F && u > 0.0F) {
+        if (offset < 0.0F) {
+            n *= -1.0F;
+        }
+        normal = n.UnitVector();
+    } else {
+        normal = d.LenghtSquared() > FLT_EPSILON ? d.UnitVector() : n.UnitVector();
+    }
+
+    AddContact(edgeBody, circle, P, Q - normal * radius, normal, contacts);
+    return true;
+}
+
+// Keep the points of the segment on the back side of the plane dot(normal, p) = offset
+static int
+ClipSegment(const d2Vec2 vIn[2], d2Vec2 vOut[2], const d2Vec2 &normal, real offset)
+{
+    int count = 0;
+
+    const real distance0 = normal.Dot(vIn[0]) - offset;
+    const real distance1 = normal.Dot(vIn[1]) - offset;
+
+    if (distance0 <= 0.0F) vOut[count++] = vIn[0];
+    if (distance1 <= 0.0F) vOut[count++] = vIn[1];
+
+    // The points are on different sides of the plane
+    if (distance0 * distance1 < 0.0F) {
+        const real t = distance0 / (distance0 - distance1);
+        vOut[count++] = vIn[0] + (vIn[1] - vIn[0]) * t;
+    }
+    return count;
+}
+
+static bool
+CollideEdgeAndRoundedPolygon(d2Body *edgeBody, const d2EdgeShape *edge,
+                             d2Body *body, const d2Vec2 *vertices, int count, real radius,
+                             std::vector<d2Contact> &contacts, real speculativeDistance)
+{
+    const real maxDistance = radius + speculativeDistance;
+
+    const d2Vec2 v1 = edge->worldVertices[1];
+    const d2Vec2 v2 = edge->worldVertices[2];
+    const d2Vec2 edge1 = (v2 - v1).UnitVector();
+    const d2Vec2 normal1(edge1.y, -edge1.x);
+
+    d2Vec2 centroid;
+    for (int i = 0; i < count; ++i) {
+        centroid += vertices[i];
+    }
+    centroid /= (real) count;
+
+    // Behind a one-sided edge
+    if (edge->oneSided && normal1.Dot(centroid - v1) < 0.0F) {
+        return false;
+    }
+
+    struct Axis
+    {
+        d2Vec2 normal; // From the edge to the polygon
+        real separation;
+        int index;
+        bool isEdge;
+    };
+
+    // Separation along the edge normal, both sides for a two-sided edge
+    Axis edgeAxis{normal1, std::numeric_limits<real>::max(), -1, true};
+    for (int i = 0; i < count; ++i) {
+        edgeAxis.separation = d2Min(edgeAxis.separation, normal1.Dot(vertices[i] - v1));
+    }
+    if (!edge->oneSided) {
+        real separation = std::numeric_limits<real>::max();
+        for (int i = 0; i < count; ++i) {
+            separation = d2Min(separation, -normal1.Dot(vertices[i] - v1));
+        }
+        if (separation > edgeAxis.separation) {
+            edgeAxis.normal = normal1 * -1.0F;
+            edgeAxis.separation = separation;
+        }
+    }
+    if (edgeAxis.separation > maxDistance) {
+        return false;
+    }
+
+    // Separation along the polygon normals
+    Axis polygonAxis{d2Vec2(), std::numeric_limits<real>::lowest(), -1, false};
+    for (int i = 0; i < count; ++i) {
+        const d2Vec2 n = EdgeNormal(vertices, count, i);
+        const real separation = d2Min(n.Dot(v1 - vertices[i]), n.Dot(v2 - vertices[i]));
+        if (separation > polygonAxis.separation) {
+            polygonAxis.normal = n * -1.0F;
+            polygonAxis.separation = separation;
+            polygonAxis.index = i;
+        }
+    }
+    if (polygonAxis.separation > maxDistance) {
+        return false;
+    }
+
+    // Use hysteresis for jitter reduction, favouring the edge normal
+    Axis primaryAxis = edgeAxis;
+    if (polygonAxis.separation - radius > 0.98F * (edgeAxis.separation - radius) + 0.1F * LINEAR_SLOP) {
+        primaryAxis = polygonAxis;
+    }
+
+    if (edge->oneSided) {
+        // Check the Gauss map against the neighbouring edges
+        const d2Vec2 edge0 = (v1 - edge->worldVertices[0]).UnitVector();
+        const d2Vec2 normal0(edge0.y, -edge0.x);
+        const bool convex1 = edge0.Cross(edge1) >= 0.0F;
+
+        const d2Vec2 edge2 = (edge->worldVertices[3] - v2).UnitVector();
+        const d2Vec2 normal2(edge2.y, -edge2.x);
+        const bool convex2 = edge1.Cross(edge2) >= 0.0F;
+
+        const real sinTol = 0.1F;
+        const bool side1 = primaryAxis.normal.Dot(edge1) <= 0.0F;
+
+        if (side1) {
+            if (convex1) {
+                // The normal belongs to the previous edge, skip it
+                if (primaryAxis.normal.Cross(normal0) > sinTol) {
+                    return false;
+                }
+            } else {
+                // Snap to the edge normal
+                primaryAxis = edgeAxis;
+            }
+        } else {
+            if (convex2) {
+                // The normal belongs to the next edge, skip it
+                if (normal2.Cross(primaryAxis.normal) > sinTol) {
+                    return false;
+                }
+            } else {
+                // Snap to the edge normal
+                primaryAxis = edgeAxis;
+            }
+        }
+    }
+
+    // Reference face and incident points
+    d2Vec2 clipPoints[2];
+    d2Vec2 refV1, refV2, refNormal, sideNormal1, sideNormal2;
+    if (primaryAxis.isEdge) {
+        // Search for the polygon normal that is most anti-parallel to the edge normal
+        int bestIndex = 0;
+        real bestValue = std::numeric_limits<real>::max();
+        for (int i = 0; i < count; ++i) {
+            const real value = primaryAxis.normal.Dot(EdgeNormal(vertices, count, i));
+            if (value < bestValue) {
+                bestValue = value;
+                bestIndex = i;
+            }
+        }
+
+        clipPoints[0] = vertices[bestIndex];
+        clipPoints[1] = vertices[(bestIndex + 1) % count];
+
+        refV1 = v1;
+        refV2 = v2;
+        refNormal = primaryAxis.normal;
+        sideNormal1 = edge1 * -1.0F;
+        sideNormal2 = edge1;
+    } else {
+        clipPoints[0] = v2;
+        clipPoints[1] = v1;
+
+        refV1 = vertices[primaryAxis.index];
+        refV2 = vertices[(primaryAxis.index + 1) % count];
+        refNormal = primaryAxis.normal * -1.0F;
+
+        // CCW winding
+        sideNormal1 = d2Vec2(refNormal.y, -refNormal.x);
+        sideNormal2 = sideNormal1 * -1.0F;
+    }
+
+    // Clip the incident points against the side planes of the reference face
+    d2Vec2 clipPoints1[2];
+    d2Vec2 clipPoints2[2];
+    if (ClipSegment(clipPoints, clipPoints1, sideNormal1, sideNormal1.Dot(refV1)) < 2) {
+        return false;
+    }
+    if (ClipSegment(clipPoints1, clipPoints2, sideNormal2, sideNormal2.Dot(refV2)) < 2) {
+        return false;
+    }
+
+    bool isColliding = false;
+    for (const d2Vec2 &vClip: clipPoints2) {
+        const real separation = refNormal.Dot(vClip - refV1);
+        if (separation > maxDistance) {
+            continue;
+        }
+
+        if (primaryAxis.isEdge) {
+            // The clipped point lies on the polygon core
+            AddContact(edgeBody, body, vClip - refNormal * separation, vClip - refNormal * radius, refNormal, contacts);
+        } else {
+            // The clipped point lies on the edge
+            AddContact(edgeBody, body, vClip, vClip - refNormal * (separation - radius), refNormal * -1.0F, contacts);
+        }
+        isColliding = true;
+    }
+    return isColliding;
+}
+
+bool
+d2CollisionDetection::IsCollidingEdgePolygon(d2Body *edgeBody, const d2EdgeShape *edge,
+                                             d2Body *polygon, const d2PolygonShape *polygonShape,
+                                             std::vector<d2Contact> &contacts, real speculativeDistance)
+{
+
+    return CollideEdgeAndRoundedPolygon(edgeBody, edge,
+                                        polygon, polygonShape->worldVertices, polygonShape->m_vertexCount, 0.0F,
+                                        contacts, speculativeDistance);
+}
+
+bool
+d2CollisionDetection::IsCollidingEdgeCapsule(d2Body *edgeBody, const d2EdgeShape *edge,
+                                             d2Body *capsule, const d2CapsuleShape *capsuleShape,
+                                             std::vector<d2Contact> &contacts, real speculativeDistance)
+{
+
+    return CollideEdgeAndRoundedPolygon(edgeBody, edge,
+                                        capsule, capsuleShape->worldVertices, 2, capsuleShape->radius,
+                                        contacts, speculativeDistance);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Overlap tests
+///////////////////////////////////////////////////////////////////////////////
+
+// World space core of a convex shape, the shape is the core inflated by the radius
+static bool
+GetRoundedCore(const d2Shape *shape, const d2Vec2 *&vertices, int &count, real &radius)
+{
+    switch (shape->GetType()) {
+        case CIRCLE:
+            vertices = &((const d2CircleShape *) shape)->worldCenter;
+            count = 1;
+            radius = ((const d2CircleShape *) shape)->radius;
+            return true;
+        case POLYGON:
+        case BOX:
+            vertices = ((const d2PolygonShape *) shape)->worldVertices;
+            count = ((const d2PolygonShape *) shape)->m_vertexCount;
+            radius = 0.0F;
+            return true;
+        case CAPSULE:
+            vertices = ((const d2CapsuleShape *) shape)->worldVertices;
+            count = 2;
+            radius = ((const d2CapsuleShape *) shape)->radius;
+            return true;
+        case EDGE:
+            vertices = ((const d2EdgeShape *) shape)->worldVertices + 1;
+            count = 2;
+            radius = 0.0F;
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Is the point inside the counter-clockwise polygon?
+static bool
+ContainsPoint(const d2Vec2 *vertices, int count, const d2Vec2 &point)
+{
+    for (int i = 0; i < count; ++i) {
+        if ((point - vertices[i]).Dot(EdgeNormal(vertices, count, i)) > 0.0F) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool
+d2CollisionDetection::TestOverlap(const d2Body *a, int32 childA, const d2Body *b, int32 childB)
+{
+    d2EdgeShape chainEdgeA, chainEdgeB;
+    return TestOverlap(GetChildShape(a, childA, &chainEdgeA), GetChildShape(b, childB, &chainEdgeB));
+}
+
+bool
+d2CollisionDetection::TestOverlap(const d2Shape *shapeA, const d2Shape *shapeB)
+{
+    const d2Vec2 *verticesA, *verticesB;
+    int countA, countB;
+    real radiusA, radiusB;
+    if (!GetRoundedCore(shapeA, verticesA, countA, radiusA) || !GetRoundedCore(shapeB, verticesB, countB, radiusB)) {
+        return false;
+    }
+    const real radius = radiusA + radiusB;
+
+    // Separating axis on the edge normals of the cores, which rejects most pairs
+    int edge = 0;
+    const real separationA = countA > 1 ? FindMaxSeparation(edge, verticesA, countA, verticesB, countB) : std::numeric_limits<real>::lowest();
+    const real separationB = countB > 1 ? FindMaxSeparation(edge, verticesB, countB, verticesA, countA) : std::numeric_limits<real>::lowest();
+    if (separationA > radius || separationB > radius) {
+        return false;
+    }
+
+    // Without points, the edge normals are all the axes there are, so the cores overlap
+    if (countA > 1 && countB > 1 && separationA <= 0.0F && separationB <= 0.0F) {
+        return true;
+    }
+
+    // The edges of the cores within the radii, points and segments are their own single edge
+    const int edgeCountA = countA > 2 ? countA : 1;
+    const int edgeCountB = countB > 2 ? countB : 1;
+    for (int i = 0; i < edgeCountA; ++i) {
+        const d2Vec2 &p1 = verticesA[i];
+        const d2Vec2 &q1 = verticesA[(i + 1) % countA];
+        for (int j = 0; j < edgeCountB; ++j) {
+            const d2SegmentDistance result = SegmentDistance(p1, q1, verticesB[j], verticesB[(j + 1) % countB]);
+            if (result.distanceSquared <= radius * radius) {
+                return true;
+            }
+        }
+    }
+
+    // No edge is close enough, so a point core can still be inside a polygon
+    return (countA > 2 && ContainsPoint(verticesA, countA, verticesB[0])) ||
+           (countB > 2 && ContainsPoint(verticesB, countB, verticesA[0]));
+}
@@ -1,33 +1,41 @@
 #include "dura2d/d2Constraint.h"
+#include "dura2d/d2ConstraintSolver.h"
 
 #include <algorithm>
 
+d2Softness
+d2MakeSoftness(real hertz, real dampingRatio, real h)
+{
+    if (hertz == 0.0f) return d2Softness{ 0.0f, 1.0f, 0.0f };
+
+    // Implicit spring and damper, see Erin Catto's "Solver2D" soft step
+    const real omega = 2.0f * PI * hertz;
+    const real a1 = 2.0f * dampingRatio + h * omega;
+    const real a2 = h * omega * a1;
+    const real a3 = 1.0f / (1.0f + a2);
+    return d2Softness{ omega / a1, a2 * a3, a3 };
+}
+
 ///////////////////////////////////////////////////////////////////////////////
-// Mat6x6 with the all inverse mass and inverse I of m_bodiesList "a" and "b"
+// Diagonal of the Mat6x6 with the inverse mass and inverse I of m_bodiesList "a" and "b"
 ///////////////////////////////////////////////////////////////////////////////
-//  [ 1/ma  0     0     0     0     0    ]
-//  [ 0     1/ma  0     0     0     0    ]
-//  [ 0     0     1/Ia  0     0     0    ]
-//  [ 0     0     0     1/mb  0     0    ]
-//  [ 0     0     0     0     1/mb  0    ]
-//  [ 0     0     0     0     0     1/Ib ]
+//  [ 1/ma  1/ma  1/Ia  1/mb  1/mb  1/Ib ]
 ///////////////////////////////////////////////////////////////////////////////
-d2MatMN
+d2Vec<6>
 d2Constraint::GetInvM() const
 {
-    d2MatMN invM(6, 6);
-    invM.Zero();
-    invM.rows[0][0] = a->GetInvMass();
-    invM.rows[1][1] = a->GetInvMass();
-    invM.rows[2][2] = a->GetInvI();
-    invM.rows[3][3] = b->GetInvMass();
-    invM.rows[4][4] = b->GetInvMass();
-    invM.rows[5][5] = b->GetInvI();
+    d2Vec<6> invM;
+    invM[0] = a->GetInvMass();
+    invM[1] = a->GetInvMass();
+    invM[2] = a->GetInvI();
+    invM[3] = b->GetInvMass();
+    invM[4] = b->GetInvMass();
+    invM[5] = b->GetInvI();
     return invM;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-// d2VecN with the all linear and angular velocities of m_bodiesList "a" and "b"
+// d2Vec<6> with the all linear and angular velocities of m_bodiesList "a" and "b"
 ///////////////////////////////////////////////////////////////////////////////
 //  [ va.x ]
 //  [ va.y ]
@@ -36,11 +44,21 @@ d2Constraint::GetInvM() const
 //  [ vb.y ]
 //  [ ωb   ]
 ///////////////////////////////////////////////////////////////////////////////
-d2VecN
+d2Vec<6>
 d2Constraint::GetVelocities() const
 {
-    d2VecN V(6);
-    V.Zero();
+    d2Vec<6> V;
+    if (solverBodies) {
+        const d2SolverBody &sa = solverBodies[indexA];
+        const d2SolverBody &sb = solverBodies[indexB];
+        V[0] = sa.v.x;
+        V[1] = sa.v.y;
+        V[2] = sa.w;
+        V[3] = sb.v.x;
+        V[4] = sb.v.y;
+        V[5] = sb.w;
+        return V;
+    }
     V[0] = a->GetVelocity().x;
     V[1] = a->GetVelocity().y;
     V[2] = a->GetAngularVelocity();
@@ -50,101 +68,159 @@ d2Constraint::GetVelocities() const
     return V;
 }
 
-d2JointConstraint::d2JointConstraint() : d2Constraint(), jacobian(1, 6), cachedLambda(1), bias(0.0f)
-{
-    cachedLambda.Zero();
-}
-
-d2JointConstraint::d2JointConstraint(d2Body *a, d2Body *b, const d2Vec2 &anchorPoint)
-        : d2Constraint(), jacobian(1, 6), cachedLambda(1), bias(0.0f)
+///////////////////////////////////////////////////////////////////////////////
+// d2Vec<6> with the motion of m_bodiesList "a" and "b" since the step started
+///////////////////////////////////////////////////////////////////////////////
+//  [ Δpa.x ]
+//  [ Δpa.y ]
+//  [ Δθa   ]
+//  [ Δpb.x ]
+//  [ Δpb.y ]
+//  [ Δθb   ]
+///////////////////////////////////////////////////////////////////////////////
+d2Vec<6>
+d2Constraint::GetDeltaPositions() const
 {
-    this->a = a;
-    this->b = b;
-    this->aPoint = a->WorldSpaceToLocalSpace(anchorPoint);
-    this->bPoint = b->WorldSpaceToLocalSpace(anchorPoint);
-    cachedLambda.Zero();
+    d2Vec<6> dx;
+    dx.Zero();
+    if (solverBodies) {
+        const d2SolverBody &sa = solverBodies[indexA];
+        const d2SolverBody &sb = solverBodies[indexB];
+        dx[0] = sa.dp.x;
+        dx[1] = sa.dp.y;
+        dx[2] = sa.dq;
+        dx[3] = sb.dp.x;
+        dx[4] = sb.dp.y;
+        dx[5] = sb.dq;
+    }
+    return dx;
 }
 
 void
-d2JointConstraint::PreSolve(const real dt)
+d2Constraint::ApplyImpulses(const d2Vec<6> &impulses)
 {
-    // Get the anchor point position in world space
-    const d2Vec2 pa = a->LocalSpaceToWorldSpace(aPoint);
-    const d2Vec2 pb = b->LocalSpaceToWorldSpace(bPoint);
-
-    const d2Vec2 ra = pa - a->GetPosition();
-    const d2Vec2 rb = pb - b->GetPosition();
-
-    jacobian.Zero();
-
-    d2Vec2 J1 = (pa - pb) * 2.0;
-    jacobian.rows[0][0] = J1.x; // A linear velocity.x
-    jacobian.rows[0][1] = J1.y; // A linear velocity.y
-
-    real J2 = ra.Cross(pa - pb) * 2.0;
-    jacobian.rows[0][2] = J2;   // A angular velocity
-
-    d2Vec2 J3 = (pb - pa) * 2.0;
-    jacobian.rows[0][3] = J3.x; // B linear velocity.x
-    jacobian.rows[0][4] = J3.y; // B linear velocity.y
-
-    real J4 = rb.Cross(pb - pa) * 2.0;
-    jacobian.rows[0][5] = J4;   // B angular velocity
-
-    // Warm starting (apply cached lambda)
-    const d2MatMN Jt = jacobian.Transpose();
-    d2VecN impulses = Jt * cachedLambda;
+    if (solverBodies) {
+        // Index 0 is the shared static body, other workers may be reading it
+        if (indexA) {
+            d2SolverBody &sa = solverBodies[indexA];
+            sa.v += d2Vec2(impulses[0], impulses[1]) * sa.invMass;
+            sa.w += impulses[2] * sa.invI;
+        }
+        if (indexB) {
+            d2SolverBody &sb = solverBodies[indexB];
+            sb.v += d2Vec2(impulses[3], impulses[4]) * sb.invMass;
+            sb.w += impulses[5] * sb.invI;
+        }
+        return;
+    }
 
-    // Apply the impulses to both m_bodiesList
     a->ApplyImpulseLinear(d2Vec2(impulses[0], impulses[1])); // A linear impulse
     a->ApplyImpulseAngular(impulses[2]);                   // A angular impulse
     b->ApplyImpulseLinear(d2Vec2(impulses[3], impulses[4])); // B linear impulse
     b->ApplyImpulseAngular(impulses[5]);                   // B angular impulse
-
-    // Compute the bias term (baumgarte stabilization)
-    const real beta = 0.02f;
-    real C = (pb - pa).Dot(pb - pa);
-    C = d2Max<real>(0.0f, C - 0.01f);
-    bias = (beta / dt) * C;
 }
 
 void
-d2JointConstraint::Solve()
+d2Constraint::ApplyPositionImpulses(const d2Vec<6> &impulses)
 {
-    const d2VecN V = GetVelocities();
-    const d2MatMN invM = GetInvM();
-
-    const d2MatMN J = jacobian;
-    const d2MatMN Jt = jacobian.Transpose();
+    if (a->m_type != d2BodyType::d2_staticBody) {
+        a->Position() += d2Vec2(impulses[0], impulses[1]) * a->GetInvMass();
+        a->Rotation() += impulses[2] * a->GetInvI();
+    }
+    if (b->m_type != d2BodyType::d2_staticBody) {
+        b->Position() += d2Vec2(impulses[3], impulses[4]) * b->GetInvMass();
+        b->Rotation() += impulses[5] * b->GetInvI();
+    }
+}
 
-    // Compute lambda using Ax=b (Gauss-Seidel method) 
-    d2MatMN lhs = J * invM * Jt;  // A
-    d2VecN rhs = J * V * -1.0f;   // b
-    rhs[0] -= bias;
-    d2VecN lambda = d2MatMN::SolveGaussSeidel(lhs, rhs);
-    cachedLambda += lambda;
+void
+d2Constraint::GetVelocities(d2Vec2 &va, real &wa, d2Vec2 &vb, real &wb) const
+{
+    if (solverBodies) {
+        const d2SolverBody &sa = solverBodies[indexA];
+        const d2SolverBody &sb = solverBodies[indexB];
+        va = sa.v;
+        wa = sa.w;
+        vb = sb.v;
+        wb = sb.w;
+        return;
+    }
+    va = a->GetVelocity();
+    wa = a->GetAngularVelocity();
+    vb = b->GetVelocity();
+    wb = b->GetAngularVelocity();
+}
 
-    // Compute the impulses with both direction and magnitude
-    d2VecN impulses = Jt * lambda;
+void
+d2Constraint::SetVelocities(const d2Vec2 &va, real wa, const d2Vec2 &vb, real wb)
+{
+    if (solverBodies) {
+        if (indexA) {
+            solverBodies[indexA].v = va;
+            solverBodies[indexA].w = wa;
+        }
+        if (indexB) {
+            solverBodies[indexB].v = vb;
+            solverBodies[indexB].w = wb;
+        }
+        return;
+    }
+    if (a->m_type != d2BodyType::d2_staticBody) {
+        a->Velocity() = va;
+        a->AngularVelocity() = wa;
+    }
+    if (b->m_type != d2BodyType::d2_staticBody) {
+        b->Velocity() = vb;
+        b->AngularVelocity() = wb;
+    }
+}
 
-    // Apply the impulses to both m_bodiesList
-    a->ApplyImpulseLinear(d2Vec2(impulses[0], impulses[1])); // A linear impulse
-    a->ApplyImpulseAngular(impulses[2]);                   // A angular impulse
-    b->ApplyImpulseLinear(d2Vec2(impulses[3], impulses[4])); // B linear impulse
-    b->ApplyImpulseAngular(impulses[5]);                   // B angular impulse
+void
+d2Constraint::GetDeltaPositions(d2Vec2 &dpa, real &dqa, d2Vec2 &dpb, real &dqb) const
+{
+    if (solverBodies) {
+        const d2SolverBody &sa = solverBodies[indexA];
+        const d2SolverBody &sb = solverBodies[indexB];
+        dpa = sa.dp;
+        dqa = sa.dq;
+        dpb = sb.dp;
+        dqb = sb.dq;
+        return;
+    }
+    dpa = dpb = d2Vec2(0.0f, 0.0f);
+    dqa = dqb = 0.0f;
 }
 
 void
-d2JointConstraint::PostSolve()
+d2Constraint::ApplyPositionImpulse(const d2Vec2 &P, real angularA, real angularB)
 {
-    // Limit the warm starting to reasonable limits
-    cachedLambda[0] = d2Clamp<real>(cachedLambda[0], -10000.0f, 10000.0f);
+    if (a->m_type != d2BodyType::d2_staticBody) {
+        a->Position() -= P * a->GetInvMass();
+        a->Rotation() += -a->GetInvI() * angularA;
+    }
+    if (b->m_type != d2BodyType::d2_staticBody) {
+        b->Position() += P * b->GetInvMass();
+        b->Rotation() += b->GetInvI() * angularB;
+    }
 }
 
-d2PenetrationConstraint::d2PenetrationConstraint() : d2Constraint(), jacobian(2, 6), cachedLambda(2), bias(0.0f)
+// Effective mass of a single row, 1 / (J * M^-1 * Jt). M^-1 is diagonal, so it is a weighted
+// dot product. Zero when neither body can move along the row.
+static real
+GetEffectiveMass(const d2Vec<6> &J, const d2Vec<6> &invM)
+{
+    real k = 0.0f;
+    for (int i = 0; i < 6; ++i) {
+        k += J[i] * J[i] * invM[i];
+    }
+    return d2Invert(k);
+}
+
+d2PenetrationConstraint::d2PenetrationConstraint() : d2Constraint(), bias(0.0f)
 {
-    cachedLambda.Zero();
     friction = 0.0f;
+    restitution = 0.0f;
+    relativeVelocity = 0.0f;
 }
 
 d2PenetrationConstraint::d2PenetrationConstraint(d2Body *a,
@@ -152,15 +228,16 @@ d2PenetrationConstraint::d2PenetrationConstraint(d2Body *a,
                                                  const d2Vec2 &aCollisionPoint,
                                                  const d2Vec2 &bCollisionPoint,
                                                  const d2Vec2 &normal)
-        : d2Constraint(), jacobian(2, 6), cachedLambda(2), bias(0.0f)
+        : d2Constraint(), bias(0.0f)
 {
     this->a = a;
     this->b = b;
     this->aPoint = a->WorldSpaceToLocalSpace(aCollisionPoint);
     this->bPoint = b->WorldSpaceToLocalSpace(bCollisionPoint);
     this->normal = a->WorldSpaceToLocalSpace(normal);
-    cachedLambda.Zero();
     friction = 0.0f;
+    restitution = 0.0f;
+    relativeVelocity = 0.0f;
 }
 
 void
@@ -171,8 +248,11 @@ d2PenetrationConstraint::PreSolve(const real dt)
     const d2Vec2 pb = b->LocalSpaceToWorldSpace(bPoint);
     d2Vec2 n = a->LocalSpaceToWorldSpace(normal);
 
-    const d2Vec2 ra = pa - a->GetPosition();
-    const d2Vec2 rb = pb - b->GetPosition();
+    // Both bodies are pushed at the middle of the contact, which matters once the points
+    // are apart, as in speculative contacts
+    const d2Vec2 anchor = (pa + pb) * 0.5f;
+    const d2Vec2 ra = anchor - a->GetPosition();
+    const d2Vec2 rb = anchor - b->GetPosition();
 
     jacobian.Zero();
 
@@ -196,64 +276,66 @@ d2PenetrationConstraint::PreSolve(const real dt)
         jacobian.rows[1][5] = rb.Cross(t);   // B angular velocity
     }
 
+    const d2Vec<6> invM = GetInvM();
+    effectiveMass[0] = GetEffectiveMass(jacobian.rows[0], invM);
+    effectiveMass[1] = GetEffectiveMass(jacobian.rows[1], invM);
+
+    // Approach velocity before the solve, bounced back by PostSolve()
+    restitution = std::max(a->GetRestitution(), b->GetRestitution());
+    relativeVelocity = jacobian.rows[0].Dot(GetVelocities());
+
     // Warm starting (apply cached lambda)
-    const d2MatMN Jt = jacobian.Transpose();
-    d2VecN impulses = Jt * cachedLambda;
+    ApplyImpulses(jacobian.TransposeMultiply(cachedLambda));
 
-    // Apply the impulses to both m_bodiesList
-    a->ApplyImpulseLinear(d2Vec2(impulses[0], impulses[1])); // A linear impulse
-    a->ApplyImpulseAngular(impulses[2]);                   // A angular impulse
-    b->ApplyImpulseLinear(d2Vec2(impulses[3], impulses[4])); // B linear impulse
-    b->ApplyImpulseAngular(impulses[5]);                   // B angular impulse
+    real C = (pb - pa).Dot(-n);
+    if (C > 0.0f) {
+        // Speculative contact, the bodies are still apart and may close the gap in this step,
+        // but not go past it
+        bias = C / dt;
+        return;
+    }
 
     // Compute the bias term (baumgarte stabilization)
     const real beta = 1.0f;
-    real C = (pb - pa).Dot(-n);
     C = d2Min<real>(0.0f, C + 0.01f);
     bias = (beta / dt) * C;
 }
 
-void
+real
 d2PenetrationConstraint::Solve()
 {
-    // check awake state
-    const d2VecN V = GetVelocities();
-    const d2MatMN invM = GetInvM();
-
-    const d2MatMN J = jacobian;
-    const d2MatMN Jt = jacobian.Transpose();
-
-    // Compute lambda using Ax=b (Gauss-Seidel method) 
-    d2MatMN lhs = J * invM * Jt;  // A
-    d2VecN rhs = J * V * -1.0f;   // b
-    rhs[0] -= bias;
-    d2VecN lambda = d2MatMN::SolveGaussSeidel(lhs, rhs);
+    // Both rows see the same velocities and are solved in closed form:
+    // lambda = -(J * V + bias) / (J * M^-1 * Jt)
+    const d2Vec<6> V = GetVelocities();
+    real lambda = -effectiveMass[0] * (jacobian.rows[0].Dot(V) + bias);
 
     // Accumulate impulses and clamp it within constraint limits
-    d2VecN oldLambda = cachedLambda;
-    cachedLambda += lambda;
-    cachedLambda[0] = (cachedLambda[0] < 0.0f) ? 0.0f : cachedLambda[0];
+    real oldLambda = cachedLambda[0];
+    cachedLambda[0] = d2Max(oldLambda + lambda, 0.0f);
+    ApplyImpulses(jacobian.rows[0] * (cachedLambda[0] - oldLambda));
+    real change = d2Abs(cachedLambda[0] - oldLambda);
 
     // Keep friction values between -(λn*µ) and (λn*µ)
     if (friction > 0.0) {
+        lambda = -effectiveMass[1] * jacobian.rows[1].Dot(V);
+
         const real maxFriction = cachedLambda[0] * friction;
-        cachedLambda[1] = std::clamp(cachedLambda[1], -maxFriction, maxFriction);
+        oldLambda = cachedLambda[1];
+        cachedLambda[1] = std::clamp(oldLambda + lambda, -maxFriction, maxFriction);
+        ApplyImpulses(jacobian.rows[1] * (cachedLambda[1] - oldLambda));
+        change += d2Abs(cachedLambda[1] - oldLambda);
     }
-
-    lambda = cachedLambda - oldLambda;
-
-    // Compute the impulses with both direction and magnitude
-    d2VecN impulses = Jt * lambda;
-
-    // Apply the impulses to both m_bodiesList
-    a->ApplyImpulseLinear(d2Vec2(impulses[0], impulses[1])); // A linear impulse
-    a->ApplyImpulseAngular(impulses[2]);                   // A angular impulse
-    b->ApplyImpulseLinear(d2Vec2(impulses[3], impulses[4])); // B linear impulse
-    b->ApplyImpulseAngular(impulses[5]);                   // B angular impulse
+    return change;
 }
 
 void
 d2PenetrationConstraint::PostSolve()
 {
+    // Contacts that approached fast enough and pushed leave with their approach velocity scaled back
+    if (relativeVelocity > -RESTITUTION_THRESHOLD || cachedLambda[0] <= 0.0f) return;
 
+    const real lambda = -effectiveMass[0] * (jacobian.rows[0].Dot(GetVelocities()) + restitution * relativeVelocity);
+    const real oldLambda = cachedLambda[0];
+    cachedLambda[0] = d2Max(oldLambda + lambda, 0.0f);
+    ApplyImpulses(jacobian.rows[0] * (cachedLambda[0] - oldLambda));
 }
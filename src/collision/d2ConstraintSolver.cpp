@@ -0,0 +1,968 @@
+#include "dura2d/d2ConstraintSolver.h"
+
+#include "dura2d/d2Body.h"
+#include "dura2d/d2Constants.h"
+#include "dura2d/d2Constraint.h"
+#include "dura2d/d2ThreadPool.h"
+
+#include <bit>
+
+///////////////////////////////////////////////////////////////////////////////
+// Wide floats
+///////////////////////////////////////////////////////////////////////////////
+// D2_SIMD_WIDTH floats processed at once: AVX when the library is built with
+// it, SSE2 on any x86-64 target and plain loops everywhere else.
+///////////////////////////////////////////////////////////////////////////////
+#if defined(__AVX__)
+
+#include <immintrin.h>
+
+typedef __m256 d2FloatW;
+
+static inline d2FloatW d2LoadW(const real *p) { return _mm256_load_ps(p); }
+static inline void d2StoreW(real *p, d2FloatW a) { _mm256_store_ps(p, a); }
+static inline d2FloatW d2SplatW(real s) { return _mm256_set1_ps(s); }
+static inline d2FloatW d2AddW(d2FloatW a, d2FloatW b) { return _mm256_add_ps(a, b); }
+static inline d2FloatW d2SubW(d2FloatW a, d2FloatW b) { return _mm256_sub_ps(a, b); }
+static inline d2FloatW d2MulW(d2FloatW a, d2FloatW b) { return _mm256_mul_ps(a, b); }
+static inline d2FloatW d2MinW(d2FloatW a, d2FloatW b) { return _mm256_min_ps(a, b); }
+static inline d2FloatW d2MaxW(d2FloatW a, d2FloatW b) { return _mm256_max_ps(a, b); }
+static inline d2FloatW d2GreaterW(d2FloatW a, d2FloatW b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+static inline d2FloatW d2SelectW(d2FloatW mask, d2FloatW a, d2FloatW b) { return _mm256_blendv_ps(b, a, mask); }
+static inline d2FloatW d2OrW(d2FloatW a, d2FloatW b) { return _mm256_or_ps(a, b); }
+
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+
+#include <emmintrin.h>
+
+typedef __m128 d2FloatW;
+
+static inline d2FloatW d2LoadW(const real *p) { return _mm_load_ps(p); }
+static inline void d2StoreW(real *p, d2FloatW a) { _mm_store_ps(p, a); }
+static inline d2FloatW d2SplatW(real s) { return _mm_set1_ps(s); }
+static inline d2FloatW d2AddW(d2FloatW a, d2FloatW b) { return _mm_add_ps(a, b); }
+static inline d2FloatW d2SubW(d2FloatW a, d2FloatW b) { return _mm_sub_ps(a, b); }
+static inline d2FloatW d2MulW(d2FloatW a, d2FloatW b) { return _mm_mul_ps(a, b); }
+static inline d2FloatW d2MinW(d2FloatW a, d2FloatW b) { return _mm_min_ps(a, b); }
+static inline d2FloatW d2MaxW(d2FloatW a, d2FloatW b) { return _mm_max_ps(a, b); }
+static inline d2FloatW d2GreaterW(d2FloatW a, d2FloatW b) { return _mm_cmpgt_ps(a, b); }
+static inline d2FloatW d2SelectW(d2FloatW mask, d2FloatW a, d2FloatW b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+static inline d2FloatW d2OrW(d2FloatW a, d2FloatW b) { return _mm_or_ps(a, b); }
+
+#else
+
+struct d2FloatW
+{
+    real v[D2_SIMD_WIDTH];
+};
+
+static inline d2FloatW d2LoadW(const real *p) { d2FloatW r; for (int i = 0; i < D2_SIMD_WIDTH; ++i) r.v[i] = p[i]; return r; }
+static inline void d2StoreW(real *p, d2FloatW a) { for (int i = 0; i < D2_SIMD_WIDTH; ++i) p[i] = a.v[i]; }
+static inline d2FloatW d2SplatW(real s) { d2FloatW r; for (int i = 0; i < D2_SIMD_WIDTH; ++i) r.v[i] = s; return r; }
+static inline d2FloatW d2AddW(d2FloatW a, d2FloatW b) { for (int i = 0; i < D2_SIMD_WIDTH; ++i) a.v[i] += b.v[i]; return a; }
+static inline d2FloatW d2SubW(d2FloatW a, d2FloatW b) { for (int i = 0; i < D2_SIMD_WIDTH; ++i) a.v[i] -= b.v[i]; return a; }
+static inline d2FloatW d2MulW(d2FloatW a, d2FloatW b) { for (int i = 0; i < D2_SIMD_WIDTH; ++i) a.v[i] *= b.v[i]; return a; }
+static inline d2FloatW d2MinW(d2FloatW a, d2FloatW b) { for (int i = 0; i < D2_SIMD_WIDTH; ++i) a.v[i] = d2Min(a.v[i], b.v[i]); return a; }
+static inline d2FloatW d2MaxW(d2FloatW a, d2FloatW b) { for (int i = 0; i < D2_SIMD_WIDTH; ++i) a.v[i] = d2Max(a.v[i], b.v[i]); return a; }
+static inline d2FloatW d2GreaterW(d2FloatW a, d2FloatW b) { for (int i = 0; i < D2_SIMD_WIDTH; ++i) a.v[i] = a.v[i] > b.v[i] ? 1.0f : 0.0f; return a; }
+static inline d2FloatW d2SelectW(d2FloatW mask, d2FloatW a, d2FloatW b) { for (int i = 0; i < D2_SIMD_WIDTH; ++i) a.v[i] = mask.v[i] != 0.0f ? a.v[i] : b.v[i]; return a; }
+static inline d2FloatW d2OrW(d2FloatW a, d2FloatW b) { for (int i = 0; i < D2_SIMD_WIDTH; ++i) a.v[i] = a.v[i] != 0.0f || b.v[i] != 0.0f ? 1.0f : 0.0f; return a; }
+
+#endif
+
+// Effective mass of a row from its lever arm terms, 1 / (J * M^-1 * Jt) for a unit direction
+static real
+GetEffectiveMass(real invMassA, real invIA, real raCross, real invMassB, real invIB, real rbCross)
+{
+    const real k = invMassA + invIA * raCross * raCross + invMassB + invIB * rbCross * rbCross;
+    return k > 0.0f ? 1.0f / k : 0.0f;
+}
+
+// Fill a point of a lane with a contact, same Jacobian and bias as d2PenetrationConstraint
+static void
+PreparePoint(d2ContactBatch &batch, d2ContactBatchPoint &point, int32 lane, const d2Contact &contact, real dt,
+             bool baumgarte)
+{
+    const d2Body *a = contact.a;
+    const d2Body *b = contact.b;
+    const d2Vec2 n = contact.normal;
+    const d2Vec2 t = n.Normal();
+
+    // Both bodies are pushed at the middle of the contact
+    const d2Vec2 anchor = (contact.start + contact.end) * 0.5f;
+    const d2Vec2 ra = anchor - a->GetPosition();
+    const d2Vec2 rb = anchor - b->GetPosition();
+
+    point.raCrossN[lane] = ra.Cross(n);
+    point.rbCrossN[lane] = rb.Cross(n);
+    point.raCrossT[lane] = ra.Cross(t);
+    point.rbCrossT[lane] = rb.Cross(t);
+
+    point.normalMass[lane] = GetEffectiveMass(batch.invMassA[lane], batch.invIA[lane], point.raCrossN[lane],
+                                              batch.invMassB[lane], batch.invIB[lane], point.rbCrossN[lane]);
+    point.tangentMass[lane] = batch.friction[lane] > 0.0f
+                              ? GetEffectiveMass(batch.invMassA[lane], batch.invIA[lane], point.raCrossT[lane],
+                                                 batch.invMassB[lane], batch.invIB[lane], point.rbCrossT[lane])
+                              : 0.0f;
+
+    // Speculative contacts may close their gap in this step, touching ones are pushed apart
+    real C = (contact.end - contact.start).Dot(n * -1.0f);
+    point.separation[lane] = C;
+    if (C > 0.0f) {
+        point.bias[lane] = C / dt;
+    } else if (!baumgarte) {
+        point.bias[lane] = 0.0f;
+    } else {
+        C = d2Min<real>(0.0f, C + LINEAR_SLOP);
+        point.bias[lane] = C / dt;
+    }
+
+    // Approach velocity before the solve, restitution scales it back once the contact pushed
+    const real vn = (b->GetVelocity() - a->GetVelocity()).Dot(n) + point.rbCrossN[lane] * b->GetAngularVelocity()
+                    - point.raCrossN[lane] * a->GetAngularVelocity();
+    point.relativeVelocity[lane] = vn;
+    point.maxNormalImpulse[lane] = 0.0f;
+
+    point.normalImpulse[lane] = 0.0f;
+    point.tangentImpulse[lane] = 0.0f;
+}
+
+// A missing point has no lever arms and no mass, so it solves to zero
+static void
+ClearPoint(d2ContactBatchPoint &point, int32 lane)
+{
+    point.raCrossN[lane] = point.rbCrossN[lane] = point.raCrossT[lane] = point.rbCrossT[lane] = 0.0f;
+    point.normalMass[lane] = point.tangentMass[lane] = 0.0f;
+    point.bias[lane] = point.separation[lane] = 0.0f;
+    point.relativeVelocity[lane] = point.maxNormalImpulse[lane] = 0.0f;
+    point.normalImpulse[lane] = point.tangentImpulse[lane] = 0.0f;
+}
+
+// Fill a lane with the one or two contacts of a manifold
+static void
+PrepareLane(d2ContactBatch &batch, int32 lane, const d2Contact *contacts, int32 pointCount, int32 indexA,
+            int32 indexB, real dt, bool baumgarte)
+{
+    const d2Body *a = contacts[0].a;
+    const d2Body *b = contacts[0].b;
+
+    batch.indexA[lane] = indexA;
+    batch.indexB[lane] = indexB;
+    batch.pointCount[lane] = pointCount;
+    batch.invMassA[lane] = a->GetInvMass();
+    batch.invIA[lane] = a->GetInvI();
+    batch.invMassB[lane] = b->GetInvMass();
+    batch.invIB[lane] = b->GetInvI();
+
+    batch.normalX[lane] = contacts[0].normal.x;
+    batch.normalY[lane] = contacts[0].normal.y;
+    batch.friction[lane] = d2Max(a->GetFriction(), b->GetFriction());
+    batch.restitution[lane] = d2Max(a->GetRestitution(), b->GetRestitution());
+
+    PreparePoint(batch, batch.points[0], lane, contacts[0], dt, baumgarte);
+    if (pointCount > 1) {
+        PreparePoint(batch, batch.points[1], lane, contacts[1], dt, baumgarte);
+    } else {
+        ClearPoint(batch.points[1], lane);
+    }
+
+    batch.k11[lane] = batch.k12[lane] = batch.k22[lane] = 0.0f;
+    batch.blockMass11[lane] = batch.blockMass12[lane] = batch.blockMass22[lane] = 0.0f;
+    if (pointCount < 2) return;
+
+    // Both normal rows share the normal, K couples them through the rotations
+    const d2ContactBatchPoint &p1 = batch.points[0];
+    const d2ContactBatchPoint &p2 = batch.points[1];
+    const real invMass = batch.invMassA[lane] + batch.invMassB[lane];
+    const real invIA = batch.invIA[lane], invIB = batch.invIB[lane];
+    const real k11 = invMass + invIA * p1.raCrossN[lane] * p1.raCrossN[lane] + invIB * p1.rbCrossN[lane] * p1.rbCrossN[lane];
+    const real k22 = invMass + invIA * p2.raCrossN[lane] * p2.raCrossN[lane] + invIB * p2.rbCrossN[lane] * p2.rbCrossN[lane];
+    const real k12 = invMass + invIA * p1.raCrossN[lane] * p2.raCrossN[lane] + invIB * p1.rbCrossN[lane] * p2.rbCrossN[lane];
+
+    // Nearly parallel rows make K close to singular, those points are solved one by one
+    const real det = k11 * k22 - k12 * k12;
+    if (k11 * k11 >= BLOCK_SOLVER_MAX_CONDITION * det) return;
+
+    batch.k11[lane] = k11;
+    batch.k12[lane] = k12;
+    batch.k22[lane] = k22;
+    batch.blockMass11[lane] = k22 / det;
+    batch.blockMass12[lane] = -k12 / det;
+    batch.blockMass22[lane] = k11 / det;
+}
+
+// Unused lanes point at the static solver body and carry no mass, so they solve to zero
+static void
+ClearLane(d2ContactBatch &batch, int32 lane)
+{
+    batch.indexA[lane] = 0;
+    batch.indexB[lane] = 0;
+    batch.pointCount[lane] = 0;
+    batch.invMassA[lane] = batch.invIA[lane] = batch.invMassB[lane] = batch.invIB[lane] = 0.0f;
+    batch.normalX[lane] = batch.normalY[lane] = 0.0f;
+    batch.friction[lane] = batch.restitution[lane] = 0.0f;
+    batch.k11[lane] = batch.k12[lane] = batch.k22[lane] = 0.0f;
+    batch.blockMass11[lane] = batch.blockMass12[lane] = batch.blockMass22[lane] = 0.0f;
+    batch.biasRate[lane] = batch.massScale[lane] = batch.impulseScale[lane] = 0.0f;
+    ClearPoint(batch.points[0], lane);
+    ClearPoint(batch.points[1], lane);
+}
+
+d2ConstraintSolver::d2ConstraintSolver(d2ThreadPool *threadPool)
+        : m_threadPool(threadPool), m_maxColorCount(SOLVER_GRAPH_COLOR_COUNT)
+{
+    m_workerIterations.resize(1);
+}
+
+// Impulse change of one joint or contact point, summed over its rows
+static inline void
+AddImpulse(d2SolverIteration &iteration, real impulse)
+{
+    iteration.maxImpulse = d2Max(iteration.maxImpulse, impulse);
+    iteration.totalImpulse += impulse;
+}
+
+void
+d2ConstraintSolver::SetColorCount(int32 colorCount)
+{
+    // The colors of a body are kept in a 32 bit mask
+    m_maxColorCount = d2Clamp<int32>(colorCount, 0, 32);
+}
+
+int32
+d2ConstraintSolver::AddBody(d2Body *body)
+{
+    // All the static bodies share index 0
+    if (body->GetType() == d2BodyType::d2_staticBody) return 0;
+    if (body->m_solverIndex < 0) {
+        body->m_solverIndex = (int32)m_bodies.size();
+        m_bodies.push_back(body);
+        m_solverBodies.push_back(d2SolverBody{ d2Vec2(0.0f, 0.0f), 0.0f, d2Vec2(0.0f, 0.0f), 0.0f,
+                                               body->GetInvMass(), body->GetInvI() });
+        m_bodyColors.push_back(0);
+    }
+    return body->m_solverIndex;
+}
+
+int32
+d2ConstraintSolver::AssignColor(int32 indexA, int32 indexB)
+{
+    // Greedy coloring, the first color free on both dynamic bodies. The static body is shared
+    // by every color since it is never written.
+    const uint32 used = (indexA ? m_bodyColors[indexA] : 0) | (indexB ? m_bodyColors[indexB] : 0);
+    const int32 color = d2Min<int32>(std::countr_one(used), m_maxColorCount);
+    if (color < m_maxColorCount) {
+        if (indexA) m_bodyColors[indexA] |= 1u << color;
+        if (indexB) m_bodyColors[indexB] |= 1u << color;
+    }
+    return color;
+}
+
+void
+d2ConstraintSolver::Prepare(const d2Contact *contacts, int32 contactCount, d2Constraint *const *joints,
+                            int32 jointCount, real dt)
+{
+    m_dt = dt;
+
+    // The worker count of the pool can change between steps
+    m_workerIterations.resize(m_threadPool ? m_threadPool->GetWorkerCount() : 1);
+
+    // Static bodies keep index 0, other solvers may be reading it
+    m_bodies.assign(1, nullptr);
+    m_solverBodies.assign(1, d2SolverBody{ d2Vec2(0.0f, 0.0f), 0.0f, d2Vec2(0.0f, 0.0f), 0.0f, 0.0f, 0.0f });
+    m_bodyColors.assign(1, 0);
+    auto resetIndex = [](d2Body *body)
+    {
+        if (body->GetType() != d2BodyType::d2_staticBody) body->m_solverIndex = -1;
+    };
+    for (int32 i = 0; i < contactCount; ++i) {
+        resetIndex(contacts[i].a);
+        resetIndex(contacts[i].b);
+    }
+    for (int32 i = 0; i < jointCount; ++i) {
+        resetIndex(joints[i]->a);
+        resetIndex(joints[i]->b);
+    }
+
+    m_colorContacts.resize(m_maxColorCount + 1);
+    m_colorJoints.resize(m_maxColorCount + 1);
+    for (int32 color = 0; color <= m_maxColorCount; ++color) {
+        m_colorContacts[color].clear();
+        m_colorJoints[color].clear();
+    }
+
+    // Joints first, they last for many steps and keep the same colors while the contacts change
+    for (int32 i = 0; i < jointCount; ++i) {
+        joints[i]->indexA = AddBody(joints[i]->a);
+        joints[i]->indexB = AddBody(joints[i]->b);
+        m_colorJoints[AssignColor(joints[i]->indexA, joints[i]->indexB)].push_back(joints[i]);
+    }
+
+    // Consecutive contacts between the same two shapes are the points of one manifold
+    m_manifolds.clear();
+    for (int32 i = 0; i < contactCount; ++i) {
+        const d2Contact &contact = contacts[i];
+        const bool samePair = i > 0 && m_manifolds.back() == i - 1 && contacts[i - 1].a == contact.a &&
+                              contacts[i - 1].b == contact.b && contacts[i - 1].childA == contact.childA &&
+                              contacts[i - 1].childB == contact.childB;
+        if (!samePair) m_manifolds.push_back(i);
+    }
+    const int32 manifoldCount = (int32)m_manifolds.size();
+    m_manifolds.push_back(contactCount);
+
+    std::vector<int32> &indices = m_manifoldBodies;
+    indices.resize(2 * manifoldCount);
+    for (int32 i = 0; i < manifoldCount; ++i) {
+        const d2Contact &contact = contacts[m_manifolds[i]];
+        const int32 indexA = AddBody(contact.a);
+        const int32 indexB = AddBody(contact.b);
+        indices[2 * i] = indexA;
+        indices[2 * i + 1] = indexB;
+        m_colorContacts[AssignColor(indexA, indexB)].push_back(i);
+    }
+
+    // Pack the colors in batches, the overflow goes last
+    m_colors.clear();
+    m_batches.clear();
+    m_joints.clear();
+    for (int32 color = 0; color <= m_maxColorCount; ++color) {
+        const std::vector<int32> &colorContacts = m_colorContacts[color];
+        const std::vector<d2Constraint*> &colorJoints = m_colorJoints[color];
+        if (colorContacts.empty() && colorJoints.empty() && color < m_maxColorCount) continue;
+
+        d2SolverColor &solverColor = m_colors.emplace_back();
+        solverColor.batchStart = (int32)m_batches.size();
+        solverColor.jointStart = (int32)m_joints.size();
+
+        const int32 count = (int32)colorContacts.size();
+        for (int32 first = 0; first < count; first += D2_SIMD_WIDTH) {
+            d2ContactBatch &batch = m_batches.emplace_back();
+            for (int32 lane = 0; lane < D2_SIMD_WIDTH; ++lane) {
+                if (first + lane < count) {
+                    const int32 i = colorContacts[first + lane];
+                    const int32 pointCount = m_manifolds[i + 1] - m_manifolds[i];
+                    PrepareLane(batch, lane, contacts + m_manifolds[i], pointCount, indices[2 * i],
+                                indices[2 * i + 1], dt, m_baumgarte);
+                } else {
+                    ClearLane(batch, lane);
+                }
+            }
+        }
+        m_joints.insert(m_joints.end(), colorJoints.begin(), colorJoints.end());
+
+        solverColor.batchCount = (int32)m_batches.size() - solverColor.batchStart;
+        solverColor.jointCount = (int32)m_joints.size() - solverColor.jointStart;
+    }
+    m_overflowCount = (int32)m_colorJoints[m_maxColorCount].size();
+    for (int32 i: m_colorContacts[m_maxColorCount]) {
+        m_overflowCount += m_manifolds[i + 1] - m_manifolds[i];
+    }
+}
+
+void
+d2ConstraintSolver::LoadVelocities()
+{
+    for (size_t i = 1; i < m_bodies.size(); ++i) {
+        m_solverBodies[i].v = m_bodies[i]->GetVelocity();
+        m_solverBodies[i].w = m_bodies[i]->GetAngularVelocity();
+        m_solverBodies[i].dp = d2Vec2(0.0f, 0.0f);
+        m_solverBodies[i].dq = 0.0f;
+    }
+
+    // The joints solve against the solver bodies as well
+    for (d2Constraint *joint: m_joints) {
+        joint->solverBodies = m_solverBodies.data();
+    }
+}
+
+void
+d2ConstraintSolver::StoreVelocities()
+{
+    for (size_t i = 1; i < m_bodies.size(); ++i) {
+        m_bodies[i]->Velocity() = m_solverBodies[i].v;
+        m_bodies[i]->AngularVelocity() = m_solverBodies[i].w;
+    }
+
+    for (d2Constraint *joint: m_joints) {
+        joint->solverBodies = nullptr;
+    }
+}
+
+void
+d2ConstraintSolver::Solve(int32 iterations)
+{
+    if (m_colors.empty()) return;
+
+    LoadVelocities();
+
+    m_iterations.clear();
+    for (int32 i = 0; i < iterations; ++i) {
+        SolveColors(d2_solveStage);
+
+        // Converged once nothing moves by more than the tolerance
+        if (m_iterations.back().maxImpulse < m_tolerance) break;
+    }
+    SolveColors(d2_restitutionStage);
+
+    StoreVelocities();
+}
+
+void
+d2ConstraintSolver::SolveSoft(int32 subStepCount, real contactHertz, real contactDampingRatio)
+{
+    if (m_colors.empty()) return;
+
+    subStepCount = d2Max<int32>(subStepCount, 1);
+    const real h = m_dt / (real)subStepCount;
+    m_invH = h > 0.0f ? 1.0f / h : 0.0f;
+
+    // Take the forces out of the velocities, they are added back a sub-step at a time
+    LoadVelocities();
+    for (size_t i = 1; i < m_bodies.size(); ++i) {
+        m_solverBodies[i].v -= m_bodies[i]->Acceleration() * m_dt;
+        m_solverBodies[i].w -= m_bodies[i]->AngularAcceleration() * m_dt;
+    }
+
+    // A spring stiffer than the sub-step rate can follow would overshoot. Contacts against static
+    // bodies only move one side, so they are made twice as stiff.
+    contactHertz = d2Min(contactHertz, 0.25f * m_invH);
+    const d2Softness softness = d2MakeSoftness(contactHertz, contactDampingRatio, h);
+    const d2Softness staticSoftness = d2MakeSoftness(2.0f * contactHertz, contactDampingRatio, h);
+    for (d2ContactBatch &batch: m_batches) {
+        for (int32 lane = 0; lane < D2_SIMD_WIDTH; ++lane) {
+            const bool isStatic = batch.invMassA[lane] == 0.0f || batch.invMassB[lane] == 0.0f;
+            const d2Softness &laneSoftness = isStatic ? staticSoftness : softness;
+            batch.biasRate[lane] = laneSoftness.biasRate;
+            batch.massScale[lane] = laneSoftness.massScale;
+            batch.impulseScale[lane] = laneSoftness.impulseScale;
+        }
+    }
+    for (d2Constraint *joint: m_joints) {
+        joint->PrepareSoft(h);
+    }
+
+    m_iterations.clear();
+    for (int32 i = 0; i < subStepCount; ++i) {
+        for (size_t j = 1; j < m_bodies.size(); ++j) {
+            m_solverBodies[j].v += m_bodies[j]->Acceleration() * h;
+            m_solverBodies[j].w += m_bodies[j]->AngularAcceleration() * h;
+        }
+
+        SolveColors(d2_warmStartStage);
+        SolveColors(d2_softSolveStage);
+
+        for (size_t j = 1; j < m_bodies.size(); ++j) {
+            m_solverBodies[j].dp += m_solverBodies[j].v * h;
+            m_solverBodies[j].dq += m_solverBodies[j].w * h;
+        }
+
+        SolveColors(d2_relaxStage);
+    }
+    SolveColors(d2_restitutionStage);
+
+    StoreVelocities();
+
+    // The sub-steps already moved the bodies
+    for (size_t i = 1; i < m_bodies.size(); ++i) {
+        d2Body *body = m_bodies[i];
+        body->Position() += m_solverBodies[i].dp;
+        body->Rotation() += m_solverBodies[i].dq;
+        body->shape->UpdateVertices(body->GetTransform());
+    }
+}
+
+void
+d2ConstraintSolver::SolveColors(d2SolverStage stage)
+{
+    // Each worker sums its own impulses, merged once the colors are done
+    m_workerIterations.resize(m_threadPool ? m_threadPool->GetWorkerCount() : 1);
+    for (d2SolverIteration &iteration: m_workerIterations) {
+        iteration = d2SolverIteration{ 0.0f, 0.0f };
+    }
+
+    const int32 colorCount = GetColorCount();
+    for (int32 color = 0; color < colorCount - 1; ++color) {
+        SolveColor(m_colors[color], stage);
+    }
+
+    // The overflow constraints may share bodies, one at a time
+    const d2SolverColor &overflow = m_colors[colorCount - 1];
+    for (int32 i = 0; i < overflow.jointCount; ++i) {
+        AddImpulse(m_workerIterations[0], SolveJoint(m_joints[overflow.jointStart + i], stage));
+    }
+    for (int32 i = 0; i < overflow.batchCount; ++i) {
+        d2ContactBatch &batch = m_batches[overflow.batchStart + i];
+        for (int32 lane = 0; lane < D2_SIMD_WIDTH; ++lane) {
+            if (stage == d2_warmStartStage) {
+                WarmStartLane(batch, lane);
+            } else if (stage == d2_restitutionStage) {
+                RestituteLane(batch, lane);
+            } else {
+                SolveLane(batch, lane, stage, m_workerIterations[0]);
+            }
+        }
+    }
+
+    if (stage == d2_solveStage || stage == d2_softSolveStage) {
+        d2SolverIteration &iteration = m_iterations.emplace_back(d2SolverIteration{ 0.0f, 0.0f });
+        for (const d2SolverIteration &worker: m_workerIterations) {
+            iteration.maxImpulse = d2Max(iteration.maxImpulse, worker.maxImpulse);
+            iteration.totalImpulse += worker.totalImpulse;
+        }
+    }
+}
+
+real
+d2ConstraintSolver::SolveJoint(d2Constraint *joint, d2SolverStage stage)
+{
+    switch (stage) {
+        case d2_solveStage:
+            // Without the velocity bias, the positions are corrected afterwards
+            return m_baumgarte ? joint->Solve() : joint->SolveSoft(false);
+        case d2_warmStartStage: joint->WarmStart(); break;
+        case d2_softSolveStage: return joint->SolveSoft(true);
+        case d2_relaxStage: return joint->SolveSoft(false);
+        case d2_restitutionStage: break;
+    }
+    return 0.0f;
+}
+
+void
+d2ConstraintSolver::SolveColor(const d2SolverColor &color, d2SolverStage stage)
+{
+    // Nothing in a color shares a dynamic body, so the joints and batches run in any order
+    auto solveRange = [this, &color, stage](int32 begin, int32 end, int32 workerIndex)
+    {
+        for (int32 i = begin; i < end; ++i) {
+            // Deterministic sums keep one entry per item, added up in order once the color is done
+            d2SolverIteration &iteration = m_deterministic ? m_itemIterations[i] : m_workerIterations[workerIndex];
+            if (i < color.jointCount) {
+                AddImpulse(iteration, SolveJoint(m_joints[color.jointStart + i], stage));
+                continue;
+            }
+
+            d2ContactBatch &batch = m_batches[color.batchStart + i - color.jointCount];
+            if (stage == d2_warmStartStage) {
+                for (int32 lane = 0; lane < D2_SIMD_WIDTH; ++lane) WarmStartLane(batch, lane);
+            } else if (stage == d2_restitutionStage) {
+                for (int32 lane = 0; lane < D2_SIMD_WIDTH; ++lane) RestituteLane(batch, lane);
+            } else {
+                SolveBatch(batch, stage, iteration);
+            }
+        }
+    };
+
+    const int32 itemCount = color.jointCount + color.batchCount;
+    if (m_deterministic) m_itemIterations.assign(itemCount, d2SolverIteration{ 0.0f, 0.0f });
+    if (m_threadPool) {
+        m_threadPool->ParallelFor(itemCount, SOLVER_MIN_COLOR_ITEMS, solveRange);
+    } else {
+        solveRange(0, itemCount, 0);
+    }
+
+    if (m_deterministic) {
+        for (const d2SolverIteration &item: m_itemIterations) {
+            m_workerIterations[0].maxImpulse = d2Max(m_workerIterations[0].maxImpulse, item.maxImpulse);
+            m_workerIterations[0].totalImpulse += item.totalImpulse;
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Contact rows
+///////////////////////////////////////////////////////////////////////////////
+// Same rows as d2PenetrationConstraint for every point of a manifold:
+//  vn = n · (vb - va) + (rb × n) ωb - (ra × n) ωa
+//  λn = -mn (vn + bias), accumulated and kept positive
+//  vt = t · (vb - va) + (rb × t) ωb - (ra × t) ωa
+//  λt = -mt vt, accumulated and kept within ±µ λn
+//
+// The normal rows of a two-point manifold are solved together by Solve(),
+// as the LCP  vn = K λn + b,  λn ≥ 0,  vn ≥ 0,  λn · vn = 0  where b is the
+// velocity left without the accumulated impulses. Its solution is one of
+// four cases, tried from both points pushing to none:
+//  both:   λn = -K^-1 b
+//  first:  λn1 = -b1 / k11, λn2 = 0, valid while vn2 = k12 λn1 + b2 ≥ 0
+//  second: λn2 = -b2 / k22, λn1 = 0, valid while vn1 = k12 λn2 + b1 ≥ 0
+//  none:   λn = 0, valid while b ≥ 0
+// When no case holds the impulses are kept, which only happens with round-off.
+//
+// The soft stages follow the separation over the sub-steps, to first order:
+//  s  = s0 + n · (Δpb - Δpa) + (rb × n) Δθb - (ra × n) Δθa
+//  λn = -massScale mn (vn + biasRate s) - impulseScale λn,accumulated
+// Speculative contacts stay rigid and may only close their gap in the sub-step.
+///////////////////////////////////////////////////////////////////////////////
+void
+d2ConstraintSolver::SolveBatch(d2ContactBatch &batch, d2SolverStage stage, d2SolverIteration &iteration)
+{
+    // Impulses before the iteration, to measure how much it changed them
+    alignas(32) real oldImpulses[4][D2_SIMD_WIDTH];
+    for (int32 p = 0; p < 2; ++p) {
+        d2StoreW(oldImpulses[2 * p], d2LoadW(batch.points[p].normalImpulse));
+        d2StoreW(oldImpulses[2 * p + 1], d2LoadW(batch.points[p].tangentImpulse));
+    }
+
+    // Gather the velocities of the lanes
+    alignas(32) real vax[D2_SIMD_WIDTH], vay[D2_SIMD_WIDTH], wa[D2_SIMD_WIDTH];
+    alignas(32) real vbx[D2_SIMD_WIDTH], vby[D2_SIMD_WIDTH], wb[D2_SIMD_WIDTH];
+    alignas(32) real dpx[D2_SIMD_WIDTH], dpy[D2_SIMD_WIDTH], dqa[D2_SIMD_WIDTH], dqb[D2_SIMD_WIDTH];
+    for (int32 lane = 0; lane < D2_SIMD_WIDTH; ++lane) {
+        const d2SolverBody &a = m_solverBodies[batch.indexA[lane]];
+        const d2SolverBody &b = m_solverBodies[batch.indexB[lane]];
+        vax[lane] = a.v.x;
+        vay[lane] = a.v.y;
+        wa[lane] = a.w;
+        vbx[lane] = b.v.x;
+        vby[lane] = b.v.y;
+        wb[lane] = b.w;
+        dpx[lane] = b.dp.x - a.dp.x;
+        dpy[lane] = b.dp.y - a.dp.y;
+        dqa[lane] = a.dq;
+        dqb[lane] = b.dq;
+    }
+
+    d2FloatW vaX = d2LoadW(vax), vaY = d2LoadW(vay), wA = d2LoadW(wa);
+    d2FloatW vbX = d2LoadW(vbx), vbY = d2LoadW(vby), wB = d2LoadW(wb);
+
+    const d2FloatW zero = d2SplatW(0.0f);
+    const d2FloatW nx = d2LoadW(batch.normalX);
+    const d2FloatW ny = d2LoadW(batch.normalY);
+    const d2FloatW tx = ny;                       // t = (n.y, -n.x)
+    const d2FloatW ty = d2SubW(zero, nx);
+    const d2FloatW invMassA = d2LoadW(batch.invMassA), invMassB = d2LoadW(batch.invMassB);
+    const d2FloatW invIA = d2LoadW(batch.invIA), invIB = d2LoadW(batch.invIB);
+
+    auto normalVelocity = [&](const d2ContactBatchPoint &point)
+    {
+        const d2FloatW vn = d2AddW(d2MulW(d2SubW(vbX, vaX), nx), d2MulW(d2SubW(vbY, vaY), ny));
+        return d2SubW(d2AddW(vn, d2MulW(d2LoadW(point.rbCrossN), wB)), d2MulW(d2LoadW(point.raCrossN), wA));
+    };
+    auto tangentVelocity = [&](const d2ContactBatchPoint &point)
+    {
+        const d2FloatW vt = d2AddW(d2MulW(d2SubW(vbX, vaX), tx), d2MulW(d2SubW(vbY, vaY), ty));
+        return d2SubW(d2AddW(vt, d2MulW(d2LoadW(point.rbCrossT), wB)), d2MulW(d2LoadW(point.raCrossT), wA));
+    };
+    auto applyImpulse = [&](const d2FloatW &dirX, const d2FloatW &dirY, const d2FloatW &raCross,
+                            const d2FloatW &rbCross, const d2FloatW &lambda)
+    {
+        const d2FloatW px = d2MulW(dirX, lambda);
+        const d2FloatW py = d2MulW(dirY, lambda);
+        vaX = d2SubW(vaX, d2MulW(px, invMassA));
+        vaY = d2SubW(vaY, d2MulW(py, invMassA));
+        wA = d2SubW(wA, d2MulW(invIA, d2MulW(raCross, lambda)));
+        vbX = d2AddW(vbX, d2MulW(px, invMassB));
+        vbY = d2AddW(vbY, d2MulW(py, invMassB));
+        wB = d2AddW(wB, d2MulW(invIB, d2MulW(rbCross, lambda)));
+    };
+
+    // Two-point manifolds with a well conditioned K are solved as a block by the rigid stage
+    const d2FloatW block = stage == d2_solveStage ? d2GreaterW(d2LoadW(batch.k11), zero) : d2GreaterW(zero, zero);
+
+    // Normal rows of the points solved one by one
+    d2FloatW bias[2];
+    for (int32 p = 0; p < 2; ++p) {
+        d2ContactBatchPoint &point = batch.points[p];
+        const d2FloatW raCn = d2LoadW(point.raCrossN), rbCn = d2LoadW(point.rbCrossN);
+
+        // Bias and softness of the normal row
+        bias[p] = d2LoadW(point.bias);
+        d2FloatW massScale = d2SplatW(1.0f);
+        d2FloatW impulseScale = zero;
+        if (stage != d2_solveStage) {
+            const d2FloatW s = d2SubW(d2AddW(d2LoadW(point.separation),
+                                             d2AddW(d2AddW(d2MulW(d2LoadW(dpx), nx), d2MulW(d2LoadW(dpy), ny)),
+                                                    d2MulW(rbCn, d2LoadW(dqb)))),
+                                      d2MulW(raCn, d2LoadW(dqa)));
+            const d2FloatW speculative = d2GreaterW(s, zero);
+            d2FloatW push = zero;
+            if (stage == d2_softSolveStage) {
+                const d2FloatW C = d2MinW(d2AddW(s, d2SplatW(LINEAR_SLOP)), zero);
+                push = d2MaxW(d2MulW(d2LoadW(batch.biasRate), C), d2SplatW(-CONTACT_PUSH_MAX_VELOCITY));
+                massScale = d2SelectW(speculative, massScale, d2LoadW(batch.massScale));
+                impulseScale = d2SelectW(speculative, impulseScale, d2LoadW(batch.impulseScale));
+            }
+            bias[p] = d2SelectW(speculative, d2MulW(s, d2SplatW(m_invH)), push);
+        }
+
+        const d2FloatW vn = normalVelocity(point);
+        const d2FloatW oldN = d2LoadW(point.normalImpulse);
+        d2FloatW lambdaN = d2SubW(d2MulW(d2SubW(zero, d2MulW(d2LoadW(point.normalMass), massScale)), d2AddW(vn, bias[p])),
+                                  d2MulW(impulseScale, oldN));
+        const d2FloatW newN = d2SelectW(block, oldN, d2MaxW(d2AddW(oldN, lambdaN), zero));
+        lambdaN = d2SubW(newN, oldN);
+        d2StoreW(point.normalImpulse, newN);
+        d2StoreW(point.maxNormalImpulse, d2MaxW(d2LoadW(point.maxNormalImpulse), newN));
+        applyImpulse(nx, ny, raCn, rbCn, lambdaN);
+    }
+
+    // Normal rows of the blocks, the lanes solved one by one keep their impulses
+    if (stage == d2_solveStage) {
+        d2ContactBatchPoint &p1 = batch.points[0];
+        d2ContactBatchPoint &p2 = batch.points[1];
+        const d2FloatW k11 = d2LoadW(batch.k11), k12 = d2LoadW(batch.k12), k22 = d2LoadW(batch.k22);
+        const d2FloatW a1 = d2LoadW(p1.normalImpulse), a2 = d2LoadW(p2.normalImpulse);
+        const d2FloatW b1 = d2SubW(d2AddW(normalVelocity(p1), bias[0]), d2AddW(d2MulW(k11, a1), d2MulW(k12, a2)));
+        const d2FloatW b2 = d2SubW(d2AddW(normalVelocity(p2), bias[1]), d2AddW(d2MulW(k12, a1), d2MulW(k22, a2)));
+        auto negative = [&zero](const d2FloatW &x) { return d2GreaterW(zero, x); };
+
+        d2FloatW x1 = a1, x2 = a2;
+
+        // None pushing
+        const d2FloatW invalidNone = d2OrW(negative(b1), negative(b2));
+        x1 = d2SelectW(invalidNone, x1, zero);
+        x2 = d2SelectW(invalidNone, x2, zero);
+
+        // Second point only
+        const d2FloatW second = d2SubW(zero, d2MulW(d2LoadW(p2.normalMass), b2));
+        const d2FloatW invalidSecond = d2OrW(negative(second), negative(d2AddW(d2MulW(k12, second), b1)));
+        x1 = d2SelectW(invalidSecond, x1, zero);
+        x2 = d2SelectW(invalidSecond, x2, second);
+
+        // First point only
+        const d2FloatW first = d2SubW(zero, d2MulW(d2LoadW(p1.normalMass), b1));
+        const d2FloatW invalidFirst = d2OrW(negative(first), negative(d2AddW(d2MulW(k12, first), b2)));
+        x1 = d2SelectW(invalidFirst, x1, first);
+        x2 = d2SelectW(invalidFirst, x2, zero);
+
+        // Both points
+        const d2FloatW both1 = d2SubW(zero, d2AddW(d2MulW(d2LoadW(batch.blockMass11), b1), d2MulW(d2LoadW(batch.blockMass12), b2)));
+        const d2FloatW both2 = d2SubW(zero, d2AddW(d2MulW(d2LoadW(batch.blockMass12), b1), d2MulW(d2LoadW(batch.blockMass22), b2)));
+        const d2FloatW invalidBoth = d2OrW(negative(both1), negative(both2));
+        x1 = d2SelectW(invalidBoth, x1, both1);
+        x2 = d2SelectW(invalidBoth, x2, both2);
+
+        x1 = d2SelectW(block, x1, a1);
+        x2 = d2SelectW(block, x2, a2);
+        d2StoreW(p1.normalImpulse, x1);
+        d2StoreW(p2.normalImpulse, x2);
+        d2StoreW(p1.maxNormalImpulse, d2MaxW(d2LoadW(p1.maxNormalImpulse), x1));
+        d2StoreW(p2.maxNormalImpulse, d2MaxW(d2LoadW(p2.maxNormalImpulse), x2));
+        applyImpulse(nx, ny, d2LoadW(p1.raCrossN), d2LoadW(p1.rbCrossN), d2SubW(x1, a1));
+        applyImpulse(nx, ny, d2LoadW(p2.raCrossN), d2LoadW(p2.rbCrossN), d2SubW(x2, a2));
+    }
+
+    // Tangent rows, within the friction cone of the new normal impulses
+    for (int32 p = 0; p < 2; ++p) {
+        d2ContactBatchPoint &point = batch.points[p];
+        d2FloatW lambdaT = d2MulW(d2SubW(zero, d2LoadW(point.tangentMass)), tangentVelocity(point));
+        const d2FloatW maxFriction = d2MulW(d2LoadW(batch.friction), d2LoadW(point.normalImpulse));
+        const d2FloatW oldT = d2LoadW(point.tangentImpulse);
+        const d2FloatW newT = d2MaxW(d2MinW(d2AddW(oldT, lambdaT), maxFriction), d2SubW(zero, maxFriction));
+        lambdaT = d2SubW(newT, oldT);
+        d2StoreW(point.tangentImpulse, newT);
+        applyImpulse(tx, ty, d2LoadW(point.raCrossT), d2LoadW(point.rbCrossT), lambdaT);
+    }
+
+    // Scatter back, the static body never changes
+    d2StoreW(vax, vaX);
+    d2StoreW(vay, vaY);
+    d2StoreW(wa, wA);
+    d2StoreW(vbx, vbX);
+    d2StoreW(vby, vbY);
+    d2StoreW(wb, wB);
+    for (int32 lane = 0; lane < D2_SIMD_WIDTH; ++lane) {
+        if (batch.indexA[lane]) {
+            d2SolverBody &a = m_solverBodies[batch.indexA[lane]];
+            a.v = d2Vec2(vax[lane], vay[lane]);
+            a.w = wa[lane];
+        }
+        if (batch.indexB[lane]) {
+            d2SolverBody &b = m_solverBodies[batch.indexB[lane]];
+            b.v = d2Vec2(vbx[lane], vby[lane]);
+            b.w = wb[lane];
+        }
+    }
+
+    // Missing points and lanes have no mass and never change
+    for (int32 lane = 0; lane < D2_SIMD_WIDTH; ++lane) {
+        for (int32 p = 0; p < batch.pointCount[lane]; ++p) {
+            AddImpulse(iteration, d2Abs(batch.points[p].normalImpulse[lane] - oldImpulses[2 * p][lane])
+                                  + d2Abs(batch.points[p].tangentImpulse[lane] - oldImpulses[2 * p + 1][lane]));
+        }
+    }
+}
+
+// Impulse along a direction at one point of a lane, the static body never changes
+static void
+ApplyLaneImpulse(d2ContactBatch &batch, int32 lane, d2SolverBody &a, d2SolverBody &b, const d2Vec2 &direction,
+                 real raCross, real rbCross, real lambda)
+{
+    const d2Vec2 P = direction * lambda;
+    if (batch.indexA[lane]) {
+        a.v -= P * batch.invMassA[lane];
+        a.w -= batch.invIA[lane] * raCross * lambda;
+    }
+    if (batch.indexB[lane]) {
+        b.v += P * batch.invMassB[lane];
+        b.w += batch.invIB[lane] * rbCross * lambda;
+    }
+}
+
+void
+d2ConstraintSolver::SolveLane(d2ContactBatch &batch, int32 lane, d2SolverStage stage, d2SolverIteration &iteration)
+{
+    real oldImpulses[2][2];
+    for (int32 p = 0; p < 2; ++p) {
+        oldImpulses[p][0] = batch.points[p].normalImpulse[lane];
+        oldImpulses[p][1] = batch.points[p].tangentImpulse[lane];
+    }
+
+    d2SolverBody &a = m_solverBodies[batch.indexA[lane]];
+    d2SolverBody &b = m_solverBodies[batch.indexB[lane]];
+    const d2Vec2 n(batch.normalX[lane], batch.normalY[lane]);
+    const d2Vec2 t(n.y, -n.x);
+    const bool block = stage == d2_solveStage && batch.k11[lane] > 0.0f;
+
+    for (int32 p = 0; p < batch.pointCount[lane] && !block; ++p) {
+        d2ContactBatchPoint &point = batch.points[p];
+
+        // Bias and softness of the normal row
+        real bias = point.bias[lane];
+        real massScale = 1.0f;
+        real impulseScale = 0.0f;
+        if (stage != d2_solveStage) {
+            const real s = point.separation[lane] + (b.dp - a.dp).Dot(n)
+                           + point.rbCrossN[lane] * b.dq - point.raCrossN[lane] * a.dq;
+            if (s > 0.0f) {
+                bias = s * m_invH;
+            } else if (stage == d2_softSolveStage) {
+                bias = d2Max(batch.biasRate[lane] * d2Min(s + LINEAR_SLOP, 0.0f), -CONTACT_PUSH_MAX_VELOCITY);
+                massScale = batch.massScale[lane];
+                impulseScale = batch.impulseScale[lane];
+            } else {
+                bias = 0.0f;
+            }
+        }
+
+        const real vn = (b.v - a.v).Dot(n) + point.rbCrossN[lane] * b.w - point.raCrossN[lane] * a.w;
+        real lambdaN = -point.normalMass[lane] * massScale * (vn + bias) - impulseScale * point.normalImpulse[lane];
+        const real newN = d2Max(point.normalImpulse[lane] + lambdaN, 0.0f);
+        lambdaN = newN - point.normalImpulse[lane];
+        point.normalImpulse[lane] = newN;
+        point.maxNormalImpulse[lane] = d2Max(point.maxNormalImpulse[lane], newN);
+        ApplyLaneImpulse(batch, lane, a, b, n, point.raCrossN[lane], point.rbCrossN[lane], lambdaN);
+    }
+    if (block) {
+        SolveBlock(batch, lane, batch.points[0].bias[lane], batch.points[1].bias[lane]);
+    }
+
+    // Tangent rows, within the friction cone of the new normal impulses
+    for (int32 p = 0; p < batch.pointCount[lane]; ++p) {
+        d2ContactBatchPoint &point = batch.points[p];
+        const real vt = (b.v - a.v).Dot(t) + point.rbCrossT[lane] * b.w - point.raCrossT[lane] * a.w;
+        real lambdaT = -point.tangentMass[lane] * vt;
+        const real maxFriction = batch.friction[lane] * point.normalImpulse[lane];
+        const real newT = d2Clamp(point.tangentImpulse[lane] + lambdaT, -maxFriction, maxFriction);
+        lambdaT = newT - point.tangentImpulse[lane];
+        point.tangentImpulse[lane] = newT;
+        ApplyLaneImpulse(batch, lane, a, b, t, point.raCrossT[lane], point.rbCrossT[lane], lambdaT);
+    }
+
+    for (int32 p = 0; p < batch.pointCount[lane]; ++p) {
+        AddImpulse(iteration, d2Abs(batch.points[p].normalImpulse[lane] - oldImpulses[p][0])
+                              + d2Abs(batch.points[p].tangentImpulse[lane] - oldImpulses[p][1]));
+    }
+}
+
+void
+d2ConstraintSolver::SolveBlock(d2ContactBatch &batch, int32 lane, real bias1, real bias2)
+{
+    d2SolverBody &a = m_solverBodies[batch.indexA[lane]];
+    d2SolverBody &b = m_solverBodies[batch.indexB[lane]];
+    const d2Vec2 n(batch.normalX[lane], batch.normalY[lane]);
+    d2ContactBatchPoint &p1 = batch.points[0];
+    d2ContactBatchPoint &p2 = batch.points[1];
+    const real k11 = batch.k11[lane], k12 = batch.k12[lane], k22 = batch.k22[lane];
+
+    const d2Vec2 dv = b.v - a.v;
+    const real vn1 = dv.Dot(n) + p1.rbCrossN[lane] * b.w - p1.raCrossN[lane] * a.w;
+    const real vn2 = dv.Dot(n) + p2.rbCrossN[lane] * b.w - p2.raCrossN[lane] * a.w;
+    const real a1 = p1.normalImpulse[lane], a2 = p2.normalImpulse[lane];
+    const real b1 = vn1 + bias1 - (k11 * a1 + k12 * a2);
+    const real b2 = vn2 + bias2 - (k12 * a1 + k22 * a2);
+
+    real x1 = a1, x2 = a2;
+    const real both1 = -(batch.blockMass11[lane] * b1 + batch.blockMass12[lane] * b2);
+    const real both2 = -(batch.blockMass12[lane] * b1 + batch.blockMass22[lane] * b2);
+    const real first = -p1.normalMass[lane] * b1;
+    const real second = -p2.normalMass[lane] * b2;
+    if (both1 >= 0.0f && both2 >= 0.0f) {
+        x1 = both1;
+        x2 = both2;
+    } else if (first >= 0.0f && k12 * first + b2 >= 0.0f) {
+        x1 = first;
+        x2 = 0.0f;
+    } else if (second >= 0.0f && k12 * second + b1 >= 0.0f) {
+        x1 = 0.0f;
+        x2 = second;
+    } else if (b1 >= 0.0f && b2 >= 0.0f) {
+        x1 = 0.0f;
+        x2 = 0.0f;
+    }
+
+    p1.normalImpulse[lane] = x1;
+    p2.normalImpulse[lane] = x2;
+    p1.maxNormalImpulse[lane] = d2Max(p1.maxNormalImpulse[lane], x1);
+    p2.maxNormalImpulse[lane] = d2Max(p2.maxNormalImpulse[lane], x2);
+    ApplyLaneImpulse(batch, lane, a, b, n, p1.raCrossN[lane], p1.rbCrossN[lane], x1 - a1);
+    ApplyLaneImpulse(batch, lane, a, b, n, p2.raCrossN[lane], p2.rbCrossN[lane], x2 - a2);
+}
+
+void
+d2ConstraintSolver::WarmStartLane(d2ContactBatch &batch, int32 lane)
+{
+    // Apply the impulses of the last sub-step again
+    d2SolverBody &a = m_solverBodies[batch.indexA[lane]];
+    d2SolverBody &b = m_solverBodies[batch.indexB[lane]];
+    const d2Vec2 n(batch.normalX[lane], batch.normalY[lane]);
+    const d2Vec2 t(n.y, -n.x);
+    for (int32 p = 0; p < batch.pointCount[lane]; ++p) {
+        const d2ContactBatchPoint &point = batch.points[p];
+        ApplyLaneImpulse(batch, lane, a, b, n, point.raCrossN[lane], point.rbCrossN[lane], point.normalImpulse[lane]);
+        ApplyLaneImpulse(batch, lane, a, b, t, point.raCrossT[lane], point.rbCrossT[lane], point.tangentImpulse[lane]);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Restitution
+///////////////////////////////////////////////////////////////////////////////
+// Once the velocities are solved, a contact that approached fast enough and
+// pushed at some point leaves with its approach velocity scaled back:
+//  λn = -mn (vn + e vn,before), accumulated and kept positive
+// Resting and sliding contacts approach slower than the threshold and keep
+// their solved velocity, speculative ones that never touched never bounce.
+// A two-point manifold bouncing on both points does it as a block, so a flat
+// landing doesn't pick up spin from the order of the points.
+///////////////////////////////////////////////////////////////////////////////
+void
+d2ConstraintSolver::RestituteLane(d2ContactBatch &batch, int32 lane)
+{
+    const real restitution = batch.restitution[lane];
+    if (restitution == 0.0f) return;
+
+    auto bounces = [&batch, lane](const d2ContactBatchPoint &point)
+    {
+        return point.relativeVelocity[lane] <= -RESTITUTION_THRESHOLD && point.maxNormalImpulse[lane] > 0.0f;
+    };
+    const d2ContactBatchPoint &p1 = batch.points[0];
+    const d2ContactBatchPoint &p2 = batch.points[1];
+    if (batch.k11[lane] > 0.0f && bounces(p1) && bounces(p2)) {
+        SolveBlock(batch, lane, restitution * p1.relativeVelocity[lane], restitution * p2.relativeVelocity[lane]);
+        return;
+    }
+
+    d2SolverBody &a = m_solverBodies[batch.indexA[lane]];
+    d2SolverBody &b = m_solverBodies[batch.indexB[lane]];
+    const d2Vec2 n(batch.normalX[lane], batch.normalY[lane]);
+    for (int32 p = 0; p < batch.pointCount[lane]; ++p) {
+        d2ContactBatchPoint &point = batch.points[p];
+        if (!bounces(point)) continue;
+
+        const real vn = (b.v - a.v).Dot(n) + point.rbCrossN[lane] * b.w - point.raCrossN[lane] * a.w;
+        real lambdaN = -point.normalMass[lane] * (vn + restitution * point.relativeVelocity[lane]);
+        const real newN = d2Max(point.normalImpulse[lane] + lambdaN, 0.0f);
+        lambdaN = newN - point.normalImpulse[lane];
+        point.normalImpulse[lane] = newN;
+        ApplyLaneImpulse(batch, lane, a, b, n, point.raCrossN[lane], point.rbCrossN[lane], lambdaN);
+    }
+}
@@ -0,0 +1,13 @@
+#include "dura2d/d2Contact.h"
+
+#include "dura2d/d2Body.h"
+
+bool
+d2ContactPair::operator<(const d2ContactPair& other) const
+{
+    // By creation order, addresses differ from one run to the next
+    if (a != other.a) return a->GetCreationIndex() < other.a->GetCreationIndex();
+    if (b != other.b) return b->GetCreationIndex() < other.b->GetCreationIndex();
+    if (childA != other.childA) return childA < other.childA;
+    return childB < other.childB;
+}
@@ -0,0 +1,884 @@
+#include "dura2d/d2Joint.h"
+
+#include <new>
+
+// Angular velocity s crossed with a lever arm v
+static inline d2Vec2
+CrossSV(real s, const d2Vec2 &v)
+{
+    return d2Vec2(-s * v.y, s * v.x);
+}
+
+// The symmetric matrix [k11 k12; k12 k22]
+static d2Mat<2, 2>
+Symmetric22(real k11, real k12, real k22)
+{
+    d2Mat<2, 2> K;
+    K[0][0] = k11;
+    K[0][1] = K[1][0] = k12;
+    K[1][1] = k22;
+    return K;
+}
+
+// Angle of b relative to a minus the reference angle, in [-π, π]
+static real
+GetRelativeAngle(const d2Body *a, const d2Body *b, real referenceAngle)
+{
+    real angle = b->GetRotation() - a->GetRotation() - referenceAngle;
+    while (angle > PI) angle -= 2.0f * PI;
+    while (angle < -PI) angle += 2.0f * PI;
+    return angle;
+}
+
+// The position solver counts an angle of ANGULAR_SLOP as much as LINEAR_SLOP of distance
+static inline real
+GetPositionError(real linearError, real angularError)
+{
+    return d2Max(linearError, d2Abs(angularError) * (LINEAR_SLOP / ANGULAR_SLOP));
+}
+
+void
+d2JointDef::Initialize(d2Body *bodyA, d2Body *bodyB, const d2Vec2 &anchor)
+{
+    Initialize(bodyA, bodyB, anchor, anchor);
+}
+
+void
+d2JointDef::Initialize(d2Body *bodyA, d2Body *bodyB, const d2Vec2 &anchorA, const d2Vec2 &anchorB)
+{
+    this->bodyA = bodyA;
+    this->bodyB = bodyB;
+    localAnchorA = bodyA->WorldSpaceToLocalSpace(anchorA);
+    localAnchorB = bodyB->WorldSpaceToLocalSpace(anchorB);
+    referenceAngle = bodyB->GetRotation() - bodyA->GetRotation();
+    length = (anchorB - anchorA).Lenght();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Joints
+///////////////////////////////////////////////////////////////////////////////
+// Every row is solved in closed form as a soft constraint:
+//  λ = -massScale m (J * V + biasRate C) - impulseScale λ,accumulated
+// with m the effective mass 1 / (J * M^-1 * Jt) derived by hand for each row,
+// or the inverse of the 2x2 block of rows solved together. The Baumgarte
+// solver uses the rigid softness {JOINT_BAUMGARTE / dt, 1, 0} over the step.
+//
+// A point row pins pb = pa, with the relative velocity of the anchors
+//  Cdot = vb + ωb × rb - va - ωa × ra
+//  K = [ mA + mB + iA ra.y² + iB rb.y²     -iA ra.x ra.y - iB rb.x rb.y ]
+//      [ -iA ra.x ra.y - iB rb.x rb.y      mA + mB + iA ra.x² + iB rb.x² ]
+// An angular row pins θb - θa, with Cdot = ωb - ωa and K = iA + iB.
+// A row along a unit axis u has Cdot = u · (vb - va) + (rb × u) ωb - (ra × u) ωa
+// and K = mA + mB + iA (ra × u)² + iB (rb × u)².
+///////////////////////////////////////////////////////////////////////////////
+d2Joint::d2Joint(const d2JointDef &def)
+        : d2Constraint(), type(def.type), angle(0.0f), mA(0.0f), iA(0.0f), mB(0.0f), iB(0.0f), h(0.0f),
+          invH(0.0f), softness{ 0.0f, 1.0f, 0.0f }
+{
+    a = def.bodyA;
+    b = def.bodyB;
+    aPoint = def.localAnchorA;
+    bPoint = def.localAnchorB;
+    next = nullptr;
+    prev = nullptr;
+    hertz = def.hertz;
+    dampingRatio = def.dampingRatio;
+}
+
+void
+d2Joint::PreSolve(const real dt)
+{
+    // The rows of the soft step over the whole step, rigid and pushed out by a fraction per step
+    PrepareSoft(dt);
+    softness = d2Softness{ dt > 0.0f ? JOINT_BAUMGARTE / dt : 0.0f, 1.0f, 0.0f };
+    WarmStart();
+}
+
+real
+d2Joint::Solve()
+{
+    return SolveSoft(true);
+}
+
+void
+d2Joint::PrepareBodies(const real h, real referenceAngle)
+{
+    const d2Vec2 pa = a->LocalSpaceToWorldSpace(aPoint);
+    const d2Vec2 pb = b->LocalSpaceToWorldSpace(bPoint);
+    ra = pa - a->GetPosition();
+    rb = pb - b->GetPosition();
+    separation = pb - pa;
+    angle = GetRelativeAngle(a, b, referenceAngle);
+
+    mA = a->GetInvMass();
+    iA = a->GetInvI();
+    mB = b->GetInvMass();
+    iB = b->GetInvI();
+
+    this->h = h;
+    invH = h > 0.0f ? 1.0f / h : 0.0f;
+}
+
+d2Vec2
+d2Joint::GetSeparation(const d2Vec2 &dpa, real dqa, const d2Vec2 &dpb, real dqb) const
+{
+    return separation + dpb - dpa + CrossSV(dqb, rb) - CrossSV(dqa, ra);
+}
+
+real
+d2Joint::GetAngle(real dqa, real dqb) const
+{
+    return angle + dqb - dqa;
+}
+
+d2Mat<2, 2>
+d2Joint::GetPointMass() const
+{
+    const real k11 = mA + mB + iA * ra.y * ra.y + iB * rb.y * rb.y;
+    const real k12 = -iA * ra.x * ra.y - iB * rb.x * rb.y;
+    const real k22 = mA + mB + iA * ra.x * ra.x + iB * rb.x * rb.x;
+    return d2Invert(Symmetric22(k11, k12, k22));
+}
+
+real
+d2Joint::SolvePointRows(const d2Mat<2, 2> &pointMass, d2Vec2 &pointImpulse, const d2Vec2 &C, bool useBias,
+                        d2Vec2 &va, real &wa, d2Vec2 &vb, real &wb) const
+{
+    const d2Vec2 Cdot = vb + CrossSV(wb, rb) - va - CrossSV(wa, ra);
+
+    d2Vec2 bias(0.0f, 0.0f);
+    real massScale = 1.0f;
+    real impulseScale = 0.0f;
+    if (useBias) {
+        bias = C * softness.biasRate;
+        massScale = softness.massScale;
+        impulseScale = softness.impulseScale;
+    }
+
+    const d2Vec2 impulse = d2Mul(pointMass, Cdot + bias) * -massScale - pointImpulse * impulseScale;
+    pointImpulse += impulse;
+
+    va -= impulse * mA;
+    wa -= iA * ra.Cross(impulse);
+    vb += impulse * mB;
+    wb += iB * rb.Cross(impulse);
+    return d2Abs(impulse.x) + d2Abs(impulse.y);
+}
+
+real
+d2Joint::SolveLimitRow(real C, real Cdot, real mass, real &impulse, bool useBias) const
+{
+    real bias = 0.0f;
+    real massScale = 1.0f;
+    real impulseScale = 0.0f;
+    if (C > 0.0f) {
+        // Inside the range, the row may only close the gap in the step
+        bias = C * invH;
+    } else if (useBias) {
+        bias = softness.biasRate * C;
+        massScale = softness.massScale;
+        impulseScale = softness.impulseScale;
+    }
+
+    const real lambda = -mass * massScale * (Cdot + bias) - impulseScale * impulse;
+    const real newImpulse = d2Max(impulse + lambda, 0.0f);
+    const real change = newImpulse - impulse;
+    impulse = newImpulse;
+    return change;
+}
+
+real
+d2Joint::SolvePointPosition()
+{
+    const d2Vec2 pa = a->LocalSpaceToWorldSpace(aPoint);
+    const d2Vec2 pb = b->LocalSpaceToWorldSpace(bPoint);
+    ra = pa - a->GetPosition();
+    rb = pb - b->GetPosition();
+    mA = a->GetInvMass();
+    iA = a->GetInvI();
+    mB = b->GetInvMass();
+    iB = b->GetInvI();
+    const d2Vec2 C = pb - pa;
+
+    // P = -K^-1 * C
+    const d2Vec2 P = d2Mul(GetPointMass(), C) * -1.0f;
+    ApplyPositionImpulse(P, ra.Cross(P), rb.Cross(P));
+    return C.Lenght();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Pin joint
+///////////////////////////////////////////////////////////////////////////////
+d2JointConstraint::d2JointConstraint(const d2JointDef &def)
+        : d2Joint(def), cachedLambda(0.0f), bias(0.0f), effectiveMass(0.0f)
+{
+    type = d2_pinJoint;
+}
+
+d2JointConstraint::d2JointConstraint(d2Body *a, d2Body *b, const d2Vec2 &anchorPoint)
+        : d2Joint(d2JointDef()), cachedLambda(0.0f), bias(0.0f), effectiveMass(0.0f)
+{
+    type = d2_pinJoint;
+    this->a = a;
+    this->b = b;
+    this->aPoint = a->WorldSpaceToLocalSpace(anchorPoint);
+    this->bPoint = b->WorldSpaceToLocalSpace(anchorPoint);
+}
+
+void
+d2JointConstraint::PreSolve(const real dt)
+{
+    // Get the anchor point position in world space
+    const d2Vec2 pa = a->LocalSpaceToWorldSpace(aPoint);
+    const d2Vec2 pb = b->LocalSpaceToWorldSpace(bPoint);
+
+    const d2Vec2 ra = pa - a->GetPosition();
+    const d2Vec2 rb = pb - b->GetPosition();
+
+    d2Vec2 J1 = (pa - pb) * 2.0;
+    jacobian[0] = J1.x; // A linear velocity.x
+    jacobian[1] = J1.y; // A linear velocity.y
+
+    real J2 = ra.Cross(pa - pb) * 2.0;
+    jacobian[2] = J2;   // A angular velocity
+
+    d2Vec2 J3 = (pb - pa) * 2.0;
+    jacobian[3] = J3.x; // B linear velocity.x
+    jacobian[4] = J3.y; // B linear velocity.y
+
+    real J4 = rb.Cross(pb - pa) * 2.0;
+    jacobian[5] = J4;   // B angular velocity
+
+    // J * M^-1 * Jt, M^-1 is diagonal
+    const d2Vec<6> invM = GetInvM();
+    real k = 0.0f;
+    for (int i = 0; i < 6; ++i) {
+        k += jacobian[i] * jacobian[i] * invM[i];
+    }
+    effectiveMass = d2Invert(k);
+
+    // Warm starting (apply cached lambda)
+    ApplyImpulses(jacobian * cachedLambda);
+
+    // Compute the bias term (baumgarte stabilization)
+    const real beta = 0.02f;
+    real C = (pb - pa).Dot(pb - pa);
+    C = d2Max<real>(0.0f, C - 0.01f);
+    bias = (beta / dt) * C;
+}
+
+real
+d2JointConstraint::Solve()
+{
+    // Closed form of (J * M^-1 * Jt) * lambda = -(J * V + bias) for a single row
+    const real lambda = -effectiveMass * (jacobian.Dot(GetVelocities()) + bias);
+    cachedLambda += lambda;
+
+    // Compute the impulses with both direction and magnitude
+    ApplyImpulses(jacobian * lambda);
+    return d2Abs(lambda);
+}
+
+void
+d2JointConstraint::PostSolve()
+{
+    // Limit the warm starting to reasonable limits
+    cachedLambda = d2Clamp<real>(cachedLambda, -10000.0f, 10000.0f);
+}
+
+void
+d2JointConstraint::PrepareSoft(const real h)
+{
+    PrepareBodies(h, 0.0f);
+    pointMass = GetPointMass();
+    softness = d2MakeSoftness(hertz, dampingRatio, h);
+}
+
+void
+d2JointConstraint::WarmStart()
+{
+    d2Vec2 va, vb;
+    real wa, wb;
+    GetVelocities(va, wa, vb, wb);
+    va -= pointImpulse * mA;
+    wa -= iA * ra.Cross(pointImpulse);
+    vb += pointImpulse * mB;
+    wb += iB * rb.Cross(pointImpulse);
+    SetVelocities(va, wa, vb, wb);
+}
+
+real
+d2JointConstraint::SolveSoft(bool useBias)
+{
+    d2Vec2 va, vb, dpa, dpb;
+    real wa, wb, dqa, dqb;
+    GetVelocities(va, wa, vb, wb);
+    GetDeltaPositions(dpa, dqa, dpb, dqb);
+
+    const real change = SolvePointRows(pointMass, pointImpulse, GetSeparation(dpa, dqa, dpb, dqb), useBias,
+                                       va, wa, vb, wb);
+    SetVelocities(va, wa, vb, wb);
+    return change;
+}
+
+real
+d2JointConstraint::SolvePosition()
+{
+    return SolvePointPosition();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Revolute joint
+///////////////////////////////////////////////////////////////////////////////
+// Point rows, a motor row Cdot = ωb - ωa - speed within ±maxMotorTorque h,
+// and the one-sided angular rows of the limits:
+//  lower: C = θ - lower,  Cdot = ωb - ωa
+//  upper: C = upper - θ,  Cdot = ωa - ωb
+///////////////////////////////////////////////////////////////////////////////
+d2RevoluteJoint::d2RevoluteJoint(const d2JointDef &def)
+        : d2Joint(def), referenceAngle(def.referenceAngle), enableLimit(def.enableLimit), lowerAngle(def.lower),
+          upperAngle(def.upper), enableMotor(def.enableMotor), motorSpeed(def.motorSpeed),
+          maxMotorTorque(def.maxMotorForce), axialMass(0.0f), motorImpulse(0.0f), lowerImpulse(0.0f),
+          upperImpulse(0.0f)
+{
+}
+
+void
+d2RevoluteJoint::PrepareSoft(const real h)
+{
+    PrepareBodies(h, referenceAngle);
+    pointMass = GetPointMass();
+    axialMass = d2Invert(iA + iB);
+    softness = d2MakeSoftness(hertz, dampingRatio, h);
+
+    if (!enableMotor) motorImpulse = 0.0f;
+    if (!enableLimit) lowerImpulse = upperImpulse = 0.0f;
+}
+
+void
+d2RevoluteJoint::WarmStart()
+{
+    d2Vec2 va, vb;
+    real wa, wb;
+    GetVelocities(va, wa, vb, wb);
+    const real axialImpulse = motorImpulse + lowerImpulse - upperImpulse;
+    va -= linearImpulse * mA;
+    wa -= iA * (ra.Cross(linearImpulse) + axialImpulse);
+    vb += linearImpulse * mB;
+    wb += iB * (rb.Cross(linearImpulse) + axialImpulse);
+    SetVelocities(va, wa, vb, wb);
+}
+
+real
+d2RevoluteJoint::SolveSoft(bool useBias)
+{
+    d2Vec2 va, vb, dpa, dpb;
+    real wa, wb, dqa, dqb;
+    GetVelocities(va, wa, vb, wb);
+    GetDeltaPositions(dpa, dqa, dpb, dqb);
+    real change = 0.0f;
+
+    if (enableMotor) {
+        const real maxImpulse = maxMotorTorque * h;
+        const real oldImpulse = motorImpulse;
+        motorImpulse = d2Clamp(oldImpulse - axialMass * (wb - wa - motorSpeed), -maxImpulse, maxImpulse);
+        const real lambda = motorImpulse - oldImpulse;
+        wa -= iA * lambda;
+        wb += iB * lambda;
+        change += d2Abs(lambda);
+    }
+
+    if (enableLimit) {
+        const real jointAngle = GetAngle(dqa, dqb);
+
+        real lambda = SolveLimitRow(jointAngle - lowerAngle, wb - wa, axialMass, lowerImpulse, useBias);
+        wa -= iA * lambda;
+        wb += iB * lambda;
+        change += d2Abs(lambda);
+
+        lambda = SolveLimitRow(upperAngle - jointAngle, wa - wb, axialMass, upperImpulse, useBias);
+        wa += iA * lambda;
+        wb -= iB * lambda;
+        change += d2Abs(lambda);
+    }
+
+    change += SolvePointRows(pointMass, linearImpulse, GetSeparation(dpa, dqa, dpb, dqb), useBias, va, wa, vb, wb);
+    SetVelocities(va, wa, vb, wb);
+    return change;
+}
+
+real
+d2RevoluteJoint::SolvePosition()
+{
+    // Rotate back within the range, then pin the anchors at the new angle
+    real angularError = 0.0f;
+    if (enableLimit) {
+        const real jointAngle = GetRelativeAngle(a, b, referenceAngle);
+        if (jointAngle < lowerAngle) {
+            angularError = jointAngle - lowerAngle;
+        } else if (jointAngle > upperAngle) {
+            angularError = jointAngle - upperAngle;
+        }
+
+        const real lambda = -d2Invert(a->GetInvI() + b->GetInvI()) * angularError;
+        ApplyPositionImpulse(d2Vec2(0.0f, 0.0f), lambda, lambda);
+    }
+
+    return GetPositionError(SolvePointPosition(), angularError);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Distance joint
+///////////////////////////////////////////////////////////////////////////////
+// A single row along the unit axis u from pa to pb:
+//  C = |pb - pa| - length
+//  Cdot = u · (vb + ωb × rb - va - ωa × ra)
+//  K = mA + mB + iA (ra × u)² + iB (rb × u)²
+///////////////////////////////////////////////////////////////////////////////
+d2DistanceJoint::d2DistanceJoint(const d2JointDef &def)
+        : d2Joint(def), length(def.length), crossA(0.0f), crossB(0.0f), axialMass(0.0f), impulse(0.0f)
+{
+}
+
+void
+d2DistanceJoint::PrepareSoft(const real h)
+{
+    PrepareBodies(h, 0.0f);
+
+    // Anchors on top of each other have no direction, the joint lets go until they part
+    const real currentLength = separation.Lenght();
+    axis = currentLength > LINEAR_SLOP ? separation * (1.0f / currentLength) : d2Vec2(0.0f, 0.0f);
+    crossA = ra.Cross(axis);
+    crossB = rb.Cross(axis);
+    axialMass = currentLength > LINEAR_SLOP ? d2Invert(mA + mB + iA * crossA * crossA + iB * crossB * crossB) : 0.0f;
+    softness = d2MakeSoftness(hertz, dampingRatio, h);
+}
+
+void
+d2DistanceJoint::WarmStart()
+{
+    d2Vec2 va, vb;
+    real wa, wb;
+    GetVelocities(va, wa, vb, wb);
+    va -= axis * (mA * impulse);
+    wa -= iA * crossA * impulse;
+    vb += axis * (mB * impulse);
+    wb += iB * crossB * impulse;
+    SetVelocities(va, wa, vb, wb);
+}
+
+real
+d2DistanceJoint::SolveSoft(bool useBias)
+{
+    d2Vec2 va, vb, dpa, dpb;
+    real wa, wb, dqa, dqb;
+    GetVelocities(va, wa, vb, wb);
+    GetDeltaPositions(dpa, dqa, dpb, dqb);
+
+    real bias = 0.0f;
+    real massScale = 1.0f;
+    real impulseScale = 0.0f;
+    if (useBias) {
+        const real C = GetSeparation(dpa, dqa, dpb, dqb).Lenght() - length;
+        bias = softness.biasRate * C;
+        massScale = softness.massScale;
+        impulseScale = softness.impulseScale;
+    }
+
+    const real Cdot = axis.Dot(vb - va) + crossB * wb - crossA * wa;
+    const real lambda = -axialMass * massScale * (Cdot + bias) - impulseScale * impulse;
+    impulse += lambda;
+
+    va -= axis * (mA * lambda);
+    wa -= iA * crossA * lambda;
+    vb += axis * (mB * lambda);
+    wb += iB * crossB * lambda;
+    SetVelocities(va, wa, vb, wb);
+    return d2Abs(lambda);
+}
+
+real
+d2DistanceJoint::SolvePosition()
+{
+    const d2Vec2 pa = a->LocalSpaceToWorldSpace(aPoint);
+    const d2Vec2 pb = b->LocalSpaceToWorldSpace(bPoint);
+    const d2Vec2 d = pb - pa;
+    const real currentLength = d.Lenght();
+    const real C = currentLength - length;
+    if (currentLength <= LINEAR_SLOP) return d2Abs(C);
+
+    const d2Vec2 u = d * (1.0f / currentLength);
+    const real crA = (pa - a->GetPosition()).Cross(u);
+    const real crB = (pb - b->GetPosition()).Cross(u);
+    const real k = a->GetInvMass() + b->GetInvMass() + a->GetInvI() * crA * crA + b->GetInvI() * crB * crB;
+    const real lambda = -d2Invert(k) * C;
+    ApplyPositionImpulse(u * lambda, crA * lambda, crB * lambda);
+    return d2Abs(C);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Prismatic joint
+///////////////////////////////////////////////////////////////////////////////
+// With d = pb - pa, the axis u of a and p = u rotated a quarter turn:
+//  perpendicular: C = p · d,  Cdot = p · (vb - va) + s2 ωb - s1 ωa
+//  angular:       C = θ,      Cdot = ωb - ωa
+// solved together with
+//  K = [ mA + mB + iA s1² + iB s2²   iA s1 + iB s2 ]
+//      [ iA s1 + iB s2               iA + iB       ]
+// where s1 = (d + ra) × p and s2 = rb × p. Along the axis the motor and the
+// limits use Cdot = u · (vb - va) + a2 ωb - a1 ωa with a1 = (d + ra) × u and
+// a2 = rb × u, and the translation u · d.
+///////////////////////////////////////////////////////////////////////////////
+d2PrismaticJoint::d2PrismaticJoint(const d2JointDef &def)
+        : d2Joint(def), referenceAngle(def.referenceAngle), localAxisA(def.localAxisA.UnitVector()),
+          enableLimit(def.enableLimit), lowerTranslation(def.lower), upperTranslation(def.upper),
+          enableMotor(def.enableMotor), motorSpeed(def.motorSpeed), maxMotorForce(def.maxMotorForce),
+          a1(0.0f), a2(0.0f), s1(0.0f), s2(0.0f), axialMass(0.0f), motorImpulse(0.0f), lowerImpulse(0.0f),
+          upperImpulse(0.0f)
+{
+}
+
+void
+d2PrismaticJoint::PrepareSoft(const real h)
+{
+    PrepareBodies(h, referenceAngle);
+
+    axis = a->LocalSpaceToWorldSpace(localAxisA) - a->GetPosition();
+    perp = d2Vec2(-axis.y, axis.x);
+    a1 = (separation + ra).Cross(axis);
+    a2 = rb.Cross(axis);
+    s1 = (separation + ra).Cross(perp);
+    s2 = rb.Cross(perp);
+
+    axialMass = d2Invert(mA + mB + iA * a1 * a1 + iB * a2 * a2);
+
+    // Two fixed rotations leave the angular row without mass, any value keeps K invertible
+    const real k22 = iA + iB;
+    const d2Mat<2, 2> K = Symmetric22(mA + mB + iA * s1 * s1 + iB * s2 * s2, iA * s1 + iB * s2, k22 > 0.0f ? k22 : 1.0f);
+    blockMass = d2Invert(K);
+    softness = d2MakeSoftness(hertz, dampingRatio, h);
+
+    if (!enableMotor) motorImpulse = 0.0f;
+    if (!enableLimit) lowerImpulse = upperImpulse = 0.0f;
+}
+
+void
+d2PrismaticJoint::WarmStart()
+{
+    d2Vec2 va, vb;
+    real wa, wb;
+    GetVelocities(va, wa, vb, wb);
+    const real axialImpulse = motorImpulse + lowerImpulse - upperImpulse;
+    const d2Vec2 P = axis * axialImpulse + perp * impulse.x;
+    va -= P * mA;
+    wa -= iA * (axialImpulse * a1 + impulse.x * s1 + impulse.y);
+    vb += P * mB;
+    wb += iB * (axialImpulse * a2 + impulse.x * s2 + impulse.y);
+    SetVelocities(va, wa, vb, wb);
+}
+
+real
+d2PrismaticJoint::SolveSoft(bool useBias)
+{
+    d2Vec2 va, vb, dpa, dpb;
+    real wa, wb, dqa, dqb;
+    GetVelocities(va, wa, vb, wb);
+    GetDeltaPositions(dpa, dqa, dpb, dqb);
+    const d2Vec2 d = GetSeparation(dpa, dqa, dpb, dqb);
+    real change = 0.0f;
+
+    auto axialVelocity = [&]() { return axis.Dot(vb - va) + a2 * wb - a1 * wa; };
+    auto applyAxial = [&](real lambda)
+    {
+        va -= axis * (mA * lambda);
+        wa -= iA * a1 * lambda;
+        vb += axis * (mB * lambda);
+        wb += iB * a2 * lambda;
+        change += d2Abs(lambda);
+    };
+
+    if (enableMotor) {
+        const real maxImpulse = maxMotorForce * h;
+        const real oldImpulse = motorImpulse;
+        motorImpulse = d2Clamp(oldImpulse + axialMass * (motorSpeed - axialVelocity()), -maxImpulse, maxImpulse);
+        applyAxial(motorImpulse - oldImpulse);
+    }
+
+    if (enableLimit) {
+        const real translation = axis.Dot(d);
+        applyAxial(SolveLimitRow(translation - lowerTranslation, axialVelocity(), axialMass, lowerImpulse, useBias));
+        applyAxial(-SolveLimitRow(upperTranslation - translation, -axialVelocity(), axialMass, upperImpulse, useBias));
+    }
+
+    d2Vec2 bias(0.0f, 0.0f);
+    real massScale = 1.0f;
+    real impulseScale = 0.0f;
+    if (useBias) {
+        bias = d2Vec2(perp.Dot(d), GetAngle(dqa, dqb)) * softness.biasRate;
+        massScale = softness.massScale;
+        impulseScale = softness.impulseScale;
+    }
+
+    const d2Vec2 Cdot(perp.Dot(vb - va) + s2 * wb - s1 * wa, wb - wa);
+    const d2Vec2 lambda = d2Mul(blockMass, Cdot + bias) * -massScale - impulse * impulseScale;
+    impulse += lambda;
+
+    va -= perp * (mA * lambda.x);
+    wa -= iA * (s1 * lambda.x + lambda.y);
+    vb += perp * (mB * lambda.x);
+    wb += iB * (s2 * lambda.x + lambda.y);
+    SetVelocities(va, wa, vb, wb);
+    return change + d2Abs(lambda.x) + d2Abs(lambda.y);
+}
+
+real
+d2PrismaticJoint::SolvePosition()
+{
+    // Measured at the current positions, the rows of the next step are prepared again
+    PrepareSoft(h);
+
+    // Perpendicular and angular rows together
+    const d2Vec2 C(perp.Dot(separation), angle);
+    const d2Vec2 lambda = d2Mul(blockMass, C) * -1.0f;
+    ApplyPositionImpulse(perp * lambda.x, s1 * lambda.x + lambda.y, s2 * lambda.x + lambda.y);
+
+    // Back within the range along the axis
+    real axialError = 0.0f;
+    if (enableLimit) {
+        const real translation = axis.Dot(separation);
+        if (translation < lowerTranslation) {
+            axialError = translation - lowerTranslation;
+        } else if (translation > upperTranslation) {
+            axialError = translation - upperTranslation;
+        }
+
+        const real axialLambda = -axialMass * axialError;
+        ApplyPositionImpulse(axis * axialLambda, a1 * axialLambda, a2 * axialLambda);
+    }
+
+    return GetPositionError(d2Max(d2Abs(C.x), d2Abs(axialError)), C.y);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Weld joint
+///////////////////////////////////////////////////////////////////////////////
+// The angular row C = θ, Cdot = ωb - ωa, then the point rows.
+// The position pass solves the three rows as one block:
+//      | mA + mB + iA ra.y² + iB rb.y²   -iA ra.x ra.y - iB rb.x rb.y   -iA ra.y - iB rb.y |
+//  K = |       ...                       mA + mB + iA ra.x² + iB rb.x²   iA ra.x + iB rb.x |
+//      |       ...                             ...                         iA + iB         |
+///////////////////////////////////////////////////////////////////////////////
+d2WeldJoint::d2WeldJoint(const d2JointDef &def)
+        : d2Joint(def), referenceAngle(def.referenceAngle), axialMass(0.0f), angularImpulse(0.0f)
+{
+}
+
+void
+d2WeldJoint::PrepareSoft(const real h)
+{
+    PrepareBodies(h, referenceAngle);
+    pointMass = GetPointMass();
+    axialMass = d2Invert(iA + iB);
+    softness = d2MakeSoftness(hertz, dampingRatio, h);
+}
+
+void
+d2WeldJoint::WarmStart()
+{
+    d2Vec2 va, vb;
+    real wa, wb;
+    GetVelocities(va, wa, vb, wb);
+    va -= linearImpulse * mA;
+    wa -= iA * (ra.Cross(linearImpulse) + angularImpulse);
+    vb += linearImpulse * mB;
+    wb += iB * (rb.Cross(linearImpulse) + angularImpulse);
+    SetVelocities(va, wa, vb, wb);
+}
+
+real
+d2WeldJoint::SolveSoft(bool useBias)
+{
+    d2Vec2 va, vb, dpa, dpb;
+    real wa, wb, dqa, dqb;
+    GetVelocities(va, wa, vb, wb);
+    GetDeltaPositions(dpa, dqa, dpb, dqb);
+
+    real bias = 0.0f;
+    real massScale = 1.0f;
+    real impulseScale = 0.0f;
+    if (useBias) {
+        bias = softness.biasRate * GetAngle(dqa, dqb);
+        massScale = softness.massScale;
+        impulseScale = softness.impulseScale;
+    }
+
+    const real lambda = -axialMass * massScale * (wb - wa + bias) - impulseScale * angularImpulse;
+    angularImpulse += lambda;
+    wa -= iA * lambda;
+    wb += iB * lambda;
+
+    const real change = d2Abs(lambda) + SolvePointRows(pointMass, linearImpulse, GetSeparation(dpa, dqa, dpb, dqb),
+                                                       useBias, va, wa, vb, wb);
+    SetVelocities(va, wa, vb, wb);
+    return change;
+}
+
+real
+d2WeldJoint::SolvePosition()
+{
+    const d2Vec2 pa = a->LocalSpaceToWorldSpace(aPoint);
+    const d2Vec2 pb = b->LocalSpaceToWorldSpace(bPoint);
+    ra = pa - a->GetPosition();
+    rb = pb - b->GetPosition();
+    mA = a->GetInvMass();
+    iA = a->GetInvI();
+    mB = b->GetInvMass();
+    iB = b->GetInvI();
+
+    // The point and angular rows share the rotations, solved together they do not undo each other
+    d2Mat<3, 3> K;
+    K[0][0] = mA + mB + iA * ra.y * ra.y + iB * rb.y * rb.y;
+    K[0][1] = K[1][0] = -iA * ra.x * ra.y - iB * rb.x * rb.y;
+    K[0][2] = K[2][0] = -iA * ra.y - iB * rb.y;
+    K[1][1] = mA + mB + iA * ra.x * ra.x + iB * rb.x * rb.x;
+    K[1][2] = K[2][1] = iA * ra.x + iB * rb.x;
+    K[2][2] = iA + iB;
+
+    const d2Vec2 linearError = pb - pa;
+    const real angularError = GetRelativeAngle(a, b, referenceAngle);
+    d2Vec<3> C;
+    C[0] = linearError.x;
+    C[1] = linearError.y;
+    C[2] = angularError;
+
+    // P = -K^-1 * C, two fixed rotations leave only the point rows
+    d2Vec<3> P;
+    if (K[2][2] > 0.0f) {
+        P = -d2Solve(K, C);
+    } else {
+        const d2Vec2 pointP = d2Mul(d2Invert(Symmetric22(K[0][0], K[0][1], K[1][1])), linearError) * -1.0f;
+        P[0] = pointP.x;
+        P[1] = pointP.y;
+    }
+    const d2Vec2 linearP(P[0], P[1]);
+    ApplyPositionImpulse(linearP, ra.Cross(linearP) + P[2], rb.Cross(linearP) + P[2]);
+
+    return GetPositionError(linearError.Lenght(), angularError);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Motor joint
+///////////////////////////////////////////////////////////////////////////////
+// Between the centers, so the rows have no lever arm:
+//  linear:  e = pb - pa - R(θa) offset,  Cdot = vb - va + β e / h,  K = (mA + mB) I
+//  angular: e = θ - angularOffset,       Cdot = ωb - ωa + β e / h,  K = iA + iB
+// The accumulated impulses stay within maxForce h and maxTorque h.
+///////////////////////////////////////////////////////////////////////////////
+d2MotorJoint::d2MotorJoint(const d2JointDef &def)
+        : d2Joint(def), linearOffset(def.linearOffset), angularOffset(def.angularOffset), maxForce(def.maxForce),
+          maxTorque(def.maxTorque), correctionFactor(def.correctionFactor), linearMass(0.0f), angularMass(0.0f),
+          angularImpulse(0.0f)
+{
+    aPoint = d2Vec2(0.0f, 0.0f);
+    bPoint = d2Vec2(0.0f, 0.0f);
+}
+
+void
+d2MotorJoint::PrepareSoft(const real h)
+{
+    PrepareBodies(h, 0.0f);
+    offset = a->LocalSpaceToWorldSpace(linearOffset) - a->GetPosition();
+    linearMass = d2Invert(mA + mB);
+    angularMass = d2Invert(iA + iB);
+}
+
+void
+d2MotorJoint::WarmStart()
+{
+    d2Vec2 va, vb;
+    real wa, wb;
+    GetVelocities(va, wa, vb, wb);
+    va -= linearImpulse * mA;
+    wa -= iA * angularImpulse;
+    vb += linearImpulse * mB;
+    wb += iB * angularImpulse;
+    SetVelocities(va, wa, vb, wb);
+}
+
+real
+d2MotorJoint::SolveSoft(bool useBias)
+{
+    // The offset error drives the velocities whether or not the position error is fed back, the
+    // motor is a velocity target
+    (void)useBias;
+
+    d2Vec2 va, vb, dpa, dpb;
+    real wa, wb, dqa, dqb;
+    GetVelocities(va, wa, vb, wb);
+    GetDeltaPositions(dpa, dqa, dpb, dqb);
+    const real rate = correctionFactor * invH;
+
+    // Angular row
+    real angularError = GetAngle(dqa, dqb) - angularOffset;
+    while (angularError > PI) angularError -= 2.0f * PI;
+    while (angularError < -PI) angularError += 2.0f * PI;
+    const real maxAngularImpulse = maxTorque * h;
+    const real oldAngularImpulse = angularImpulse;
+    angularImpulse = d2Clamp(oldAngularImpulse - angularMass * (wb - wa + rate * angularError),
+                             -maxAngularImpulse, maxAngularImpulse);
+    const real angularLambda = angularImpulse - oldAngularImpulse;
+    wa -= iA * angularLambda;
+    wb += iB * angularLambda;
+
+    // Linear rows, the impulse is clamped as a vector
+    const d2Vec2 linearError = separation + dpb - dpa - offset - CrossSV(dqa, offset);
+    const d2Vec2 oldLinearImpulse = linearImpulse;
+    linearImpulse -= (vb - va + linearError * rate) * linearMass;
+    const real maxLinearImpulse = maxForce * h;
+    if (linearImpulse.LenghtSquared() > maxLinearImpulse * maxLinearImpulse) {
+        linearImpulse = linearImpulse.UnitVector() * maxLinearImpulse;
+    }
+    const d2Vec2 linearLambda = linearImpulse - oldLinearImpulse;
+    va -= linearLambda * mA;
+    vb += linearLambda * mB;
+
+    SetVelocities(va, wa, vb, wb);
+    return d2Abs(angularLambda) + d2Abs(linearLambda.x) + d2Abs(linearLambda.y);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Joint registry
+///////////////////////////////////////////////////////////////////////////////
+template <typename T>
+static d2Joint*
+CreateJointOfType(void *memory, const d2JointDef &def)
+{
+    return new(memory) T(def);
+}
+
+d2JointRegister*
+d2JointRegistry::GetRegisters()
+{
+    static d2JointRegister registers[d2_jointTypeCount] =
+    {
+        { CreateJointOfType<d2JointConstraint>, (int32)sizeof(d2JointConstraint) },
+        { CreateJointOfType<d2RevoluteJoint>, (int32)sizeof(d2RevoluteJoint) },
+        { CreateJointOfType<d2DistanceJoint>, (int32)sizeof(d2DistanceJoint) },
+        { CreateJointOfType<d2PrismaticJoint>, (int32)sizeof(d2PrismaticJoint) },
+        { CreateJointOfType<d2WeldJoint>, (int32)sizeof(d2WeldJoint) },
+        { CreateJointOfType<d2MotorJoint>, (int32)sizeof(d2MotorJoint) },
+    };
+    return registers;
+}
+
+void
+d2JointRegistry::Register(d2JointType type, d2JointCreateFcn *createFcn, int32 size)
+{
+    GetRegisters()[type] = d2JointRegister{ createFcn, size };
+}
+
+const d2JointRegister&
+d2JointRegistry::Get(d2JointType type)
+{
+    return GetRegisters()[type];
+}
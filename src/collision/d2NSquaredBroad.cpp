@@ -3,23 +3,54 @@
 #include "dura2d/d2Body.h"
 #include "dura2d/d2AABB.h"
 
+#include <algorithm>
+
 void
 d2NSquaredBroad::Add(d2Body *body)
 {
-    bodies.push_back(body);
+    for (int32 i = 0; i < body->GetProxyCount(); ++i) {
+        proxies.push_back(body->GetAABB(i));
+    }
 }
 
 void
 d2NSquaredBroad::Remove(d2Body *body)
 {
-    for (int i = 0; i < (int)bodies.size(); ++i) {
-        if (bodies[i] == body) {
-            bodies.erase(bodies.begin() + i);
-            break;
+    for (int i = 0; i < (int)proxies.size(); ++i) {
+        if (proxies[i]->Collider == body) {
+            proxies.erase(proxies.begin() + i);
+            --i;
         }
     }
 }
 
+void
+d2NSquaredBroad::AddBodies(d2Body *const *bodies, int32 count)
+{
+    size_t proxyCount = proxies.size();
+    for (int32 i = 0; i < count; ++i) {
+        proxyCount += bodies[i]->GetProxyCount();
+    }
+    proxies.reserve(proxyCount);
+
+    for (int32 i = 0; i < count; ++i) {
+        Add(bodies[i]);
+    }
+}
+
+void
+d2NSquaredBroad::RemoveBodies(d2Body *const *bodies, int32 count)
+{
+    std::vector<d2Body*> removed(bodies, bodies + count);
+    std::sort(removed.begin(), removed.end());
+
+    proxies.erase(std::remove_if(proxies.begin(), proxies.end(), [&](const d2AABB *proxy)
+                  {
+                      return std::binary_search(removed.begin(), removed.end(), proxy->Collider);
+                  }),
+                  proxies.end());
+}
+
 void
 d2NSquaredBroad::Update(void)
 {
@@ -31,19 +62,19 @@ d2NSquaredBroad::ComputePairs(void)
 {
     m_pairs.clear();
 
-    for (int i = 0; i < (int)bodies.size(); ++i)
+    for (int i = 0; i < (int)proxies.size(); ++i)
     {
         //if (!bodies[i]->IsAwake()) continue;
 
-        for (int j = i + 1; j < (int)bodies.size(); ++j)
+        for (int j = i + 1; j < (int)proxies.size(); ++j)
         {
-            d2AABB *a = bodies[i]->GetAABB();
-            d2AABB *b = bodies[j]->GetAABB();
+            d2AABB *a = proxies[i];
+            d2AABB *b = proxies[j];
 
-            if (bodies[i] == bodies[j]) continue;
+            if (!ShouldCollide(*a, *b)) continue;
 
             if (a->Overlaps(*b)) {
-                m_pairs.emplace_back(bodies[i], bodies[j]);
+                m_pairs.emplace_back(a, b);
             }
         }
     }
@@ -54,9 +85,9 @@ d2NSquaredBroad::ComputePairs(void)
 d2Body *
 d2NSquaredBroad::Pick(const d2Vec2 &point) const
 {
-    for (const auto &body : bodies) {
-        if (body->GetAABB()->Contains(point)) {
-            return body;
+    for (const auto &proxy : proxies) {
+        if (proxy->Contains(point)) {
+            return proxy->Collider;
         }
     }
     return nullptr;
@@ -65,9 +96,9 @@ d2NSquaredBroad::Pick(const d2Vec2 &point) const
 void
 d2NSquaredBroad::Query(const d2AABB &aabb, d2NSquaredBroad::ColliderList &output) const
 {
-    for (const auto &body : bodies) {
-        if (body->GetAABB()->Overlaps(aabb)) {
-            output.push_back(body);
+    for (const auto &proxy : proxies) {
+        if (proxy->Overlaps(aabb)) {
+            output.push_back(proxy->Collider);
         }
     }
 }
@@ -0,0 +1,90 @@
+#include "dura2d/d2PositionSolver.h"
+
+#include "dura2d/d2Body.h"
+#include "dura2d/d2Constants.h"
+#include "dura2d/d2Constraint.h"
+
+void
+d2PositionSolver::Prepare(const d2Contact *contacts, int32 contactCount)
+{
+    m_contacts.resize(contactCount);
+    for (int32 i = 0; i < contactCount; ++i) {
+        const d2Contact &contact = contacts[i];
+        d2PositionContact &positionContact = m_contacts[i];
+        positionContact.a = contact.a;
+        positionContact.b = contact.b;
+        // The deepest point of a into b is the end of the contact, the one of b its start
+        positionContact.localPointA = contact.a->WorldSpaceToLocalSpace(contact.end);
+        positionContact.localPointB = contact.b->WorldSpaceToLocalSpace(contact.start);
+
+        // Rotated only, like a direction
+        positionContact.localNormal = d2InvRotate(contact.a->Rotation(), contact.normal);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Contact position row
+///////////////////////////////////////////////////////////////////////////////
+// Same row as the normal velocity row, on positions:
+//  C = (pb - pa) · n, negative when penetrating
+//  λ = -β (C + slop) / (J * M^-1 * Jt), clamped so a step never moves too far
+// Returns the separation before the correction.
+///////////////////////////////////////////////////////////////////////////////
+real
+d2PositionSolver::SolveContact(const d2PositionContact &contact)
+{
+    d2Body *a = contact.a;
+    d2Body *b = contact.b;
+
+    const d2Vec2 pa = a->LocalSpaceToWorldSpace(contact.localPointA);
+    const d2Vec2 pb = b->LocalSpaceToWorldSpace(contact.localPointB);
+    const d2Vec2 n = d2Rotate(a->Rotation(), contact.localNormal);
+
+    const real separation = (pb - pa).Dot(n);
+    const real C = d2Clamp(POSITION_CORRECTION_RATE * (separation + LINEAR_SLOP), -MAX_POSITION_CORRECTION, 0.0f);
+    if (C == 0.0f) return separation;
+
+    // Both bodies are pushed at the middle of the contact
+    const d2Vec2 anchor = (pa + pb) * 0.5f;
+    const d2Vec2 ra = anchor - a->GetPosition();
+    const d2Vec2 rb = anchor - b->GetPosition();
+    const real raCrossN = ra.Cross(n);
+    const real rbCrossN = rb.Cross(n);
+
+    const real k = a->GetInvMass() + a->GetInvI() * raCrossN * raCrossN
+                   + b->GetInvMass() + b->GetInvI() * rbCrossN * rbCrossN;
+    if (k <= 0.0f) return separation;
+
+    // The static bodies are shared by every island, they are never written
+    const real lambda = -C / k;
+    if (a->m_type != d2BodyType::d2_staticBody) {
+        a->Position() -= n * (lambda * a->GetInvMass());
+        a->Rotation() += -a->GetInvI() * raCrossN * lambda;
+    }
+    if (b->m_type != d2BodyType::d2_staticBody) {
+        b->Position() += n * (lambda * b->GetInvMass());
+        b->Rotation() += b->GetInvI() * rbCrossN * lambda;
+    }
+    return separation;
+}
+
+int32
+d2PositionSolver::Solve(int32 contactStart, int32 contactCount, d2Constraint *const *joints, int32 jointCount,
+                        int32 iterations) const
+{
+    for (int32 i = 0; i < iterations; ++i) {
+        real maxJointError = 0.0f;
+        for (int32 j = 0; j < jointCount; ++j) {
+            maxJointError = d2Max(maxJointError, joints[j]->SolvePosition());
+        }
+
+        real minSeparation = 0.0f;
+        for (int32 j = 0; j < contactCount; ++j) {
+            minSeparation = d2Min(minSeparation, SolveContact(m_contacts[contactStart + j]));
+        }
+
+        // The contacts are pushed to a slop of penetration, so a few slops are close enough
+        if (minSeparation >= -3.0f * LINEAR_SLOP && maxJointError <= LINEAR_SLOP) return i + 1;
+    }
+    return iterations;
+}
@@ -1,5 +1,5 @@
 #include "dura2d/d2Shape.h"
-#include <iostream>
+#include <cassert>
 #include <limits>
 
 d2CircleShape::d2CircleShape(real radius)
@@ -31,6 +31,12 @@ d2CircleShape::GetMomentOfInertia() const
     return 0.5F * (radius * radius);
 }
 
+real
+d2CircleShape::GetArea() const
+{
+    return PI * radius * radius;
+}
+
 d2PolygonShape::d2PolygonShape(const d2Vec2* vertices, int vertexCount)
 {
     real minX = std::numeric_limits<real>::max();
@@ -115,6 +121,12 @@ d2PolygonShape::GetMomentOfInertia() const
     return acc0 / 6 / acc1;
 }
 
+real
+d2PolygonShape::GetArea() const
+{
+    return d2Abs(PolygonArea());
+}
+
 d2Vec2
 d2PolygonShape::EdgeAt(int index) const
 {
@@ -260,3 +272,386 @@ d2BoxShape::GetMomentOfInertia() const
     // But this still needs to be multiplied by the rigidbody's mass
     return (0.083333F) * (width * width + height * height);
 }
+
+d2CapsuleShape::d2CapsuleShape(real length, real radius)
+{
+    this->radius = radius;
+
+    localVertices[0] = d2Vec2(-length / 2.0F, 0.0F);
+    localVertices[1] = d2Vec2(+length / 2.0F, 0.0F);
+    worldVertices[0] = localVertices[0];
+    worldVertices[1] = localVertices[1];
+}
+
+d2CapsuleShape::d2CapsuleShape(const d2Vec2 &center1, const d2Vec2 &center2, real radius)
+{
+    this->radius = radius;
+
+    localVertices[0] = center1;
+    localVertices[1] = center2;
+    worldVertices[0] = center1;
+    worldVertices[1] = center2;
+}
+
+d2CapsuleShape::~d2CapsuleShape()
+{
+
+}
+
+d2ShapeType
+d2CapsuleShape::GetType() const
+{
+    return CAPSULE;
+}
+
+d2Shape *
+d2CapsuleShape::Clone() const
+{
+    return new d2CapsuleShape(localVertices[0], localVertices[1], radius);
+}
+
+real
+d2CapsuleShape::GetLength() const
+{
+    return (localVertices[1] - localVertices[0]).Lenght();
+}
+
+real
+d2CapsuleShape::GetMomentOfInertia() const
+{
+    // A capsule is a box of size length x 2r plus two half circles at its ends
+    const real rr = radius * radius;
+    const real length = GetLength();
+    const real circleArea = PI * rr;
+    const real boxArea = 2.0F * radius * length;
+    const real area = circleArea + boxArea;
+
+    // Each half circle has its centroid at 4r/3pi from the cap center, which sits at half the length
+    // from the capsule center, so the parallel axis theorem is applied twice:
+    // (h + lc)^2 - lc^2 = h^2 + 2 * h * lc
+    const real lc = 4.0F * radius / (3.0F * PI);
+    const real h = 0.5F * length;
+    const real circleInertia = circleArea * (0.5F * rr + h * h + 2.0F * h * lc);
+    const real boxInertia = boxArea * (4.0F * rr + length * length) / 12.0F;
+
+    // Move it to the body origin
+    const d2Vec2 center = (localVertices[0] + localVertices[1]) * 0.5F;
+
+    // But this still needs to be multiplied by the rigidbody's mass
+    return (circleInertia + boxInertia) / area + center.Dot(center);
+}
+
+real
+d2CapsuleShape::GetArea() const
+{
+    return PI * radius * radius + 2.0F * radius * GetLength();
+}
+
+void
+d2CapsuleShape::UpdateVertices(const d2Transform &transform)
+{
+    worldVertices[0] = d2Rotate(transform.q, localVertices[0]) + transform.p;
+    worldVertices[1] = d2Rotate(transform.q, localVertices[1]) + transform.p;
+}
+
+d2EdgeShape::d2EdgeShape(const d2Vec2 &v1, const d2Vec2 &v2)
+{
+    localVertices[0] = v1;
+    localVertices[1] = v1;
+    localVertices[2] = v2;
+    localVertices[3] = v2;
+    std::copy(std::begin(localVertices), std::end(localVertices), worldVertices);
+    oneSided = false;
+}
+
+d2EdgeShape::d2EdgeShape(const d2Vec2 &v0, const d2Vec2 &v1, const d2Vec2 &v2, const d2Vec2 &v3)
+{
+    localVertices[0] = v0;
+    localVertices[1] = v1;
+    localVertices[2] = v2;
+    localVertices[3] = v3;
+    std::copy(std::begin(localVertices), std::end(localVertices), worldVertices);
+    oneSided = true;
+}
+
+d2EdgeShape::~d2EdgeShape()
+{
+
+}
+
+d2ShapeType
+d2EdgeShape::GetType() const
+{
+    return EDGE;
+}
+
+d2Shape *
+d2EdgeShape::Clone() const
+{
+    d2EdgeShape *clone = new d2EdgeShape();
+    *clone = *this;
+    return clone;
+}
+
+real
+d2EdgeShape::GetMomentOfInertia() const
+{
+    // Edges have no area, they are meant for static bodies
+    return 0.0F;
+}
+
+real
+d2EdgeShape::GetArea() const
+{
+    return 0.0F;
+}
+
+void
+d2EdgeShape::UpdateVertices(const d2Transform &transform)
+{
+    for (int i = 0; i < 4; ++i) {
+        worldVertices[i] = d2Rotate(transform.q, localVertices[i]) + transform.p;
+    }
+}
+
+d2ChainShape::d2ChainShape(const d2Vec2* vertices, int32 vertexCount)
+{
+    localVertices = new d2Vec2[vertexCount];
+    worldVertices = new d2Vec2[vertexCount];
+    std::copy(vertices, vertices + vertexCount, localVertices);
+    std::copy(vertices, vertices + vertexCount, worldVertices);
+    m_vertexCount = vertexCount;
+
+    // The neighbours of the closing segment are the chain vertices themselves
+    localGhosts[0] = vertices[vertexCount - 1];
+    localGhosts[1] = vertices[0];
+    worldGhosts[0] = localGhosts[0];
+    worldGhosts[1] = localGhosts[1];
+    loop = true;
+}
+
+d2ChainShape::d2ChainShape(const d2Vec2* vertices, int32 vertexCount, const d2Vec2 &prevVertex, const d2Vec2 &nextVertex)
+{
+    localVertices = new d2Vec2[vertexCount];
+    worldVertices = new d2Vec2[vertexCount];
+    std::copy(vertices, vertices + vertexCount, localVertices);
+    std::copy(vertices, vertices + vertexCount, worldVertices);
+    m_vertexCount = vertexCount;
+
+    localGhosts[0] = prevVertex;
+    localGhosts[1] = nextVertex;
+    worldGhosts[0] = prevVertex;
+    worldGhosts[1] = nextVertex;
+    loop = false;
+}
+
+d2ChainShape::~d2ChainShape()
+{
+    delete[] localVertices;
+    delete[] worldVertices;
+}
+
+d2ShapeType
+d2ChainShape::GetType() const
+{
+    return CHAIN;
+}
+
+d2Shape *
+d2ChainShape::Clone() const
+{
+    if (loop) {
+        return new d2ChainShape(localVertices, m_vertexCount);
+    }
+    return new d2ChainShape(localVertices, m_vertexCount, localGhosts[0], localGhosts[1]);
+}
+
+real
+d2ChainShape::GetMomentOfInertia() const
+{
+    // Chains have no area, they are meant for static bodies
+    return 0.0F;
+}
+
+real
+d2ChainShape::GetArea() const
+{
+    return 0.0F;
+}
+
+void
+d2ChainShape::UpdateVertices(const d2Transform &transform)
+{
+    for (int32 i = 0; i < m_vertexCount; ++i) {
+        worldVertices[i] = d2Rotate(transform.q, localVertices[i]) + transform.p;
+    }
+    worldGhosts[0] = d2Rotate(transform.q, localGhosts[0]) + transform.p;
+    worldGhosts[1] = d2Rotate(transform.q, localGhosts[1]) + transform.p;
+}
+
+int32
+d2ChainShape::GetChildCount() const
+{
+    // A loop has one more segment to close it
+    return loop ? m_vertexCount : m_vertexCount - 1;
+}
+
+void
+d2ChainShape::GetChildEdge(d2EdgeShape *edge, int32 index) const
+{
+    const int32 i1 = index;
+    const int32 i2 = (index + 1) % m_vertexCount;
+
+    edge->oneSided = true;
+    edge->localVertices[1] = localVertices[i1];
+    edge->localVertices[2] = localVertices[i2];
+    edge->worldVertices[1] = worldVertices[i1];
+    edge->worldVertices[2] = worldVertices[i2];
+
+    if (loop) {
+        const int32 i0 = (index + m_vertexCount - 1) % m_vertexCount;
+        const int32 i3 = (index + 2) % m_vertexCount;
+        edge->localVertices[0] = localVertices[i0];
+        edge->localVertices[3] = localVertices[i3];
+        edge->worldVertices[0] = worldVertices[i0];
+        edge->worldVertices[3] = worldVertices[i3];
+        return;
+    }
+
+    // Open chains use the ghost vertices at both ends
+    edge->localVertices[0] = index > 0 ? localVertices[index - 1] : localGhosts[0];
+    edge->worldVertices[0] = index > 0 ? worldVertices[index - 1] : worldGhosts[0];
+    edge->localVertices[3] = index < m_vertexCount - 2 ? localVertices[index + 2] : localGhosts[1];
+    edge->worldVertices[3] = index < m_vertexCount - 2 ? worldVertices[index + 2] : worldGhosts[1];
+}
+
+d2CompoundShape::~d2CompoundShape()
+{
+    for (d2Shape *child: m_children) {
+        delete child;
+    }
+}
+
+// Centroid of a child shape in its own frame
+static d2Vec2
+GetLocalCentroid(const d2Shape *shape)
+{
+    switch (shape->GetType())
+    {
+        case POLYGON:
+        case BOX:
+            return ((const d2PolygonShape *) shape)->PolygonCentroid();
+        case CAPSULE:
+        {
+            const d2CapsuleShape *capsule = (const d2CapsuleShape *) shape;
+            return (capsule->localVertices[0] + capsule->localVertices[1]) * 0.5F;
+        }
+        default:
+            return { 0.0F, 0.0F };
+    }
+}
+
+// Moment of inertia of a child shape about its centroid, polygons give theirs about their origin
+static real
+GetCentroidInertia(const d2Shape *shape, const d2Vec2 &centroid)
+{
+    const d2ShapeType type = shape->GetType();
+    if (type == POLYGON || type == BOX) {
+        return shape->GetMomentOfInertia() - centroid.Dot(centroid);
+    }
+    return shape->GetMomentOfInertia();
+}
+
+void
+d2CompoundShape::AddChild(const d2Shape &shape, const d2Transform &localTransform)
+{
+    assert(shape.GetType() != CHAIN && shape.GetType() != COMPOUND);
+
+    d2Shape *child = shape.Clone();
+    m_children.push_back(child);
+    m_localTransforms.emplace_back(localTransform.p - m_center, localTransform.q);
+
+    // The body rotates about its origin, so the children are moved to keep their centroid on it
+    d2Vec2 centroid(0.0F, 0.0F);
+    real area = 0.0F;
+    for (size_t i = 0; i < m_children.size(); ++i) {
+        const real childArea = m_children[i]->GetArea();
+        centroid += d2TransformPoint(m_localTransforms[i], GetLocalCentroid(m_children[i])) * childArea;
+        area += childArea;
+    }
+    if (area > 0.0F) {
+        centroid = centroid / area;
+        m_center += centroid;
+        for (d2Transform &transform: m_localTransforms) {
+            transform.p -= centroid;
+        }
+    }
+
+    for (size_t i = 0; i < m_children.size(); ++i) {
+        m_children[i]->UpdateVertices(m_localTransforms[i]);
+    }
+}
+
+d2ShapeType
+d2CompoundShape::GetType() const
+{
+    return COMPOUND;
+}
+
+d2Shape *
+d2CompoundShape::Clone() const
+{
+    // The children are already centered
+    d2CompoundShape *clone = new d2CompoundShape();
+    for (size_t i = 0; i < m_children.size(); ++i) {
+        d2Shape *child = m_children[i]->Clone();
+        child->UpdateVertices(m_localTransforms[i]);
+        clone->m_children.push_back(child);
+        clone->m_localTransforms.push_back(m_localTransforms[i]);
+    }
+    clone->m_center = m_center;
+    return clone;
+}
+
+real
+d2CompoundShape::GetMomentOfInertia() const
+{
+    // Each child contributes by its share of the area, moved from its centroid to the body origin
+    // with the parallel axis theorem. Children without area are ignored.
+    real inertia = 0.0F;
+    real area = 0.0F;
+    for (size_t i = 0; i < m_children.size(); ++i) {
+        const d2Vec2 centroid = GetLocalCentroid(m_children[i]);
+        const d2Vec2 offset = d2TransformPoint(m_localTransforms[i], centroid);
+        const real childArea = m_children[i]->GetArea();
+        inertia += childArea * (GetCentroidInertia(m_children[i], centroid) + offset.Dot(offset));
+        area += childArea;
+    }
+
+    // But this still needs to be multiplied by the rigidbody's mass
+    return area > 0.0F ? inertia / area : 0.0F;
+}
+
+real
+d2CompoundShape::GetArea() const
+{
+    real area = 0.0F;
+    for (const d2Shape *child: m_children) {
+        area += child->GetArea();
+    }
+    return area;
+}
+
+void
+d2CompoundShape::UpdateVertices(const d2Transform &transform)
+{
+    for (size_t i = 0; i < m_children.size(); ++i) {
+        m_children[i]->UpdateVertices(d2Mul(transform, m_localTransforms[i]));
+    }
+}
+
+int32
+d2CompoundShape::GetChildCount() const
+{
+    return (int32) m_children.size();
+}
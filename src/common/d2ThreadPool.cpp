@@ -0,0 +1,117 @@
+#include "dura2d/d2ThreadPool.h"
+
+#include "dura2d/d2Math.h"
+
+d2ThreadPool::d2ThreadPool(int32 workerCount)
+{
+    Start(workerCount);
+}
+
+d2ThreadPool::~d2ThreadPool()
+{
+    Stop();
+}
+
+void
+d2ThreadPool::SetWorkerCount(int32 workerCount)
+{
+    if (workerCount == GetWorkerCount()) return;
+
+    Stop();
+    Start(workerCount);
+}
+
+void
+d2ThreadPool::Start(int32 workerCount)
+{
+    workerCount = d2Max<int32>(1, workerCount);
+
+    m_exit = false;
+    m_threads.reserve(workerCount - 1);
+    for (int32 i = 1; i < workerCount; ++i)
+    {
+        m_threads.emplace_back(&d2ThreadPool::WorkerMain, this, i, m_generation);
+    }
+}
+
+void
+d2ThreadPool::Stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_exit = true;
+    }
+    m_wakeCondition.notify_all();
+
+    for (std::thread& thread: m_threads)
+    {
+        thread.join();
+    }
+    m_threads.clear();
+}
+
+void
+d2ThreadPool::ParallelFor(int32 count, int32 minRange, const d2RangeTask& task)
+{
+    if (count <= 0) return;
+
+    const int32 workerCount = GetWorkerCount();
+    minRange = d2Max<int32>(1, minRange);
+
+    // Not worth waking anyone up, run it inline
+    if (workerCount == 1 || count <= minRange)
+    {
+        task(0, count, 0);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_task = &task;
+        m_count = count;
+        m_rangeSize = d2Max<int32>(minRange, (count + workerCount - 1) / workerCount);
+        m_pending = workerCount - 1;
+        ++m_generation;
+    }
+    m_wakeCondition.notify_all();
+
+    // The calling thread takes the first range
+    RunRange(0);
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_doneCondition.wait(lock, [this] { return m_pending == 0; });
+    m_task = nullptr;
+}
+
+void
+d2ThreadPool::RunRange(int32 workerIndex)
+{
+    const int32 begin = workerIndex * m_rangeSize;
+    const int32 end = d2Min(m_count, begin + m_rangeSize);
+    if (begin < end)
+    {
+        (*m_task)(begin, end, workerIndex);
+    }
+}
+
+void
+d2ThreadPool::WorkerMain(int32 workerIndex, uint32 generation)
+{
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wakeCondition.wait(lock, [&] { return m_exit || m_generation != generation; });
+            if (m_exit) return;
+            generation = m_generation;
+        }
+
+        RunRange(workerIndex);
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            --m_pending;
+        }
+        m_doneCondition.notify_one();
+    }
+}
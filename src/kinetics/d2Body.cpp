@@ -3,26 +3,22 @@
 #include <iostream>
 
 #include "dura2d/d2AABB.h"
+#include "dura2d/d2Broadphase.h"
+#include "dura2d/d2Constants.h"
+#include "dura2d/d2Island.h"
 #include "dura2d/d2World.h"
 
 d2Body::d2Body(const d2Shape &shape, real x, real y, real mass, d2World *world) : world(world)
 {
-    this->m_transform = d2Transform((d2Vec2(x, y)), d2Rot(0.F));
-
-    this->velocity = d2Vec2(0, 0);
-    this->acceleration = d2Vec2(0, 0);
-
-    this->angularVelocity = 0.F;
-    this->angularAcceleration = 0.F;
-
-    this->sumForces = d2Vec2(0, 0);
-    this->sumTorque = 0.F;
+    // The origin of a compound is the centroid of its children, not the frame they were given in
+    d2Vec2 origin(x, y);
+    if (shape.GetType() == COMPOUND) origin += ((const d2CompoundShape &) shape).m_center;
+    const d2Transform transform(origin, d2Rot(0.F));
 
     this->restitution = 0.6F;
     this->friction = 0.7F;
 
-    this->mass = mass;
-    this->invMass = (mass != 0.F) ? 1.F / mass : 0.F;
+    const real invMass = (mass != 0.F) ? 1.F / mass : 0.F;
     {
         const real epsilon = 0.005f;
         d2Abs(invMass - 0.0) < epsilon
@@ -31,38 +27,47 @@ d2Body::d2Body(const d2Shape &shape, real x, real y, real mass, d2World *world)
     }
 
     this->I = shape.GetMomentOfInertia() * mass;
-    this->invI = (I != 0.F) ? 1.F / I : 0.F;
+    const real invI = (I != 0.F) ? 1.F / I : 0.F;
+    world->m_bodyStorage.Add(this, transform, mass, invI, m_type == d2_dynamicBody);
 
     this->shape = shape.Clone();
-    this->shape->UpdateVertices(m_transform);
+    this->shape->UpdateVertices(transform);
 
     this->m_flags = d2Body::e_awakeFlag;
     this->m_sleepTime = 0.0F;
 
-    // Create the d2AABB for this body
-    aabb = new d2AABB();
+    // Create one d2AABB per shape child, each one is a broadphase proxy
+    m_proxyCount = this->shape->GetChildCount();
+    aabb = new d2AABB[m_proxyCount];
+    for (int32 i = 0; i < m_proxyCount; ++i)
+    {
+        aabb[i].Collider = this;
+        aabb[i].childIndex = i;
+    }
     ComputeAABB();
 }
 
 d2Body::~d2Body()
 {
+    m_storage->Remove(this);
     delete shape;
-    delete aabb;
+    delete[] aabb;
 }
 
-void
-d2Body::ComputeAABB()
+// Bound a single child shape, with its vertices already in world space
+static void
+ComputeShapeAABB(const d2Shape *shape, d2AABB *aabb)
 {
     switch (shape->GetType())
     {
         case POLYGON:
         case BOX:
         {
-            auto* box = dynamic_cast<d2PolygonShape*>(shape);
+            auto* box = (const d2PolygonShape*)shape;
             d2Vec2 minVertex = box->worldVertices[0];
             d2Vec2 maxVertex = box->worldVertices[0];
 
-            for (int i = 1; i < 4; ++i) {
+            for (int i = 1; i < box->m_vertexCount; ++i) {
                 minVertex = d2Min(minVertex, box->worldVertices[i]);
                 maxVertex = d2Max(maxVertex, box->worldVertices[i]);
             }
@@ -73,80 +78,166 @@ d2Body::ComputeAABB()
         }
         case CIRCLE:
         {
-            auto* circle = dynamic_cast<d2CircleShape*>(shape);
-            d2Vec2 lowerBound = m_transform.p - d2Vec2(circle->radius, circle->radius);
-            d2Vec2 upperBound = m_transform.p + d2Vec2(circle->radius, circle->radius);
+            auto* circle = (const d2CircleShape*)shape;
+            d2Vec2 lowerBound = circle->worldCenter - d2Vec2(circle->radius, circle->radius);
+            d2Vec2 upperBound = circle->worldCenter + d2Vec2(circle->radius, circle->radius);
             aabb->lowerBound = lowerBound;
             aabb->upperBound = upperBound;
             break;
         }
+        case CAPSULE:
+        {
+            auto* capsule = (const d2CapsuleShape*)shape;
+            const d2Vec2 radius(capsule->radius, capsule->radius);
+            aabb->lowerBound = d2Min(capsule->worldVertices[0], capsule->worldVertices[1]) - radius;
+            aabb->upperBound = d2Max(capsule->worldVertices[0], capsule->worldVertices[1]) + radius;
+            break;
+        }
+        case EDGE:
+        {
+            auto* edge = (const d2EdgeShape*)shape;
+            aabb->lowerBound = d2Min(edge->worldVertices[1], edge->worldVertices[2]);
+            aabb->upperBound = d2Max(edge->worldVertices[1], edge->worldVertices[2]);
+            break;
+        }
         default:
             std::cout << "d2Shape type not supported" << std::endl;
             break;
     }
+}
+
+void
+d2Body::ComputeAABB()
+{
+    switch (shape->GetType())
+    {
+        case CHAIN:
+        {
+            auto* chain = dynamic_cast<d2ChainShape*>(shape);
+            for (int32 i = 0; i < m_proxyCount; ++i)
+            {
+                const d2Vec2 v1 = chain->worldVertices[i];
+                const d2Vec2 v2 = chain->worldVertices[(i + 1) % chain->m_vertexCount];
+                aabb[i].lowerBound = d2Min(v1, v2);
+                aabb[i].upperBound = d2Max(v1, v2);
+            }
+            break;
+        }
+        case COMPOUND:
+        {
+            auto* compound = dynamic_cast<d2CompoundShape*>(shape);
+            for (int32 i = 0; i < m_proxyCount; ++i)
+            {
+                ComputeShapeAABB(compound->GetChild(i), aabb + i);
+            }
+            break;
+        }
+        default:
+            ComputeShapeAABB(shape, aabb);
+            break;
+    }
+}
+
+void
+d2Body::ComputeSpeculativeDistance(real dt)
+{
+    d2AABB bound = aabb[0];
+    for (int32 i = 1; i < m_proxyCount; ++i)
+    {
+        bound.Combine(aabb[i]);
+    }
+
+    // The farthest point of the body moves with the linear velocity plus the rotation around the origin
+    const real travel = (GetVelocity().Lenght() + d2Abs(GetAngularVelocity()) * bound.GetExtents().Lenght()) * dt;
+    m_speculativeDistance = d2Min(travel, SPECULATIVE_DISTANCE_MAX);
+
+    const d2Vec2 margin(m_speculativeDistance, m_speculativeDistance);
+    for (int32 i = 0; i < m_proxyCount; ++i)
+    {
+        aabb[i].lowerBound -= margin;
+        aabb[i].upperBound += margin;
+    }
+}
 
-    if (aabb->Collider == nullptr)
-        aabb->Collider = this;
+void
+d2Body::WakeIsland()
+{
+    world->m_islandBuilder->Wake(m_sleepingIsland);
+}
+
+void
+d2Body::RefreshProxies()
+{
+    world->broadphase->Refresh(this);
 }
 
 void
 d2Body::AddForce(const d2Vec2 &force)
 {
-    sumForces += force;
+    if (m_type == d2_staticBody) return;
+    if (!IsAwake()) SetAwake(true);
+    m_storage->forces[m_denseIndex] += force;
 }
 
 void
 d2Body::AddTorque(real torque)
 {
-    sumTorque += torque;
+    if (m_type == d2_staticBody) return;
+    if (!IsAwake()) SetAwake(true);
+    m_storage->torques[m_denseIndex] += torque;
 }
 
 void
 d2Body::ClearForces()
 {
-    sumForces = d2Vec2(0.0, 0.0);
+    m_storage->forces[m_denseIndex] = d2Vec2(0.0, 0.0);
 }
 
 void
 d2Body::ClearTorque()
 {
-    sumTorque = 0.0;
+    m_storage->torques[m_denseIndex] = 0.0;
 }
 
 d2Vec2
 d2Body::LocalSpaceToWorldSpace(const d2Vec2 &point) const
 {
-    d2Vec2 rotated = d2Rotate(m_transform.q, point);
-    return rotated + m_transform.p;
+    const int32 i = m_denseIndex;
+    d2Vec2 rotated = d2Rotate(m_storage->rotations[i], point);
+    return rotated + m_storage->positions[i];
 }
 
 d2Vec2
 d2Body::WorldSpaceToLocalSpace(const d2Vec2 &point) const
 {
-    const d2Vec2 translated = point - m_transform.p;
-    return { m_transform.q.GetXAxis().Dot(translated), m_transform.q.GetYAxis().Dot(translated) };
+    const d2Rot &q = m_storage->rotations[m_denseIndex];
+    const d2Vec2 translated = point - m_storage->positions[m_denseIndex];
+    return { q.GetXAxis().Dot(translated), q.GetYAxis().Dot(translated) };
 }
 
 void
 d2Body::ApplyImpulseLinear(const d2Vec2 &j)
 {
     if (m_type == d2_staticBody) return;
-    velocity += j * invMass;
+    if (!IsAwake()) SetAwake(true);
+    Velocity() += j * GetInvMass();
 }
 
 void
 d2Body::ApplyImpulseAngular(const real j)
 {
     if (m_type == d2_staticBody) return;
-    angularVelocity += j * invI;
+    if (!IsAwake()) SetAwake(true);
+    AngularVelocity() += j * GetInvI();
 }
 
 void
 d2Body::ApplyImpulseAtPoint(const d2Vec2 &j, const d2Vec2 &r)
 {
     if (m_type == d2_staticBody) return;
-    velocity += j * invMass;
-    angularVelocity += r.Cross(j) * invI;
+    if (!IsAwake()) SetAwake(true);
+    Velocity() += j * GetInvMass();
+    AngularVelocity() += r.Cross(j) * GetInvI();
 }
 
 void
@@ -154,17 +245,20 @@ d2Body::IntegrateForces(const real dt)
 {
     if (m_type == d2_staticBody) return;
 
+    d2BodyStorage &s = *m_storage;
+    const int32 i = m_denseIndex;
+
     // Find the acceleration based on the forces that are being applied and the mass
-    acceleration = sumForces * invMass;
+    s.accelerations[i] = s.forces[i] * s.invMasses[i];
 
     // Integrate the acceleration to find the new velocity
-    velocity += acceleration * dt;
+    s.velocities[i] += s.accelerations[i] * dt;
 
     // Find the angular acceleration based on the torque that is being applied and the moment of inertia
-    angularAcceleration = sumTorque * invI;
+    s.angularAccelerations[i] = s.torques[i] * s.invInertias[i];
 
     // Integrate the angular acceleration to find the new angular velocity
-    angularVelocity += angularAcceleration * dt;
+    s.angularVelocities[i] += s.angularAccelerations[i] * dt;
 
     // Clear all the forces and torque acting on the object before the next physics step
     ClearForces();
@@ -176,12 +270,15 @@ d2Body::IntegrateVelocities(const real dt)
 {
     if (m_type == d2_staticBody) return;
 
+    d2BodyStorage &s = *m_storage;
+    const int32 i = m_denseIndex;
+
     // Integrate the velocity to find the new position
-    m_transform.p += velocity * dt;
+    s.positions[i] += s.velocities[i] * dt;
 
     // Integrate the angular velocity to find the new rotation angle
-    m_transform.q += angularVelocity * dt;
+    s.rotations[i] += s.angularVelocities[i] * dt;
 
     // Update the vertices to adjust them to the new position/rotation
-    shape->UpdateVertices(m_transform);
+    shape->UpdateVertices(GetTransform());
 }
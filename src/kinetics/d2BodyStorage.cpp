@@ -0,0 +1,116 @@
+#include "dura2d/d2BodyStorage.h"
+
+#include "dura2d/d2Body.h"
+
+#include <algorithm>
+
+void
+d2BodyStorage::Add(d2Body *body, const d2Transform &transform, real mass, real invI, bool dynamic)
+{
+    // Reuse a slot of a destroyed body, its generation was bumped when it was freed
+    int32 slot = m_freeSlot;
+    if (slot != -1) {
+        m_freeSlot = m_slots[slot].denseIndex;
+    } else {
+        slot = (int32)m_slots.size();
+        m_slots.push_back({ -1, 1 });
+    }
+
+    const int32 denseIndex = GetCount();
+    m_slots[slot].denseIndex = denseIndex;
+    body->m_storage = this;
+    body->m_denseIndex = denseIndex;
+    body->m_id = { slot, m_slots[slot].generation };
+
+    bodies.push_back(body);
+    positions.push_back(transform.p);
+    rotations.push_back(transform.q);
+    velocities.emplace_back(0.0F, 0.0F);
+    angularVelocities.push_back(0.0F);
+    accelerations.emplace_back(0.0F, 0.0F);
+    angularAccelerations.push_back(0.0F);
+    forces.emplace_back(0.0F, 0.0F);
+    torques.push_back(0.0F);
+    masses.push_back(mass);
+    invMasses.push_back((mass != 0.F) ? 1.F / mass : 0.F);
+    invInertias.push_back(invI);
+    gravityScales.push_back(1.0F);
+    moving.push_back(dynamic ? 1 : 0);
+}
+
+// Move the last element of an array into a hole, then drop the last one
+template <typename T>
+static void
+SwapRemove(std::vector<T> &array, int32 index)
+{
+    array[index] = array.back();
+    array.pop_back();
+}
+
+void
+d2BodyStorage::Remove(d2Body *body)
+{
+    const int32 index = body->m_denseIndex;
+    const int32 last = GetCount() - 1;
+    if (index != last) {
+        d2Body *moved = bodies[last];
+        moved->m_denseIndex = index;
+        m_slots[moved->m_id.index].denseIndex = index;
+    }
+
+    SwapRemove(bodies, index);
+    SwapRemove(positions, index);
+    SwapRemove(rotations, index);
+    SwapRemove(velocities, index);
+    SwapRemove(angularVelocities, index);
+    SwapRemove(accelerations, index);
+    SwapRemove(angularAccelerations, index);
+    SwapRemove(forces, index);
+    SwapRemove(torques, index);
+    SwapRemove(masses, index);
+    SwapRemove(invMasses, index);
+    SwapRemove(invInertias, index);
+    SwapRemove(gravityScales, index);
+    SwapRemove(moving, index);
+
+    // Stale the handles to the body, a generation of 0 is kept for the null handle
+    Slot &slot = m_slots[body->m_id.index];
+    if (++slot.generation == 0) slot.generation = 1;
+    slot.denseIndex = m_freeSlot;
+    m_freeSlot = body->m_id.index;
+    body->m_denseIndex = -1;
+}
+
+void
+d2BodyStorage::Reserve(int32 count)
+{
+    // Grown geometrically like push_back, so a batch a frame doesn't copy every array every frame
+    const size_t capacity = bodies.capacity();
+    if ((size_t)count <= capacity) return;
+    count = (int32)std::max((size_t)count, 2 * capacity);
+
+    bodies.reserve(count);
+    positions.reserve(count);
+    rotations.reserve(count);
+    velocities.reserve(count);
+    angularVelocities.reserve(count);
+    accelerations.reserve(count);
+    angularAccelerations.reserve(count);
+    forces.reserve(count);
+    torques.reserve(count);
+    masses.reserve(count);
+    invMasses.reserve(count);
+    invInertias.reserve(count);
+    gravityScales.reserve(count);
+    moving.reserve(count);
+}
+
+d2Body*
+d2BodyStorage::Get(d2BodyId id) const
+{
+    if (id.index < 0 || id.index >= (int32)m_slots.size()) return nullptr;
+
+    const Slot &slot = m_slots[id.index];
+    if (slot.generation != id.generation) return nullptr;
+    return bodies[slot.denseIndex];
+}
@@ -0,0 +1,211 @@
+#include "dura2d/d2Island.h"
+
+#include "dura2d/d2Body.h"
+#include "dura2d/d2BodyStorage.h"
+#include "dura2d/d2Constraint.h"
+
+#include <algorithm>
+#include <numeric>
+
+int32
+d2IslandBuilder::Find(int32 index)
+{
+    // Path halving keeps the trees flat without recursion
+    while (m_parents[index] != index) {
+        m_parents[index] = m_parents[m_parents[index]];
+        index = m_parents[index];
+    }
+    return index;
+}
+
+void
+d2IslandBuilder::Union(int32 indexA, int32 indexB)
+{
+    const int32 rootA = Find(indexA);
+    const int32 rootB = Find(indexB);
+    if (rootA == rootB) return;
+
+    // The lower root wins so the result only depends on the body order
+    if (rootA < rootB) {
+        m_parents[rootB] = rootA;
+    } else {
+        m_parents[rootA] = rootB;
+    }
+}
+
+void
+d2IslandBuilder::Build(const d2BodyStorage &storage, const std::vector<d2Contact> &contacts, d2Constraint *joints)
+{
+    // Every awake dynamic body starts as its own island, the sleeping ones are kept by Sleep()
+    std::vector<d2Body*> &awakeBodies = m_awakeBodies;
+    awakeBodies.clear();
+    const int32 storageCount = storage.GetCount();
+    for (int32 i = 0; i < storageCount; ++i) {
+        if (!storage.moving[i]) continue;
+
+        d2Body *body = storage.bodies[i];
+        body->m_islandIndex = (int32)awakeBodies.size();
+        awakeBodies.push_back(body);
+    }
+    const int32 bodyCount = (int32)awakeBodies.size();
+    m_parents.resize(bodyCount);
+    std::iota(m_parents.begin(), m_parents.end(), 0);
+
+    // Link the awake bodies of every contact and joint
+    auto isMoving = [&storage](const d2Body *body) { return storage.moving[body->m_denseIndex] != 0; };
+    for (const d2Contact &contact: contacts) {
+        if (isMoving(contact.a) && isMoving(contact.b)) {
+            Union(contact.a->m_islandIndex, contact.b->m_islandIndex);
+        }
+    }
+    for (d2Constraint *joint = joints; joint; joint = joint->GetNext()) {
+        if (isMoving(joint->a) && isMoving(joint->b)) {
+            Union(joint->a->m_islandIndex, joint->b->m_islandIndex);
+        }
+    }
+
+    // Number the islands by their first body
+    std::vector<int32> &bodyIslands = m_bodyIslands;
+    std::vector<int32> &rootIslands = m_rootIslands;
+    bodyIslands.resize(bodyCount);
+    rootIslands.assign(bodyCount, -1);
+    int32 islandCount = 0;
+    for (int32 i = 0; i < bodyCount; ++i) {
+        const int32 root = Find(i);
+        if (rootIslands[root] < 0) rootIslands[root] = islandCount++;
+        bodyIslands[i] = rootIslands[root];
+    }
+
+    // Island of a constraint, from any of its awake bodies. Constraints without one have nothing
+    // to solve and belong to no island.
+    auto getIsland = [&](const d2Body *a, const d2Body *b)
+    {
+        if (isMoving(a)) return bodyIslands[a->m_islandIndex];
+        if (isMoving(b)) return bodyIslands[b->m_islandIndex];
+        return -1;
+    };
+
+    std::vector<d2Island> &islands = m_unsortedIslands;
+    islands.assign(islandCount, d2Island{ 0, 0, 0, 0, 0, 0 });
+    for (int32 i = 0; i < bodyCount; ++i) {
+        ++islands[bodyIslands[i]].bodyCount;
+    }
+    std::vector<int32> &contactIslands = m_contactIslands;
+    contactIslands.resize(contacts.size());
+    for (size_t i = 0; i < contacts.size(); ++i) {
+        contactIslands[i] = getIsland(contacts[i].a, contacts[i].b);
+        if (contactIslands[i] >= 0) ++islands[contactIslands[i]].contactCount;
+    }
+    std::vector<d2Constraint*> &jointList = m_jointList;
+    std::vector<int32> &jointIslands = m_jointIslands;
+    jointList.clear();
+    jointIslands.clear();
+    for (d2Constraint *joint = joints; joint; joint = joint->GetNext()) {
+        const int32 island = getIsland(joint->a, joint->b);
+        if (island < 0) continue;
+
+        jointList.push_back(joint);
+        jointIslands.push_back(island);
+        ++islands[island].jointCount;
+    }
+
+    // The biggest first, ties keep the body order
+    std::vector<int32> &order = m_order;
+    order.resize(islandCount);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&islands](int32 lhs, int32 rhs)
+    {
+        return islands[lhs].GetConstraintCount() > islands[rhs].GetConstraintCount();
+    });
+
+    m_islands.resize(islandCount);
+    std::vector<int32> &ranks = m_ranks;
+    ranks.resize(islandCount);
+    int32 bodyStart = 0, contactStart = 0, jointStart = 0;
+    for (int32 rank = 0; rank < islandCount; ++rank) {
+        d2Island island = islands[order[rank]];
+        island.bodyStart = bodyStart;
+        island.contactStart = contactStart;
+        island.jointStart = jointStart;
+        bodyStart += island.bodyCount;
+        contactStart += island.contactCount;
+        jointStart += island.jointCount;
+
+        m_islands[rank] = island;
+        ranks[order[rank]] = rank;
+    }
+
+    // Group everything by island, keeping the original order inside an island
+    m_bodyCursors.resize(islandCount);
+    m_contactCursors.resize(islandCount);
+    m_jointCursors.resize(islandCount);
+    for (int32 rank = 0; rank < islandCount; ++rank) {
+        m_bodyCursors[rank] = m_islands[rank].bodyStart;
+        m_contactCursors[rank] = m_islands[rank].contactStart;
+        m_jointCursors[rank] = m_islands[rank].jointStart;
+    }
+
+    m_bodies.resize(bodyCount);
+    for (int32 i = 0; i < bodyCount; ++i) {
+        m_bodies[m_bodyCursors[ranks[bodyIslands[i]]]++] = awakeBodies[i];
+    }
+    m_contacts.resize(contactStart);
+    for (size_t i = 0; i < contacts.size(); ++i) {
+        if (contactIslands[i] < 0) continue;
+        m_contacts[m_contactCursors[ranks[contactIslands[i]]]++] = contacts[i];
+    }
+    m_joints.resize(jointStart);
+    for (size_t i = 0; i < jointList.size(); ++i) {
+        m_joints[m_jointCursors[ranks[jointIslands[i]]]++] = jointList[i];
+    }
+}
+
+void
+d2IslandBuilder::Sleep(int32 index)
+{
+    int32 slot;
+    if (!m_freeSleepingIslands.empty()) {
+        slot = m_freeSleepingIslands.back();
+        m_freeSleepingIslands.pop_back();
+    } else {
+        slot = (int32)m_sleepingIslands.size();
+        m_sleepingIslands.emplace_back();
+    }
+
+    // The contacts are kept too, the narrowphase won't find them again until the island is awake
+    const d2Island &island = m_islands[index];
+    SleepingIsland &sleeping = m_sleepingIslands[slot];
+    sleeping.bodies.assign(m_bodies.begin() + island.bodyStart, m_bodies.begin() + island.bodyStart + island.bodyCount);
+    sleeping.contacts.assign(m_contacts.begin() + island.contactStart,
+                             m_contacts.begin() + island.contactStart + island.contactCount);
+    for (d2Body *body: sleeping.bodies) {
+        body->m_sleepingIsland = slot;
+    }
+}
+
+void
+d2IslandBuilder::Wake(int32 index)
+{
+    SleepingIsland &sleeping = m_sleepingIslands[index];
+
+    // Unlinked first, so waking the bodies doesn't come back here
+    for (d2Body *body: sleeping.bodies) {
+        body->m_sleepingIsland = -1;
+    }
+    for (d2Body *body: sleeping.bodies) {
+        body->SetAwake(true);
+    }
+
+    m_wokenBodies.insert(m_wokenBodies.end(), sleeping.bodies.begin(), sleeping.bodies.end());
+    m_wokenContacts.insert(m_wokenContacts.end(), sleeping.contacts.begin(), sleeping.contacts.end());
+    sleeping.bodies.clear();
+    sleeping.contacts.clear();
+    m_freeSleepingIslands.push_back(index);
+}
+
+void
+d2IslandBuilder::ClearWoken()
+{
+    m_wokenBodies.clear();
+    m_wokenContacts.clear();
+}
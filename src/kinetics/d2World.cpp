@@ -5,30 +5,157 @@
 #include "dura2d/d2NSquaredBroad.h"
 #include "dura2d/d2AABBTree.h"
 #include "dura2d/d2Constraint.h"
+#include "dura2d/d2Joint.h"
+#include "dura2d/d2ConstraintSolver.h"
 #include "dura2d/d2Constants.h"
 #include "dura2d/d2CollisionDetection.h"
 #include "dura2d/d2Draw.h"
+#include "dura2d/d2Island.h"
+#include "dura2d/d2PositionSolver.h"
+#include "dura2d/d2ThreadPool.h"
 
 #include "dura2d/d2Timer.h"
 
+#include <algorithm>
+#include <iterator>
 #include <iostream>
+#include <limits>
 
 d2World::d2World(const d2Vec2 &gravity)
 {
     m_gravity = gravity * -1.0f;
     broadphase = new d2AABBTree();
+    m_threadPool = new d2ThreadPool();
+    m_constraintSolver = new d2ConstraintSolver(m_threadPool);
+    m_islandBuilder = new d2IslandBuilder();
+    m_positionSolver = new d2PositionSolver();
 }
 
 d2World::~d2World()
 {
+    for (d2ConstraintSolver *solver: m_islandSolvers) {
+        delete solver;
+    }
+    delete m_positionSolver;
+    delete m_islandBuilder;
+    delete m_constraintSolver;
+    delete m_threadPool;
     delete broadphase;
 }
 
+void
+d2World::SetWorkerCount(int32 workerCount)
+{
+    m_threadPool->SetWorkerCount(workerCount);
+}
+
+int32
+d2World::GetWorkerCount() const
+{
+    return m_threadPool->GetWorkerCount();
+}
+
+void
+d2World::SetDeterministic(bool flag)
+{
+    m_deterministic = flag;
+    m_constraintSolver->SetDeterministic(flag);
+}
+
+bool
+d2World::GetDeterministic() const
+{
+    return m_deterministic;
+}
+
+// FNV-1a over the bytes of a value
+template <typename T>
+static uint64
+HashBytes(uint64 hash, const T &value)
+{
+    const uint8 *bytes = reinterpret_cast<const uint8*>(&value);
+    for (size_t i = 0; i < sizeof(T); ++i) {
+        hash = (hash ^ bytes[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+uint64
+d2World::GetStateHash() const
+{
+    uint64 hash = 14695981039346656037ull;
+    for (const d2Body *body = m_bodiesList; body; body = body->next) {
+        const d2Transform transform = body->GetTransform();
+        const d2Vec2 velocity = body->GetVelocity();
+        hash = HashBytes(hash, body->m_creationIndex);
+        hash = HashBytes(hash, transform.p.x);
+        hash = HashBytes(hash, transform.p.y);
+        hash = HashBytes(hash, transform.q.s);
+        hash = HashBytes(hash, transform.q.c);
+        hash = HashBytes(hash, velocity.x);
+        hash = HashBytes(hash, velocity.y);
+        hash = HashBytes(hash, body->GetAngularVelocity());
+        hash = HashBytes(hash, (uint8)body->IsAwake());
+    }
+    return hash;
+}
+
+void
+d2World::SetSolverColorCount(int32 colorCount)
+{
+    m_constraintSolver->SetColorCount(colorCount);
+}
+
+int32
+d2World::GetSolverColorCount() const
+{
+    return m_constraintSolver->GetMaxColorCount();
+}
+
+void
+d2World::SetSolverTolerance(real tolerance)
+{
+    m_constraintSolver->SetTolerance(tolerance);
+}
+
+real
+d2World::GetSolverTolerance() const
+{
+    return m_constraintSolver->GetTolerance();
+}
+
 d2Body*
 d2World::CreateBody(const d2Shape &shape, d2Vec2 position, real mass)
+{
+    d2Body* body = NewBody(shape, position, mass);
+
+    // add to broadphase
+    broadphase->Add(body);
+
+    return body;
+}
+
+void
+d2World::CreateBodies(const d2BodyDef *defs, int32 count, d2BodyId *ids)
+{
+    m_bodyStorage.Reserve(m_bodyStorage.GetCount() + count);
+
+    m_batchBodies.clear();
+    m_batchBodies.reserve(count);
+    for (int32 i = 0; i < count; ++i) {
+        m_batchBodies.push_back(NewBody(*defs[i].shape, defs[i].position, defs[i].mass));
+        if (ids) ids[i] = m_batchBodies.back()->GetId();
+    }
+
+    broadphase->AddBodies(m_batchBodies.data(), count);
+}
+
+d2Body*
+d2World::NewBody(const d2Shape &shape, d2Vec2 position, real mass)
 {
     void* ptr = m_blockAllocator.Allocate(sizeof(d2Body));
     d2Body* body = new(ptr) d2Body(shape, position.x, position.y, mass, this);
+    body->m_creationIndex = m_creationCount++;
 
     // Add to world doubly linked list.
     body->prev = nullptr;
@@ -39,18 +166,87 @@ d2World::CreateBody(const d2Shape &shape, d2Vec2 position, real mass)
     m_bodiesList = body;
     ++m_bodyCount;
 
-    // add to broadphase
-    broadphase->Add(body);
-
     return body;
 }
 
+template <typename IsDestroyed>
+void
+d2World::ForgetBodies(IsDestroyed isDestroyed)
+{
+    // Whatever rested on them has to fall
+    for (const d2ContactPair &pair: m_touchingPairs) {
+        if (isDestroyed(pair.a) != isDestroyed(pair.b)) {
+            d2Body *other = isDestroyed(pair.a) ? pair.b : pair.a;
+            if (other->m_type != d2BodyType::d2_staticBody) other->SetAwake(true);
+        }
+    }
+
+    // Forget their contacts and overlaps, they won't report an end event
+    auto involves = [&](const d2ContactPair &pair) { return isDestroyed(pair.a) || isDestroyed(pair.b); };
+    auto forget = [&](std::vector<d2ContactPair> &pairs) { pairs.erase(std::remove_if(pairs.begin(), pairs.end(), involves), pairs.end()); };
+    forget(m_touchingPairs);
+    forget(m_contactEvents.beginEvents);
+    forget(m_contactEvents.endEvents);
+    m_contactEvents.hitEvents.erase(std::remove_if(m_contactEvents.hitEvents.begin(), m_contactEvents.hitEvents.end(),
+                                                   [&](const d2ContactHitEvent &hit) { return involves(hit.pair); }),
+                                    m_contactEvents.hitEvents.end());
+    forget(m_sensorOverlaps);
+    forget(m_sensorEvents.beginEvents);
+    forget(m_sensorEvents.endEvents);
+}
+
 void
 d2World::DestroyBody(d2Body *body)
 {
+    // Its sleeping island must not keep it
+    if (body->m_type != d2BodyType::d2_staticBody) body->SetAwake(true);
+
     // Remove from broadphase
     broadphase->Remove(body);
 
+    ForgetBodies([body](const d2Body *other) { return other == body; });
+    FreeBody(body);
+}
+
+void
+d2World::DestroyBodies(const d2BodyId *ids, int32 count)
+{
+    // Stale handles are skipped. Sorted by address for the lookups, with the position of each
+    // body in the batch so a body named twice is destroyed once, in the order it was first named.
+    std::vector<std::pair<d2Body*, int32>> named;
+    named.reserve(count);
+    for (int32 i = 0; i < count; ++i) {
+        d2Body *body = GetBody(ids[i]);
+        if (body) named.emplace_back(body, i);
+    }
+    std::sort(named.begin(), named.end());
+    named.erase(std::unique(named.begin(), named.end(), [](const auto &a, const auto &b) { return a.first == b.first; }),
+                named.end());
+
+    std::vector<d2Body*> sorted(named.size());
+    std::transform(named.begin(), named.end(), sorted.begin(), [](const auto &entry) { return entry.first; });
+    std::sort(named.begin(), named.end(), [](const auto &a, const auto &b) { return a.second < b.second; });
+
+    m_batchBodies.clear();
+    for (const auto &entry: named) {
+        m_batchBodies.push_back(entry.first);
+    }
+
+    // Their sleeping islands must not keep them
+    for (d2Body *body: m_batchBodies) {
+        if (body->m_type != d2BodyType::d2_staticBody) body->SetAwake(true);
+    }
+
+    broadphase->RemoveBodies(m_batchBodies.data(), (int32)m_batchBodies.size());
+    ForgetBodies([&sorted](const d2Body *body) { return std::binary_search(sorted.begin(), sorted.end(), body); });
+    for (d2Body *body: m_batchBodies) {
+        FreeBody(body);
+    }
+}
+
+void
+d2World::FreeBody(d2Body *body)
+{
     // Remove from world doubly linked list.
     if (body->prev) {
         body->prev->next = body->next;
@@ -68,11 +264,25 @@ d2World::DestroyBody(d2Body *body)
     m_blockAllocator.Free(body, sizeof(d2Body));
 }
 
-d2Constraint *
+d2Joint *
 d2World::CreateJoint(d2Body *bodyA, d2Body *bodyB, d2Vec2 anchorPoint)
 {
-    void* ptr = m_blockAllocator.Allocate(sizeof(d2JointConstraint));
-    d2JointConstraint* joint = new(ptr) d2JointConstraint(bodyA, bodyB, anchorPoint);
+    d2JointDef def;
+    def.type = d2JointType::d2_pinJoint;
+    def.Initialize(bodyA, bodyB, anchorPoint);
+    return CreateJoint(def);
+}
+
+d2Joint *
+d2World::CreateJoint(const d2JointDef &def)
+{
+    const d2JointRegister &entry = d2JointRegistry::Get(def.type);
+    void* ptr = m_blockAllocator.Allocate(entry.size);
+    d2Joint* joint = entry.createFcn(ptr, def);
+
+    // The solver only writes awake bodies, so both ends have to move
+    if (joint->a->m_type != d2BodyType::d2_staticBody) joint->a->SetAwake(true);
+    if (joint->b->m_type != d2BodyType::d2_staticBody) joint->b->SetAwake(true);
 
     // Add to world doubly linked list.
     joint->prev = nullptr;
@@ -89,6 +299,10 @@ d2World::CreateJoint(d2Body *bodyA, d2Body *bodyB, d2Vec2 anchorPoint)
 void
 d2World::DestroyJoint(d2Constraint *joint)
 {
+    // The bodies may no longer be held in place
+    if (joint->a->m_type != d2BodyType::d2_staticBody) joint->a->SetAwake(true);
+    if (joint->b->m_type != d2BodyType::d2_staticBody) joint->b->SetAwake(true);
+
     // Remove from world doubly linked list.
     if (joint->prev) {
         joint->prev->next = joint->next;
@@ -101,79 +315,706 @@ d2World::DestroyJoint(d2Constraint *joint)
     }
     --m_constraintCount;
 
-    // Destroy the joint.
+    // Destroy the joint, with the size its type was allocated with
+    const int32 size = d2JointRegistry::Get(static_cast<d2Joint*>(joint)->GetType()).size;
     joint->~d2Constraint();
-    m_blockAllocator.Free(joint, sizeof(d2Constraint));
+    m_blockAllocator.Free(joint, size);
+}
+
+// Apply gravity and integrate the forces of a body, from the arrays of the storage only
+static void
+IntegrateForces(d2BodyStorage &storage, int32 i, const d2Vec2 &gravity, real dt)
+{
+    const real massScaled = storage.masses[i] * PIXELS_PER_METER * storage.gravityScales[i];
+    storage.forces[i] += gravity * massScaled;
+
+    storage.accelerations[i] = storage.forces[i] * storage.invMasses[i];
+    storage.velocities[i] += storage.accelerations[i] * dt;
+    storage.angularAccelerations[i] = storage.torques[i] * storage.invInertias[i];
+    storage.angularVelocities[i] += storage.angularAccelerations[i] * dt;
+
+    storage.forces[i] = d2Vec2(0.0F, 0.0F);
+    storage.torques[i] = 0.0F;
 }
 
 void
-d2World::Step(real dt, int32 posIterations)
+d2World::Step(real dt, int32 velocityIterations, int32 positionIterations)
 {
-    // Loop all m_bodiesList of the world applying forces
-    for (auto body = m_bodiesList; body; body = body->next)
+    // Only the islands woken by this step are handed back below, the ones woken before it are
+    // already moving
+    m_islandBuilder->ClearWoken();
+
+    // Integrate the forces of the awake dynamic bodies, streaming over the arrays of the storage
+    // without reading the bodies themselves
+    d2BodyStorage &storage = m_bodyStorage;
+    const int32 storageCount = storage.GetCount();
+    for (int32 i = 0; i < storageCount; ++i)
     {
-        if (body->m_type == d2BodyType::d2_staticBody) continue;
+        if (!storage.moving[i]) continue;
 
-        const real massScaled = body->mass * PIXELS_PER_METER * body->m_gravityScale;
-        body->AddForce(m_gravity * massScaled);
+        IntegrateForces(storage, i, m_gravity, dt);
+    }
+
+    // The bounds need the shapes
+    for (int32 i = 0; i < storageCount; ++i)
+    {
+        if (!storage.moving[i]) continue;
 
-        body->IntegrateForces(dt);
-        body->ComputeAABB();
+        storage.bodies[i]->ComputeAABB();
+        storage.bodies[i]->ComputeSpeculativeDistance(dt);
     }
 
     broadphase->Update();
 
-    std::vector<d2PenetrationConstraint> penetrations;
+    CheckCollisions();
+
+    // A moving body touching a sleeping one wakes its whole island. The narrowphase skipped the
+    // contacts inside the island, so the ones it fell asleep with are solved this step, and its
+    // bodies get the forces they missed. A body put to sleep on its own has no island to wake.
+    auto wake = [&](d2Body *body)
     {
-        //d2Timer timer;
+        if (body->m_type == d2BodyType::d2_staticBody || body->IsAwake()) return false;
+
+        const bool alone = body->m_sleepingIsland < 0;
+        body->SetAwake(true);
+        if (alone) IntegrateForces(storage, body->m_denseIndex, m_gravity, dt);
+        return true;
+    };
+    for (const d2Contact &contact: m_contacts) {
+        wake(contact.a);
+        wake(contact.b);
+    }
+
+    // Same for the joints, the solver must not write a sleeping end. Waking a lone body may reach
+    // the next joint of a chain, so this runs until nothing wakes.
+    bool woken = true;
+    while (woken) {
+        woken = false;
+        for (d2Constraint *joint = m_constraints; joint; joint = joint->GetNext()) {
+            if (storage.moving[joint->a->m_denseIndex]) woken = wake(joint->b) || woken;
+            if (storage.moving[joint->b->m_denseIndex]) woken = wake(joint->a) || woken;
+        }
+    }
+    const std::vector<d2Contact> &wokenContacts = m_islandBuilder->GetWokenContacts();
+    m_contacts.insert(m_contacts.end(), wokenContacts.begin(), wokenContacts.end());
+    for (d2Body *body: m_islandBuilder->GetWokenBodies()) {
+        if (storage.moving[body->m_denseIndex]) IntegrateForces(storage, body->m_denseIndex, m_gravity, dt);
+    }
+
+    UpdateContactEvents(dt);
+    UpdateSensorEvents();
+
+    // Only the awake bodies are built into islands, the sleeping ones are kept aside
+    m_islandBuilder->Build(m_bodyStorage, m_contacts, m_constraints);
+    const int32 awakeIslandCount = m_islandBuilder->GetIslandCount();
+    int32 awakeContactCount = 0;
+    int32 awakeJointCount = 0;
+    for (int32 i = 0; i < awakeIslandCount; ++i) {
+        const d2Island &island = m_islandBuilder->GetIsland(i);
+        awakeContactCount += island.contactCount;
+        awakeJointCount += island.jointCount;
+    }
+
+    // Solve all constraints, each island on its own. The soft step prepares its joints itself.
+    const bool softStep = m_solverType == d2SolverType::d2_softStepSolver;
+    // With position iterations the joints pin their anchors with rigid point rows, the squared
+    // distance row of the Baumgarte solver loses its Jacobian once the positions are corrected
+    d2Constraint *const *joints = m_islandBuilder->GetJoints();
+    const bool correctPositions = !softStep && positionIterations > 0;
+    if (!softStep) {
+        for (int32 i = 0; i < awakeJointCount; ++i) {
+            if (correctPositions) {
+                joints[i]->PrepareSoft(dt);
+                joints[i]->WarmStart();
+            } else {
+                joints[i]->PreSolve(dt);
+            }
+        }
+    }
+    SolveIslands(dt, velocityIterations, !correctPositions);
+    for (int32 i = 0; i < awakeJointCount; ++i) {
+        joints[i]->PostSolve();
+    }
+
+    // The contacts are measured again once the bodies moved
+    if (correctPositions) {
+        m_positionSolver->Prepare(m_islandBuilder->GetContacts(), awakeContactCount);
+    }
+
+    // Integrate all the velocities, bullets are swept against the static geometry. The soft step
+    // already moved the islands with constraints. The other bodies are flagged and integrated
+    // together in storage order.
+    std::vector<uint8> &integrate = m_integrateFlags;
+    integrate.assign(storageCount, 0);
+    for (int32 i = 0; i < awakeIslandCount; ++i) {
+        const d2Island &island = m_islandBuilder->GetIsland(i);
+        if (softStep && island.GetConstraintCount() > 0) continue;
+
+        for (int32 j = 0; j < island.bodyCount; ++j) {
+            d2Body *body = m_islandBuilder->GetBodies()[island.bodyStart + j];
+            if (body->IsBullet() && !body->IsSensor()) {
+                SolveContinuous(body, dt);
+            } else {
+                integrate[body->m_denseIndex] = 1;
+            }
+        }
+    }
+
+    for (int32 i = 0; i < storageCount; ++i) {
+        if (!integrate[i]) continue;
+
+        storage.positions[i] += storage.velocities[i] * dt;
+        storage.rotations[i] += storage.angularVelocities[i] * dt;
+    }
+
+    // Sync the shapes with the new transforms
+    for (int32 i = 0; i < storageCount; ++i) {
+        if (!integrate[i]) continue;
+
+        storage.bodies[i]->shape->UpdateVertices(d2Transform(storage.positions[i], storage.rotations[i]));
+    }
+
+    m_positionIterationCount = 0;
+    if (correctPositions) {
+        SolvePositions(positionIterations);
+    }
 
-        ColliderPairList pairs;
-        pairs = broadphase->ComputePairs();
-        for (const auto &pair: pairs)
+    UpdateSleep(dt);
+}
+
+void
+d2World::UpdateSleep(real dt)
+{
+    const real linearTolerance = LINEAR_SLEEP_TOLERANCE * LINEAR_SLEEP_TOLERANCE;
+    const real angularTolerance = ANGULAR_SLEEP_TOLERANCE * ANGULAR_SLEEP_TOLERANCE;
+
+    // An island sleeps when its most restless body does
+    for (int32 i = 0; i < m_islandBuilder->GetIslandCount(); ++i) {
+        const d2Island &island = m_islandBuilder->GetIsland(i);
+        d2Body *const *bodies = m_islandBuilder->GetBodies() + island.bodyStart;
+
+        real minSleepTime = std::numeric_limits<real>::max();
+        for (int32 j = 0; j < island.bodyCount; ++j) {
+            d2Body *body = bodies[j];
+            const real angularVelocity = body->GetAngularVelocity();
+            if (body->GetVelocity().LenghtSquared() > linearTolerance ||
+                angularVelocity * angularVelocity > angularTolerance) {
+                body->m_sleepTime = 0.0f;
+            } else {
+                body->m_sleepTime += dt;
+            }
+            minSleepTime = d2Min(minSleepTime, body->m_sleepTime);
+        }
+
+        if (m_allowSleep && minSleepTime >= TIME_TO_SLEEP) {
+            m_islandBuilder->Sleep(i);
+            for (int32 j = 0; j < island.bodyCount; ++j) {
+                bodies[j]->SetAwake(false);
+            }
+        }
+    }
+}
+
+void
+d2World::SetAllowSleeping(bool flag)
+{
+    m_allowSleep = flag;
+    if (m_allowSleep) return;
+
+    for (d2Body *body = m_bodiesList; body; body = body->next) {
+        if (body->m_type != d2BodyType::d2_staticBody) body->SetAwake(true);
+    }
+}
+
+// Radius of a circle that fits inside the shape, zero for shapes without area
+static real
+GetInnerRadius(const d2Shape *shape)
+{
+    switch (shape->GetType())
+    {
+        case d2ShapeType::CIRCLE:
+            return ((const d2CircleShape*)shape)->radius;
+        case d2ShapeType::CAPSULE:
+            return ((const d2CapsuleShape*)shape)->radius;
+        case d2ShapeType::BOX:
+        case d2ShapeType::POLYGON:
         {
-            auto a = pair.first;
-            auto b = pair.second;
+            // Distance from the origin to the closest edge
+            const d2PolygonShape *polygon = (const d2PolygonShape*)shape;
+            real radius = std::numeric_limits<real>::max();
+            for (int i = 0; i < polygon->m_vertexCount; ++i)
+            {
+                const d2Vec2 &v1 = polygon->localVertices[i];
+                const d2Vec2 &v2 = polygon->localVertices[(i + 1) % polygon->m_vertexCount];
+                const d2Vec2 normal = (v2 - v1).Normal();
+                radius = d2Min(radius, -normal.Dot(v1));
+            }
+            return d2Max(radius, 0.0F);
+        }
+        case d2ShapeType::COMPOUND:
+        {
+            // Every child has to be caught on its own
+            const d2CompoundShape *compound = (const d2CompoundShape*)shape;
+            real radius = std::numeric_limits<real>::max();
+            for (int32 i = 0; i < compound->GetChildCount(); ++i)
+            {
+                radius = d2Min(radius, GetInnerRadius(compound->GetChild(i)));
+            }
+            return compound->GetChildCount() > 0 ? radius : 0.0F;
+        }
+        default:
+            return 0.0F;
+    }
+}
 
-            std::vector<d2Contact> contacts;
-            if (!d2CollisionDetection::IsColliding(a, b, contacts)) continue;
+// Merge the iterations of a solve into the ones of the step, iteration by iteration
+static void
+MergeIterations(std::vector<d2SolverIteration> &iterations, const std::vector<d2SolverIteration> &solved)
+{
+    if (iterations.size() < solved.size()) {
+        iterations.resize(solved.size(), d2SolverIteration{ 0.0f, 0.0f });
+    }
+    for (size_t i = 0; i < solved.size(); ++i) {
+        iterations[i].maxImpulse = d2Max(iterations[i].maxImpulse, solved[i].maxImpulse);
+        iterations[i].totalImpulse += solved[i].totalImpulse;
+    }
+}
 
-            for (const auto &contact: contacts) {
-                // Create a new penetration constraint
-                d2PenetrationConstraint penetration(contact.a, contact.b, contact.start, contact.end, contact.normal);
-                penetrations.push_back(penetration);
+void
+d2World::SolveIslands(real dt, int32 iterations, bool baumgarte)
+{
+    const int32 islandCount = m_islandBuilder->GetIslandCount();
+    const int32 workerCount = m_threadPool->GetWorkerCount();
+    const d2Contact *contacts = m_islandBuilder->GetContacts();
+    d2Constraint *const *joints = m_islandBuilder->GetJoints();
+
+    int32 constraintCount = 0;
+    for (int32 i = 0; i < islandCount; ++i) {
+        constraintCount += m_islandBuilder->GetIsland(i).GetConstraintCount();
+    }
+
+    // The islands are sorted by size, the ones too big to share a worker come first and are
+    // solved together in parallel by color. With a single worker that's all of them.
+    int32 largeCount = 0;
+    int32 largeContacts = 0;
+    int32 largeJoints = 0;
+    for (; largeCount < islandCount; ++largeCount) {
+        const d2Island &island = m_islandBuilder->GetIsland(largeCount);
+        if (workerCount > 1 && island.GetConstraintCount() * workerCount <= constraintCount) break;
+
+        largeContacts += island.contactCount;
+        largeJoints += island.jointCount;
+    }
+    auto solve = [this, iterations](d2ConstraintSolver *solver)
+    {
+        if (m_solverType == d2SolverType::d2_softStepSolver) {
+            solver->SolveSoft(m_subStepCount, m_contactHertz, m_contactDampingRatio);
+        } else {
+            solver->Solve(iterations);
+        }
+    };
+
+    m_solverIterations.clear();
+    m_islandSolverIterations.resize(islandCount);
+    m_constraintSolver->SetBaumgarte(baumgarte);
+    if (m_deterministic) {
+        // One island at a time, an island that converges early only stops its own iterations
+        for (int32 i = 0; i < largeCount; ++i) {
+            const d2Island &island = m_islandBuilder->GetIsland(i);
+            m_constraintSolver->Prepare(contacts + island.contactStart, island.contactCount,
+                                        joints + island.jointStart, island.jointCount, dt);
+            solve(m_constraintSolver);
+            MergeIterations(m_solverIterations, m_constraintSolver->GetIterations());
+        }
+    } else if (largeContacts + largeJoints > 0) {
+        m_constraintSolver->Prepare(contacts, largeContacts, joints, largeJoints, dt);
+        solve(m_constraintSolver);
+        MergeIterations(m_solverIterations, m_constraintSolver->GetIterations());
+    }
+
+    // Deal the rest from the biggest down, each to the least loaded worker
+    while ((int32)m_islandSolvers.size() < workerCount) {
+        m_islandSolvers.push_back(new d2ConstraintSolver());
+    }
+    for (d2ConstraintSolver *solver: m_islandSolvers) {
+        solver->SetColorCount(m_constraintSolver->GetMaxColorCount());
+        solver->SetBaumgarte(baumgarte);
+        solver->SetTolerance(m_constraintSolver->GetTolerance());
+    }
+
+    std::vector<std::vector<int32>> &workerIslands = m_workerIslands;
+    std::vector<int32> &workerLoads = m_workerLoads;
+    workerIslands.resize(workerCount);
+    for (std::vector<int32> &islands: workerIslands) {
+        islands.clear();
+    }
+    workerLoads.assign(workerCount, 0);
+    for (int32 i = largeCount; i < islandCount; ++i) {
+        const int32 load = m_islandBuilder->GetIsland(i).GetConstraintCount();
+        if (load == 0) break;
+
+        const int32 worker = (int32)(std::min_element(workerLoads.begin(), workerLoads.end()) - workerLoads.begin());
+        workerIslands[worker].push_back(i);
+        workerLoads[worker] += load;
+    }
+
+    if (workerLoads[0] == 0) return;
+
+    m_threadPool->ParallelFor(workerCount, 1, [&](int32 begin, int32 end, int32 workerIndex)
+    {
+        (void)workerIndex;
+        for (int32 worker = begin; worker < end; ++worker) {
+            d2ConstraintSolver *solver = m_islandSolvers[worker];
+            for (int32 i: workerIslands[worker]) {
+                const d2Island &island = m_islandBuilder->GetIsland(i);
+                solver->Prepare(contacts + island.contactStart, island.contactCount,
+                                joints + island.jointStart, island.jointCount, dt);
+                solve(solver);
+                m_islandSolverIterations[i] = solver->GetIterations();
             }
         }
+    });
+
+    // In island order, so the sums don't depend on which worker solved what
+    for (int32 i = largeCount; i < islandCount; ++i) {
+        if (m_islandBuilder->GetIsland(i).GetConstraintCount() == 0) break;
+        MergeIterations(m_solverIterations, m_islandSolverIterations[i]);
+    }
+}
+
+void
+d2World::SolvePositions(int32 iterations)
+{
+    // The islands without constraints come last among the awake ones
+    int32 islandCount = 0;
+    while (islandCount < m_islandBuilder->GetIslandCount() &&
+           m_islandBuilder->GetIsland(islandCount).GetConstraintCount() > 0) {
+        ++islandCount;
+    }
+
+    d2Constraint *const *joints = m_islandBuilder->GetJoints();
+    std::vector<int32> &workerIterations = m_workerPositionIterations;
+    workerIterations.assign(m_threadPool->GetWorkerCount(), 0);
+    m_threadPool->ParallelFor(islandCount, 1, [&](int32 begin, int32 end, int32 workerIndex)
+    {
+        for (int32 i = begin; i < end; ++i) {
+            const d2Island &island = m_islandBuilder->GetIsland(i);
+            const int32 islandIterations = m_positionSolver->Solve(island.contactStart, island.contactCount,
+                                                                   joints + island.jointStart, island.jointCount,
+                                                                   iterations);
+            workerIterations[workerIndex] = d2Max(workerIterations[workerIndex], islandIterations);
+
+            for (int32 j = 0; j < island.bodyCount; ++j) {
+                d2Body *body = m_islandBuilder->GetBodies()[island.bodyStart + j];
+                body->shape->UpdateVertices(body->GetTransform());
+            }
+        }
+    });
+
+    for (int32 workerIteration: workerIterations) {
+        m_positionIterationCount = d2Max(m_positionIterationCount, workerIteration);
+    }
+}
+
+int32
+d2World::GetIslandCount() const
+{
+    return m_islandBuilder->GetIslandCount() + m_islandBuilder->GetSleepingIslandCount();
+}
+
+int32
+d2World::GetPositionIterationCount() const
+{
+    return m_positionIterationCount;
+}
+
+const std::vector<d2SolverIteration>&
+d2World::GetSolverIterations() const
+{
+    return m_solverIterations;
+}
+
+void
+d2World::SolveContinuous(d2Body *body, real dt)
+{
+    const d2Transform start = body->GetTransform();
+    const d2Vec2 translation = body->GetVelocity() * dt;
+    const real rotation = body->GetAngularVelocity() * dt;
+
+    d2AABB sweptBound = body->aabb[0];
+    for (int32 i = 1; i < body->m_proxyCount; ++i)
+    {
+        sweptBound.Combine(body->aabb[i]);
     }
 
-    // Solve all constraints
-    for (d2Constraint *constraint = m_constraints; constraint; constraint = constraint->GetNext()) {
-        constraint->PreSolve(dt);
+    // Sub-steps needed to move the farthest point of the body by less than its inner radius each time
+    const real travel = translation.Lenght() + d2Abs(rotation) * sweptBound.GetExtents().Lenght();
+    const real innerRadius = GetInnerRadius(body->shape);
+    int32 subStepCount = CCD_MAX_SUBSTEPS;
+    if (innerRadius > 0.0F)
+    {
+        subStepCount = d2Clamp((int32)ceilf(travel / (CCD_SUBSTEP_FRACTION * innerRadius)), 1, CCD_MAX_SUBSTEPS);
     }
-    for (auto& penetration: penetrations) {
-        penetration.PreSolve(dt);
+
+    // Slow enough for the discrete step
+    body->IntegrateVelocities(dt);
+    if (subStepCount == 1) return;
+
+    body->ComputeAABB();
+    for (int32 i = 0; i < body->m_proxyCount; ++i)
+    {
+        sweptBound.Combine(body->aabb[i]);
     }
-    for (int i = 0; i < posIterations; i++)
+
+    // Static bodies along the sweep
+    d2Broadphase::ColliderList &candidates = m_continuousCandidates;
+    candidates.clear();
+    broadphase->Query(sweptBound, candidates);
+    std::sort(candidates.begin(), candidates.end());
+    candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+
+    auto setPose = [&](real t)
+    {
+        body->Position() = start.p + translation * t;
+        body->Rotation() = start.q + d2Rot(rotation * t);
+        body->shape->UpdateVertices(body->GetTransform());
+    };
+
+    auto isTouching = [&](d2Body *other, int32 childIndex)
+    {
+        m_continuousContacts.clear();
+        for (int32 i = 0; i < body->m_proxyCount; ++i)
+        {
+            if (d2CollisionDetection::IsColliding(body, i, other, childIndex, m_continuousContacts)) return true;
+        }
+        return false;
+    };
+
+    // Children already touching at the start are left to the contact solver
+    std::vector<std::pair<d2Body*, int32>> &targets = m_continuousTargets;
+    targets.clear();
+    setPose(0.0F);
+    for (d2Body *other: candidates)
     {
-        for (d2Constraint *constraint = m_constraints; constraint; constraint = constraint->GetNext()) {
-            constraint->Solve();
+        if (other->m_type != d2BodyType::d2_staticBody || other->IsSensor()) continue;
+
+        for (int32 j = 0; j < other->m_proxyCount; ++j)
+        {
+            if (other->aabb[j].Overlaps(sweptBound) && !isTouching(other, j))
+            {
+                targets.emplace_back(other, j);
+            }
+        }
+    }
+
+    auto isHit = [&]()
+    {
+        for (const auto &target: targets)
+        {
+            if (isTouching(target.first, target.second)) return true;
+        }
+        return false;
+    };
+
+    real timeOfImpact = 1.0F;
+    real t0 = 0.0F;
+    for (int32 k = 1; k <= subStepCount && !targets.empty(); ++k)
+    {
+        real t1 = (real)k / (real)subStepCount;
+        setPose(t1);
+        if (!isHit())
+        {
+            t0 = t1;
+            continue;
+        }
+
+        // Narrow down the time of impact, keeping the colliding side
+        for (int32 i = 0; i < CCD_BISECTION_ITERATIONS; ++i)
+        {
+            const real t = 0.5F * (t0 + t1);
+            setPose(t);
+            if (isHit())
+            {
+                t1 = t;
+            }
+            else
+            {
+                t0 = t;
+            }
         }
-        for (auto& penetration: penetrations) {
-            penetration.Solve();
+
+        timeOfImpact = t1;
+        break;
+    }
+
+    setPose(timeOfImpact);
+    body->ComputeAABB();
+}
+
+void
+d2World::CheckCollisions()
+{
+    const ColliderPairList &pairs = broadphase->ComputePairs();
+    const int32 pairCount = (int32)pairs.size();
+
+    const int32 workerCount = m_threadPool->GetWorkerCount();
+    if ((int32)m_workerContacts.size() != workerCount) {
+        m_workerContacts.resize(workerCount);
+        m_workerSensorOverlaps.resize(workerCount);
+    }
+    for (auto &contacts: m_workerContacts) {
+        contacts.clear();
+    }
+    for (auto &overlaps: m_workerSensorOverlaps) {
+        overlaps.clear();
+    }
+
+    // Each worker only touches its own contact buffer
+    m_threadPool->ParallelFor(pairCount, NARROWPHASE_MIN_PAIRS, [&](int32 begin, int32 end, int32 workerIndex)
+    {
+        std::vector<d2Contact> &contacts = m_workerContacts[workerIndex];
+        std::vector<d2ContactPair> &sensorOverlaps = m_workerSensorOverlaps[workerIndex];
+        for (int32 i = begin; i < end; ++i) {
+            const d2AABB *proxyA = pairs[i].first;
+            const d2AABB *proxyB = pairs[i].second;
+
+            // Sensors only look for overlaps and never reach the solver, two sensors ignore each other
+            const bool sensorA = proxyA->Collider->IsSensor();
+            const bool sensorB = proxyB->Collider->IsSensor();
+            if (sensorA || sensorB) {
+                if (sensorA != sensorB && d2CollisionDetection::TestOverlap(proxyA->Collider, proxyA->childIndex,
+                                                                            proxyB->Collider, proxyB->childIndex)) {
+                    if (sensorB) std::swap(proxyA, proxyB);
+                    sensorOverlaps.push_back({ proxyA->Collider, proxyB->Collider, proxyA->childIndex, proxyB->childIndex });
+                }
+                continue;
+            }
+
+            const real speculativeDistance = proxyA->Collider->GetSpeculativeDistance() + proxyB->Collider->GetSpeculativeDistance();
+            const size_t first = contacts.size();
+            d2CollisionDetection::IsColliding(proxyA->Collider, proxyA->childIndex,
+                                              proxyB->Collider, proxyB->childIndex, contacts, speculativeDistance);
+
+            // The routines may swap the bodies, the children follow them
+            for (size_t k = first; k < contacts.size(); ++k) {
+                const bool swapped = contacts[k].a != proxyA->Collider;
+                contacts[k].childA = swapped ? proxyB->childIndex : proxyA->childIndex;
+                contacts[k].childB = swapped ? proxyA->childIndex : proxyB->childIndex;
+            }
         }
+    });
+
+    // Ranges are handed out in order, so merging in worker order is deterministic
+    m_contacts.clear();
+    for (const auto &contacts: m_workerContacts) {
+        m_contacts.insert(m_contacts.end(), contacts.begin(), contacts.end());
     }
-    for (d2Constraint *constraint = m_constraints; constraint; constraint = constraint->GetNext()) {
-        constraint->PostSolve();
+
+    m_previousSensorOverlaps.swap(m_sensorOverlaps);
+    m_sensorOverlaps.clear();
+    for (const auto &overlaps: m_workerSensorOverlaps) {
+        m_sensorOverlaps.insert(m_sensorOverlaps.end(), overlaps.begin(), overlaps.end());
+    }
+}
+
+// Static and sleeping bodies don't move, the broadphase never pairs two of them
+static bool
+IsResting(const d2Body *body)
+{
+    return body->GetType() == d2BodyType::d2_staticBody || !body->IsAwake();
+}
+
+// Key of the pair a contact belongs to, with the older body first
+static d2ContactPair
+MakeContactPair(const d2Contact &contact)
+{
+    if (contact.b->GetCreationIndex() < contact.a->GetCreationIndex()) {
+        return { contact.b, contact.a, contact.childB, contact.childA };
+    }
+    return { contact.a, contact.b, contact.childA, contact.childB };
+}
+
+static d2Vec2
+GetPointVelocity(const d2Body *body, const d2Vec2 &point)
+{
+    const d2Vec2 r = point - body->GetPosition();
+    return body->GetVelocity() + d2Vec2(-r.y, r.x) * body->GetAngularVelocity();
+}
+
+void
+d2World::UpdateContactEvents(real dt)
+{
+    m_contactEvents.Clear();
+    m_previousTouchingPairs.swap(m_touchingPairs);
+    m_touchingPairs.clear();
+
+    // The contacts of a pair are contiguous, they come from the same narrowphase call
+    const int32 contactCount = (int32)m_contacts.size();
+    for (int32 i = 0; i < contactCount;)
+    {
+        const d2ContactPair pair = MakeContactPair(m_contacts[i]);
+        d2ContactHitEvent hit { pair, d2Vec2(), d2Vec2(), 0.0F };
+        bool touching = false;
+
+        for (; i < contactCount && MakeContactPair(m_contacts[i]) == pair; ++i)
+        {
+            const d2Contact &contact = m_contacts[i];
+            const d2Vec2 point = (contact.start + contact.end) * 0.5F;
+            const real approachSpeed = (GetPointVelocity(contact.a, point) - GetPointVelocity(contact.b, point)).Dot(contact.normal);
+
+            // Speculative contacts touch in the step their gap closes
+            if (contact.depth < -LINEAR_SLOP && -contact.depth > approachSpeed * dt) continue;
+
+            touching = true;
+            if (approachSpeed > hit.approachSpeed)
+            {
+                hit.point = point;
+                hit.normal = contact.a == pair.a ? contact.normal : contact.normal * -1.0F;
+                hit.approachSpeed = approachSpeed;
+            }
+        }
+
+        if (!touching) continue;
+
+        // Only pairs that start touching can hit, resting ones keep a small approach speed
+        m_touchingPairs.push_back(pair);
+        if (hit.approachSpeed > m_hitEventThreshold && !std::binary_search(m_previousTouchingPairs.begin(), m_previousTouchingPairs.end(), pair)) {
+            m_contactEvents.hitEvents.push_back(hit);
+        }
     }
-    for (auto& penetration: penetrations) {
-        penetration.PostSolve();
+
+    // Pairs that can't move keep touching, the narrowphase skips them
+    for (const d2ContactPair &pair: m_previousTouchingPairs) {
+        if (IsResting(pair.a) && IsResting(pair.b)) m_touchingPairs.push_back(pair);
     }
 
-    // Integrate all the velocities
-    for (auto body = m_bodiesList; body; body = body->next) {
-        if (body->m_type == d2BodyType::d2_staticBody) continue;
+    std::sort(m_touchingPairs.begin(), m_touchingPairs.end());
+    m_touchingPairs.erase(std::unique(m_touchingPairs.begin(), m_touchingPairs.end()), m_touchingPairs.end());
 
-        body->IntegrateVelocities(dt);
+    std::set_difference(m_touchingPairs.begin(), m_touchingPairs.end(),
+                        m_previousTouchingPairs.begin(), m_previousTouchingPairs.end(),
+                        std::back_inserter(m_contactEvents.beginEvents));
+    std::set_difference(m_previousTouchingPairs.begin(), m_previousTouchingPairs.end(),
+                        m_touchingPairs.begin(), m_touchingPairs.end(),
+                        std::back_inserter(m_contactEvents.endEvents));
+}
+
+void
+d2World::UpdateSensorEvents()
+{
+    m_sensorEvents.Clear();
+
+    for (const d2ContactPair &pair: m_previousSensorOverlaps) {
+        if (IsResting(pair.a) && IsResting(pair.b)) m_sensorOverlaps.push_back(pair);
     }
+    std::sort(m_sensorOverlaps.begin(), m_sensorOverlaps.end());
+
+    std::set_difference(m_sensorOverlaps.begin(), m_sensorOverlaps.end(),
+                        m_previousSensorOverlaps.begin(), m_previousSensorOverlaps.end(),
+                        std::back_inserter(m_sensorEvents.beginEvents));
+    std::set_difference(m_previousSensorOverlaps.begin(), m_previousSensorOverlaps.end(),
+                        m_sensorOverlaps.begin(), m_sensorOverlaps.end(),
+                        std::back_inserter(m_sensorEvents.endEvents));
 }
 
 void
@@ -185,10 +1026,12 @@ d2World::SetDebugDraw(d2Draw *debugDraw)
 void
 d2World::DrawShape(const d2Body* body, const bool &mesh, const d2Color& color)
 {
-    d2Shape* shape = body->GetShape();
-    d2Vec2 position = body->GetPosition();
-    real angle = body->GetRotation();
+    DrawShape(body->GetShape(), body->GetRotation(), mesh, color);
+}
 
+void
+d2World::DrawShape(d2Shape* shape, real angle, const bool &mesh, const d2Color& color)
+{
     switch (shape->GetType())
     {
         case d2ShapeType::CIRCLE:
@@ -196,7 +1039,7 @@ d2World::DrawShape(const d2Body* body, const bool &mesh, const d2Color& color)
             d2CircleShape *circle = (d2CircleShape*)shape;
             real radius = circle->radius;
 
-            m_debugDraw->DrawSolidCircle(position, radius, angle, color);
+            m_debugDraw->DrawSolidCircle(circle->worldCenter, radius, angle, color);
             break;
         }
         case d2ShapeType::BOX:
@@ -209,6 +1052,42 @@ d2World::DrawShape(const d2Body* body, const bool &mesh, const d2Color& color)
             m_debugDraw->DrawSolidPolygon(vertices, vertexCount, angle, mesh, color);
             break;
         }
+        case d2ShapeType::CAPSULE:
+        {
+            d2CapsuleShape *capsule = (d2CapsuleShape*)shape;
+
+            m_debugDraw->DrawSolidCapsule(capsule->worldVertices[0], capsule->worldVertices[1], capsule->radius, color);
+            break;
+        }
+        case d2ShapeType::EDGE:
+        {
+            d2EdgeShape *edge = (d2EdgeShape*)shape;
+
+            m_debugDraw->DrawSegment(edge->worldVertices[1], edge->worldVertices[2], color);
+            break;
+        }
+        case d2ShapeType::CHAIN:
+        {
+            d2ChainShape *chain = (d2ChainShape*)shape;
+            int32 childCount = chain->GetChildCount();
+
+            for (int32 i = 0; i < childCount; ++i)
+            {
+                m_debugDraw->DrawSegment(chain->worldVertices[i], chain->worldVertices[(i + 1) % chain->m_vertexCount], color);
+            }
+            break;
+        }
+        case d2ShapeType::COMPOUND:
+        {
+            d2CompoundShape *compound = (d2CompoundShape*)shape;
+            int32 childCount = compound->GetChildCount();
+
+            for (int32 i = 0; i < childCount; ++i)
+            {
+                DrawShape(compound->GetChild(i), angle + compound->m_localTransforms[i].q.GetAngle(), mesh, color);
+            }
+            break;
+        }
         default:
             break;
     }
@@ -225,11 +1104,18 @@ d2World::DebugDraw()
     {
         d2Color staticColor(1.0f, 0.721568627f, 0.423529412f); // #ffb86c
         d2Color dynamicColor(0.545098039f, 0.91372549f, 0.992156863f); // #8be9fd
+        d2Color sensorColor(0.31372549f, 0.980392157f, 0.482352941f); // #50fa7b
+        d2Color sleepingColor(0.384313725f, 0.447058824f, 0.643137255f); // #6272a4
         bool mesh = flags & d2Draw::e_meshBit;
 
         for (d2Body *b = m_bodiesList; b; b = b->GetNext())
         {
             d2Color color = b->m_type == d2BodyType::d2_staticBody ? staticColor : dynamicColor;
+            if (b->IsSensor()) {
+                color = sensorColor;
+            } else if (!b->IsAwake()) {
+                color = sleepingColor;
+            }
             DrawShape(b, mesh, color);
         }
     }
@@ -240,15 +1126,18 @@ d2World::DebugDraw()
 
         for (d2Body *b = m_bodiesList; b; b = b->GetNext())
         {
-            d2AABB *aabb = b->aabb;
-            d2Vec2 vertices[4] = {
-                    d2Vec2(aabb->lowerBound.x, aabb->lowerBound.y),
-                    d2Vec2(aabb->upperBound.x, aabb->lowerBound.y),
-                    d2Vec2(aabb->upperBound.x, aabb->upperBound.y),
-                    d2Vec2(aabb->lowerBound.x, aabb->upperBound.y)
-            };
-
-            m_debugDraw->DrawPolygon(vertices, 4, b->GetRotation(), color);
+            for (int32 i = 0; i < b->GetProxyCount(); ++i)
+            {
+                d2AABB *aabb = b->GetAABB(i);
+                d2Vec2 vertices[4] = {
+                        d2Vec2(aabb->lowerBound.x, aabb->lowerBound.y),
+                        d2Vec2(aabb->upperBound.x, aabb->lowerBound.y),
+                        d2Vec2(aabb->upperBound.x, aabb->upperBound.y),
+                        d2Vec2(aabb->lowerBound.x, aabb->upperBound.y)
+                };
+
+                m_debugDraw->DrawPolygon(vertices, 4, b->GetRotation(), color);
+            }
         }
     }
 
@@ -263,7 +1152,7 @@ d2World::DebugDraw()
         for (d2Body *b = m_bodiesList; b; b = b->GetNext())
         {
             d2ShapeType sType = b->GetShape()->GetType();
-            d2Transform transform = b->m_transform;
+            d2Transform transform = b->GetTransform();
 
             switch (sType)
             {
@@ -10,7 +10,7 @@ d2MatMN::d2MatMN(int M, int N) : M(M), N(N)
         rows[i] = d2VecN(N);
 }
 
-d2MatMN::d2MatMN(const d2MatMN &m)
+d2MatMN::d2MatMN(const d2MatMN &m) : M(0), N(0), rows(nullptr)
 {
     *this = m;
 }
@@ -41,6 +41,9 @@ d2MatMN::Transpose() const
 const d2MatMN&
 d2MatMN::operator=(const d2MatMN &m)
 {
+    if (this == &m) return *this;
+
+    delete[] rows;
     M = m.M;
     N = m.N;
     rows = new d2VecN[M];
@@ -66,11 +69,13 @@ d2MatMN::operator*(const d2MatMN &m) const
 {
     if (m.M != N && m.N != M) return m;
 
-    d2MatMN transposed = m.Transpose();
+    // Accumulate the rows of m instead of transposing it to dot the columns
     d2MatMN result(M, m.N);
+    result.Zero();
     for (int i = 0; i < M; i++)
-        for (int j = 0; j < m.N; j++)
-            result.rows[i][j] = rows[i].Dot(transposed.rows[j]);
+        for (int k = 0; k < N; k++)
+            for (int j = 0; j < m.N; j++)
+                result.rows[i][j] += rows[i][k] * m.rows[k][j];
 
     return result;
 }
@@ -40,6 +40,8 @@ d2VecN::Dot(const d2VecN &v) const
 d2VecN &
 d2VecN::operator=(const d2VecN &v)
 {
+    if (this == &v) return *this;
+
     delete[] data;
     N = v.N;
     data = new real[N];
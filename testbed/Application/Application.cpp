@@ -121,14 +121,29 @@ Application::Render()
             SetTargetFPS(m_settings->targetFPS);
         }
 
-        // Change position iterations
-        if (ImGui::SliderInt("Position Iterations", &m_settings->positionIterations, 1, 10)) {
-            m_settings->positionIterations = m_settings->positionIterations;
+        // Change velocity iterations
+        if (ImGui::SliderInt("Velocity Iterations", &m_settings->velocityIterations, 1, 10)) {
+            m_settings->velocityIterations = m_settings->velocityIterations;
         }
         if (ImGui::IsItemHovered(ImGuiHoveredFlags_AllowWhenDisabled)) {
             ImGui::SetTooltip("Higher values can improve stability but decrease performance");
         }
 
+        // Change position iterations
+        ImGui::SliderInt("Position Iterations", &m_settings->positionIterations, 0, 10);
+        if (ImGui::IsItemHovered(ImGuiHoveredFlags_AllowWhenDisabled)) {
+            ImGui::SetTooltip("Corrects the positions after the velocities instead of the velocity bias");
+        }
+
+        // Change the solver
+        ImGui::Checkbox("Soft Step", &m_settings->softStep);
+        if (ImGui::IsItemHovered(ImGuiHoveredFlags_AllowWhenDisabled)) {
+            ImGui::SetTooltip("Sub-steps of soft constraints instead of velocity iterations");
+        }
+        if (m_settings->softStep) {
+            ImGui::SliderInt("Sub-steps", &m_settings->subSteps, 1, 8);
+        }
+
         // Bodies count
         ImGui::Text("Bodies: %d", s_test->m_world->GetBodyCount());
         ImGui::SameLine();
@@ -74,6 +74,41 @@ draw::DrawSolidCircle(const d2Vec2 &center, float radius, const float &angle, co
     ::DrawCircleLines(center.x, center.y, radius, convertToColor(color));
 }
 
+void
+draw::DrawSolidCapsule(const d2Vec2 &p1, const d2Vec2 &p2, float radius, const d2Color &color) const
+{
+    const Color fillColor = convertToColor(color * 0.5f);
+    const Color borderColor = convertToColor(color);
+
+    const d2Vec2 axis = p2 - p1;
+    const float length = axis.Lenght();
+    const float angle = atan2f(axis.y, axis.x) * RAD2DEG;
+    const d2Vec2 center = (p1 + p2) * 0.5f;
+
+    // Draw the interior, a rotated box between the two caps
+    ::DrawCircleV(Vector2{p1.x, p1.y}, radius, fillColor);
+    ::DrawCircleV(Vector2{p2.x, p2.y}, radius, fillColor);
+    ::DrawRectanglePro(Rectangle{center.x, center.y, length, 2.0f * radius},
+                       Vector2{0.5f * length, radius}, angle, fillColor);
+
+    // Draw the outline, two sides and the outer half of each cap
+    const d2Vec2 side = d2Vec2(-sinf(angle * DEG2RAD), cosf(angle * DEG2RAD)) * radius;
+    ::DrawLineV(Vector2{p1.x + side.x, p1.y + side.y}, Vector2{p2.x + side.x, p2.y + side.y}, borderColor);
+    ::DrawLineV(Vector2{p1.x - side.x, p1.y - side.y}, Vector2{p2.x - side.x, p2.y - side.y}, borderColor);
+
+    constexpr int segments = 16;
+    const float start = angle * DEG2RAD + 0.5f * PI;
+    for (int i = 0; i < segments; ++i)
+    {
+        const float a0 = start + PI * i / segments;
+        const float a1 = start + PI * (i + 1) / segments;
+        ::DrawLineV(Vector2{p1.x + cosf(a0) * radius, p1.y + sinf(a0) * radius},
+                    Vector2{p1.x + cosf(a1) * radius, p1.y + sinf(a1) * radius}, borderColor);
+        ::DrawLineV(Vector2{p2.x - cosf(a0) * radius, p2.y - sinf(a0) * radius},
+                    Vector2{p2.x - cosf(a1) * radius, p2.y - sinf(a1) * radius}, borderColor);
+    }
+}
+
 void
 draw::DrawTransform(const d2Transform &transform) const
 {
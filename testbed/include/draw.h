@@ -19,6 +19,8 @@ public:
 
     void DrawSolidCircle(const d2Vec2 &center, float radius, const float &angle, const d2Color &color) const override;
 
+    void DrawSolidCapsule(const d2Vec2 &p1, const d2Vec2 &p2, float radius, const d2Color &color) const override;
+
     void DrawTransform(const d2Transform &transform) const override;
 
     void DrawSegment(const d2Vec2 &p1, const d2Vec2 &p2, const d2Color &color) const override;
@@ -9,11 +9,17 @@ struct Settings
     void Reset()
     {
         targetFPS = 60;
-        positionIterations = 3;
+        velocityIterations = 3;
+        positionIterations = 0;
+        softStep = false;
+        subSteps = 4;
     }
 
     int targetFPS {60};
-    int positionIterations {3};
+    int velocityIterations {3};
+    int positionIterations {0};
+    bool softStep {false};
+    int subSteps {4};
 };
 
 
@@ -17,7 +17,9 @@ Test::~Test()
 void
 Test::Step(const float& dt, Settings& settings)
 {
-    m_world->Step(dt, settings.positionIterations);
+    m_world->SetSolverType(settings.softStep ? d2_softStepSolver : d2_baumgarteSolver);
+    m_world->SetSubStepCount(settings.subSteps);
+    m_world->Step(dt, settings.velocityIterations, settings.positionIterations);
 }
 
 void
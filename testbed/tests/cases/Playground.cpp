@@ -36,6 +36,20 @@ public:
             m_world->CreateBody(d2BoxShape(10.0f, screenHeight), {screenWidth - 5.0f, screenHeight / 2.0f}, 0.0f);
         }
 
+        // create a bumpy ground with a chain, left to right so it collides from above
+        {
+            const int32 vertexCount = 9;
+            d2Vec2 vertices[vertexCount];
+            for (int i = 0; i < vertexCount; ++i) {
+                float x = 10.0f + (screenWidth - 20.0f) * i / (vertexCount - 1);
+                float y = screenHeight - 60.0f - 30.0f * sinf(TAU * i / (vertexCount - 1));
+                vertices[i] = {x, y};
+            }
+
+            m_world->CreateBody(d2ChainShape(vertices, vertexCount, vertices[0] + d2Vec2(-10.0f, 0.0f),
+                                             vertices[vertexCount - 1] + d2Vec2(10.0f, 0.0f)), {0.0f, 0.0f}, 0.0f);
+        }
+
         // create 1000 boxes
         for (int i = 0; i < 25; ++i) {
             d2Body *body = m_world->CreateBody(d2BoxShape(10.0f, 10.0f), {(float) GetRandomValue(0, screenWidth),
@@ -55,6 +69,20 @@ public:
             auto mousePos = GetMousePosition();
             m_world->CreateBody(d2CircleShape(25.0f), {mousePos.x, mousePos.y}, 1.0f);
         }
+
+        if (IsMouseButtonPressed(MOUSE_MIDDLE_BUTTON)) {
+            auto mousePos = GetMousePosition();
+            m_world->CreateBody(d2CapsuleShape(40.0f, 15.0f), {mousePos.x, mousePos.y}, 1.0f);
+        }
+
+        if (IsKeyPressed(KEY_C)) {
+            auto mousePos = GetMousePosition();
+            d2CompoundShape dumbbell;
+            dumbbell.AddChild(d2BoxShape(60.0f, 8.0f), d2Transform());
+            dumbbell.AddChild(d2CircleShape(15.0f), d2Transform({-30.0f, 0.0f}, d2Rot(0.0f)));
+            dumbbell.AddChild(d2CircleShape(15.0f), d2Transform({30.0f, 0.0f}, d2Rot(0.0f)));
+            m_world->CreateBody(dumbbell, {mousePos.x, mousePos.y}, 2.0f);
+        }
     }
 
     static Test* Create()
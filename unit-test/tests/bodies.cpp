@@ -0,0 +1,189 @@
+#include <doctest/doctest.h>
+
+#include <vector>
+#include "dura2d/dura2d.h"
+
+DOCTEST_TEST_CASE("body handles go stale when their body is destroyed")
+{
+    d2World world(d2Vec2(0.0F, -9.81F));
+    d2Body *a = world.CreateBody(d2BoxShape(20.0F, 20.0F), {100.0F, 100.0F}, 1.0F);
+    d2Body *b = world.CreateBody(d2BoxShape(20.0F, 20.0F), {200.0F, 100.0F}, 1.0F);
+    d2Body *c = world.CreateBody(d2CircleShape(10.0F), {300.0F, 100.0F}, 1.0F);
+
+    const d2BodyId idA = a->GetId();
+    const d2BodyId idB = b->GetId();
+    const d2BodyId idC = c->GetId();
+    CHECK( world.GetBody(idA) == a );
+    CHECK( world.GetBody(idB) == b );
+    CHECK( world.GetBody(idC) == c );
+    CHECK( world.GetBody(d2BodyId()) == nullptr );
+
+    world.DestroyBody(a);
+    CHECK( world.GetBody(idA) == nullptr );
+    CHECK( world.GetBody(idB) == b );
+    CHECK( world.GetBody(idC) == c );
+    CHECK( c->GetPosition().x == 300.0F );
+
+    // The slot is reused, the old handle still doesn't resolve
+    d2Body *d = world.CreateBody(d2BoxShape(20.0F, 20.0F), {400.0F, 100.0F}, 1.0F);
+    CHECK( d->GetId().index == idA.index );
+    CHECK( d->GetId() != idA );
+    CHECK( world.GetBody(idA) == nullptr );
+    CHECK( world.GetBody(d->GetId()) == d );
+}
+
+DOCTEST_TEST_CASE("destroying a body leaves the others simulated as before")
+{
+    // Bodies far apart so they fall on their own
+    auto build = [](d2World &world, std::vector<d2Body*> &bodies)
+    {
+        for (int32 i = 0; i < 8; ++i) {
+            bodies.push_back(world.CreateBody(d2BoxShape(20.0F, 20.0F), {100.0F * (real)i, 100.0F}, 1.0F));
+            bodies.back()->SetAngularVelocity((real)i * 0.1F);
+        }
+    };
+
+    d2World reference(d2Vec2(0.0F, -9.81F));
+    std::vector<d2Body*> referenceBodies;
+    build(reference, referenceBodies);
+
+    d2World world(d2Vec2(0.0F, -9.81F));
+    std::vector<d2Body*> bodies;
+    build(world, bodies);
+
+    for (int32 i = 0; i < 60; ++i) {
+        if (i == 20) {
+            world.DestroyBody(bodies[0]);
+            world.DestroyBody(bodies[5]);
+        }
+        reference.Step(1.0F / 60.0F);
+        world.Step(1.0F / 60.0F);
+    }
+
+    CHECK( world.GetBodyCount() == 6 );
+    for (int32 i = 0; i < 8; ++i) {
+        if (i == 0 || i == 5) continue;
+        CHECK( bodies[i]->GetPosition().x == referenceBodies[i]->GetPosition().x );
+        CHECK( bodies[i]->GetPosition().y == referenceBodies[i]->GetPosition().y );
+        CHECK( bodies[i]->GetRotation() == referenceBodies[i]->GetRotation() );
+        CHECK( bodies[i]->GetVelocity().y == referenceBodies[i]->GetVelocity().y );
+    }
+}
+
+// Columns of boxes on the ground
+static std::vector<d2BodyDef>
+MakeWall(const d2Shape &box)
+{
+    std::vector<d2BodyDef> defs;
+    for (int32 row = 0; row < 10; ++row) {
+        for (int32 column = 0; column < 10; ++column) {
+            d2BodyDef def;
+            def.shape = &box;
+            def.position = {100.0F + (real)column * 30.0F, 780.0F - (real)row * 21.0F};
+            def.mass = 1.0F;
+            defs.push_back(def);
+        }
+    }
+    return defs;
+}
+
+DOCTEST_TEST_CASE("bodies created in a batch are simulated like bodies created one by one")
+{
+    const d2BoxShape ground(2000.0F, 20.0F);
+    const d2BoxShape box(20.0F, 20.0F);
+    const std::vector<d2BodyDef> defs = MakeWall(box);
+
+    d2World reference(d2Vec2(0.0F, -9.81F));
+    reference.CreateBody(ground, {1000.0F, 800.0F}, 0.0F);
+    std::vector<d2Body*> referenceBodies;
+    for (const d2BodyDef &def: defs) {
+        referenceBodies.push_back(reference.CreateBody(*def.shape, def.position, def.mass));
+    }
+
+    d2World world(d2Vec2(0.0F, -9.81F));
+    world.CreateBody(ground, {1000.0F, 800.0F}, 0.0F);
+    std::vector<d2BodyId> ids(defs.size());
+    world.CreateBodies(defs.data(), (int32)defs.size(), ids.data());
+    CHECK( world.GetBodyCount() == 101 );
+
+    for (int32 i = 0; i < 120; ++i) {
+        reference.Step(1.0F / 60.0F);
+        world.Step(1.0F / 60.0F);
+    }
+
+    for (size_t i = 0; i < defs.size(); ++i) {
+        const d2Body *body = world.GetBody(ids[i]);
+        REQUIRE( body != nullptr );
+        CHECK( body->GetShape()->GetType() == BOX );
+        CHECK( body->GetPosition().x == doctest::Approx(referenceBodies[i]->GetPosition().x).epsilon(0.001) );
+        CHECK( body->GetPosition().y == doctest::Approx(referenceBodies[i]->GetPosition().y).epsilon(0.001) );
+    }
+}
+
+DOCTEST_TEST_CASE("destroying bodies in a batch skips stale handles and wakes what rested on them")
+{
+    d2World world(d2Vec2(0.0F, -9.81F));
+    world.CreateBody(d2BoxShape(2000.0F, 20.0F), {1000.0F, 800.0F}, 0.0F);
+    const d2BoxShape box(20.0F, 20.0F);
+    const std::vector<d2BodyDef> defs = MakeWall(box);
+    std::vector<d2BodyId> ids(defs.size());
+    world.CreateBodies(defs.data(), (int32)defs.size(), ids.data());
+
+    for (int32 i = 0; i < 300; ++i) {
+        world.Step(1.0F / 60.0F);
+    }
+    d2Body *top = world.GetBody(ids[95]);
+    CHECK( !top->IsAwake() );
+    const real restingY = top->GetPosition().y;
+
+    // The first column is already gone, and the bottom row is named twice
+    std::vector<d2BodyId> doomed;
+    for (int32 row = 0; row < 10; ++row) {
+        world.DestroyBody(world.GetBody(ids[row * 10]));
+        doomed.push_back(ids[row * 10]);
+    }
+    for (int32 column = 1; column < 10; ++column) {
+        doomed.push_back(ids[column]);
+        doomed.push_back(ids[column]);
+    }
+    world.DestroyBodies(doomed.data(), (int32)doomed.size());
+
+    CHECK( world.GetBodyCount() == 1 + 81 );
+    for (int32 column = 0; column < 10; ++column) {
+        CHECK( world.GetBody(ids[column]) == nullptr );
+    }
+
+    // The boxes that rested on the bottom row are woken, and their columns fall down by one row
+    CHECK( world.GetBody(ids[15])->IsAwake() );
+    for (int32 i = 0; i < 120; ++i) {
+        world.Step(1.0F / 60.0F);
+    }
+    CHECK( top->GetPosition().y == doctest::Approx(restingY + 21.0F).epsilon(0.01) );
+}
+
+DOCTEST_TEST_CASE("creating a batch each frame grows the body storage geometrically")
+{
+    d2World world(d2Vec2(0.0F, -9.81F));
+    const d2CircleShape ball(5.0F);
+    std::vector<d2BodyDef> defs(10);
+    for (d2BodyDef &def: defs) {
+        def.shape = &ball;
+        def.mass = 1.0F;
+    }
+
+    int32 growCount = 0;
+    const d2Vec2 *positions = nullptr;
+    for (int32 frame = 0; frame < 100; ++frame) {
+        for (int32 i = 0; i < 10; ++i) {
+            defs[i].position = {(real)i * 20.0F, (real)frame * 20.0F};
+        }
+        world.CreateBodies(defs.data(), (int32)defs.size());
+        if (world.m_bodyStorage.positions.data() != positions) {
+            positions = world.m_bodyStorage.positions.data();
+            ++growCount;
+        }
+    }
+
+    CHECK( world.GetBodyCount() == 1000 );
+    CHECK( growCount <= 8 );
+}
@@ -0,0 +1,412 @@
+#include <doctest/doctest.h>
+
+#include <cmath>
+#include <set>
+#include <vector>
+#include "dura2d/dura2d.h"
+
+// Touching contact between two bodies, as the narrowphase would report it
+static d2Contact
+MakeContact(d2Body *a, d2Body *b)
+{
+    d2Contact contact{};
+    contact.a = a;
+    contact.b = b;
+    contact.normal = (b->GetPosition() - a->GetPosition()).UnitVector();
+    contact.start = (a->GetPosition() + b->GetPosition()) * 0.5F;
+    contact.end = contact.start;
+    contact.depth = 0.0F;
+    return contact;
+}
+
+DOCTEST_TEST_CASE("contact colors never share a dynamic body")
+{
+    d2World world(d2Vec2(0.0F, 0.0F));
+    d2Body *ground = world.CreateBody(d2BoxShape(1000.0F, 10.0F), {0.0F, 100.0F}, 0.0F);
+
+    // A row of boxes touching each other and the ground, plus a hub touching all of them
+    std::vector<d2Body*> boxes;
+    for (int32 i = 0; i < 40; ++i)
+    {
+        boxes.push_back(world.CreateBody(d2BoxShape(10.0F, 10.0F), {(real)i * 10.0F, 90.0F}, 1.0F));
+    }
+    d2Body *hub = world.CreateBody(d2CircleShape(5.0F), {200.0F, 0.0F}, 1.0F);
+
+    std::vector<d2Contact> contacts;
+    for (int32 i = 0; i < 40; ++i)
+    {
+        contacts.push_back(MakeContact(ground, boxes[i]));
+        contacts.push_back(MakeContact(hub, boxes[i]));
+        if (i > 0) contacts.push_back(MakeContact(boxes[i - 1], boxes[i]));
+    }
+
+    d2ConstraintSolver solver;
+    solver.Prepare(contacts.data(), (int32)contacts.size(), nullptr, 0, 1.0F / 60.0F);
+
+    // Every box takes the first color with the ground, so the hub only gets the other ones
+    // and the rest of its contacts overflow
+    CHECK( solver.GetOverflowCount() == 40 - (SOLVER_GRAPH_COLOR_COUNT - 1) );
+
+    int32 packed = 0;
+    for (int32 color = 0; color < solver.GetColorCount() - 1; ++color)
+    {
+        int32 batchCount = 0;
+        const d2ContactBatch *batches = solver.GetColorBatches(color, batchCount);
+        CHECK( batchCount > 0 );
+
+        std::set<int32> bodies;
+        for (int32 i = 0; i < batchCount; ++i)
+        {
+            for (int32 lane = 0; lane < D2_SIMD_WIDTH; ++lane)
+            {
+                const int32 indexA = batches[i].indexA[lane];
+                const int32 indexB = batches[i].indexB[lane];
+                if (indexA == 0 && indexB == 0) continue;
+
+                ++packed;
+                if (indexA != 0) CHECK( bodies.insert(indexA).second );
+                if (indexB != 0) CHECK( bodies.insert(indexB).second );
+            }
+        }
+    }
+    CHECK( packed + solver.GetOverflowCount() == (int32)contacts.size() );
+}
+
+DOCTEST_TEST_CASE("joints and contacts share the colors")
+{
+    d2World world(d2Vec2(0.0F, 0.0F));
+    d2Body *ground = world.CreateBody(d2BoxShape(1000.0F, 10.0F), {0.0F, 100.0F}, 0.0F);
+
+    // A chain of boxes jointed to each other and resting on the ground
+    std::vector<d2Body*> boxes;
+    std::vector<d2Contact> contacts;
+    std::vector<d2Constraint*> joints;
+    for (int32 i = 0; i < 30; ++i)
+    {
+        boxes.push_back(world.CreateBody(d2BoxShape(10.0F, 10.0F), {(real)i * 10.0F, 90.0F}, 1.0F));
+        contacts.push_back(MakeContact(ground, boxes[i]));
+        if (i > 0) joints.push_back(world.CreateJoint(boxes[i - 1], boxes[i], {(real)i * 10.0F - 5.0F, 90.0F}));
+    }
+
+    d2ConstraintSolver solver;
+    solver.Prepare(contacts.data(), (int32)contacts.size(), joints.data(), (int32)joints.size(), 1.0F / 60.0F);
+    CHECK( solver.GetOverflowCount() == 0 );
+
+    int32 jointTotal = 0;
+    int32 laneTotal = 0;
+    for (int32 color = 0; color < solver.GetColorCount() - 1; ++color)
+    {
+        std::set<const d2Body*> bodies;
+
+        int32 jointCount = 0;
+        d2Constraint *const *colorJoints = solver.GetColorJoints(color, jointCount);
+        for (int32 i = 0; i < jointCount; ++i)
+        {
+            CHECK( bodies.insert(colorJoints[i]->a).second );
+            CHECK( bodies.insert(colorJoints[i]->b).second );
+        }
+        jointTotal += jointCount;
+
+        int32 batchCount = 0;
+        const d2ContactBatch *batches = solver.GetColorBatches(color, batchCount);
+        for (int32 i = 0; i < batchCount; ++i)
+        {
+            for (int32 lane = 0; lane < D2_SIMD_WIDTH; ++lane)
+            {
+                if (batches[i].indexB[lane] == 0) continue;
+
+                ++laneTotal;
+                CHECK( bodies.insert(solver.GetBody(batches[i].indexB[lane])).second );
+            }
+        }
+    }
+    CHECK( jointTotal == world.GetConstraintCount() );
+    CHECK( laneTotal == (int32)contacts.size() );
+
+    // Without colors everything is solved serially in the overflow color
+    solver.SetColorCount(0);
+    solver.Prepare(contacts.data(), (int32)contacts.size(), joints.data(), (int32)joints.size(), 1.0F / 60.0F);
+    CHECK( solver.GetColorCount() == 1 );
+    CHECK( solver.GetOverflowCount() == world.GetConstraintCount() + (int32)contacts.size() );
+}
+
+DOCTEST_TEST_CASE("two-point manifolds share a lane and a block")
+{
+    d2World world(d2Vec2(0.0F, 0.0F));
+    d2Body *ground = world.CreateBody(d2BoxShape(1000.0F, 10.0F), {0.0F, 100.0F}, 0.0F);
+    d2Body *box = world.CreateBody(d2BoxShape(40.0F, 40.0F), {0.0F, 75.0F}, 1.0F);
+    d2Body *ball = world.CreateBody(d2CircleShape(10.0F), {100.0F, 85.0F}, 1.0F);
+
+    // Both corners of the box on the ground, then the ball on its own
+    std::vector<d2Contact> contacts;
+    for (real x: {-20.0F, 20.0F})
+    {
+        d2Contact contact = MakeContact(box, ground);
+        contact.normal = d2Vec2(0.0F, 1.0F);
+        contact.start = contact.end = d2Vec2(x, 95.0F);
+        contacts.push_back(contact);
+    }
+    contacts.push_back(MakeContact(ball, ground));
+
+    d2ConstraintSolver solver;
+    solver.Prepare(contacts.data(), (int32)contacts.size(), nullptr, 0, 1.0F / 60.0F);
+    REQUIRE( solver.GetColorCount() == 2 );
+
+    int32 batchCount = 0;
+    const d2ContactBatch *batch = solver.GetColorBatches(0, batchCount);
+    REQUIRE( batchCount == 1 );
+    CHECK( batch->pointCount[0] == 2 );
+    CHECK( batch->pointCount[1] == 1 );
+    CHECK( batch->pointCount[2] == 0 );
+
+    // K of the box is well conditioned, the ball has no second row to couple
+    CHECK( batch->k11[0] > 0.0F );
+    CHECK( batch->k11[0] * batch->blockMass11[0] + batch->k12[0] * batch->blockMass12[0] == doctest::Approx(1.0F) );
+    CHECK( batch->k11[1] == 0.0F );
+}
+
+DOCTEST_TEST_CASE("block solver keeps a tall stack upright with two iterations")
+{
+    d2World world(d2Vec2(0.0F, -9.81F));
+    world.CreateBody(d2BoxShape(600.0F, 20.0F), {300.0F, 600.0F}, 0.0F);
+
+    std::vector<d2Body*> boxes;
+    for (int32 i = 0; i < 10; ++i)
+    {
+        boxes.push_back(world.CreateBody(d2BoxShape(40.0F, 40.0F), {300.0F, 570.0F - (real)i * 40.0F}, 1.0F));
+    }
+
+    for (int32 i = 0; i < 300; ++i)
+    {
+        world.Step(1.0F / 60.0F, 2);
+    }
+
+    // The Baumgarte bias leaves each box sunk a little in the one below
+    for (int32 i = 0; i < 10; ++i)
+    {
+        CHECK( std::abs(boxes[i]->GetPosition().y - (570.0F - (real)i * 40.0F)) < 5.0F );
+        CHECK( boxes[i]->GetPosition().x == doctest::Approx(300.0F).epsilon(0.001) );
+        CHECK( std::abs(boxes[i]->GetRotation()) < 0.01F );
+    }
+}
+
+DOCTEST_TEST_CASE("solver iterations converge and stop at the tolerance")
+{
+    d2World world(d2Vec2(0.0F, -9.81F));
+    world.SetAllowSleeping(false);
+    world.CreateBody(d2BoxShape(600.0F, 20.0F), {300.0F, 600.0F}, 0.0F);
+    for (int32 i = 0; i < 4; ++i)
+    {
+        world.CreateBody(d2BoxShape(40.0F, 40.0F), {300.0F, 570.0F - (real)i * 40.0F}, 1.0F);
+    }
+
+    for (int32 i = 0; i < 120; ++i)
+    {
+        world.Step(1.0F / 60.0F, 20);
+    }
+
+    // Without a tolerance every iteration runs, changing the impulses less and less
+    const std::vector<d2SolverIteration> &iterations = world.GetSolverIterations();
+    REQUIRE( iterations.size() == 20 );
+    for (size_t i = 1; i < iterations.size(); ++i)
+    {
+        CHECK( iterations[i].maxImpulse < iterations[i - 1].maxImpulse );
+        CHECK( iterations[i].maxImpulse <= iterations[i].totalImpulse );
+    }
+
+    world.SetSolverTolerance(0.5F);
+    world.Step(1.0F / 60.0F, 20);
+    REQUIRE( !iterations.empty() );
+    CHECK( iterations.size() < 20 );
+    CHECK( iterations.back().maxImpulse < 0.5F );
+    for (size_t i = 0; i + 1 < iterations.size(); ++i)
+    {
+        CHECK( iterations[i].maxImpulse >= 0.5F );
+    }
+}
+
+DOCTEST_TEST_CASE("colored solver keeps a stack at rest")
+{
+    d2World world(d2Vec2(0.0F, -9.81F));
+    world.SetWorkerCount(4);
+    world.CreateBody(d2BoxShape(600.0F, 20.0F), {300.0F, 600.0F}, 0.0F);
+
+    std::vector<d2Body*> boxes;
+    for (int32 i = 0; i < 6; ++i)
+    {
+        boxes.push_back(world.CreateBody(d2BoxShape(40.0F, 40.0F), {300.0F, 570.0F - (real)i * 40.0F}, 1.0F));
+    }
+
+    for (int32 i = 0; i < 300; ++i)
+    {
+        world.Step(1.0F / 60.0F);
+    }
+
+    // The whole stack may slide a little, but stays upright
+    for (int32 i = 0; i < 6; ++i)
+    {
+        CHECK( boxes[i]->GetPosition().y == doctest::Approx(570.0F - (real)i * 40.0F).epsilon(0.01) );
+        CHECK( std::abs(boxes[i]->GetPosition().x - boxes[0]->GetPosition().x) < 10.0F );
+        CHECK( std::abs(boxes[i]->GetRotation()) < 0.05F );
+    }
+}
+
+DOCTEST_TEST_CASE("soft step solver keeps a stack at rest with a single iteration")
+{
+    d2World world(d2Vec2(0.0F, -9.81F));
+    world.SetWorkerCount(4);
+    world.SetSolverType(d2SolverType::d2_softStepSolver);
+    world.CreateBody(d2BoxShape(600.0F, 20.0F), {300.0F, 600.0F}, 0.0F);
+
+    std::vector<d2Body*> boxes;
+    for (int32 i = 0; i < 6; ++i)
+    {
+        boxes.push_back(world.CreateBody(d2BoxShape(40.0F, 40.0F), {300.0F, 570.0F - (real)i * 40.0F}, 1.0F));
+    }
+
+    for (int32 i = 0; i < 300; ++i)
+    {
+        world.Step(1.0F / 60.0F, 1);
+    }
+
+    for (int32 i = 0; i < 6; ++i)
+    {
+        CHECK( boxes[i]->GetPosition().y == doctest::Approx(570.0F - (real)i * 40.0F).epsilon(0.01) );
+        CHECK( std::abs(boxes[i]->GetPosition().x - boxes[0]->GetPosition().x) < 10.0F );
+        CHECK( std::abs(boxes[i]->GetRotation()) < 0.05F );
+    }
+}
+
+DOCTEST_TEST_CASE("soft step joints stretch with their stiffness")
+{
+    // Pendulums hanging from a pin, the stiffer the joint the closer its anchors
+    auto stretch = [](real hertz)
+    {
+        d2World world(d2Vec2(0.0F, -9.81F));
+        world.SetSolverType(d2SolverType::d2_softStepSolver);
+        d2Body *pin = world.CreateBody(d2BoxShape(10.0F, 10.0F), {0.0F, 0.0F}, 0.0F);
+        d2Body *bob = world.CreateBody(d2BoxShape(10.0F, 10.0F), {30.0F, 50.0F}, 1.0F);
+        d2Constraint *joint = world.CreateJoint(pin, bob, {0.0F, 0.0F});
+        joint->hertz = hertz;
+
+        real maxStretch = 0.0F;
+        for (int32 i = 0; i < 300; ++i)
+        {
+            world.Step(1.0F / 60.0F);
+            maxStretch = std::max(maxStretch, (bob->LocalSpaceToWorldSpace(joint->bPoint) - pin->GetPosition()).Lenght());
+        }
+
+        // The bob keeps swinging at its length
+        CHECK( std::abs((bob->GetPosition() - pin->GetPosition()).Lenght() - std::sqrt(30.0F * 30.0F + 50.0F * 50.0F)) < maxStretch + 1.0F );
+        return maxStretch;
+    };
+
+    const real stiff = stretch(JOINT_HERTZ);
+    const real soft = stretch(2.0F);
+    CHECK( stiff < 0.5F );
+    CHECK( soft > 2.0F * stiff );
+}
+
+DOCTEST_TEST_CASE("position iterations push out of penetration without adding speed")
+{
+    // A box sunk 10 pixels in the ground, pushed out by the velocity bias or by the position solver
+    auto pushOut = [](int32 positionIterations, real &speed, real &height)
+    {
+        d2World world(d2Vec2(0.0F, 0.0F));
+        world.SetAllowSleeping(false);
+        world.CreateBody(d2BoxShape(600.0F, 20.0F), {300.0F, 600.0F}, 0.0F);
+        d2Body *box = world.CreateBody(d2BoxShape(40.0F, 40.0F), {300.0F, 580.0F}, 1.0F);
+
+        speed = 0.0F;
+        int32 iterationCount = 0;
+        for (int32 i = 0; i < 60; ++i)
+        {
+            world.Step(1.0F / 60.0F, 3, positionIterations);
+            speed = d2Max(speed, box->GetVelocity().Lenght());
+            iterationCount = world.GetPositionIterationCount();
+        }
+
+        height = box->GetPosition().y;
+        return iterationCount;
+    };
+
+    // The velocity bias throws the box out of the ground
+    real speed, height;
+    CHECK( pushOut(0, speed, height) == 0 );
+    CHECK( speed > 100.0F );
+
+    // The position solver lifts it to rest on the ground, and once out of it a single iteration
+    // finds nothing left to correct
+    CHECK( pushOut(8, speed, height) == 1 );
+    CHECK( speed < 1.0F );
+    CHECK( height == doctest::Approx(570.0F).epsilon(0.001) );
+}
+
+DOCTEST_TEST_CASE("position iterations keep a bridge of joints together")
+{
+    auto maxJointError = [](int32 positionIterations)
+    {
+        d2World world(d2Vec2(0.0F, -9.81F));
+        d2Body *previous = world.CreateBody(d2BoxShape(10.0F, 10.0F), {100.0F, 300.0F}, 0.0F);
+        for (int32 i = 1; i <= 10; ++i)
+        {
+            d2Body *link = world.CreateBody(d2BoxShape(16.0F, 8.0F), {100.0F + (real)i * 20.0F, 300.0F}, 1.0F);
+            world.CreateJoint(previous, link, {90.0F + (real)i * 20.0F, 300.0F});
+            previous = link;
+        }
+        d2Body *end = world.CreateBody(d2BoxShape(10.0F, 10.0F), {320.0F, 300.0F}, 0.0F);
+        world.CreateJoint(previous, end, {310.0F, 300.0F});
+
+        for (int32 i = 0; i < 300; ++i)
+        {
+            world.Step(1.0F / 60.0F, 3, positionIterations);
+        }
+
+        real error = 0.0F;
+        for (d2Constraint *joint = world.m_constraints; joint; joint = joint->GetNext())
+        {
+            const d2Vec2 pa = joint->a->LocalSpaceToWorldSpace(joint->aPoint);
+            const d2Vec2 pb = joint->b->LocalSpaceToWorldSpace(joint->bPoint);
+            error = d2Max(error, (pb - pa).Lenght());
+        }
+        return error;
+    };
+
+    // The velocity bias lets the anchors stretch apart, the position solver pins them back
+    CHECK( maxJointError(0) > 1.0F );
+    CHECK( maxJointError(3) < 0.5F );
+}
+
+DOCTEST_TEST_CASE("contacts bounce with their restitution above the threshold")
+{
+    // A ball dropped on the ground, returns the speed it leaves the ground with
+    auto bounce = [](real restitution, real height)
+    {
+        d2World world(d2Vec2(0.0F, -9.81F));
+        world.SetAllowSleeping(false);
+        d2Body *ground = world.CreateBody(d2BoxShape(600.0F, 20.0F), {300.0F, 600.0F}, 0.0F);
+        d2Body *ball = world.CreateBody(d2CircleShape(20.0F), {300.0F, 570.0F - height}, 1.0F);
+        ground->SetRestitution(restitution);
+        ball->SetRestitution(restitution);
+
+        real impactSpeed = 0.0F;
+        for (int32 i = 0; i < 120; ++i)
+        {
+            const real speed = ball->GetVelocity().y;
+            world.Step(1.0F / 60.0F, 8);
+            if (speed > 0.0F && ball->GetVelocity().y < 0.0F)
+            {
+                impactSpeed = speed;
+                return -ball->GetVelocity().y / impactSpeed;
+            }
+        }
+        return 0.0F;
+    };
+
+    CHECK( bounce(0.0F, 100.0F) == doctest::Approx(0.0F).epsilon(0.05) );
+    CHECK( bounce(0.5F, 100.0F) == doctest::Approx(0.5F).epsilon(0.1) );
+    CHECK( bounce(1.0F, 100.0F) == doctest::Approx(1.0F).epsilon(0.1) );
+
+    // Slower than the threshold, the ball comes to rest instead of jittering
+    CHECK( bounce(1.0F, 1.0F) < 0.1F );
+}
@@ -0,0 +1,98 @@
+#include <doctest/doctest.h>
+
+#include "dura2d/dura2d.h"
+#include "dura2d/d2CollisionDetection.h"
+
+DOCTEST_TEST_CASE("contact events follow the touching pairs")
+{
+    d2World world(d2Vec2(0.0F, -9.8F));
+    d2Body *ground = world.CreateBody(d2BoxShape(800.0F, 40.0F), {400.0F, 600.0F}, 0.0F);
+    d2Body *box = world.CreateBody(d2BoxShape(20.0F, 20.0F), {400.0F, 500.0F}, 1.0F);
+    ground->SetRestitution(0.0F);
+    box->SetRestitution(0.0F);
+
+    int beginCount = 0;
+    int endCount = 0;
+    int hitCount = 0;
+    for (int i = 0; i < 180; ++i)
+    {
+        world.Step(1.0F / 60.0F, 10);
+
+        const d2ContactEvents &events = world.GetContactEvents();
+        for (const d2ContactPair &pair: events.beginEvents)
+        {
+            CHECK( ( ( pair.a == box && pair.b == ground ) || ( pair.a == ground && pair.b == box ) ) );
+        }
+        for (const d2ContactHitEvent &hit: events.hitEvents)
+        {
+            CHECK( ( hit.approachSpeed > world.GetHitEventThreshold() ) );
+
+            // The box lands on the ground, +y is down
+            const d2Vec2 normal = hit.pair.a == ground ? hit.normal : hit.normal * -1.0F;
+            CHECK( ( normal.y < -0.9F ) );
+        }
+        beginCount += (int)events.beginEvents.size();
+        endCount += (int)events.endEvents.size();
+        hitCount += (int)events.hitEvents.size();
+    }
+
+    // One landing, and resting doesn't report anything else
+    CHECK( ( beginCount == 1 ) );
+    CHECK( ( endCount == 0 ) );
+    CHECK( ( hitCount == 1 ) );
+
+    // Lifting the box ends the contact
+    box->SetPosition({400.0F, 100.0F});
+    world.Step(1.0F / 60.0F, 10);
+    REQUIRE( ( world.GetContactEvents().endEvents.size() == 1 ) );
+    CHECK( ( world.GetContactEvents().beginEvents.empty() ) );
+
+    // Destroyed bodies are forgotten without an end event
+    box->SetPosition({400.0F, 571.0F});
+    world.Step(1.0F / 60.0F, 10);
+    CHECK( ( world.GetContactEvents().beginEvents.size() == 1 ) );
+    world.DestroyBody(box);
+    world.Step(1.0F / 60.0F, 10);
+    CHECK( ( world.GetContactEvents().endEvents.empty() ) );
+}
+
+DOCTEST_TEST_CASE("sensors report overlaps without contacts")
+{
+    d2World world(d2Vec2(0.0F, -9.8F));
+    d2Body *sensor = world.CreateBody(d2BoxShape(200.0F, 50.0F), {400.0F, 300.0F}, 0.0F);
+    d2Body *ball = world.CreateBody(d2CircleShape(10.0F), {400.0F, 200.0F}, 1.0F);
+    sensor->SetSensor(true);
+
+    int beginStep = -1;
+    int endStep = -1;
+    for (int i = 0; i < 120; ++i)
+    {
+        world.Step(1.0F / 60.0F, 10);
+        CHECK( world.GetContacts().empty() );
+
+        const d2SensorEvents &events = world.GetSensorEvents();
+        if (!events.beginEvents.empty())
+        {
+            CHECK( ( events.beginEvents[0].a == sensor ) );
+            CHECK( ( events.beginEvents[0].b == ball ) );
+            beginStep = i;
+        }
+        if (!events.endEvents.empty())
+        {
+            endStep = i;
+        }
+    }
+
+    // The ball falls through the sensor
+    CHECK( ( ball->GetPosition().y > 400.0F ) );
+    CHECK( ( beginStep >= 0 ) );
+    CHECK( ( endStep > beginStep ) );
+
+    // The overlap test follows the rounded shapes, the box corner is at (500, 325)
+    ball->SetPosition({400.0F, 300.0F});
+    CHECK( d2CollisionDetection::TestOverlap(sensor, 0, ball, 0) );
+    ball->SetPosition({507.0F, 332.0F});
+    CHECK( d2CollisionDetection::TestOverlap(sensor, 0, ball, 0) );
+    ball->SetPosition({508.0F, 334.0F});
+    CHECK_FALSE( d2CollisionDetection::TestOverlap(sensor, 0, ball, 0) );
+}
@@ -0,0 +1,74 @@
+#include <doctest/doctest.h>
+
+#include "dura2d/dura2d.h"
+
+// Fire a small body at a thin static wall at 30 Hz, returning where it ends up
+static d2Vec2
+FireAtWall(const d2Shape &projectile, bool bullet)
+{
+    d2World world(d2Vec2(0.0F, 0.0F));
+    world.CreateBody(d2BoxShape(4.0F, 200.0F), {300.0F, 0.0F}, 0.0F);
+
+    d2Body *body = world.CreateBody(projectile, {0.0F, 0.0F}, 1.0F);
+    body->SetBullet(bullet);
+    body->ApplyImpulseLinear({6000.0F, 0.0F}); // 200 units per step, way more than its size
+
+    for (int i = 0; i < 30; ++i)
+    {
+        world.Step(1.0F / 30.0F, 10);
+    }
+    return body->GetPosition();
+}
+
+DOCTEST_TEST_CASE("bullets don't tunnel through thin walls")
+{
+    // Without CCD both projectiles jump over the wall
+    CHECK( ( FireAtWall(d2CircleShape(5.0F), false).x > 300.0F ) );
+    CHECK( ( FireAtWall(d2BoxShape(10.0F, 10.0F), false).x > 300.0F ) );
+
+    // Bullets are stopped on the near side
+    CHECK( ( FireAtWall(d2CircleShape(5.0F), true).x < 300.0F ) );
+    CHECK( ( FireAtWall(d2BoxShape(10.0F, 10.0F), true).x < 300.0F ) );
+}
+
+DOCTEST_TEST_CASE("bullets move like any other body in open space")
+{
+    d2World world(d2Vec2(0.0F, 0.0F));
+    d2Body *bullet = world.CreateBody(d2CircleShape(5.0F), {0.0F, 0.0F}, 1.0F);
+    d2Body *body = world.CreateBody(d2CircleShape(5.0F), {0.0F, 100.0F}, 1.0F);
+    bullet->SetBullet(true);
+    bullet->ApplyImpulseLinear({6000.0F, 0.0F});
+    body->ApplyImpulseLinear({6000.0F, 0.0F});
+
+    for (int i = 0; i < 10; ++i)
+    {
+        world.Step(1.0F / 30.0F, 10);
+    }
+    CHECK( ( d2Abs(bullet->GetPosition().x - body->GetPosition().x) < 1e-3F ) );
+}
+
+DOCTEST_TEST_CASE("speculative contacts stop bodies that would skip a wall in one step")
+{
+    d2World world(d2Vec2(0.0F, 0.0F));
+    d2Body *wall = world.CreateBody(d2BoxShape(4.0F, 200.0F), {300.0F, 0.0F}, 0.0F);
+
+    // 18 units per step, more than the circle and wall together, and not a bullet
+    d2Body *body = world.CreateBody(d2CircleShape(2.0F), {0.0F, 0.0F}, 1.0F);
+    body->ApplyImpulseLinear({540.0F, 0.0F});
+    wall->SetRestitution(0.0F);
+    body->SetRestitution(0.0F);
+
+    for (int i = 0; i < 30; ++i)
+    {
+        world.Step(1.0F / 30.0F, 10);
+    }
+    CHECK( ( body->GetPosition().x < 300.0F ) );
+    CHECK( ( body->GetPosition().x > 280.0F ) );
+
+    // Nothing within reach, so the margin doesn't slow anything down
+    d2World empty(d2Vec2(0.0F, 0.0F));
+    d2Body *free = empty.CreateBody(d2CircleShape(2.0F), {0.0F, 0.0F}, 1.0F);
+    free->ApplyImpulseLinear({540.0F, 0.0F});
+    empty.Step(1.0F / 30.0F, 10);
+    CHECK( free->GetPosition().x == doctest::Approx(18.0F) );
+}
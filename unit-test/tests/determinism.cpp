@@ -0,0 +1,194 @@
+#include <doctest/doctest.h>
+
+#include <vector>
+#include "dura2d/dura2d.h"
+
+// How a scene is stepped, the same for every worker count it's compared on
+struct RunSettings
+{
+    int32 stepCount { 60 };
+    int32 velocityIterations { 3 };
+    int32 positionIterations { POSITION_ITERATIONS };
+    bool allowSleeping { true };
+    bool deterministic { false };
+    real tolerance { 0.0F };
+};
+
+// What a run leaves behind: the bodies in list order, the hash of every step and the impulses
+// of the last one
+struct RunResult
+{
+    std::vector<d2Vec2> positions;
+    std::vector<uint64> hashes;
+    std::vector<d2SolverIteration> iterations;
+    int32 islandCount { 0 };
+};
+
+// The workers are added once the world and its solvers exist
+static RunResult
+Run(void (*build)(d2World &world), const RunSettings &settings, int32 workerCount)
+{
+    d2World world(d2Vec2(0.0F, -9.81F));
+    world.SetWorkerCount(workerCount);
+    world.SetAllowSleeping(settings.allowSleeping);
+    world.SetDeterministic(settings.deterministic);
+    world.SetSolverTolerance(settings.tolerance);
+    build(world);
+
+    RunResult result;
+    for (int32 i = 0; i < settings.stepCount; ++i) {
+        world.Step(1.0F / 60.0F, settings.velocityIterations, settings.positionIterations);
+        result.hashes.push_back(world.GetStateHash());
+    }
+    for (const d2Body *body = world.GetBodies(); body; body = body->GetNext()) {
+        result.positions.push_back(body->GetPosition());
+    }
+    result.iterations = world.GetSolverIterations();
+    result.islandCount = world.GetIslandCount();
+    return result;
+}
+
+// Boxes and circles dropped in a heap, for the narrowphase
+static void
+BuildHeap(d2World &world)
+{
+    world.CreateBody(d2BoxShape(2000.0F, 40.0F), {0.0F, 600.0F}, 0.0F);
+    for (int32 i = 0; i < 200; ++i) {
+        const d2Vec2 position(-500.0F + (real)(i % 20) * 50.0F, 540.0F - (real)(i / 20) * 45.0F);
+        if (i % 2 == 0)
+            world.CreateBody(d2BoxShape(40.0F, 40.0F), position, 1.0F);
+        else
+            world.CreateBody(d2CircleShape(20.0F), position, 1.0F);
+    }
+}
+
+// Many small piles apart from each other, so each is an island
+static void
+BuildPiles(d2World &world)
+{
+    world.CreateBody(d2BoxShape(4000.0F, 40.0F), {0.0F, 600.0F}, 0.0F);
+    for (int32 pile = 0; pile < 40; ++pile) {
+        for (int32 i = 0; i < 1 + pile % 5; ++i) {
+            world.CreateBody(d2BoxShape(20.0F, 20.0F), {-1900.0F + (real)pile * 95.0F, 570.0F - (real)i * 21.0F}, 1.0F);
+        }
+    }
+}
+
+static void
+AddPyramid(d2World &world, int32 rowCount)
+{
+    for (int32 row = 0; row < rowCount; ++row) {
+        for (int32 column = 0; column < rowCount - row; ++column) {
+            world.CreateBody(d2BoxShape(20.0F, 20.0F), {100.0F + (real)column * 21.0F + (real)row * 10.5F,
+                                                        780.0F - (real)row * 21.0F}, 1.0F);
+        }
+    }
+}
+
+// One island big enough to be solved by color on every worker
+static void
+BuildPyramid(d2World &world)
+{
+    world.CreateBody(d2BoxShape(2000.0F, 20.0F), {1000.0F, 800.0F}, 0.0F);
+    AddPyramid(world, 30);
+}
+
+// A pyramid big enough to be solved by color across the workers, next to many small stacks
+// handed to the workers one island at a time
+static void
+BuildMixed(d2World &world)
+{
+    world.CreateBody(d2BoxShape(2000.0F, 20.0F), {1000.0F, 800.0F}, 0.0F);
+    AddPyramid(world, 12);
+    for (int32 stack = 0; stack < 20; ++stack) {
+        for (int32 level = 0; level < 3; ++level) {
+            world.CreateBody(d2BoxShape(20.0F, 20.0F), {600.0F + (real)stack * 60.0F, 780.0F - (real)level * 21.0F}, 1.0F);
+        }
+    }
+}
+
+DOCTEST_TEST_CASE("parallel narrowphase matches the serial one")
+{
+    const RunSettings settings;
+    const RunResult serial = Run(BuildHeap, settings, 1);
+    const RunResult parallel = Run(BuildHeap, settings, 4);
+
+    REQUIRE( ( serial.positions.size() == parallel.positions.size() ) );
+    for (size_t i = 0; i < serial.positions.size(); ++i) {
+        CHECK( ( serial.positions[i] == parallel.positions[i] ) );
+    }
+}
+
+DOCTEST_TEST_CASE("islands give the same result on any number of workers")
+{
+    RunSettings settings;
+    settings.allowSleeping = false;
+    const RunResult serial = Run(BuildPiles, settings, 1);
+    const RunResult parallel = Run(BuildPiles, settings, 4);
+    CHECK( serial.islandCount == 40 );
+    CHECK( parallel.islandCount == 40 );
+
+    REQUIRE( serial.positions.size() == parallel.positions.size() );
+    for (size_t i = 0; i < serial.positions.size(); ++i) {
+        CHECK( serial.positions[i].x == doctest::Approx(parallel.positions[i].x) );
+        CHECK( serial.positions[i].y == doctest::Approx(parallel.positions[i].y) );
+    }
+}
+
+DOCTEST_TEST_CASE("colored solver sums the impulses of every worker")
+{
+    RunSettings settings;
+    settings.stepCount = 30;
+    settings.velocityIterations = 8;
+    settings.allowSleeping = false;
+    const RunResult single = Run(BuildPyramid, settings, 1);
+    const RunResult parallel = Run(BuildPyramid, settings, 4);
+
+    REQUIRE( parallel.iterations.size() == single.iterations.size() );
+    for (size_t i = 0; i < single.iterations.size(); ++i) {
+        CHECK( parallel.iterations[i].maxImpulse == single.iterations[i].maxImpulse );
+        CHECK( parallel.iterations[i].totalImpulse == doctest::Approx(single.iterations[i].totalImpulse).epsilon(0.001) );
+    }
+}
+
+DOCTEST_TEST_CASE("deterministic steps match for any number of workers")
+{
+    RunSettings settings;
+    settings.stepCount = 120;
+    settings.velocityIterations = 8;
+    settings.positionIterations = 2;
+    settings.deterministic = true;
+    // Islands converge at different iterations, which used to depend on how they were grouped
+    settings.tolerance = 0.5F;
+    const RunResult serial = Run(BuildMixed, settings, 1);
+    CHECK( serial.hashes.front() != serial.hashes.back() );
+
+    for (int32 workerCount: {2, 3, 4, 8}) {
+        const RunResult parallel = Run(BuildMixed, settings, workerCount);
+        CHECK( parallel.hashes == serial.hashes );
+
+        REQUIRE( parallel.iterations.size() == serial.iterations.size() );
+        for (size_t i = 0; i < parallel.iterations.size(); ++i) {
+            CHECK( parallel.iterations[i].maxImpulse == serial.iterations[i].maxImpulse );
+            CHECK( parallel.iterations[i].totalImpulse == serial.iterations[i].totalImpulse );
+        }
+    }
+}
+
+DOCTEST_TEST_CASE("contact pairs are ordered by creation")
+{
+    d2World world(d2Vec2(0.0F, -9.81F));
+    d2Body *ground = world.CreateBody(d2BoxShape(400.0F, 20.0F), {200.0F, 400.0F}, 0.0F);
+    d2Body *left = world.CreateBody(d2BoxShape(20.0F, 20.0F), {100.0F, 380.0F}, 1.0F);
+    d2Body *right = world.CreateBody(d2BoxShape(20.0F, 20.0F), {300.0F, 380.0F}, 1.0F);
+    CHECK( ground->GetCreationIndex() < left->GetCreationIndex() );
+    CHECK( left->GetCreationIndex() < right->GetCreationIndex() );
+
+    world.Step(1.0F / 60.0F);
+    const std::vector<d2ContactPair> &begins = world.GetContactEvents().beginEvents;
+    REQUIRE( begins.size() == 2 );
+    CHECK( begins[0].a == ground );
+    CHECK( begins[0].b == left );
+    CHECK( begins[1].a == ground );
+    CHECK( begins[1].b == right );
+}
@@ -0,0 +1,174 @@
+#include <doctest/doctest.h>
+
+#include <algorithm>
+#include <vector>
+#include "dura2d/dura2d.h"
+#include "dura2d/d2Island.h"
+
+// A contact between two bodies, the island builder only looks at the bodies
+static d2Contact
+MakeContact(d2Body *a, d2Body *b)
+{
+    d2Contact contact{};
+    contact.a = a;
+    contact.b = b;
+    return contact;
+}
+
+DOCTEST_TEST_CASE("islands group the bodies connected by contacts and joints")
+{
+    d2World world(d2Vec2(0.0F, 0.0F));
+    d2Body *ground = world.CreateBody(d2BoxShape(1000.0F, 10.0F), {0.0F, 100.0F}, 0.0F);
+
+    std::vector<d2Body*> boxes;
+    for (int32 i = 0; i < 8; ++i)
+    {
+        boxes.push_back(world.CreateBody(d2BoxShape(10.0F, 10.0F), {(real)i * 50.0F, 90.0F}, 1.0F));
+    }
+
+    // Everything rests on the ground, which doesn't link the islands together
+    std::vector<d2Contact> contacts;
+    for (d2Body *box: boxes)
+    {
+        contacts.push_back(MakeContact(ground, box));
+    }
+
+    // A pile of three boxes, a pair held by a joint and a lone box in the air
+    contacts.push_back(MakeContact(boxes[0], boxes[1]));
+    contacts.push_back(MakeContact(boxes[1], boxes[2]));
+    world.CreateJoint(boxes[3], boxes[4], {175.0F, 90.0F});
+    d2Body *flying = world.CreateBody(d2CircleShape(5.0F), {0.0F, -500.0F}, 1.0F);
+
+    d2IslandBuilder builder;
+    builder.Build(world.m_bodyStorage, contacts, world.GetConstraints());
+
+    // The pile, the pair, the three lone boxes on the ground and the flying one
+    REQUIRE( builder.GetIslandCount() == 6 );
+    CHECK( builder.GetIsland(0).bodyCount == 3 );
+    CHECK( builder.GetIsland(0).contactCount == 5 );
+    CHECK( builder.GetIsland(1).bodyCount == 2 );
+    CHECK( builder.GetIsland(1).GetConstraintCount() == 3 );
+    CHECK( builder.GetIsland(5).bodyCount == 1 );
+    CHECK( builder.GetIsland(5).GetConstraintCount() == 0 );
+    CHECK( builder.GetBodies()[builder.GetIsland(5).bodyStart] == flying );
+
+    for (int32 i = 0; i < builder.GetIslandCount(); ++i)
+    {
+        const d2Island &island = builder.GetIsland(i);
+        if (i > 0) CHECK( island.GetConstraintCount() <= builder.GetIsland(i - 1).GetConstraintCount() );
+
+        // Every dynamic body of a contact is in the island of the contact
+        for (int32 j = 0; j < island.contactCount; ++j)
+        {
+            const d2Contact &contact = builder.GetContacts()[island.contactStart + j];
+            d2Body *const *first = builder.GetBodies() + island.bodyStart;
+            d2Body *const *last = first + island.bodyCount;
+            CHECK( std::find(first, last, contact.b) != last );
+        }
+    }
+}
+
+DOCTEST_TEST_CASE("resting islands fall asleep and wake up when touched")
+{
+    d2World world(d2Vec2(0.0F, -9.81F));
+    world.CreateBody(d2BoxShape(2000.0F, 40.0F), {0.0F, 600.0F}, 0.0F);
+
+    // Two piles far apart
+    std::vector<d2Body*> left, right;
+    for (int32 i = 0; i < 3; ++i)
+    {
+        left.push_back(world.CreateBody(d2BoxShape(40.0F, 40.0F), {-400.0F, 560.0F - (real)i * 40.0F}, 1.0F));
+        right.push_back(world.CreateBody(d2BoxShape(40.0F, 40.0F), {400.0F, 560.0F - (real)i * 40.0F}, 1.0F));
+    }
+
+    for (int32 i = 0; i < 120; ++i)
+    {
+        world.Step(1.0F / 60.0F);
+    }
+    for (int32 i = 0; i < 3; ++i)
+    {
+        CHECK_FALSE( left[i]->IsAwake() );
+        CHECK_FALSE( right[i]->IsAwake() );
+    }
+
+    // Sleeping bodies don't move at all
+    const d2Vec2 restingPosition = left[2]->GetPosition();
+    world.Step(1.0F / 60.0F);
+    CHECK( left[2]->GetPosition().x == restingPosition.x );
+    CHECK( left[2]->GetPosition().y == restingPosition.y );
+
+    // A box dropped on the left pile wakes all of it in the step it touches, the right pile keeps
+    // sleeping
+    d2Body *dropped = world.CreateBody(d2BoxShape(40.0F, 40.0F), {-400.0F, 400.0F}, 1.0F);
+    dropped->ApplyImpulseLinear({0.0F, 300.0F});
+    bool touched = false;
+    for (int32 i = 0; i < 30 && !touched; ++i)
+    {
+        world.Step(1.0F / 60.0F);
+        touched = left[0]->IsAwake() || left[1]->IsAwake() || left[2]->IsAwake();
+    }
+    REQUIRE( touched );
+    for (int32 i = 0; i < 3; ++i)
+    {
+        CHECK( left[i]->IsAwake() );
+        CHECK_FALSE( right[i]->IsAwake() );
+    }
+
+    // Pushing a body wakes its whole pile
+    right[2]->ApplyImpulseLinear({100.0F, 0.0F});
+    for (int32 i = 0; i < 3; ++i)
+    {
+        CHECK( right[i]->IsAwake() );
+    }
+}
+
+DOCTEST_TEST_CASE("a body put to sleep is woken by a joint to a moving body")
+{
+    d2World world(d2Vec2(0.0F, -9.81F));
+
+    // Two jointed pendulums falling from the same height, one end of the second one put to sleep
+    d2Body *a = world.CreateBody(d2BoxShape(20.0F, 20.0F), {0.0F, 100.0F}, 1.0F);
+    d2Body *b = world.CreateBody(d2BoxShape(20.0F, 20.0F), {50.0F, 100.0F}, 1.0F);
+    world.CreateJoint(a, b, {25.0F, 100.0F});
+    d2Body *c = world.CreateBody(d2BoxShape(20.0F, 20.0F), {500.0F, 100.0F}, 1.0F);
+    d2Body *d = world.CreateBody(d2BoxShape(20.0F, 20.0F), {550.0F, 100.0F}, 1.0F);
+    world.CreateJoint(c, d, {525.0F, 100.0F});
+    d->SetAwake(false);
+
+    world.Step(1.0F / 60.0F);
+    CHECK( d->IsAwake() );
+    for (int32 i = 0; i < 30; ++i)
+    {
+        world.Step(1.0F / 60.0F);
+    }
+
+    // The slept body falls with its partner, as if it had never slept
+    CHECK( d->IsAwake() );
+    CHECK( d->GetPosition().y == doctest::Approx(b->GetPosition().y) );
+    CHECK( c->GetPosition().y == doctest::Approx(a->GetPosition().y) );
+}
+
+DOCTEST_TEST_CASE("sleeping islands drop out of the broadphase pairs until they wake")
+{
+    d2World world(d2Vec2(0.0F, -9.81F));
+    world.CreateBody(d2BoxShape(2000.0F, 40.0F), {0.0F, 600.0F}, 0.0F);
+    std::vector<d2Body*> pile;
+    for (int32 i = 0; i < 3; ++i)
+    {
+        pile.push_back(world.CreateBody(d2BoxShape(40.0F, 40.0F), {0.0F, 560.0F - (real)i * 40.0F}, 1.0F));
+    }
+    for (int32 i = 0; i < 120; ++i)
+    {
+        world.Step(1.0F / 60.0F);
+    }
+    REQUIRE_FALSE( pile[2]->IsAwake() );
+
+    // Only static and sleeping proxies left, nothing to pair
+    world.broadphase->Update();
+    CHECK( world.broadphase->ComputePairs().empty() );
+
+    // Waking the top of the pile wakes all of it, the boxes and the ground are paired again
+    pile[2]->ApplyImpulseLinear({10.0F, 0.0F});
+    world.broadphase->Update();
+    CHECK( world.broadphase->ComputePairs().size() == 3 );
+}
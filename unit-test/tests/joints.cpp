@@ -0,0 +1,190 @@
+#include <doctest/doctest.h>
+
+#include <cmath>
+#include <vector>
+#include "dura2d/dura2d.h"
+
+// Distance between the anchors of a joint
+static real
+GetAnchorGap(const d2Joint *joint)
+{
+    return (joint->a->LocalSpaceToWorldSpace(joint->aPoint) - joint->b->LocalSpaceToWorldSpace(joint->bPoint)).Lenght();
+}
+
+DOCTEST_TEST_CASE("every joint type holds with every solver")
+{
+    for (int32 mode = 0; mode < 3; ++mode)
+    {
+        d2World world(d2Vec2(0.0F, -9.81F));
+        if (mode == 1) world.SetSolverType(d2SolverType::d2_softStepSolver);
+        const int32 positionIterations = mode == 2 ? 4 : 0;
+
+        // Far from everything so no contact gets in the way
+        d2Body *ground = world.CreateBody(d2BoxShape(10.0F, 10.0F), {-500.0F, -500.0F}, 0.0F);
+
+        d2Body *pendulum = world.CreateBody(d2BoxShape(20.0F, 20.0F), {400.0F, 100.0F}, 1.0F);
+        d2JointDef revoluteDef;
+        revoluteDef.type = d2_revoluteJoint;
+        revoluteDef.Initialize(ground, pendulum, {300.0F, 100.0F});
+        d2Joint *revolute = world.CreateJoint(revoluteDef);
+
+        d2Body *ball = world.CreateBody(d2CircleShape(10.0F), {700.0F, 100.0F}, 1.0F);
+        d2JointDef distanceDef;
+        distanceDef.type = d2_distanceJoint;
+        distanceDef.Initialize(ground, ball, {600.0F, 100.0F}, {700.0F, 100.0F});
+        world.CreateJoint(distanceDef);
+
+        d2Body *slider = world.CreateBody(d2BoxShape(20.0F, 20.0F), {350.0F, 400.0F}, 1.0F);
+        d2JointDef prismaticDef;
+        prismaticDef.type = d2_prismaticJoint;
+        prismaticDef.Initialize(ground, slider, {350.0F, 400.0F});
+        prismaticDef.enableMotor = true;
+        prismaticDef.motorSpeed = 50.0F;
+        prismaticDef.maxMotorForce = 1000.0F;
+        prismaticDef.enableLimit = true;
+        prismaticDef.lower = -10.0F;
+        prismaticDef.upper = 60.0F;
+        world.CreateJoint(prismaticDef);
+
+        d2Body *beam = world.CreateBody(d2BoxShape(60.0F, 20.0F), {640.0F, 400.0F}, 1.0F);
+        d2JointDef weldDef;
+        weldDef.type = d2_weldJoint;
+        weldDef.Initialize(ground, beam, {610.0F, 400.0F});
+        world.CreateJoint(weldDef);
+
+        d2Body *driven = world.CreateBody(d2BoxShape(20.0F, 20.0F), {300.0F, 750.0F}, 1.0F);
+        d2JointDef motorDef;
+        motorDef.type = d2_motorJoint;
+        motorDef.bodyA = ground;
+        motorDef.bodyB = driven;
+        motorDef.linearOffset = {900.0F, 1200.0F};
+        motorDef.angularOffset = 1.0F;
+        motorDef.maxForce = 5000.0F;
+        motorDef.maxTorque = 5000.0F;
+        world.CreateJoint(motorDef);
+
+        d2Body *wheel = world.CreateBody(d2CircleShape(20.0F), {900.0F, 700.0F}, 1.0F);
+        d2JointDef wheelDef;
+        wheelDef.type = d2_revoluteJoint;
+        wheelDef.Initialize(ground, wheel, {900.0F, 700.0F});
+        wheelDef.enableMotor = true;
+        wheelDef.motorSpeed = 2.0F;
+        wheelDef.maxMotorForce = 1.0e6F;
+        world.CreateJoint(wheelDef);
+
+        d2Body *arm = world.CreateBody(d2BoxShape(100.0F, 10.0F), {950.0F, 300.0F}, 1.0F);
+        d2JointDef armDef;
+        armDef.type = d2_revoluteJoint;
+        armDef.Initialize(ground, arm, {900.0F, 300.0F});
+        armDef.enableLimit = true;
+        armDef.lower = -0.5F;
+        armDef.upper = 0.5F;
+        world.CreateJoint(armDef);
+
+        for (int32 i = 0; i < 120; ++i)
+        {
+            world.Step(1.0F / 60.0F, 8, positionIterations);
+        }
+
+        // The pendulum swung down around its anchor
+        CHECK( revolute->GetType() == d2_revoluteJoint );
+        CHECK( GetAnchorGap(revolute) < 0.5F );
+        CHECK( pendulum->GetPosition().x < 300.0F );
+
+        CHECK( (ball->GetPosition() - d2Vec2(600.0F, 100.0F)).Lenght() == doctest::Approx(100.0F).epsilon(0.005) );
+
+        // Driven along the axis up to the upper limit, without leaving it
+        CHECK( slider->GetPosition().x == doctest::Approx(410.0F).epsilon(0.001) );
+        CHECK( slider->GetPosition().y == doctest::Approx(400.0F).epsilon(0.001) );
+        CHECK( std::abs(slider->GetRotation()) < 0.001F );
+
+        CHECK( beam->GetPosition().x == doctest::Approx(640.0F).epsilon(0.001) );
+        CHECK( beam->GetPosition().y == doctest::Approx(400.0F).epsilon(0.001) );
+        CHECK( std::abs(beam->GetRotation()) < 0.001F );
+
+        CHECK( driven->GetPosition().x == doctest::Approx(400.0F).epsilon(0.001) );
+        CHECK( driven->GetPosition().y == doctest::Approx(700.0F).epsilon(0.001) );
+        CHECK( driven->GetRotation() == doctest::Approx(1.0F).epsilon(0.01) );
+
+        CHECK( wheel->GetAngularVelocity() == doctest::Approx(2.0F).epsilon(0.01) );
+
+        // The arm falls to one end of its range
+        CHECK( std::abs(arm->GetRotation()) == doctest::Approx(0.5F).epsilon(0.02) );
+    }
+}
+
+DOCTEST_TEST_CASE("revolute joints hold a bridge between two static ends")
+{
+    d2World world(d2Vec2(0.0F, -9.81F));
+    d2Body *left = world.CreateBody(d2BoxShape(10.0F, 10.0F), {100.0F, 300.0F}, 0.0F);
+    d2Body *right = world.CreateBody(d2BoxShape(10.0F, 10.0F), {520.0F, 300.0F}, 0.0F);
+
+    std::vector<d2Joint*> joints;
+    d2Body *previous = left;
+    for (int32 i = 0; i < 20; ++i)
+    {
+        d2Body *link = world.CreateBody(d2BoxShape(20.0F, 5.0F), {110.0F + (real)i * 20.0F, 300.0F}, 1.0F);
+        d2JointDef def;
+        def.Initialize(previous, link, {100.0F + (real)i * 20.0F, 300.0F});
+        joints.push_back(world.CreateJoint(def));
+        previous = link;
+    }
+    d2JointDef def;
+    def.Initialize(previous, right, {500.0F, 300.0F});
+    joints.push_back(world.CreateJoint(def));
+
+    for (int32 i = 0; i < 300; ++i)
+    {
+        world.Step(1.0F / 60.0F, 8);
+    }
+
+    // The bridge was built taut, it can only sag by stretching its joints a little
+    for (const d2Joint *joint: joints)
+    {
+        CHECK( GetAnchorGap(joint) < 15.0F );
+    }
+}
+
+// Joint counting how many of its kind are alive
+class CountedWeldJoint : public d2WeldJoint
+{
+public:
+    static int32 s_count;
+
+    explicit CountedWeldJoint(const d2JointDef &def) : d2WeldJoint(def) { ++s_count; }
+    ~CountedWeldJoint() override { --s_count; }
+
+    static d2Joint *Create(void *memory, const d2JointDef &def) { return new(memory) CountedWeldJoint(def); }
+};
+
+int32 CountedWeldJoint::s_count = 0;
+
+DOCTEST_TEST_CASE("joint registry builds the joints of a type")
+{
+    const d2JointRegister builtIn = d2JointRegistry::Get(d2_weldJoint);
+    d2JointRegistry::Register(d2_weldJoint, CountedWeldJoint::Create, (int32)sizeof(CountedWeldJoint));
+
+    {
+        d2World world(d2Vec2(0.0F, -9.81F));
+        d2Body *a = world.CreateBody(d2BoxShape(20.0F, 20.0F), {100.0F, 100.0F}, 0.0F);
+        d2Body *b = world.CreateBody(d2BoxShape(20.0F, 20.0F), {130.0F, 100.0F}, 1.0F);
+
+        d2JointDef def;
+        def.type = d2_weldJoint;
+        def.Initialize(a, b, {115.0F, 100.0F});
+        d2Joint *joint = world.CreateJoint(def);
+        CHECK( joint->GetType() == d2_weldJoint );
+        CHECK( dynamic_cast<CountedWeldJoint*>(joint) != nullptr );
+        CHECK( CountedWeldJoint::s_count == 1 );
+
+        world.Step(1.0F / 60.0F);
+        world.DestroyJoint(joint);
+        CHECK( CountedWeldJoint::s_count == 0 );
+
+        // The other types keep their built-in joints
+        def.type = d2_revoluteJoint;
+        CHECK( dynamic_cast<d2RevoluteJoint*>(world.CreateJoint(def)) != nullptr );
+    }
+
+    d2JointRegistry::Register(d2_weldJoint, builtIn.createFcn, builtIn.size);
+}
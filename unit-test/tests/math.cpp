@@ -0,0 +1,107 @@
+#include <doctest/doctest.h>
+
+#include "dura2d/dura2d.h"
+
+// Evaluated by the compiler, so the fixed-size types stay usable in constant expressions
+static constexpr real
+GetConstantTrace()
+{
+    d2Mat<2, 3> A;
+    A[0][0] = 1.0F; A[0][1] = 2.0F; A[0][2] = 3.0F;
+    A[1][0] = 4.0F; A[1][1] = 5.0F; A[1][2] = 6.0F;
+    const d2Mat<2, 2> AAt = A * A.Transpose();
+    return AAt[0][0] + AAt[1][1];
+}
+
+static_assert(GetConstantTrace() == 14.0F + 77.0F, "d2Mat is not constexpr");
+static_assert(alignof(d2Vec<4>) == 16 && alignof(d2Vec<6>) == 16, "wide rows are not SIMD aligned");
+static_assert(sizeof(d2Vec<2>) == 2 * sizeof(real), "narrow vectors are padded");
+
+DOCTEST_TEST_CASE("fixed-size vectors and matrices")
+{
+    d2Vec<3> v;
+    v[0] = 1.0F; v[1] = -2.0F; v[2] = 3.0F;
+    d2Vec<3> w = 2.0F * v - v / 2.0F;
+    CHECK( w[0] == doctest::Approx(1.5F) );
+    CHECK( w[1] == doctest::Approx(-3.0F) );
+    CHECK( (-v).Dot(v) == doctest::Approx(-14.0F) );
+    CHECK( v.LenghtSquared() == doctest::Approx(14.0F) );
+    CHECK( v * 1.0F == v );
+    CHECK( w != v );
+
+    d2Mat<2, 3> J;
+    J[0] = v;
+    J[1][1] = 1.0F;
+    CHECK( J.GetColumn(2)[0] == 3.0F );
+
+    // Jt * lambda without building the transpose
+    d2Vec<2> lambda;
+    lambda[0] = 2.0F; lambda[1] = 10.0F;
+    CHECK( J.TransposeMultiply(lambda) == J.Transpose() * lambda );
+
+    const d2Mat<3, 3> I = d2Mat<3, 3>::Identity();
+    CHECK( J * I == J );
+    CHECK( (J + J - J * 2.0F) == d2Mat<2, 3>() );
+}
+
+DOCTEST_TEST_CASE("dynamic vectors and matrices")
+{
+    d2MatMN A(2, 3);
+    for (int i = 0; i < 2; ++i)
+        for (int j = 0; j < 3; ++j)
+            A.rows[i][j] = (real)(i * 3 + j + 1);
+
+    d2MatMN copy = A;
+    copy = copy;
+    const d2MatMN AAt = copy * A.Transpose();
+    CHECK( AAt.M == 2 );
+    CHECK( AAt.N == 2 );
+    CHECK( AAt.rows[0][0] == doctest::Approx(14.0F) );
+    CHECK( AAt.rows[0][1] == doctest::Approx(32.0F) );
+    CHECK( AAt.rows[1][1] == doctest::Approx(77.0F) );
+}
+
+// Symmetric positive definite N x N system with a known solution
+template <int N>
+static void
+CheckSolve()
+{
+    d2Mat<N, N> B;
+    for (int i = 0; i < N; ++i)
+        for (int j = 0; j < N; ++j)
+            B[i][j] = (real)((i + 1) * (j + 2) % 5) - 2.0F;
+    d2Mat<N, N> A = B * B.Transpose() + d2Mat<N, N>::Identity();
+
+    d2Vec<N> x;
+    for (int i = 0; i < N; ++i) x[i] = (real)i - 1.5F;
+    const d2Vec<N> b = A * x;
+
+    const d2Vec<N> solved = d2Solve(A, b);
+    const d2Vec<N> factored = d2SolveLDLT(A, b);
+    for (int i = 0; i < N; ++i) {
+        CHECK( solved[i] == doctest::Approx(x[i]).epsilon(1e-4) );
+        CHECK( factored[i] == doctest::Approx(x[i]).epsilon(1e-4) );
+    }
+}
+
+DOCTEST_TEST_CASE("direct small-system solvers")
+{
+    CheckSolve<1>();
+    CheckSolve<2>();
+    CheckSolve<3>();
+    CheckSolve<6>();
+
+    const d2Mat<3, 3> A = 2.0F * d2Mat<3, 3>::Identity();
+    CHECK( d2Invert(A) == 0.5F * d2Mat<3, 3>::Identity() );
+    CHECK( d2Invert(0.0F) == 0.0F );
+
+    // A direction no body can move along gets no impulse
+    d2Mat<2, 2> singular;
+    singular[0][0] = 1.0F;
+    d2Vec<2> b;
+    b[0] = 3.0F; b[1] = 4.0F;
+    const d2Vec<2> x = d2SolveLDLT(singular, b);
+    CHECK( x[0] == doctest::Approx(3.0F) );
+    CHECK( x[1] == 0.0F );
+    CHECK( d2Invert(singular) == d2Mat<2, 2>() );
+}
@@ -0,0 +1,210 @@
+#include <doctest/doctest.h>
+
+#include <vector>
+#include "dura2d/dura2d.h"
+#include "dura2d/d2CollisionDetection.h"
+
+DOCTEST_TEST_CASE("capsule collisions")
+{
+    d2World world(d2Vec2(0.0F, 0.0F));
+
+    d2Body *capsule = world.CreateBody(d2CapsuleShape(100.0F, 10.0F), {0.0F, 0.0F}, 1.0F);
+    d2Body *circle = world.CreateBody(d2CircleShape(10.0F), {30.0F, 15.0F}, 1.0F);
+    d2Body *box = world.CreateBody(d2BoxShape(200.0F, 20.0F), {0.0F, -19.0F}, 0.0F);
+    d2Body *other = world.CreateBody(d2CapsuleShape(100.0F, 10.0F), {120.0F, 0.0F}, 1.0F);
+
+    std::vector<d2Contact> contacts;
+
+    // Circle resting on the side of the capsule, 5 units deep
+    CHECK( d2CollisionDetection::IsColliding(capsule, circle, contacts) );
+    REQUIRE( ( contacts.size() == 1 ) );
+    CHECK( ( contacts[0].normal == d2Vec2(0.0F, 1.0F) ) );
+    CHECK( ( d2Abs(contacts[0].depth - 5.0F) < 1e-4F ) );
+
+    // Flat capsule on a box gives a two point manifold, 1 unit deep
+    contacts.clear();
+    CHECK( d2CollisionDetection::IsColliding(box, capsule, contacts) );
+    REQUIRE( ( contacts.size() == 2 ) );
+    for (const d2Contact &contact: contacts)
+    {
+        CHECK( ( contact.a == box ) );
+        CHECK( ( d2Abs(contact.normal.y - 1.0F) < 1e-4F ) );
+        CHECK( ( d2Abs(contact.depth - 1.0F) < 1e-3F ) );
+    }
+
+    // Caps touching end to end
+    contacts.clear();
+    CHECK( d2CollisionDetection::IsColliding(capsule, other, contacts) );
+    REQUIRE( ( contacts.size() == 1 ) );
+    CHECK( ( d2Abs(contacts[0].normal.x - 1.0F) < 1e-4F ) );
+
+    // Moving the circle away separates it
+    circle->SetPosition({30.0F, 40.0F});
+    contacts.clear();
+    CHECK_FALSE( d2CollisionDetection::IsColliding(capsule, circle, contacts) );
+
+    // Same inertia as a circle when the length is zero
+    CHECK( ( d2Abs(d2CapsuleShape(0.0F, 10.0F).GetMomentOfInertia() - d2CircleShape(10.0F).GetMomentOfInertia()) < 1e-3F ) );
+}
+
+DOCTEST_TEST_CASE("chain collisions")
+{
+    d2World world(d2Vec2(0.0F, 0.0F));
+
+    // Flat ground, the right side of the segments faces -y
+    const d2Vec2 vertices[3] = {{0.0F, 0.0F}, {100.0F, 0.0F}, {200.0F, 0.0F}};
+    d2Body *ground = world.CreateBody(d2ChainShape(vertices, 3, {-100.0F, 0.0F}, {300.0F, 0.0F}), {0.0F, 0.0F}, 0.0F);
+    REQUIRE( ( ground->GetProxyCount() == 2 ) );
+
+    // Box across the seam, 1 unit deep, only ever pushed along the ground normal
+    d2Body *box = world.CreateBody(d2BoxShape(20.0F, 20.0F), {100.0F, -9.0F}, 1.0F);
+
+    std::vector<d2Contact> contacts;
+    for (int32 i = 0; i < ground->GetProxyCount(); ++i)
+    {
+        CHECK( d2CollisionDetection::IsColliding(ground, i, box, 0, contacts) );
+    }
+    REQUIRE( ( !contacts.empty() ) );
+    for (const d2Contact &contact: contacts)
+    {
+        CHECK( ( contact.a == ground ) );
+        CHECK( ( d2Abs(contact.normal.y + 1.0F) < 1e-4F ) );
+        CHECK( ( d2Abs(contact.depth - 1.0F) < 1e-3F ) );
+    }
+
+    // Circle just past the seam, the vertex region of the first segment belongs to the second one
+    d2Body *circle = world.CreateBody(d2CircleShape(10.0F), {100.5F, -8.0F}, 1.0F);
+    contacts.clear();
+    CHECK_FALSE( d2CollisionDetection::IsColliding(ground, 0, circle, 0, contacts) );
+    CHECK( d2CollisionDetection::IsColliding(ground, 1, circle, 0, contacts) );
+    REQUIRE( ( contacts.size() == 1 ) );
+    CHECK( ( d2Abs(contacts[0].normal.y + 1.0F) < 1e-4F ) );
+    CHECK( ( d2Abs(contacts[0].depth - 2.0F) < 1e-4F ) );
+
+    // One-sided, nothing happens from below
+    circle->SetPosition({50.0F, 8.0F});
+    contacts.clear();
+    CHECK_FALSE( d2CollisionDetection::IsColliding(ground, 0, circle, 0, contacts) );
+}
+
+DOCTEST_TEST_CASE("compound shapes")
+{
+    d2World world(d2Vec2(0.0F, 0.0F));
+
+    // Dumbbell, two circles at the ends of a bar
+    d2CompoundShape dumbbell;
+    dumbbell.AddChild(d2BoxShape(100.0F, 10.0F), d2Transform());
+    dumbbell.AddChild(d2CircleShape(20.0F), d2Transform({-50.0F, 0.0F}, d2Rot(0.0F)));
+    dumbbell.AddChild(d2CircleShape(20.0F), d2Transform({50.0F, 0.0F}, d2Rot(0.0F)));
+    CHECK( ( dumbbell.GetChildCount() == 3 ) );
+
+    d2Body *body = world.CreateBody(dumbbell, {0.0F, 0.0F}, 10.0F);
+    REQUIRE( ( body->GetProxyCount() == 3 ) );
+
+    // Merged inertia, each child weighted by its area and moved to the body origin
+    const real boxArea = 1000.0F;
+    const real circleArea = PI * 400.0F;
+    const real inertia = (boxArea * d2BoxShape(100.0F, 10.0F).GetMomentOfInertia() +
+                          2.0F * circleArea * (d2CircleShape(20.0F).GetMomentOfInertia() + 2500.0F)) /
+                         (boxArea + 2.0F * circleArea);
+    CHECK( ( d2Abs(body->GetShape()->GetMomentOfInertia() - inertia) < 1e-2F ) );
+
+    // Children follow the body
+    body->SetPosition({10.0F, 5.0F});
+    const d2CircleShape *right = (const d2CircleShape *) ((d2CompoundShape *) body->GetShape())->GetChild(2);
+    CHECK( ( d2Abs(right->worldCenter.x - 60.0F) < 1e-4F ) );
+    CHECK( ( d2Abs(right->worldCenter.y - 5.0F) < 1e-4F ) );
+
+    // Only the right circle touches a ball on that side
+    d2Body *ball = world.CreateBody(d2CircleShape(10.0F), {85.0F, 5.0F}, 1.0F);
+    std::vector<d2Contact> contacts;
+    CHECK_FALSE( d2CollisionDetection::IsColliding(body, 0, ball, 0, contacts) );
+    CHECK_FALSE( d2CollisionDetection::IsColliding(body, 1, ball, 0, contacts) );
+    CHECK( d2CollisionDetection::IsColliding(body, 2, ball, 0, contacts) );
+    REQUIRE( ( contacts.size() == 1 ) );
+    CHECK( ( contacts[0].a == body ) );
+    CHECK( ( d2Abs(contacts[0].depth - 5.0F) < 1e-4F ) );
+}
+
+DOCTEST_TEST_CASE("lopsided compound shapes rotate about their centroid")
+{
+    d2World world(d2Vec2(0.0F, 0.0F));
+
+    // A hammer, a bar with a heavy head on the right and a triangle off its own origin on the left
+    const d2Vec2 triangle[3] = { {0.0F, 0.0F}, {30.0F, 0.0F}, {0.0F, 30.0F} };
+    d2CompoundShape hammer;
+    hammer.AddChild(d2BoxShape(100.0F, 10.0F), d2Transform());
+    hammer.AddChild(d2CircleShape(20.0F), d2Transform({50.0F, 0.0F}, d2Rot(0.0F)));
+    hammer.AddChild(d2PolygonShape(triangle, 3), d2Transform({-80.0F, 0.0F}, d2Rot(0.0F)));
+
+    const real boxArea = 1000.0F;
+    const real circleArea = PI * 400.0F;
+    const real triangleArea = 450.0F;
+    const real area = boxArea + circleArea + triangleArea;
+    const d2Vec2 triangleCentroid(-70.0F, 10.0F);
+    const d2Vec2 center = (d2Vec2(50.0F, 0.0F) * circleArea + triangleCentroid * triangleArea) / area;
+    CHECK( ( d2Abs(hammer.m_center.x - center.x) < 1e-3F ) );
+    CHECK( ( d2Abs(hammer.m_center.y - center.y) < 1e-3F ) );
+
+    // The children keep their place around the given position, the body origin is their centroid
+    d2Body *body = world.CreateBody(hammer, {200.0F, 100.0F}, 10.0F);
+    CHECK( ( d2Abs(body->GetPosition().x - (200.0F + center.x)) < 1e-3F ) );
+    CHECK( ( d2Abs(body->GetPosition().y - (100.0F + center.y)) < 1e-3F ) );
+    const d2CircleShape *head = (const d2CircleShape *) ((d2CompoundShape *) body->GetShape())->GetChild(1);
+    CHECK( ( d2Abs(head->worldCenter.x - 250.0F) < 1e-3F ) );
+    CHECK( ( d2Abs(head->worldCenter.y - 100.0F) < 1e-3F ) );
+
+    // Each child about its own centroid, moved to the centroid of the hammer. A right triangle
+    // with legs a has a polar moment of a^2 / 9 about its centroid.
+    const d2Vec2 boxOffset = d2Vec2(0.0F, 0.0F) - center;
+    const d2Vec2 circleOffset = d2Vec2(50.0F, 0.0F) - center;
+    const d2Vec2 triangleOffset = triangleCentroid - center;
+    const real inertia = (boxArea * (d2BoxShape(100.0F, 10.0F).GetMomentOfInertia() + boxOffset.Dot(boxOffset)) +
+                          circleArea * (d2CircleShape(20.0F).GetMomentOfInertia() + circleOffset.Dot(circleOffset)) +
+                          triangleArea * (900.0F / 9.0F + triangleOffset.Dot(triangleOffset))) / area;
+    CHECK( ( d2Abs(body->GetShape()->GetMomentOfInertia() - inertia) < 1e-1F ) );
+
+    // Spun about its origin, the centroid doesn't move
+    body->SetAngularVelocity(1.0F);
+    const d2Vec2 start = body->GetPosition();
+    for (int32 i = 0; i < 60; ++i) {
+        world.Step(1.0F / 60.0F);
+    }
+    CHECK( ( d2Abs(body->GetPosition().x - start.x) < 1e-3F ) );
+    CHECK( ( d2Abs(body->GetPosition().y - start.y) < 1e-3F ) );
+}
+
+// Only draws what every debug draw had to implement before capsules
+struct CountingDraw : public d2Draw
+{
+    mutable int32 circleCount { 0 };
+    mutable std::vector<d2Vec2> segmentPoints;
+
+    void DrawPolygon(const d2Vec2 *, int32, const float &, const d2Color &) const override {}
+    void DrawSolidPolygon(const d2Vec2 *, int32, const float &, const bool &, const d2Color &) const override {}
+    void DrawCircle(const d2Vec2 &, float, const float &, const d2Color &) const override {}
+    void DrawSolidCircle(const d2Vec2 &, float, const float &, const d2Color &) const override { ++circleCount; }
+    void DrawTransform(const d2Transform &) const override {}
+    void DrawSegment(const d2Vec2 &p1, const d2Vec2 &p2, const d2Color &) const override
+    {
+        segmentPoints.push_back(p1);
+        segmentPoints.push_back(p2);
+    }
+};
+
+DOCTEST_TEST_CASE("debug draws without capsule support draw capsules from circles and segments")
+{
+    d2World world(d2Vec2(0.0F, 0.0F));
+    world.CreateBody(d2CapsuleShape(40.0F, 10.0F), {100.0F, 100.0F}, 1.0F);
+
+    CountingDraw draw;
+    world.SetDebugDraw(&draw);
+    world.DebugDraw();
+
+    CHECK( draw.circleCount == 2 );
+    REQUIRE( draw.segmentPoints.size() == 4 );
+    for (const d2Vec2 &point: draw.segmentPoints)
+    {
+        CHECK( d2Abs(d2Abs(point.y - 100.0F) - 10.0F) < 1e-4F );
+    }
+}